@@ -0,0 +1,545 @@
+// Pool occupancy and acquisition success rate under container-style churn,
+// once with silent scale-ins and once with DHCPRELEASE. Every slot is a veth
+// pair whose client end gets a fresh MAC for each "container": it acquires a
+// lease, holds it for a random time and goes away, either through
+// dhcpc_release() or like a killed pod. A responder thread serves a small
+// pool on the server ends and, like a real server, only takes an address back
+// on RELEASE or at lease expiry.
+//
+// Usage: churn_bench <slots> [pool_size] [seconds] [hold_ms] [lease_secs]
+// See bench/run_churn_bench.sh for the veth setup.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "dhcp.h"
+#include "dhcpclient.h"
+#include "network_utils.h"
+#include "packet_utils.h"
+
+#define FRAME_HEADERS \
+  (sizeof(eth_header_t) + sizeof(ip_header_t) + sizeof(udp_header_t))
+#define MAX_SLOTS 64
+// How long an OFFER reserves its address for the REQUEST.
+#define OFFER_HOLD_MS 2000
+#define SAMPLE_MS 1000
+
+typedef struct {
+  uint8_t chaddr[6];
+  int bound;
+  uint64_t expires_ms;  // free once passed
+} pool_entry_t;
+
+typedef struct {
+  int slots;
+  int ifindex[MAX_SLOTS];  // server ends
+  uint8_t mac[MAX_SLOTS][6];
+  int pool_size;
+  pool_entry_t *pool;
+  uint32_t lease_secs;
+  uint64_t exhausted;  // DISCOVERs left unanswered for want of an address
+  uint64_t released;
+  pthread_mutex_t lock;
+  volatile int stop;
+} responder_t;
+
+typedef enum { SLOT_IDLE, SLOT_ACQUIRING, SLOT_HOLDING } slot_state_t;
+
+typedef struct {
+  char ifname[IFNAMSIZ];
+  dhcpc_t *client;
+  slot_state_t state;
+  uint64_t next_ms;  // IDLE: next container, HOLDING: scale-in
+  uint64_t started_ms;
+  int event;  // last dhcpc_event_t from the callback, -1 for none
+} slot_t;
+
+typedef struct {
+  uint64_t attempts;
+  uint64_t acquired;
+  uint64_t failed;
+  uint64_t acquire_ms;
+  uint64_t exhausted;
+  uint64_t released;
+  int peak_bound;
+} churn_stats_t;
+
+static uint32_t rng = 2463534242u;
+
+static uint32_t next_rand(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+static uint32_t pool_addr(int index) {
+  return htonl(0x0a580000 + 10 + index);  // 10.88.0.10 onwards
+}
+
+static pool_entry_t *pool_find(responder_t *r, const uint8_t *chaddr) {
+  for (int i = 0; i < r->pool_size; i++) {
+    if (!memcmp(r->pool[i].chaddr, chaddr, 6)) {
+      return &r->pool[i];
+    }
+  }
+  return NULL;
+}
+
+// Walks the options for code; returns its 4 byte value or 0.
+static uint32_t find_option_u32(const dhcp_packet_t *packet, size_t len,
+                                uint8_t code) {
+  const uint8_t *opt = packet->options;
+  const uint8_t *end = (const uint8_t *)packet + len;
+  while (opt + 2 <= end && *opt != DHCP_OPTION_END) {
+    if (*opt == 0) {
+      opt++;
+      continue;
+    }
+    if (opt[0] == code && opt[1] == 4 && opt + 6 <= end) {
+      uint32_t value;
+      memcpy(&value, opt + 2, 4);
+      return value;
+    }
+    opt += 2 + opt[1];
+  }
+  return 0;
+}
+
+static void build_reply(dhcp_packet_t *reply, const dhcp_packet_t *request,
+                        uint8_t msg_type, uint32_t yiaddr,
+                        uint32_t lease_secs) {
+  memset(reply, 0, sizeof(dhcp_packet_t));
+  reply->op = BOOTREPLY;
+  reply->htype = DHCP_HTYPE_ETHERNET;
+  reply->hlen = DHCP_HLEN_ETHERNET;
+  reply->xid = request->xid;
+  reply->flags = request->flags;
+  reply->yiaddr = yiaddr;
+  reply->siaddr = inet_addr("10.88.0.1");
+  memcpy(reply->chaddr, request->chaddr, 16);
+  reply->magic_cookie = htonl(DHCP_MAGIC_COOKIE);
+
+  uint8_t *opt = reply->options;
+  uint32_t addr;
+
+  *opt++ = DHCP_OPTION_MSG_TYPE;
+  *opt++ = 1;
+  *opt++ = msg_type;
+
+  addr = inet_addr("10.88.0.1");
+  *opt++ = DHCP_OPTION_DHCP_SERVER;
+  *opt++ = 4;
+  memcpy(opt, &addr, 4);
+  opt += 4;
+
+  if (msg_type != DHCPNAK) {
+    addr = inet_addr("255.255.255.255");
+    *opt++ = DHCP_OPTION_SUBNET_MASK;
+    *opt++ = 4;
+    memcpy(opt, &addr, 4);
+    opt += 4;
+
+    addr = htonl(lease_secs);
+    *opt++ = DHCP_OPTION_LEASE_TIME;
+    *opt++ = 4;
+    memcpy(opt, &addr, 4);
+    opt += 4;
+  }
+
+  *opt = DHCP_OPTION_END;
+}
+
+// Decides what to answer, if anything, with the pool locked.
+static uint8_t serve_request(responder_t *r, const dhcp_packet_t *request,
+                             size_t len, uint32_t *yiaddr) {
+  uint8_t msg_type = request->options[2];
+  uint64_t now = monotonic_ms();
+  pool_entry_t *entry = pool_find(r, request->chaddr);
+  if (entry && entry->expires_ms <= now) {
+    entry = NULL;
+  }
+
+  switch (msg_type) {
+    case DHCPDISCOVER:
+      if (!entry) {
+        for (int i = 0; i < r->pool_size && !entry; i++) {
+          if (r->pool[i].expires_ms <= now) {
+            entry = &r->pool[i];
+          }
+        }
+        if (!entry) {
+          r->exhausted++;
+          return 0;
+        }
+        memcpy(entry->chaddr, request->chaddr, 6);
+        entry->bound = 0;
+        entry->expires_ms = now + OFFER_HOLD_MS;
+      }
+      *yiaddr = pool_addr(entry - r->pool);
+      return DHCPOFFER;
+
+    case DHCPREQUEST: {
+      uint32_t requested = find_option_u32(request, len,
+                                           DHCP_OPTION_REQUESTED_IP);
+      if (!requested) {
+        requested = request->ciaddr;
+      }
+      if (!entry || pool_addr(entry - r->pool) != requested) {
+        *yiaddr = 0;
+        return DHCPNAK;
+      }
+      entry->bound = 1;
+      entry->expires_ms = now + r->lease_secs * 1000ULL;
+      *yiaddr = requested;
+      return DHCPACK;
+    }
+
+    case DHCPRELEASE:
+      if (entry && pool_addr(entry - r->pool) == request->ciaddr) {
+        entry->expires_ms = 0;
+        entry->bound = 0;
+        r->released++;
+      }
+      return 0;
+
+    default:
+      return 0;
+  }
+}
+
+static void *responder_main(void *arg) {
+  responder_t *r = arg;
+  // Unbound, so one socket serves every server end.
+  int sock = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_IP));
+  if (sock < 0) {
+    perror("[-] socket() responder");
+    return NULL;
+  }
+  struct timeval tv = {0, 100000};
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  uint8_t bcast[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+  uint8_t buffer[1500];
+  while (!r->stop) {
+    struct sockaddr_ll from;
+    socklen_t from_len = sizeof(from);
+    ssize_t n = recvfrom(sock, buffer, sizeof(buffer), 0,
+                         (struct sockaddr *)&from, &from_len);
+    if (n < (ssize_t)(FRAME_HEADERS + 240) ||
+        from.sll_pkttype == PACKET_OUTGOING) {
+      continue;
+    }
+    int slot = 0;
+    while (slot < r->slots && r->ifindex[slot] != from.sll_ifindex) {
+      slot++;
+    }
+    udp_header_t *udp =
+        (udp_header_t *)(buffer + sizeof(eth_header_t) + sizeof(ip_header_t));
+    if (slot == r->slots || ntohs(udp->dest) != DHCP_PORT_SERVER) {
+      continue;
+    }
+
+    dhcp_packet_t *request = (dhcp_packet_t *)(buffer + FRAME_HEADERS);
+    uint32_t yiaddr = 0;
+    pthread_mutex_lock(&r->lock);
+    uint8_t reply_type = serve_request(r, request, n - FRAME_HEADERS, &yiaddr);
+    pthread_mutex_unlock(&r->lock);
+    if (!reply_type) {
+      continue;
+    }
+
+    uint8_t frame[1500];
+    create_header(frame, r->mac[slot], bcast, inet_addr("10.88.0.1"),
+                  INADDR_BROADCAST, DHCP_PORT_SERVER, DHCP_PORT_CLIENT,
+                  sizeof(dhcp_packet_t));
+    build_reply((dhcp_packet_t *)(frame + FRAME_HEADERS), request, reply_type,
+                yiaddr, r->lease_secs);
+
+    struct sockaddr_ll dest = {.sll_family = AF_PACKET,
+                               .sll_ifindex = from.sll_ifindex,
+                               .sll_halen = 6};
+    memcpy(dest.sll_addr, bcast, 6);
+    sendto(sock, frame, FRAME_HEADERS + sizeof(dhcp_packet_t), 0,
+           (struct sockaddr *)&dest, sizeof(dest));
+  }
+  close(sock);
+  return NULL;
+}
+
+static void pool_count(responder_t *r, int *bound, int *offered) {
+  uint64_t now = monotonic_ms();
+  *bound = *offered = 0;
+  pthread_mutex_lock(&r->lock);
+  for (int i = 0; i < r->pool_size; i++) {
+    if (r->pool[i].expires_ms > now) {
+      (*(r->pool[i].bound ? bound : offered))++;
+    }
+  }
+  pthread_mutex_unlock(&r->lock);
+}
+
+static int iface_mac(int fd, const char *ifname, uint8_t *mac, int set) {
+  struct ifreq ifr;
+  memset(&ifr, 0, sizeof(ifr));
+  snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", ifname);
+  if (set) {
+    ifr.ifr_hwaddr.sa_family = ARPHRD_ETHER;
+    memcpy(ifr.ifr_hwaddr.sa_data, mac, 6);
+  }
+  if (ioctl(fd, set ? SIOCSIFHWADDR : SIOCGIFHWADDR, &ifr) < 0) {
+    fprintf(stderr, "[-] %s MAC of %s: %s\n", set ? "Setting" : "Reading",
+            ifname, strerror(errno));
+    return -1;
+  }
+  memcpy(mac, ifr.ifr_hwaddr.sa_data, 6);
+  return 0;
+}
+
+static void on_event(dhcpc_t *client, dhcpc_event_t event,
+                     const dhcpc_lease_t *lease, void *arg) {
+  (void)client;
+  (void)lease;
+  ((slot_t *)arg)->event = event;
+}
+
+// A new container on the slot: fresh MAC, fresh handle, first DISCOVER.
+static int slot_start(slot_t *slot, int ioctl_fd, dhcpc_timers_t *timers,
+                      churn_stats_t *stats) {
+  uint8_t mac[6] = {0x02};
+  uint32_t rand = next_rand();
+  memcpy(mac + 1, &rand, 4);
+  mac[5] = next_rand();
+  if (iface_mac(ioctl_fd, slot->ifname, mac, 1) < 0) {
+    return -1;
+  }
+
+  dhcpc_config_t config;
+  dhcpc_config_init(&config);
+  config.ifname = slot->ifname;
+  config.timeout_secs = 1;
+  config.retries = 3;
+  config.configure = 0;
+  config.log_level = DHCPC_LOG_ERROR;
+  config.timers = timers;
+  config.on_lease = on_event;
+  config.cb_arg = slot;
+
+  slot->event = -1;
+  slot->client = dhcpc_new(&config);
+  if (!slot->client) {
+    return -1;
+  }
+  slot->state = SLOT_ACQUIRING;
+  slot->started_ms = monotonic_ms();
+  stats->attempts++;
+  if (dhcpc_start(slot->client) < 0) {
+    slot->event = DHCPC_EVENT_FAILED;
+  }
+  return 0;
+}
+
+static void slot_stop(slot_t *slot, int release, uint64_t next_ms) {
+  if (release && slot->state == SLOT_HOLDING) {
+    dhcpc_release(slot->client);
+  }
+  dhcpc_free(slot->client);
+  slot->client = NULL;
+  slot->state = SLOT_IDLE;
+  slot->next_ms = next_ms;
+}
+
+static uint64_t random_hold(int hold_ms) {
+  return hold_ms / 2 + next_rand() % (hold_ms + 1);
+}
+
+static void run_churn(const char *mode, int release, slot_t *slots,
+                      int slot_count, responder_t *r, int seconds,
+                      int hold_ms, churn_stats_t *stats) {
+  pthread_mutex_lock(&r->lock);
+  memset(r->pool, 0, r->pool_size * sizeof(pool_entry_t));
+  r->exhausted = r->released = 0;
+  pthread_mutex_unlock(&r->lock);
+
+  memset(stats, 0, sizeof(churn_stats_t));
+  int ioctl_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  dhcpc_timers_t *timers = dhcpc_timers_new();
+  if (ioctl_fd < 0 || !timers) {
+    perror("[-] churn setup");
+    return;
+  }
+
+  uint64_t start = monotonic_ms();
+  uint64_t end = start + seconds * 1000ULL;
+  uint64_t next_sample = start + SAMPLE_MS;
+  for (int i = 0; i < slot_count; i++) {
+    slots[i].state = SLOT_IDLE;
+    slots[i].next_ms = start + next_rand() % (hold_ms + 1);
+  }
+
+  struct pollfd pfds[MAX_SLOTS + 1];
+  for (uint64_t now = start; now < end; now = monotonic_ms()) {
+    int timeout = dhcpc_timers_next_timeout_ms(timers);
+    uint64_t wake = next_sample;
+    pfds[0] = (struct pollfd){.fd = dhcpc_timers_get_fd(timers),
+                              .events = POLLIN};
+    for (int i = 0; i < slot_count; i++) {
+      pfds[i + 1] = (struct pollfd){
+          .fd = slots[i].client ? dhcpc_get_fd(slots[i].client) : -1,
+          .events = POLLIN};
+      if (slots[i].state != SLOT_ACQUIRING && slots[i].next_ms < wake) {
+        wake = slots[i].next_ms;
+      }
+    }
+    int until_wake = wake > now ? (int)(wake - now) : 0;
+    if (timeout < 0 || until_wake < timeout) {
+      timeout = until_wake;
+    }
+    if (poll(pfds, slot_count + 1, timeout) < 0 && errno != EINTR) {
+      perror("[-] poll()");
+      break;
+    }
+
+    if (pfds[0].revents) {
+      dhcpc_timers_process(timers);
+    }
+    now = monotonic_ms();
+    for (int i = 0; i < slot_count; i++) {
+      slot_t *slot = &slots[i];
+      if (pfds[i + 1].revents &&
+          dhcpc_process(slot->client, pfds[i + 1].revents) < 0) {
+        slot->event = DHCPC_EVENT_FAILED;
+      }
+
+      if (slot->state == SLOT_ACQUIRING && slot->event == DHCPC_EVENT_BOUND) {
+        stats->acquired++;
+        stats->acquire_ms += now - slot->started_ms;
+        slot->state = SLOT_HOLDING;
+        slot->next_ms = now + random_hold(hold_ms);
+      } else if (slot->state == SLOT_ACQUIRING &&
+                 slot->event == DHCPC_EVENT_FAILED) {
+        // The pod restarts with a new identity straight away.
+        stats->failed++;
+        slot_stop(slot, 0, now);
+      } else if (slot->state == SLOT_HOLDING && now >= slot->next_ms) {
+        slot_stop(slot, release, now + random_hold(hold_ms) / 4);
+      }
+      slot->event = -1;
+
+      if (slot->state == SLOT_IDLE && now >= slot->next_ms &&
+          slot_start(slot, ioctl_fd, timers, stats) < 0) {
+        slot->next_ms = now + hold_ms;
+      }
+    }
+
+    if (now >= next_sample) {
+      int bound, offered, holding = 0;
+      pool_count(r, &bound, &offered);
+      for (int i = 0; i < slot_count; i++) {
+        holding += slots[i].state == SLOT_HOLDING;
+      }
+      if (bound > stats->peak_bound) {
+        stats->peak_bound = bound;
+      }
+      printf("series  %-7s %4.0f %6d %6d %6d\n", mode,
+             (now - start) / 1000.0, bound, offered, holding);
+      next_sample += SAMPLE_MS;
+    }
+  }
+
+  for (int i = 0; i < slot_count; i++) {
+    if (slots[i].client) {
+      slot_stop(&slots[i], release, 0);
+    }
+  }
+  dhcpc_timers_free(timers);
+  close(ioctl_fd);
+
+  pthread_mutex_lock(&r->lock);
+  stats->exhausted = r->exhausted;
+  stats->released = r->released;
+  pthread_mutex_unlock(&r->lock);
+}
+
+static void print_summary(const char *mode, const churn_stats_t *stats) {
+  uint64_t finished = stats->acquired + stats->failed;
+  printf("summary %-7s %8llu %8llu %8llu %7.1f%% %10.1f %9llu %8llu %4d\n",
+         mode, (unsigned long long)stats->attempts,
+         (unsigned long long)stats->acquired, (unsigned long long)stats->failed,
+         finished ? 100.0 * stats->acquired / finished : 0.0,
+         stats->acquired ? (double)stats->acquire_ms / stats->acquired : 0.0,
+         (unsigned long long)stats->exhausted,
+         (unsigned long long)stats->released, stats->peak_bound);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr,
+            "Usage: %s <slots> [pool_size] [seconds] [hold_ms] "
+            "[lease_secs]\n",
+            argv[0]);
+    return 1;
+  }
+  int slot_count = atoi(argv[1]);
+  int pool_size = argc > 2 ? atoi(argv[2]) : 2 * slot_count;
+  int seconds = argc > 3 ? atoi(argv[3]) : 20;
+  int hold_ms = argc > 4 ? atoi(argv[4]) : 1000;
+  int lease_secs = argc > 5 ? atoi(argv[5]) : 10;
+  if (slot_count < 1 || slot_count > MAX_SLOTS || pool_size < 1 ||
+      seconds < 1 || hold_ms < 1 || lease_secs < 1) {
+    fprintf(stderr, "[-] Bad arguments (at most %d slots)\n", MAX_SLOTS);
+    return 1;
+  }
+
+  static responder_t r;
+  static slot_t slots[MAX_SLOTS];
+  r.slots = slot_count;
+  r.pool_size = pool_size;
+  r.lease_secs = lease_secs;
+  r.pool = calloc(pool_size, sizeof(pool_entry_t));
+  pthread_mutex_init(&r.lock, NULL);
+
+  int ioctl_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  for (int i = 0; i < slot_count; i++) {
+    char server_if[IFNAMSIZ];
+    snprintf(slots[i].ifname, IFNAMSIZ, "chc%d", i);
+    snprintf(server_if, IFNAMSIZ, "chs%d", i);
+    r.ifindex[i] = if_nametoindex(server_if);
+    if (!r.ifindex[i] || iface_mac(ioctl_fd, server_if, r.mac[i], 0) < 0) {
+      fprintf(stderr, "[-] No %s; see bench/run_churn_bench.sh\n", server_if);
+      return 1;
+    }
+  }
+  close(ioctl_fd);
+
+  pthread_t responder;
+  pthread_create(&responder, NULL, responder_main, &r);
+
+  printf("[*] %d slots, pool of %d, %d s per mode, hold ~%d ms, lease %d s\n",
+         slot_count, pool_size, seconds, hold_ms, lease_secs);
+  printf("series  mode       t_s  bound offered holding\n");
+  churn_stats_t silent, released;
+  run_churn("silent", 0, slots, slot_count, &r, seconds, hold_ms, &silent);
+  run_churn("release", 1, slots, slot_count, &r, seconds, hold_ms, &released);
+  printf("summary mode    attempts acquired   failed  success acq_ms_avg "
+         "exhausted released peak\n");
+  print_summary("silent", &silent);
+  print_summary("release", &released);
+
+  r.stop = 1;
+  pthread_join(responder, NULL);
+  free(r.pool);
+  return 0;
+}
@@ -0,0 +1,366 @@
+// Retransmission policies on a misbehaving network. A responder thread
+// serves one veth pair per slot and, depending on the scenario, drops frames
+// in either direction, delays replies (so they also arrive reordered),
+// duplicates them, holds ACKs back and NAKs REQUESTs. For every scenario
+// and retry policy the driver runs `trials` acquisitions, `slots` at a time,
+// and reports the time-to-bound distribution and how many frames the client
+// sent per acquisition. Each slot keeps a lease file on tmpfs for the whole
+// row, so the adaptive policy learns from one trial to the next, as it would
+// across restarts.
+//
+// Usage: fault_bench <slots> [trials] [scenario...]
+// A scenario is comma separated key=value pairs:
+//   drop=P           each frame, either direction, is lost with probability P
+//   delay=MS:JITTER  replies wait MS plus up to JITTER ms (uniform)
+//   spike=P:MS       and with probability P another MS (queueing stalls)
+//   dup=P            a reply is sent twice, with separate delays
+//   nak=P            a REQUEST is NAKed instead of ACKed
+//   ack_delay=MS     ACKs wait MS more than OFFERs
+// Without any a built-in sweep runs. See bench/run_fault_bench.sh.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dhcp.h"
+#include "dhcpclient.h"
+#include "network_utils.h"
+#include "responder.h"
+
+#define MAX_SLOTS RESPONDER_MAX_SLOTS
+
+typedef struct {
+  const char *spec;
+  double drop;
+  int delay_ms;
+  int jitter_ms;
+  double spike;
+  int spike_ms;
+  double dup;
+  double nak;
+  int ack_delay_ms;
+} fault_t;
+
+typedef struct {
+  const char *name;
+  int retransmit;
+  int timeout_secs;
+  int retries;
+} policy_t;
+
+// What the responder thread needs to misbehave.
+typedef struct {
+  uint64_t client_frames[MAX_SLOTS];  // DHCP frames the client sent
+  const fault_t *fault;
+  uint32_t rng;
+} faulty_t;
+
+typedef struct {
+  char ifname[IFNAMSIZ];
+  char lease_file[64];
+  dhcpc_t *client;
+  uint64_t started_us;
+  uint64_t bound_us;  // 0 until bound
+  uint64_t frames_before;
+  int done;
+} slot_t;
+
+static const policy_t policies[] = {
+    {"restart", DHCPC_RETRANSMIT_RESTART, 1, 6},
+    {"backoff", DHCPC_RETRANSMIT_BACKOFF, 1, 6},
+    {"adaptive", DHCPC_RETRANSMIT_ADAPTIVE, 1, 6},
+};
+
+static const char *default_sweep[] = {
+    "clean",
+    "drop=0.1",
+    "drop=0.3",
+    "delay=20:80,spike=0.2:1500",
+    "dup=0.5,delay=0:50",
+    "nak=0.2",
+    "ack_delay=1500",
+    "drop=0.1,delay=10:100,spike=0.05:1200,dup=0.2,nak=0.05",
+};
+
+static uint32_t next_rand(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+static int chance(faulty_t *f, double p) {
+  return p > 0 && next_rand(&f->rng) < p * 4294967296.0;
+}
+
+static int parse_fault(const char *spec, fault_t *fault) {
+  memset(fault, 0, sizeof(fault_t));
+  fault->spec = spec;
+  if (!strcmp(spec, "clean")) {
+    return 0;
+  }
+
+  char buf[256];
+  snprintf(buf, sizeof(buf), "%s", spec);
+  for (char *save, *kv = strtok_r(buf, ",", &save); kv;
+       kv = strtok_r(NULL, ",", &save)) {
+    if (sscanf(kv, "drop=%lf", &fault->drop) != 1 &&
+        sscanf(kv, "delay=%d:%d", &fault->delay_ms, &fault->jitter_ms) < 1 &&
+        sscanf(kv, "spike=%lf:%d", &fault->spike, &fault->spike_ms) != 2 &&
+        sscanf(kv, "dup=%lf", &fault->dup) != 1 &&
+        sscanf(kv, "nak=%lf", &fault->nak) != 1 &&
+        sscanf(kv, "ack_delay=%d", &fault->ack_delay_ms) != 1) {
+      fprintf(stderr, "[-] Bad scenario item '%s'\n", kv);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static uint64_t reply_delay(faulty_t *f, const fault_t *fault,
+                            uint8_t msg_type) {
+  uint64_t delay = fault->delay_ms;
+  if (fault->jitter_ms > 0) {
+    delay += next_rand(&f->rng) % (fault->jitter_ms + 1);
+  }
+  if (chance(f, fault->spike)) {
+    delay += fault->spike_ms;
+  }
+  if (msg_type == DHCPACK) {
+    delay += fault->ack_delay_ms;
+  }
+  return delay;
+}
+
+static void handle_request(responder_t *r, int slot,
+                           const dhcp_packet_t *request) {
+  faulty_t *f = r->arg;
+  const fault_t *fault = __atomic_load_n(&f->fault, __ATOMIC_ACQUIRE);
+  __atomic_add_fetch(&f->client_frames[slot], 1, __ATOMIC_RELAXED);
+  if (chance(f, fault->drop)) {
+    return;
+  }
+
+  uint8_t msg_type = request->options[2];
+  uint8_t reply_type;
+  if (msg_type == DHCPDISCOVER) {
+    reply_type = DHCPOFFER;
+  } else if (msg_type == DHCPREQUEST) {
+    reply_type = chance(f, fault->nak) ? DHCPNAK : DHCPACK;
+  } else {
+    return;
+  }
+
+  uint8_t options[12];
+  uint8_t *opt = options;
+  uint32_t yiaddr = 0;
+  if (reply_type != DHCPNAK) {
+    uint32_t mask = inet_addr("255.255.255.0");
+    uint32_t lease_time = htonl(3600);
+    yiaddr = htonl(0x0a630000 + 10 + slot);  // 10.99.0.10 onwards
+    *opt++ = DHCP_OPTION_SUBNET_MASK;
+    *opt++ = 4;
+    memcpy(opt, &mask, 4);
+    opt += 4;
+    *opt++ = DHCP_OPTION_LEASE_TIME;
+    *opt++ = 4;
+    memcpy(opt, &lease_time, 4);
+    opt += 4;
+  }
+
+  // A duplicate gets its own delay, and each copy its own chance of loss.
+  int copies = 1 + chance(f, fault->dup);
+  for (int i = 0; i < copies; i++) {
+    uint64_t delay_ms = reply_delay(f, fault, reply_type);
+    if (!chance(f, fault->drop)) {
+      responder_reply(r, slot, request, reply_type, yiaddr, options,
+                      opt - options, delay_ms);
+    }
+  }
+}
+
+static void on_event(dhcpc_t *client, dhcpc_event_t event,
+                     const dhcpc_lease_t *lease, void *arg) {
+  slot_t *slot = arg;
+  (void)client;
+  (void)lease;
+  if (event == DHCPC_EVENT_BOUND) {
+    slot->bound_us = monotonic_us();
+  }
+  if (event == DHCPC_EVENT_BOUND || event == DHCPC_EVENT_FAILED) {
+    slot->done = 1;
+  }
+}
+
+// Runs trials acquisitions under fault with policy, slot_count at a time.
+static void run_cell(faulty_t *f, slot_t *slots, int slot_count,
+                     const fault_t *fault, const policy_t *policy,
+                     int trials) {
+  __atomic_store_n(&f->fault, fault, __ATOMIC_RELEASE);
+  dhcpc_timers_t *timers = dhcpc_timers_new();
+  uint64_t *times = calloc(trials, sizeof(uint64_t));
+  if (!timers || !times) {
+    perror("[-] run_cell");
+    return;
+  }
+  for (int i = 0; i < slot_count; i++) {
+    unlink(slots[i].lease_file);
+  }
+
+  // Trials run in rounds of slot_count. Opening and closing a packet socket
+  // waits for an RCU grace period (milliseconds), so every handle of a round
+  // is created before the first one starts and freed after the last one is
+  // done; otherwise that wait would land in the other slots' times.
+  int started = 0, bound = 0;
+  uint64_t frames = 0;
+  struct pollfd pfds[MAX_SLOTS + 1];
+  while (started < trials) {
+    int round = trials - started < slot_count ? trials - started : slot_count;
+    for (int i = 0; i < round; i++) {
+      slot_t *slot = &slots[i];
+      dhcpc_config_t config;
+      dhcpc_config_init(&config);
+      config.ifname = slot->ifname;
+      config.timeout_secs = policy->timeout_secs;
+      config.retries = policy->retries;
+      config.retransmit = policy->retransmit;
+      config.configure = 0;
+      config.lease_file = slots[i].lease_file;
+      config.log_level = DHCPC_LOG_ERROR;
+      config.timers = timers;
+      config.on_lease = on_event;
+      config.cb_arg = slot;
+      slot->done = 0;
+      slot->bound_us = 0;
+      if (!(slot->client = dhcpc_new(&config))) {
+        round = i;
+        break;
+      }
+    }
+    if (round == 0) {
+      break;
+    }
+    for (int i = 0; i < round; i++) {
+      slot_t *slot = &slots[i];
+      slot->frames_before =
+          __atomic_load_n(&f->client_frames[i], __ATOMIC_RELAXED);
+      slot->started_us = monotonic_us();
+      if (dhcpc_start(slot->client) < 0) {
+        slot->done = 1;
+      }
+    }
+
+    int pending = round;
+    while (pending > 0) {
+      pfds[0] = (struct pollfd){.fd = dhcpc_timers_get_fd(timers),
+                                .events = POLLIN};
+      for (int i = 0; i < round; i++) {
+        pfds[i + 1] = (struct pollfd){
+            .fd = slots[i].done ? -1 : dhcpc_get_fd(slots[i].client),
+            .events = POLLIN};
+      }
+      if (poll(pfds, round + 1, dhcpc_timers_next_timeout_ms(timers)) < 0 &&
+          errno != EINTR) {
+        perror("[-] poll()");
+        break;
+      }
+      if (pfds[0].revents) {
+        dhcpc_timers_process(timers);
+      }
+      pending = 0;
+      for (int i = 0; i < round; i++) {
+        slot_t *slot = &slots[i];
+        if (pfds[i + 1].revents &&
+            dhcpc_process(slot->client, pfds[i + 1].revents) < 0) {
+          slot->done = 1;
+        }
+        pending += !slot->done;
+      }
+    }
+
+    for (int i = 0; i < round; i++) {
+      slot_t *slot = &slots[i];
+      if (slot->bound_us) {
+        times[bound++] = slot->bound_us - slot->started_us;
+      }
+      frames += __atomic_load_n(&f->client_frames[i], __ATOMIC_RELAXED) -
+                slot->frames_before;
+      dhcpc_free(slot->client);
+      slot->client = NULL;
+    }
+    started += round;
+  }
+
+  qsort(times, bound, sizeof(uint64_t), cmp_u64);
+  printf("%-8s %-44s %5.1f%% %8.1f %8.1f %8.1f %8.1f %6.2f\n", policy->name,
+         fault->spec, 100.0 * bound / trials, percentile_ms(times, bound, 50),
+         percentile_ms(times, bound, 90), percentile_ms(times, bound, 99),
+         percentile_ms(times, bound, 100), (double)frames / trials);
+  fflush(stdout);
+  free(times);
+  dhcpc_timers_free(timers);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <slots> [trials] [scenario...]\n", argv[0]);
+    return 1;
+  }
+  int slot_count = atoi(argv[1]);
+  int trials = argc > 2 ? atoi(argv[2]) : 64;
+  if (slot_count < 1 || slot_count > MAX_SLOTS || trials < 1) {
+    fprintf(stderr, "[-] Bad arguments (at most %d slots)\n", MAX_SLOTS);
+    return 1;
+  }
+
+  int fault_count = argc > 3 ? argc - 3 : (int)(sizeof(default_sweep) /
+                                                sizeof(default_sweep[0]));
+  fault_t *faults = calloc(fault_count, sizeof(fault_t));
+  for (int i = 0; i < fault_count; i++) {
+    if (parse_fault(argc > 3 ? argv[3 + i] : default_sweep[i], &faults[i]) <
+        0) {
+      return 1;
+    }
+  }
+
+  static faulty_t faulty;
+  static responder_t r;
+  static slot_t slots[MAX_SLOTS];
+  faulty.rng = 2463534242u;
+  faulty.fault = &faults[0];
+  if (responder_init(&r, "fbs", slot_count, handle_request, &faulty) < 0) {
+    fprintf(stderr, "[-] See bench/run_fault_bench.sh\n");
+    return 1;
+  }
+  for (int i = 0; i < slot_count; i++) {
+    snprintf(slots[i].ifname, IFNAMSIZ, "fbc%d", i);
+    snprintf(slots[i].lease_file, sizeof(slots[i].lease_file),
+             "/dev/shm/fault_bench.%d.lease", i);
+    r.server_ip[i] = inet_addr("10.99.0.1");
+  }
+  if (responder_start(&r) < 0) {
+    return 1;
+  }
+
+  printf("[*] %d slots, %d trials per row\n", slot_count, trials);
+  printf("%-8s %-44s %6s %8s %8s %8s %8s %6s\n", "policy", "scenario",
+         "bound", "p50_ms", "p90_ms", "p99_ms", "max_ms", "frames");
+  for (int f = 0; f < fault_count; f++) {
+    for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); p++) {
+      run_cell(&faulty, slots, slot_count, &faults[f], &policies[p], trials);
+    }
+  }
+
+  responder_stop(&r);
+  for (int i = 0; i < slot_count; i++) {
+    unlink(slots[i].lease_file);
+  }
+  free(faults);
+  return 0;
+}
@@ -0,0 +1,145 @@
+// Cost of running post-bind commands, as seen by the event loop. A process
+// of `rss_mb` resident megabytes (a client with capture rings, UMEM and
+// thousands of handles) runs `commands` commands per event in three ways:
+//   serial  fork + exec + wait for each in turn, like a script after exit
+//   fork    fork + exec each from the client, reaping them later
+//   helper  dhcpc_hooks: hand them to the helper forked at start-up
+// and reports how long the loop was stopped per event and how long until
+// every command had finished. No network is needed.
+//
+// Usage: hook_bench [rss_mb] [commands] [events] [command]
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "dhcpclient.h"
+#include "hooks.h"
+#include "network_utils.h"
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void print_row(const char *mode, uint64_t *stall_us,
+                      uint64_t *done_us, int events) {
+  qsort(stall_us, events, sizeof(uint64_t), cmp_u64);
+  qsort(done_us, events, sizeof(uint64_t), cmp_u64);
+  printf("%-7s %10.3f %10.3f %10.3f %10.3f\n", mode, stall_us[events / 2] / 1e3,
+         stall_us[(events - 1) * 99 / 100] / 1e3, done_us[events / 2] / 1e3,
+         done_us[(events - 1) * 99 / 100] / 1e3);
+  fflush(stdout);
+}
+
+static pid_t spawn(const char *command) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+    _exit(127);
+  }
+  return pid;
+}
+
+int main(int argc, char *argv[]) {
+  int rss_mb = argc > 1 ? atoi(argv[1]) : 256;
+  int commands = argc > 2 ? atoi(argv[2]) : 4;
+  int events = argc > 3 ? atoi(argv[3]) : 50;
+  const char *command = argc > 4 ? argv[4] : "true";
+  if (rss_mb < 0 || commands < 1 || commands > DHCPC_MAX_HOOK_COMMANDS ||
+      events < 1) {
+    fprintf(stderr, "Usage: %s [rss_mb] [commands<=%d] [events] [command]\n",
+            argv[0], DHCPC_MAX_HOOK_COMMANDS);
+    return 1;
+  }
+
+  // The helper is forked while we are small, as dhcp_client does.
+  const char *list[DHCPC_MAX_HOOK_COMMANDS];
+  for (int i = 0; i < commands; i++) {
+    list[i] = command;
+  }
+  dhcpc_hooks_config_t config;
+  dhcpc_hooks_config_init(&config);
+  config.commands = list;
+  config.command_count = commands;
+  config.log_level = DHCPC_LOG_ERROR;
+  dhcpc_hooks_t *hooks = dhcpc_hooks_new(&config);
+  if (!hooks) {
+    return 1;
+  }
+
+  size_t rss = (size_t)rss_mb << 20;
+  char *ballast = malloc(rss ? rss : 1);
+  uint64_t *stall_us = calloc(events, sizeof(uint64_t));
+  uint64_t *done_us = calloc(events, sizeof(uint64_t));
+  pid_t *pids = calloc(commands, sizeof(pid_t));
+  if (!ballast || !stall_us || !done_us || !pids) {
+    perror("[-] malloc");
+    return 1;
+  }
+  memset(ballast, 1, rss);
+
+  dhcpc_lease_t lease;
+  memset(&lease, 0, sizeof(lease));
+  lease.address.s_addr = inet_addr("10.0.0.2");
+  lease.netmask.s_addr = inet_addr("255.255.255.0");
+  lease.router.s_addr = inet_addr("10.0.0.1");
+  lease.server = lease.router;
+  lease.lease_time = 3600;
+  lease.search = "";
+
+  printf("[*] %d MB resident, %d x '%s' per event, %d events\n", rss_mb,
+         commands, command, events);
+  printf("%-7s %10s %10s %10s %10s\n", "mode", "stall_p50", "stall_p99",
+         "done_p50", "done_p99");
+
+  for (int e = 0; e < events; e++) {
+    uint64_t start_us = monotonic_us();
+    for (int i = 0; i < commands; i++) {
+      waitpid(spawn(command), NULL, 0);
+    }
+    stall_us[e] = done_us[e] = monotonic_us() - start_us;
+  }
+  print_row("serial", stall_us, done_us, events);
+
+  for (int e = 0; e < events; e++) {
+    uint64_t start_us = monotonic_us();
+    for (int i = 0; i < commands; i++) {
+      pids[i] = spawn(command);
+    }
+    stall_us[e] = monotonic_us() - start_us;
+    for (int i = 0; i < commands; i++) {
+      waitpid(pids[i], NULL, 0);
+    }
+    done_us[e] = monotonic_us() - start_us;
+  }
+  print_row("fork", stall_us, done_us, events);
+
+  for (int e = 0; e < events; e++) {
+    uint64_t start_us = monotonic_us();
+    hooks_run(hooks, "bench0", DHCPC_EVENT_BOUND, &lease);
+    stall_us[e] = monotonic_us() - start_us;
+    while (dhcpc_hooks_pending(hooks) > 0) {
+      struct pollfd pfd = {.fd = dhcpc_hooks_get_fd(hooks), .events = POLLIN};
+      if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+        perror("[-] poll()");
+        return 1;
+      }
+      dhcpc_hooks_process(hooks);
+    }
+    done_us[e] = monotonic_us() - start_us;
+  }
+  print_row("helper", stall_us, done_us, events);
+
+  dhcpc_hooks_free(hooks);
+  free(ballast);
+  free(stall_us);
+  free(done_us);
+  free(pids);
+  return 0;
+}
@@ -0,0 +1,258 @@
+// Compares the I/O backends on syscalls and CPU time per lease. A responder
+// thread answers DISCOVER/REQUEST on the peer end of a veth pair and sprays
+// unrelated frames in front of every reply, the way a busy segment does to a
+// promiscuous ETH_P_ALL socket.
+//
+// Usage: io_bench <client_if> <server_if> [leases] [noise_per_reply]
+//                 [capture.pcap]
+// With a capture file every backend runs a second time with the pcap tap on
+// (the "+pcap" rows), to show what leaving it enabled costs.
+// See bench/run_io_bench.sh for the veth setup.
+
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "capture.h"
+#include "dhcp.h"
+#include "io_backend.h"
+#include "network_utils.h"
+#include "packet_utils.h"
+
+#define FRAME_HEADERS \
+  (sizeof(eth_header_t) + sizeof(ip_header_t) + sizeof(udp_header_t))
+
+typedef struct {
+  const char *ifname;
+  int noise;
+  volatile int stop;
+} responder_t;
+
+static uint64_t clock_us(clockid_t id) {
+  struct timespec ts;
+  clock_gettime(id, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void build_reply(dhcp_packet_t *reply, const dhcp_packet_t *request,
+                        uint8_t msg_type) {
+  memset(reply, 0, sizeof(dhcp_packet_t));
+  reply->op = BOOTREPLY;
+  reply->htype = DHCP_HTYPE_ETHERNET;
+  reply->hlen = DHCP_HLEN_ETHERNET;
+  reply->xid = request->xid;
+  reply->flags = request->flags;
+  reply->yiaddr = inet_addr("10.255.0.100");
+  reply->siaddr = inet_addr("10.255.0.1");
+  memcpy(reply->chaddr, request->chaddr, 16);
+  reply->magic_cookie = htonl(DHCP_MAGIC_COOKIE);
+
+  uint8_t *opt = reply->options;
+  uint32_t addr;
+
+  *opt++ = DHCP_OPTION_MSG_TYPE;
+  *opt++ = 1;
+  *opt++ = msg_type;
+
+  addr = inet_addr("10.255.0.1");
+  *opt++ = DHCP_OPTION_DHCP_SERVER;
+  *opt++ = 4;
+  memcpy(opt, &addr, 4);
+  opt += 4;
+
+  addr = inet_addr("255.255.255.0");
+  *opt++ = DHCP_OPTION_SUBNET_MASK;
+  *opt++ = 4;
+  memcpy(opt, &addr, 4);
+  opt += 4;
+
+  addr = htonl(3600);
+  *opt++ = DHCP_OPTION_LEASE_TIME;
+  *opt++ = 4;
+  memcpy(opt, &addr, 4);
+  opt += 4;
+
+  *opt = DHCP_OPTION_END;
+}
+
+static void *responder_main(void *arg) {
+  responder_t *r = arg;
+  iface_ctx_t iface;
+  if (iface_ctx_init(&iface, r->ifname) < 0) {
+    return NULL;
+  }
+  int sock = create_raw_socket(&iface);
+  if (sock < 0) {
+    iface_ctx_close(&iface);
+    return NULL;
+  }
+
+  uint8_t *mac = iface.mac;
+  struct sockaddr_ll dest = iface.bcast_addr;
+
+  struct timeval tv = {0, 100000};
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  uint8_t bcast[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+  uint8_t noise[128];
+  create_header(noise, mac, bcast, inet_addr("10.255.0.1"),
+                INADDR_BROADCAST, 9, 9, sizeof(noise) - FRAME_HEADERS);
+
+  uint8_t buffer[1500];
+  while (!r->stop) {
+    ssize_t n = recv(sock, buffer, sizeof(buffer), 0);
+    if (n < (ssize_t)(FRAME_HEADERS + 240)) {
+      continue;
+    }
+
+    udp_header_t *udp =
+        (udp_header_t *)(buffer + sizeof(eth_header_t) + sizeof(ip_header_t));
+    if (ntohs(udp->dest) != DHCP_PORT_SERVER) {
+      continue;
+    }
+
+    dhcp_packet_t *request = (dhcp_packet_t *)(buffer + FRAME_HEADERS);
+    uint8_t msg_type = request->options[2];
+    uint8_t reply_type = msg_type == DHCPDISCOVER  ? DHCPOFFER
+                         : msg_type == DHCPREQUEST ? DHCPACK
+                                                   : 0;
+    if (!reply_type) {
+      continue;
+    }
+
+    for (int i = 0; i < r->noise; i++) {
+      sendto(sock, noise, sizeof(noise), 0, (struct sockaddr *)&dest,
+             sizeof(dest));
+    }
+
+    uint8_t frame[1500];
+    create_header(frame, mac, bcast, inet_addr("10.255.0.1"), INADDR_BROADCAST,
+                  DHCP_PORT_SERVER, DHCP_PORT_CLIENT, sizeof(dhcp_packet_t));
+    build_reply((dhcp_packet_t *)(frame + FRAME_HEADERS), request, reply_type);
+    sendto(sock, frame, FRAME_HEADERS + sizeof(dhcp_packet_t), 0,
+           (struct sockaddr *)&dest, sizeof(dest));
+  }
+
+  close(sock);
+  iface_ctx_close(&iface);
+  return NULL;
+}
+
+static int run_backend(io_backend_type_t type, const char *ifname,
+                       int leases, const char *capture_path) {
+  dhcp_client_t client;
+  memset(&client, 0, sizeof(client));
+  if (iface_ctx_init(&client.iface, ifname) < 0) {
+    return -1;
+  }
+
+  client.sock = -1;
+  if (type != IO_BACKEND_XDP &&
+      (client.sock = create_raw_socket(&client.iface)) < 0) {
+    iface_ctx_close(&client.iface);
+    return -1;
+  }
+  client.io = io_backend_create(type, client.sock, client.iface.ifindex);
+  if (!client.io) {
+    if (client.sock >= 0) {
+      close(client.sock);
+    }
+    iface_ctx_close(&client.iface);
+    return -1;
+  }
+  if (capture_path) {
+    client.io->capture = capture_open(capture_path, 0);
+  }
+  char name[32];
+  snprintf(name, sizeof(name), "%s%s", client.io->ops->name,
+           client.io->capture ? "+pcap" : "");
+
+  int bound = 0;
+  uint64_t wall_start = clock_us(CLOCK_MONOTONIC);
+  uint64_t cpu_start = clock_us(CLOCK_THREAD_CPUTIME_ID);
+
+  for (int i = 0; i < leases; i++) {
+    dhcp_packet_t packet;
+    dhcp_msg_t reply;
+    client.xid = (uint32_t)rand();
+
+    create_dhcp_packet(&packet, client.iface.mac, client.xid, DHCPDISCOVER);
+    if (send_dhcp_packet(client.io, &client.iface, &packet) < 0 ||
+        receive_dhcp_packet(client.io, &reply, client.xid, 1) < 0 ||
+        parse_options(&reply, &client) != DHCPOFFER) {
+      continue;
+    }
+
+    create_dhcp_packet(&packet, client.iface.mac, client.xid, DHCPREQUEST);
+    if (send_dhcp_packet(client.io, &client.iface, &packet) < 0 ||
+        receive_dhcp_packet(client.io, &reply, client.xid, 1) < 0 ||
+        parse_options(&reply, &client) != DHCPACK) {
+      continue;
+    }
+    bound++;
+  }
+
+  uint64_t cpu_us = clock_us(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+  uint64_t wall_us = clock_us(CLOCK_MONOTONIC) - wall_start;
+
+  if (bound > 0) {
+    printf("%-11s %6d %14.1f %14.1f %14.1f\n", name, bound,
+           (double)client.io->stats.syscalls / bound, (double)cpu_us / bound,
+           (double)wall_us / bound);
+  } else {
+    printf("%-11s %6d (no leases completed)\n", name, bound);
+  }
+
+  capture_close(client.io->capture);
+  io_backend_destroy(client.io);
+  if (client.sock >= 0) {
+    close(client.sock);
+  }
+  iface_ctx_close(&client.iface);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    fprintf(stderr,
+            "Usage: %s <client_if> <server_if> [leases] [noise_per_reply] "
+            "[capture.pcap]\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int leases = argc > 3 ? atoi(argv[3]) : 2000;
+  responder_t responder = {argv[2], argc > 4 ? atoi(argv[4]) : 8, 0};
+  const char *capture_path = argc > 5 ? argv[5] : NULL;
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, responder_main, &responder);
+  usleep(100000);
+
+  printf("%-11s %6s %14s %14s %14s\n", "backend", "leases", "syscalls/lease",
+         "cpu_us/lease", "wall_us/lease");
+
+  io_backend_type_t types[] = {IO_BACKEND_SELECT, IO_BACKEND_URING,
+                               IO_BACKEND_XDP};
+  // Capture runs go last: an AF_XDP socket is not released at once, so the
+  // same backend cannot be rebound straight away.
+  for (int pass = 0; pass < (capture_path ? 2 : 1); pass++) {
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+      if (io_backend_available(types[i])) {
+        run_backend(types[i], argv[1], leases, pass ? capture_path : NULL);
+      }
+    }
+  }
+
+  responder.stop = 1;
+  pthread_join(thread, NULL);
+  return 0;
+}
@@ -0,0 +1,399 @@
+// Load generator: a large simulated client population acquiring leases from
+// one thread and one packet socket. Client state lives in a client_table_t
+// (include/client_table.h) rather than a dhcp_client_t per client; every
+// client gets its own chaddr (derived from its slot) and xid, and at most
+// `window` of them are mid-exchange at once. Timeouts come from a scan of the
+// table every SCAN_MS.
+//
+// Usage: loadgen <client_if> <server_if|-> [clients] [window] [backend]
+//                [hugepages]
+// With a server_if a stateless responder thread answers on it (veth runs,
+// see bench/run_loadgen.sh); with "-" a real server on client_if does.
+
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <net/if.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "client_table.h"
+#include "dhcp.h"
+#include "io_backend.h"
+#include "network_utils.h"
+#include "packet_utils.h"
+
+#define FRAME_HEADERS \
+  (sizeof(eth_header_t) + sizeof(ip_header_t) + sizeof(udp_header_t))
+#define TIMEOUT_MS 1000
+#define MAX_TRIES 4
+#define SCAN_MS 10
+// A full window of requests arrives as one burst.
+#define SOCKET_BUFFER (8 << 20)
+
+typedef struct {
+  const char *ifname;
+  volatile int stop;
+} responder_t;
+
+typedef struct {
+  client_table_t ct;
+  io_backend_t *io;
+  iface_ctx_t iface;
+  uint64_t now;
+  uint32_t inflight;
+  uint64_t bound;
+  uint64_t failed;
+  uint64_t retransmits;
+  uint64_t naks;
+  uint64_t stray;  // replies for no current exchange
+} loadgen_t;
+
+static uint32_t rng = 2463534242u;
+
+static uint32_t next_xid(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+// 02:00 followed by the slot, so a server sees one MAC per client.
+static void slot_mac(uint32_t slot, uint8_t *mac) {
+  uint32_t be = htonl(slot);
+  mac[0] = 0x02;
+  mac[1] = 0x00;
+  memcpy(mac + 2, &be, 4);
+}
+
+// Returns the 4 byte value of option code (0 if absent) and the message type.
+static uint32_t reply_option(const dhcp_packet_t *packet, size_t len,
+                             uint8_t code, uint8_t *msg_type) {
+  const uint8_t *opt = packet->options;
+  const uint8_t *end = (const uint8_t *)packet + len;
+  uint32_t value = 0;
+  while (opt + 2 <= end && *opt != DHCP_OPTION_END) {
+    if (*opt == 0) {
+      opt++;
+      continue;
+    }
+    if (opt + 2 + opt[1] > end) {
+      break;
+    }
+    if (opt[0] == DHCP_OPTION_MSG_TYPE && opt[1] == 1) {
+      *msg_type = opt[2];
+    } else if (opt[0] == code && opt[1] == 4) {
+      memcpy(&value, opt + 2, 4);
+    }
+    opt += 2 + opt[1];
+  }
+  return value;
+}
+
+// Stateless: the address follows from the chaddr, so it keeps up with any
+// population without a pool.
+static void *responder_main(void *arg) {
+  responder_t *r = arg;
+  iface_ctx_t iface;
+  if (iface_ctx_init(&iface, r->ifname) < 0) {
+    return NULL;
+  }
+  int sock = create_raw_socket(&iface);
+  if (sock < 0) {
+    iface_ctx_close(&iface);
+    return NULL;
+  }
+  struct timeval tv = {0, 100000};
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  int rcvbuf = SOCKET_BUFFER;
+  setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf));
+
+  uint8_t bcast[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+  uint32_t server_id = inet_addr("10.255.255.254");
+  uint8_t buffer[1500];
+  uint8_t frame[1500];
+  create_header(frame, iface.mac, bcast, server_id, INADDR_BROADCAST,
+                DHCP_PORT_SERVER, DHCP_PORT_CLIENT, sizeof(dhcp_packet_t));
+
+  while (!r->stop) {
+    ssize_t n = recv(sock, buffer, sizeof(buffer), 0);
+    if (n < (ssize_t)(FRAME_HEADERS + 240)) {
+      continue;
+    }
+    udp_header_t *udp =
+        (udp_header_t *)(buffer + sizeof(eth_header_t) + sizeof(ip_header_t));
+    if (ntohs(udp->dest) != DHCP_PORT_SERVER) {
+      continue;
+    }
+
+    dhcp_packet_t *request = (dhcp_packet_t *)(buffer + FRAME_HEADERS);
+    uint8_t msg_type = 0;
+    reply_option(request, n - FRAME_HEADERS, 0, &msg_type);
+    uint8_t reply_type = msg_type == DHCPDISCOVER  ? DHCPOFFER
+                         : msg_type == DHCPREQUEST ? DHCPACK
+                                                   : 0;
+    if (!reply_type) {
+      continue;
+    }
+
+    uint32_t slot;
+    memcpy(&slot, request->chaddr + 2, 4);
+    dhcp_packet_t *reply = (dhcp_packet_t *)(frame + FRAME_HEADERS);
+    memset(reply, 0, sizeof(dhcp_packet_t));
+    reply->op = BOOTREPLY;
+    reply->htype = DHCP_HTYPE_ETHERNET;
+    reply->hlen = DHCP_HLEN_ETHERNET;
+    reply->xid = request->xid;
+    reply->flags = request->flags;
+    reply->yiaddr = htonl(0x0a000000 | (ntohl(slot) & 0xffffff));
+    reply->siaddr = server_id;
+    memcpy(reply->chaddr, request->chaddr, 16);
+    reply->magic_cookie = htonl(DHCP_MAGIC_COOKIE);
+
+    uint8_t *opt = reply->options;
+    uint32_t lease_time = htonl(3600);
+    *opt++ = DHCP_OPTION_MSG_TYPE;
+    *opt++ = 1;
+    *opt++ = reply_type;
+    *opt++ = DHCP_OPTION_DHCP_SERVER;
+    *opt++ = 4;
+    memcpy(opt, &server_id, 4);
+    opt += 4;
+    *opt++ = DHCP_OPTION_LEASE_TIME;
+    *opt++ = 4;
+    memcpy(opt, &lease_time, 4);
+    opt += 4;
+    *opt = DHCP_OPTION_END;
+
+    sendto(sock, frame, FRAME_HEADERS + sizeof(dhcp_packet_t), 0,
+           (struct sockaddr *)&iface.bcast_addr, sizeof(iface.bcast_addr));
+  }
+
+  close(sock);
+  iface_ctx_close(&iface);
+  return NULL;
+}
+
+static void send_message(loadgen_t *lg, uint32_t slot) {
+  client_table_t *ct = &lg->ct;
+  uint8_t mac[6];
+  slot_mac(slot, mac);
+
+  dhcp_packet_t packet;
+  if (ct->state[slot] == CT_SELECTING) {
+    create_dhcp_packet(&packet, mac, ct->xid[slot], DHCPDISCOVER);
+  } else {
+    create_dhcp_packet(&packet, mac, ct->xid[slot], DHCPREQUEST);
+    uint8_t *opt = dhcp_options_end(&packet);
+    *opt++ = DHCP_OPTION_REQUESTED_IP;
+    *opt++ = 4;
+    memcpy(opt, &ct->lease[slot], 4);
+    opt += 4;
+    *opt++ = DHCP_OPTION_DHCP_SERVER;
+    *opt++ = 4;
+    memcpy(opt, &ct->server[slot], 4);
+    opt += 4;
+    *opt = DHCP_OPTION_END;
+  }
+
+  send_dhcp_packet(lg->io, &lg->iface, &packet);
+  ct->tries[slot]++;
+  client_table_arm(ct, slot, lg->now + TIMEOUT_MS);
+}
+
+// A fresh exchange for slot: new xid, state CT_SELECTING.
+static void start_discover(loadgen_t *lg, uint32_t slot) {
+  client_table_t *ct = &lg->ct;
+  while (client_table_set_xid(ct, slot, next_xid()) < 0) {
+  }
+  ct->state[slot] = CT_SELECTING;
+  ct->tries[slot] = 0;
+  send_message(lg, slot);
+}
+
+static void on_timeout(client_table_t *ct, uint32_t slot, void *arg) {
+  loadgen_t *lg = arg;
+  if (ct->tries[slot] < MAX_TRIES) {
+    lg->retransmits++;
+    send_message(lg, slot);
+    return;
+  }
+  lg->failed++;
+  lg->inflight--;
+  client_table_free(ct, slot);
+}
+
+static void handle_reply(loadgen_t *lg, const uint8_t *frame, ssize_t n) {
+  if (n < (ssize_t)(FRAME_HEADERS + 240)) {
+    return;
+  }
+  const eth_header_t *eth = (const eth_header_t *)frame;
+  const udp_header_t *udp =
+      (const udp_header_t *)(frame + sizeof(eth_header_t) +
+                             sizeof(ip_header_t));
+  const dhcp_packet_t *reply = (const dhcp_packet_t *)(frame + FRAME_HEADERS);
+  if (ntohs(eth->eth_type) != ETH_P_IP ||
+      ntohs(udp->dest) != DHCP_PORT_CLIENT || reply->op != BOOTREPLY ||
+      reply->magic_cookie != htonl(DHCP_MAGIC_COOKIE)) {
+    return;
+  }
+
+  client_table_t *ct = &lg->ct;
+  uint32_t slot = client_table_lookup(ct, ntohl(reply->xid));
+  uint8_t msg_type = 0;
+  uint32_t server_id = reply_option(reply, n - FRAME_HEADERS,
+                                    DHCP_OPTION_DHCP_SERVER, &msg_type);
+  if (slot == CT_NONE) {
+    lg->stray++;
+    return;
+  }
+
+  if (ct->state[slot] == CT_SELECTING && msg_type == DHCPOFFER) {
+    ct->state[slot] = CT_REQUESTING;
+    ct->tries[slot] = 0;
+    ct->lease[slot] = reply->yiaddr;
+    ct->server[slot] = server_id;
+    send_message(lg, slot);
+  } else if (ct->state[slot] == CT_REQUESTING && msg_type == DHCPACK) {
+    ct->state[slot] = CT_BOUND;
+    client_table_disarm(ct, slot);
+    lg->bound++;
+    lg->inflight--;
+  } else if (ct->state[slot] == CT_REQUESTING && msg_type == DHCPNAK) {
+    lg->naks++;
+    start_discover(lg, slot);
+  } else {
+    lg->stray++;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    fprintf(stderr,
+            "Usage: %s <client_if> <server_if|-> [clients] [window] "
+            "[backend] [hugepages]\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+  uint32_t clients = argc > 3 ? strtoul(argv[3], NULL, 10) : 100000;
+  uint32_t window = argc > 4 ? strtoul(argv[4], NULL, 10) : 1024;
+  io_backend_type_t type = IO_BACKEND_SELECT;
+  if (argc > 5 && io_backend_parse_type(argv[5], &type) != 0) {
+    fprintf(stderr, "[-] Unknown I/O backend '%s'\n", argv[5]);
+    return EXIT_FAILURE;
+  }
+  int hugepages = argc > 6 ? atoi(argv[6]) : 1;
+  if (window == 0) {
+    window = 1;
+  }
+
+  static loadgen_t lg;
+  if (client_table_init(&lg.ct, clients, hugepages) < 0 ||
+      iface_ctx_init(&lg.iface, argv[1]) < 0) {
+    return EXIT_FAILURE;
+  }
+  int sock = -1;
+  if (type != IO_BACKEND_XDP) {
+    if ((sock = create_raw_socket(&lg.iface)) < 0) {
+      return EXIT_FAILURE;
+    }
+    int rcvbuf = SOCKET_BUFFER;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf));
+  }
+  lg.io = io_backend_create(type, sock, lg.iface.ifindex);
+  if (!lg.io) {
+    return EXIT_FAILURE;
+  }
+
+  responder_t responder = {argv[2], 0};
+  pthread_t thread;
+  int own_responder = strcmp(argv[2], "-") != 0;
+  if (own_responder) {
+    pthread_create(&thread, NULL, responder_main, &responder);
+    usleep(100000);
+  }
+
+  printf("[*] %u clients, window %u, %s backend\n", clients, window,
+         lg.io->ops->name);
+  printf("[*] Client table: %.1f MiB arena (%s), %.1f bytes per client; "
+         "dhcp_client_t is %zu\n",
+         lg.ct.arena_bytes / 1048576.0,
+         lg.ct.hugepages ? "hugetlb" : hugepages ? "thp" : "4k pages",
+         (double)lg.ct.used_bytes / clients, sizeof(dhcp_client_t));
+
+  uint32_t launched = 0;
+  uint64_t start_ms = monotonic_ms();
+  uint64_t next_scan = start_ms + SCAN_MS;
+  uint8_t frame[2048];
+
+  while (lg.bound + lg.failed < clients) {
+    lg.now = monotonic_ms();
+    while (lg.inflight < window && launched < clients) {
+      uint32_t slot = client_table_alloc(&lg.ct);
+      if (slot == CT_NONE) {
+        break;
+      }
+      launched++;
+      lg.inflight++;
+      start_discover(&lg, slot);
+    }
+    io_flush(lg.io);
+
+    // Wait for the first reply, then take whatever else is queued.
+    for (int timeout = 1;; timeout = 0) {
+      ssize_t n = io_recv(lg.io, frame, sizeof(frame), timeout);
+      if (n <= 0) {
+        break;
+      }
+      lg.now = monotonic_ms();
+      handle_reply(&lg, frame, n);
+    }
+
+    lg.now = monotonic_ms();
+    if (lg.now >= next_scan) {
+      client_table_expire(&lg.ct, lg.now, on_timeout, &lg);
+      next_scan = lg.now + SCAN_MS;
+    }
+  }
+  io_flush(lg.io);
+
+  double secs = (monotonic_ms() - start_ms) / 1000.0;
+
+  // The scan on its own, over the full table with nothing due: what every
+  // SCAN_MS costs however few clients are waiting.
+  int scans = 0;
+  uint64_t scan_start = monotonic_us();
+  do {
+    client_table_expire(&lg.ct, lg.ct.epoch_ms, on_timeout, &lg);
+    scans++;
+  } while (monotonic_us() - scan_start < 200000);
+  double scan_ns = (monotonic_us() - scan_start) * 1000.0 / scans;
+
+  printf("%10s %10s %8s %11s %8s %10s %12s %14s\n", "clients", "bound",
+         "failed", "retransmits", "seconds", "leases/s", "scan_us", "ns/slot");
+  printf("%10u %10llu %8llu %11llu %8.2f %10.0f %12.1f %14.3f\n", clients,
+         (unsigned long long)lg.bound, (unsigned long long)lg.failed,
+         (unsigned long long)lg.retransmits, secs,
+         secs > 0 ? lg.bound / secs : 0.0,
+         scan_ns / 1000.0, scan_ns / clients);
+  if (lg.naks || lg.stray) {
+    printf("[*] %llu NAKs, %llu stray replies\n", (unsigned long long)lg.naks,
+           (unsigned long long)lg.stray);
+  }
+
+  if (own_responder) {
+    responder.stop = 1;
+    pthread_join(thread, NULL);
+  }
+  io_backend_destroy(lg.io);
+  if (sock >= 0) {
+    close(sock);
+  }
+  iface_ctx_close(&lg.iface);
+  client_table_destroy(&lg.ct);
+  return 0;
+}
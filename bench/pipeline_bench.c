@@ -0,0 +1,291 @@
+// Lease installation inline against on a pipeline. One event loop drives
+// `slots` handles, each on its own veth pair with configure on, a
+// resolv.conf and a lease file, so every ACK costs a netlink batch of
+// `routes` routes and two fsync()s. A slot starts over as soon as it is
+// bound, which keeps a steady stream of exchanges going. The responder
+// thread answers at once and measures how long each client took from our
+// OFFER to its REQUEST: that is the time the client's loop was busy with
+// something else, mostly installing other slots' leases.
+//
+// Usage: pipeline_bench <slots> [secs] [routes] [depth]
+// See bench/run_pipeline_bench.sh.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dhcp.h"
+#include "dhcpclient.h"
+#include "network_utils.h"
+#include "responder.h"
+
+#define MAX_SLOTS RESPONDER_MAX_SLOTS
+#define MAX_ROUTES 30  // what fits in one option 121
+#define MAX_SAMPLES (1 << 20)
+
+// What the responder thread answers with and measures.
+typedef struct {
+  int slots;
+  int routes;
+  uint64_t offer_us[MAX_SLOTS];  // when the last OFFER went out, 0 if none
+  uint64_t *turnaround_us;       // OFFER -> REQUEST, written here only
+  uint32_t samples;
+} server_t;
+
+typedef struct {
+  char ifname[IFNAMSIZ];
+  char resolv_conf[64];
+  char lease_file[64];
+  dhcpc_t *client;
+  uint64_t started_us;
+  int restart;
+} slot_t;
+
+typedef struct {
+  uint64_t *bind_us;
+  uint32_t count;
+} bind_times_t;
+
+static bind_times_t bind_times;
+
+static void handle_request(responder_t *r, int slot,
+                           const dhcp_packet_t *request) {
+  server_t *server = r->arg;
+  uint8_t msg_type = request->options[2];
+  uint8_t reply_type;
+  if (msg_type == DHCPDISCOVER) {
+    reply_type = DHCPOFFER;
+  } else if (msg_type == DHCPREQUEST) {
+    reply_type = DHCPACK;
+    if (server->offer_us[slot] && server->samples < MAX_SAMPLES) {
+      server->turnaround_us[server->samples] =
+          monotonic_us() - server->offer_us[slot];
+      __atomic_store_n(&server->samples, server->samples + 1,
+                       __ATOMIC_RELEASE);
+    }
+    server->offer_us[slot] = 0;
+  } else {
+    return;
+  }
+
+  uint8_t options[18 + 2 + MAX_ROUTES * 8];
+  uint8_t *opt = options;
+  uint32_t server_id = r->server_ip[slot];
+  uint32_t mask = inet_addr("255.255.255.0");
+  uint32_t lease_time = htonl(3600);
+  *opt++ = DHCP_OPTION_SUBNET_MASK;
+  *opt++ = 4;
+  memcpy(opt, &mask, 4);
+  opt += 4;
+  *opt++ = DHCP_OPTION_LEASE_TIME;
+  *opt++ = 4;
+  memcpy(opt, &lease_time, 4);
+  opt += 4;
+  *opt++ = DHCP_OPTION_DNS_SERVER;
+  *opt++ = 4;
+  memcpy(opt, &server_id, 4);
+  opt += 4;
+  // 100.(64 + slot).<i>.0/24 via the server, 8 bytes each.
+  *opt++ = DHCP_OPTION_CLASSLESS_ROUTE;
+  *opt++ = server->routes * 8;
+  for (int i = 0; i < server->routes; i++) {
+    *opt++ = 24;
+    *opt++ = 100;
+    *opt++ = 64 + slot;
+    *opt++ = i;
+    memcpy(opt, &server_id, 4);
+    opt += 4;
+  }
+
+  // 10.98.<slot>.10
+  responder_reply(r, slot, request, reply_type,
+                  htonl(ntohl(server_id) + 9), options, opt - options, 0);
+  if (reply_type == DHCPOFFER) {
+    server->offer_us[slot] = monotonic_us();
+  }
+}
+
+static void on_event(dhcpc_t *client, dhcpc_event_t event,
+                     const dhcpc_lease_t *lease, void *arg) {
+  slot_t *slot = arg;
+  (void)client;
+  (void)lease;
+  if (event == DHCPC_EVENT_BOUND) {
+    if (bind_times.count < MAX_SAMPLES) {
+      bind_times.bind_us[bind_times.count++] =
+          monotonic_us() - slot->started_us;
+    }
+    slot->restart = 1;
+  }
+}
+
+// Runs every slot for secs, configuring through pipeline (or inline if
+// NULL), and prints one row.
+static void run_mode(server_t *server, slot_t *slots, const char *name,
+                     dhcpc_pipeline_t *pipeline, int secs) {
+  dhcpc_timers_t *timers = dhcpc_timers_new();
+  if (!timers) {
+    return;
+  }
+  int count = 0;
+  for (; count < server->slots; count++) {
+    slot_t *slot = &slots[count];
+    dhcpc_config_t config;
+    dhcpc_config_init(&config);
+    config.ifname = slot->ifname;
+    config.resolv_conf = slot->resolv_conf;
+    config.lease_file = slot->lease_file;
+    config.log_level = DHCPC_LOG_ERROR;
+    config.timers = timers;
+    config.pipeline = pipeline;
+    config.on_lease = on_event;
+    config.cb_arg = slot;
+    slot->restart = 1;
+    if (!(slot->client = dhcpc_new(&config))) {
+      break;
+    }
+  }
+
+  // Handles are all created first: opening a packet socket waits for an RCU
+  // grace period, which would otherwise land in the measurement.
+  bind_times.count = 0;
+  __atomic_store_n(&server->samples, 0, __ATOMIC_RELEASE);
+  memset(server->offer_us, 0, sizeof(server->offer_us));
+  struct pollfd pfds[MAX_SLOTS + 2];
+  uint64_t start_us = monotonic_us();
+  uint64_t end_us = start_us + secs * 1000000ULL;
+  while (monotonic_us() < end_us) {
+    for (int i = 0; i < count; i++) {
+      slot_t *slot = &slots[i];
+      if (slot->restart) {
+        slot->restart = 0;
+        slot->started_us = monotonic_us();
+        dhcpc_start(slot->client);
+      }
+    }
+
+    pfds[0] = (struct pollfd){.fd = dhcpc_timers_get_fd(timers),
+                              .events = POLLIN};
+    pfds[1] = (struct pollfd){
+        .fd = pipeline ? dhcpc_pipeline_get_fd(pipeline) : -1,
+        .events = POLLIN};
+    for (int i = 0; i < count; i++) {
+      pfds[i + 2] = (struct pollfd){.fd = dhcpc_get_fd(slots[i].client),
+                                    .events = POLLIN};
+    }
+    int timeout = dhcpc_timers_next_timeout_ms(timers);
+    if (timeout < 0 || timeout > 100) {
+      timeout = 100;
+    }
+    if (poll(pfds, count + 2, timeout) < 0 && errno != EINTR) {
+      perror("[-] poll()");
+      break;
+    }
+    if (pfds[0].revents) {
+      dhcpc_timers_process(timers);
+    }
+    if (pfds[1].revents) {
+      dhcpc_pipeline_process(pipeline);
+    }
+    for (int i = 0; i < count; i++) {
+      if (pfds[i + 2].revents) {
+        dhcpc_process(slots[i].client, pfds[i + 2].revents);
+      }
+    }
+  }
+  double elapsed = (monotonic_us() - start_us) / 1e6;
+
+  uint32_t samples = __atomic_load_n(&server->samples, __ATOMIC_ACQUIRE);
+  qsort(bind_times.bind_us, bind_times.count, sizeof(uint64_t), cmp_u64);
+  qsort(server->turnaround_us, samples, sizeof(uint64_t), cmp_u64);
+  printf("%-9s %8.0f %8.2f %8.2f %8.2f %8.2f %8.2f", name,
+         bind_times.count / elapsed,
+         percentile_ms(bind_times.bind_us, bind_times.count, 50),
+         percentile_ms(bind_times.bind_us, bind_times.count, 99),
+         percentile_ms(server->turnaround_us, samples, 50),
+         percentile_ms(server->turnaround_us, samples, 99),
+         percentile_ms(server->turnaround_us, samples, 100));
+  if (pipeline) {
+    dhcpc_pipeline_stats_t stats;
+    dhcpc_pipeline_get_stats(pipeline, &stats);
+    printf(" %6u %6llu %5.0f%%", stats.max_depth,
+           (unsigned long long)stats.inline_jobs,
+           100.0 * stats.busy_us / (elapsed * 1e6));
+  }
+  printf("\n");
+  fflush(stdout);
+
+  for (int i = 0; i < count; i++) {
+    dhcpc_free(slots[i].client);
+    slots[i].client = NULL;
+  }
+  dhcpc_timers_free(timers);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <slots> [secs] [routes] [depth]\n", argv[0]);
+    return 1;
+  }
+  static server_t server;
+  static responder_t r;
+  static slot_t slots[MAX_SLOTS];
+  server.slots = atoi(argv[1]);
+  int secs = argc > 2 ? atoi(argv[2]) : 5;
+  server.routes = argc > 3 ? atoi(argv[3]) : 16;
+  int depth = argc > 4 ? atoi(argv[4]) : server.slots;
+  if (server.slots < 1 || server.slots > MAX_SLOTS || secs < 1 ||
+      server.routes < 0 || server.routes > MAX_ROUTES || depth < 1) {
+    fprintf(stderr, "[-] Bad arguments (at most %d slots, %d routes)\n",
+            MAX_SLOTS, MAX_ROUTES);
+    return 1;
+  }
+
+  server.turnaround_us = malloc(MAX_SAMPLES * sizeof(uint64_t));
+  bind_times.bind_us = malloc(MAX_SAMPLES * sizeof(uint64_t));
+  if (!server.turnaround_us || !bind_times.bind_us) {
+    perror("[-] malloc");
+    return 1;
+  }
+  if (responder_init(&r, "pbs", server.slots, handle_request, &server) < 0) {
+    fprintf(stderr, "[-] See bench/run_pipeline_bench.sh\n");
+    return 1;
+  }
+  for (int i = 0; i < server.slots; i++) {
+    snprintf(slots[i].ifname, IFNAMSIZ, "pbc%d", i);
+    snprintf(slots[i].resolv_conf, sizeof(slots[i].resolv_conf),
+             "/tmp/pipeline_bench.%d.resolv", i);
+    snprintf(slots[i].lease_file, sizeof(slots[i].lease_file),
+             "/tmp/pipeline_bench.%d.lease", i);
+    r.server_ip[i] = htonl(0x0a620001 + (i << 8));  // 10.98.<slot>.1
+  }
+  if (responder_start(&r) < 0) {
+    return 1;
+  }
+
+  printf("[*] %d slots, %d routes per lease, %d s per mode, depth %d\n",
+         server.slots, server.routes, secs, depth);
+  printf("%-9s %8s %8s %8s %8s %8s %8s %6s %6s %6s\n", "mode", "leases/s",
+         "bind_p50", "bind_p99", "turn_p50", "turn_p99", "turn_max",
+         "depth", "inline", "busy");
+  run_mode(&server, slots, "inline", NULL, secs);
+  dhcpc_pipeline_t *pipeline = dhcpc_pipeline_new(depth);
+  if (pipeline) {
+    run_mode(&server, slots, "pipeline", pipeline, secs);
+    dhcpc_pipeline_free(pipeline);
+  }
+
+  responder_stop(&r);
+  for (int i = 0; i < server.slots; i++) {
+    unlink(slots[i].resolv_conf);
+    unlink(slots[i].lease_file);
+  }
+  free(server.turnaround_us);
+  free(bind_times.bind_us);
+  return 0;
+}
@@ -0,0 +1,197 @@
+#include "responder.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "packet_utils.h"
+
+typedef struct {
+  tw_timer_t timer;
+  responder_t *r;
+  int ifindex;
+  uint8_t frame[RESPONDER_FRAME_LEN];
+} pending_reply_t;
+
+int responder_init(responder_t *r, const char *prefix, int slots,
+                   responder_request_fn on_request, void *arg) {
+  memset(r, 0, sizeof(responder_t));
+  r->slots = slots;
+  r->on_request = on_request;
+  r->arg = arg;
+  r->sock = -1;
+
+  int ioctl_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  for (int i = 0; i < slots; i++) {
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s%d", prefix, i);
+    r->ifindex[i] = if_nametoindex(ifr.ifr_name);
+    if (!r->ifindex[i] || ioctl(ioctl_fd, SIOCGIFHWADDR, &ifr) < 0) {
+      fprintf(stderr, "[-] No %s\n", ifr.ifr_name);
+      close(ioctl_fd);
+      return -1;
+    }
+    memcpy(r->mac[i], ifr.ifr_hwaddr.sa_data, 6);
+  }
+  close(ioctl_fd);
+
+  // Unbound, so one socket serves every server end.
+  r->sock = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_IP));
+  if (r->sock < 0 || timer_wheel_init(&r->wheel, 1, 1) < 0) {
+    perror("[-] responder setup");
+    if (r->sock >= 0) {
+      close(r->sock);
+    }
+    return -1;
+  }
+  return 0;
+}
+
+static void send_frame(responder_t *r, int ifindex, const uint8_t *frame) {
+  struct sockaddr_ll dest = {.sll_family = AF_PACKET,
+                             .sll_ifindex = ifindex,
+                             .sll_halen = 6};
+  memset(dest.sll_addr, 0xff, 6);
+  sendto(r->sock, frame, RESPONDER_FRAME_LEN, 0, (struct sockaddr *)&dest,
+         sizeof(dest));
+}
+
+static void send_pending(tw_timer_t *timer, void *arg) {
+  pending_reply_t *p = arg;
+  (void)timer;
+  send_frame(p->r, p->ifindex, p->frame);
+  free(p);
+}
+
+void responder_reply(responder_t *r, int slot, const dhcp_packet_t *request,
+                     uint8_t reply_type, uint32_t yiaddr,
+                     const uint8_t *options, size_t options_len,
+                     uint64_t delay_ms) {
+  uint8_t frame[RESPONDER_FRAME_LEN];
+  uint8_t bcast[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+  uint32_t server_id = r->server_ip[slot];
+  create_header(frame, r->mac[slot], bcast, server_id, INADDR_BROADCAST,
+                DHCP_PORT_SERVER, DHCP_PORT_CLIENT, sizeof(dhcp_packet_t));
+
+  dhcp_packet_t *reply = (dhcp_packet_t *)(frame + RESPONDER_FRAME_HEADERS);
+  memset(reply, 0, sizeof(dhcp_packet_t));
+  reply->op = BOOTREPLY;
+  reply->htype = DHCP_HTYPE_ETHERNET;
+  reply->hlen = DHCP_HLEN_ETHERNET;
+  reply->xid = request->xid;
+  reply->flags = request->flags;
+  reply->yiaddr = yiaddr;
+  reply->siaddr = server_id;
+  memcpy(reply->chaddr, request->chaddr, 16);
+  reply->magic_cookie = htonl(DHCP_MAGIC_COOKIE);
+
+  uint8_t *opt = reply->options;
+  *opt++ = DHCP_OPTION_MSG_TYPE;
+  *opt++ = 1;
+  *opt++ = reply_type;
+  *opt++ = DHCP_OPTION_DHCP_SERVER;
+  *opt++ = 4;
+  memcpy(opt, &server_id, 4);
+  opt += 4;
+  if (options_len > sizeof(reply->options) - (opt - reply->options) - 1) {
+    return;
+  }
+  memcpy(opt, options, options_len);
+  opt[options_len] = DHCP_OPTION_END;
+
+  if (!delay_ms) {
+    send_frame(r, r->ifindex[slot], frame);
+    return;
+  }
+  pending_reply_t *p = malloc(sizeof(pending_reply_t));
+  if (!p) {
+    return;
+  }
+  p->r = r;
+  p->ifindex = r->ifindex[slot];
+  memcpy(p->frame, frame, RESPONDER_FRAME_LEN);
+  tw_timer_init(&p->timer, send_pending, p);
+  tw_timer_schedule(&r->wheel, &p->timer, delay_ms);
+}
+
+static void *responder_main(void *arg) {
+  responder_t *r = arg;
+  uint8_t buffer[1500];
+
+  while (!r->stop) {
+    struct pollfd pfds[2] = {{.fd = r->sock, .events = POLLIN},
+                             {.fd = r->wheel.timer_fd, .events = POLLIN}};
+    int timeout = timer_wheel_next_timeout_ms(&r->wheel);
+    if (timeout < 0 || timeout > 100) {
+      timeout = 100;
+    }
+    if (poll(pfds, 2, timeout) < 0 && errno != EINTR) {
+      perror("[-] poll() responder");
+      break;
+    }
+
+    for (;;) {
+      struct sockaddr_ll from;
+      socklen_t from_len = sizeof(from);
+      ssize_t n = recvfrom(r->sock, buffer, sizeof(buffer), MSG_DONTWAIT,
+                           (struct sockaddr *)&from, &from_len);
+      if (n < 0) {
+        break;
+      }
+      if (from.sll_pkttype == PACKET_OUTGOING ||
+          n < (ssize_t)RESPONDER_FRAME_HEADERS + 240) {
+        continue;
+      }
+      int slot = 0;
+      while (slot < r->slots && r->ifindex[slot] != from.sll_ifindex) {
+        slot++;
+      }
+      const udp_header_t *udp =
+          (const udp_header_t *)(buffer + sizeof(eth_header_t) +
+                                 sizeof(ip_header_t));
+      const dhcp_packet_t *request =
+          (const dhcp_packet_t *)(buffer + RESPONDER_FRAME_HEADERS);
+      if (slot < r->slots && ntohs(udp->dest) == DHCP_PORT_SERVER &&
+          request->op == BOOTREQUEST) {
+        r->on_request(r, slot, request);
+      }
+    }
+    timer_wheel_run(&r->wheel);
+  }
+  return NULL;
+}
+
+int responder_start(responder_t *r) {
+  if (pthread_create(&r->thread, NULL, responder_main, r) != 0) {
+    perror("[-] pthread_create() responder");
+    return -1;
+  }
+  return 0;
+}
+
+// Replies still waiting on the wheel are dropped with it.
+void responder_stop(responder_t *r) {
+  r->stop = 1;
+  pthread_join(r->thread, NULL);
+  timer_wheel_destroy(&r->wheel);
+  close(r->sock);
+}
+
+int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+double percentile_ms(const uint64_t *sorted, size_t n, int pct) {
+  return n ? sorted[(n - 1) * pct / 100] / 1000.0 : 0.0;
+}
@@ -0,0 +1,60 @@
+#ifndef BENCH_RESPONDER_H
+#define BENCH_RESPONDER_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dhcp.h"
+#include "network_utils.h"
+#include "timer_wheel.h"
+
+// A stand-in DHCP server for the benches that run one veth pair per slot.
+// One thread serves the server end of every pair through one unbound packet
+// socket and hands each BOOTREQUEST to the bench, which answers it with
+// responder_reply(): at once, later, more than once or not at all.
+#define RESPONDER_FRAME_HEADERS \
+  (sizeof(eth_header_t) + sizeof(ip_header_t) + sizeof(udp_header_t))
+#define RESPONDER_FRAME_LEN (RESPONDER_FRAME_HEADERS + sizeof(dhcp_packet_t))
+#define RESPONDER_MAX_SLOTS 64
+
+typedef struct responder responder_t;
+
+// Runs on the responder thread for every request slot's client sends.
+typedef void (*responder_request_fn)(responder_t *r, int slot,
+                                     const dhcp_packet_t *request);
+
+struct responder {
+  int slots;
+  int ifindex[RESPONDER_MAX_SLOTS];  // server ends
+  uint8_t mac[RESPONDER_MAX_SLOTS][6];
+  uint32_t server_ip[RESPONDER_MAX_SLOTS];  // set by the bench, option 54
+  responder_request_fn on_request;
+  void *arg;
+  int sock;
+  timer_wheel_t wheel;  // replies sent with a delay
+  pthread_t thread;
+  volatile int stop;
+};
+
+// Looks up <prefix>0 .. <prefix>{slots - 1}, the server ends, and opens the
+// socket. The bench sets server_ip[] before responder_start().
+int responder_init(responder_t *r, const char *prefix, int slots,
+                   responder_request_fn on_request, void *arg);
+int responder_start(responder_t *r);
+void responder_stop(responder_t *r);
+
+// Broadcasts a reply_type answer to request on slot's pair after delay_ms,
+// with options 53 and 54 followed by the options_len bytes of options and
+// END.
+void responder_reply(responder_t *r, int slot, const dhcp_packet_t *request,
+                     uint8_t reply_type, uint32_t yiaddr,
+                     const uint8_t *options, size_t options_len,
+                     uint64_t delay_ms);
+
+// For the benches' reports: qsort() order and the pct percentile of a
+// sorted array, in ms of the microsecond values.
+int cmp_u64(const void *a, const void *b);
+double percentile_ms(const uint64_t *sorted, size_t n, int pct);
+
+#endif
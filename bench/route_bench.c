@@ -0,0 +1,148 @@
+// Time to install a lease's address and N routes: one ioctl per change (the
+// old set_ip_addr/add_default_router path) against one netlink batch.
+//
+// Usage: route_bench <ifname> [max_routes]
+// See bench/run_route_bench.sh; it runs inside a throwaway netns.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <net/if.h>
+#include <net/route.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "netlink.h"
+#include "network_utils.h"
+
+#define GATEWAY "10.254.0.1"
+#define ADDRESS "10.254.0.2"
+
+static void make_routes(ipv4_route_t *routes, int count) {
+  for (int i = 0; i < count; i++) {
+    routes[i].dst = htonl(0x0ac80000 + (i << 8));  // 10.200.i.0/24
+    routes[i].gateway = inet_addr(GATEWAY);
+    routes[i].prefix_len = 24;
+  }
+}
+
+static int ioctl_install(const char *ifname, const ipv4_route_t *routes,
+                         int count) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    return -1;
+  }
+
+  struct ifreq ifr;
+  memset(&ifr, 0, sizeof(ifr));
+  strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+  struct sockaddr_in *addr = (struct sockaddr_in *)&ifr.ifr_addr;
+  addr->sin_family = AF_INET;
+  addr->sin_addr.s_addr = inet_addr(ADDRESS);
+  ioctl(fd, SIOCSIFADDR, &ifr);
+  addr->sin_addr.s_addr = inet_addr("255.255.255.0");
+  ioctl(fd, SIOCSIFNETMASK, &ifr);
+
+  for (int i = 0; i < count; i++) {
+    struct rtentry route;
+    memset(&route, 0, sizeof(route));
+    addr = (struct sockaddr_in *)&route.rt_dst;
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = routes[i].dst;
+    addr = (struct sockaddr_in *)&route.rt_genmask;
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(~0u << (32 - routes[i].prefix_len));
+    addr = (struct sockaddr_in *)&route.rt_gateway;
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = routes[i].gateway;
+    route.rt_flags = RTF_UP | RTF_GATEWAY;
+    route.rt_dev = (char *)ifname;
+    if (ioctl(fd, SIOCADDRT, &route) < 0 && errno != EEXIST) {
+      perror("ioctl() SIOCADDRT");
+      close(fd);
+      return -1;
+    }
+  }
+  close(fd);
+  return 0;
+}
+
+// Drops the routes and the address so every run starts from a clean link.
+static void reset_link(iface_ctx_t *iface, const ipv4_route_t *routes,
+                       int count) {
+  size_t cap = (size_t)(count + 1) * 64;
+  uint8_t *batch = calloc(1, cap);
+  size_t len = 0;
+
+  for (int i = 0; i < count; i++) {
+    struct nlmsghdr *nlh = (struct nlmsghdr *)(batch + len);
+    nlh->nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+    nlh->nlmsg_type = RTM_DELROUTE;
+    struct rtmsg *rtm = NLMSG_DATA(nlh);
+    rtm->rtm_family = AF_INET;
+    rtm->rtm_dst_len = routes[i].prefix_len;
+    rtm->rtm_table = RT_TABLE_MAIN;
+    nl_addattr(nlh, 64, RTA_DST, &routes[i].dst, 4);
+    len += NLMSG_ALIGN(nlh->nlmsg_len);
+  }
+
+  struct nlmsghdr *nlh = (struct nlmsghdr *)(batch + len);
+  nlh->nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+  nlh->nlmsg_type = RTM_DELADDR;
+  struct ifaddrmsg *ifa = NLMSG_DATA(nlh);
+  ifa->ifa_family = AF_INET;
+  ifa->ifa_prefixlen = 24;
+  ifa->ifa_index = iface->ifindex;
+  uint32_t local = inet_addr(ADDRESS);
+  nl_addattr(nlh, 64, IFA_LOCAL, &local, 4);
+  len += NLMSG_ALIGN(nlh->nlmsg_len);
+
+  nl_talk_batch(&iface->nl, batch, len);
+  free(batch);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <ifname> [max_routes]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  int max_routes = argc > 2 ? atoi(argv[2]) : 1024;
+
+  iface_ctx_t iface;
+  if (iface_ctx_init(&iface, argv[1]) < 0) {
+    return EXIT_FAILURE;
+  }
+
+  ipv4_route_t *routes = calloc(max_routes, sizeof(ipv4_route_t));
+  make_routes(routes, max_routes);
+  struct in_addr address = {inet_addr(ADDRESS)};
+
+  printf("%-8s %12s %14s %12s %14s %10s\n", "routes", "ioctl_us",
+         "ioctl_us/route", "netlink_us", "netlink_us/rt", "sendmsgs");
+
+  for (int count = 1; count <= max_routes; count *= 4) {
+    reset_link(&iface, routes, count);
+    uint64_t start = monotonic_us();
+    ioctl_install(iface.ifname, routes, count);
+    uint64_t ioctl_us = monotonic_us() - start;
+
+    reset_link(&iface, routes, count);
+    start = monotonic_us();
+    int failed = iface_ctx_configure(&iface, address, 24, 0, 0, routes, count);
+    uint64_t netlink_us = monotonic_us() - start;
+
+    printf("%-8d %12llu %14.2f %12llu %14.2f %10d%s\n", count,
+           (unsigned long long)ioctl_us, (double)ioctl_us / count,
+           (unsigned long long)netlink_us, (double)netlink_us / count,
+           count / NL_BATCH_MAX_MSGS + 1, failed ? "  (errors)" : "");
+  }
+
+  reset_link(&iface, routes, max_routes);
+  free(routes);
+  iface_ctx_close(&iface);
+  return 0;
+}
@@ -0,0 +1,26 @@
+#!/bin/sh
+# Runs bench/churn_bench.c over one veth pair per slot inside a throwaway
+# netns.
+# Usage: sudo bench/run_churn_bench.sh [slots] [pool_size] [seconds] [hold_ms]
+#                                      [lease_secs]
+set -e
+
+NETNS=dhcp-churn-bench
+SLOTS=${1:-16}
+[ $# -gt 0 ] && shift
+
+cleanup() {
+  ip netns del "$NETNS" 2>/dev/null || true
+}
+trap cleanup EXIT
+
+ip netns add "$NETNS"
+i=0
+while [ "$i" -lt "$SLOTS" ]; do
+  ip -n "$NETNS" link add "chc$i" type veth peer name "chs$i"
+  ip -n "$NETNS" link set "chc$i" up
+  ip -n "$NETNS" link set "chs$i" up
+  i=$((i + 1))
+done
+
+ip netns exec "$NETNS" ./bin/churn_bench "$SLOTS" "$@" | grep -v '^MAC'
@@ -0,0 +1,25 @@
+#!/bin/sh
+# Runs bench/fault_bench.c over one veth pair per slot inside a throwaway
+# netns.
+# Usage: sudo bench/run_fault_bench.sh [slots] [trials] [scenario...]
+set -e
+
+NETNS=dhcp-fault-bench
+SLOTS=${1:-16}
+[ $# -gt 0 ] && shift
+
+cleanup() {
+  ip netns del "$NETNS" 2>/dev/null || true
+}
+trap cleanup EXIT
+
+ip netns add "$NETNS"
+i=0
+while [ "$i" -lt "$SLOTS" ]; do
+  ip -n "$NETNS" link add "fbc$i" type veth peer name "fbs$i"
+  ip -n "$NETNS" link set "fbc$i" up
+  ip -n "$NETNS" link set "fbs$i" up
+  i=$((i + 1))
+done
+
+ip netns exec "$NETNS" ./bin/fault_bench "$SLOTS" "$@" | grep -v '^MAC'
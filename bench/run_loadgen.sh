@@ -0,0 +1,21 @@
+#!/bin/sh
+# Runs bench/loadgen.c over a veth pair inside a throwaway netns, with the
+# built-in responder on the peer.
+# Usage: sudo bench/run_loadgen.sh [clients] [window] [backend] [hugepages]
+set -e
+
+NETNS=dhcp-loadgen
+IFNAME=dhcplg0
+
+cleanup() {
+  ip netns del "$NETNS" 2>/dev/null || true
+}
+trap cleanup EXIT
+
+ip netns add "$NETNS"
+ip -n "$NETNS" link add "$IFNAME" type veth peer name "${IFNAME}p"
+ip -n "$NETNS" link set "$IFNAME" up
+ip -n "$NETNS" link set "${IFNAME}p" up
+
+ip netns exec "$NETNS" ./bin/loadgen "$IFNAME" "${IFNAME}p" "$@" |
+  grep -v '^MAC'
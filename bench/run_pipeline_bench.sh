@@ -0,0 +1,25 @@
+#!/bin/sh
+# Runs bench/pipeline_bench.c over one veth pair per slot inside a throwaway
+# netns.
+# Usage: sudo bench/run_pipeline_bench.sh [slots] [secs] [routes] [depth]
+set -e
+
+NETNS=dhcp-pipeline-bench
+SLOTS=${1:-8}
+[ $# -gt 0 ] && shift
+
+cleanup() {
+  ip netns del "$NETNS" 2>/dev/null || true
+}
+trap cleanup EXIT
+
+ip netns add "$NETNS"
+i=0
+while [ "$i" -lt "$SLOTS" ]; do
+  ip -n "$NETNS" link add "pbc$i" type veth peer name "pbs$i"
+  ip -n "$NETNS" link set "pbc$i" up
+  ip -n "$NETNS" link set "pbs$i" up
+  i=$((i + 1))
+done
+
+ip netns exec "$NETNS" ./bin/pipeline_bench "$SLOTS" "$@" | grep -v '^MAC'
@@ -0,0 +1,20 @@
+#!/bin/sh
+# Runs bench/route_bench.c on a veth link inside a throwaway netns, so the
+# host routing table is never touched.
+# Usage: sudo bench/run_route_bench.sh [max_routes]
+set -e
+
+NETNS=dhcp-route-bench
+IFNAME=dhcprb0
+
+cleanup() {
+  ip netns del "$NETNS" 2>/dev/null || true
+}
+trap cleanup EXIT
+
+ip netns add "$NETNS"
+ip -n "$NETNS" link add "$IFNAME" type veth peer name "${IFNAME}p"
+ip -n "$NETNS" link set "$IFNAME" up
+ip -n "$NETNS" link set "${IFNAME}p" up
+
+ip netns exec "$NETNS" ./bin/route_bench "$IFNAME" "$@" | grep -v '^MAC'
@@ -0,0 +1,42 @@
+#!/bin/sh
+# Runs bin/dhcp_server on one end of a veth pair inside a throwaway netns and
+# bench/loadgen.c against it from the other, then the engine on its own
+# (bench/server_bench.c), so client-side and server-side limits show apart.
+# Usage: sudo bench/run_server_bench.sh [clients] [window] [lease_log]
+set -e
+
+NETNS=dhcp-server-bench
+IFNAME=dhcpsb0
+CLIENTS=${1:-200000}
+WINDOW=${2:-1024}
+LEASE_LOG=${3:-/tmp/dhcp-server-bench.log}
+
+cleanup() {
+  [ -n "$SERVER_PID" ] && kill "$SERVER_PID" 2>/dev/null && wait "$SERVER_PID"
+  ip netns del "$NETNS" 2>/dev/null || true
+  rm -f "$LEASE_LOG"
+}
+trap cleanup EXIT
+
+ip netns add "$NETNS"
+ip -n "$NETNS" link add "$IFNAME" type veth peer name "${IFNAME}p"
+ip -n "$NETNS" link set "$IFNAME" up
+ip -n "$NETNS" link set "${IFNAME}p" up
+
+# A pool of exactly CLIENTS addresses from 10.0.0.2.
+LAST=$((CLIENTS + 1))
+POOL=10.0.0.2-10.$((LAST >> 16 & 255)).$((LAST >> 8 & 255)).$((LAST & 255))
+rm -f "$LEASE_LOG"
+ip netns exec "$NETNS" ./bin/dhcp_server -s 10.0.0.1/8 -p "$POOL" \
+  -f "$LEASE_LOG" "${IFNAME}p" &
+SERVER_PID=$!
+sleep 0.5
+
+ip netns exec "$NETNS" ./bin/loadgen "$IFNAME" - "$CLIENTS" "$WINDOW" |
+  grep -v '^MAC'
+kill "$SERVER_PID"
+wait "$SERVER_PID" || true
+SERVER_PID=
+
+echo
+./bin/server_bench "$CLIENTS" "$LEASE_LOG"
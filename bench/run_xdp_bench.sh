@@ -0,0 +1,18 @@
+#!/bin/sh
+# Runs bench/xdp_bench.c over a throwaway veth pair.
+# Usage: sudo bench/run_xdp_bench.sh [seconds]
+set -e
+
+CLIENT_IF=dhcpb0
+SERVER_IF=dhcpb1
+
+cleanup() {
+  ip link del "$CLIENT_IF" 2>/dev/null || true
+}
+trap cleanup EXIT
+
+ip link add "$CLIENT_IF" type veth peer name "$SERVER_IF"
+ip link set "$CLIENT_IF" up
+ip link set "$SERVER_IF" up
+
+./bin/xdp_bench "$CLIENT_IF" "$SERVER_IF" "$@" | grep -E '^(tx|rx) '
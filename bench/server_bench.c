@@ -0,0 +1,156 @@
+// Cost of the server engine (include/dhcp_server.h) without a socket: one
+// DISCOVER and one REQUEST per client through dhcp_server_handle_frame(),
+// then the same clients again (their leases are found through the chaddr
+// index), then a RELEASE each. Log records are flushed every
+// DHCP_SERVER_BATCH requests, as dhcp_server_process() does.
+//
+// Usage: server_bench [clients] [lease_log]
+// No privileges needed. bench/run_server_bench.sh also runs the server on
+// a veth pair against bin/loadgen.
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dhcp.h"
+#include "dhcp_server.h"
+#include "network_utils.h"
+#include "packet_utils.h"
+
+#define FRAME_HEADERS \
+  (sizeof(eth_header_t) + sizeof(ip_header_t) + sizeof(udp_header_t))
+#define FRAME_LEN (FRAME_HEADERS + sizeof(dhcp_packet_t))
+
+typedef struct {
+  uint8_t frame[FRAME_LEN];
+  uint8_t *requested;  // option 50 value, NULL if the message has none
+} request_frame_t;
+
+static uint8_t reply[2048];
+static struct sockaddr_ll dst;
+
+static void build_frame(request_frame_t *req, uint8_t msg_type,
+                        uint32_t server_id) {
+  static uint8_t bcast[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+  static uint8_t mac[6] = {0x02};
+  dhcp_packet_t *packet = (dhcp_packet_t *)(req->frame + FRAME_HEADERS);
+  create_dhcp_packet(packet, mac, 1, msg_type);
+  req->requested = NULL;
+  if (msg_type == DHCPREQUEST) {
+    uint8_t *opt = dhcp_options_end(packet);
+    *opt++ = DHCP_OPTION_REQUESTED_IP;
+    *opt++ = 4;
+    req->requested = opt;
+    opt += 4;
+    *opt++ = DHCP_OPTION_DHCP_SERVER;
+    *opt++ = 4;
+    memcpy(opt, &server_id, 4);
+    opt += 4;
+    *opt = DHCP_OPTION_END;
+  }
+  create_header(req->frame, mac, bcast, INADDR_ANY, INADDR_BROADCAST,
+                DHCP_PORT_CLIENT, DHCP_PORT_SERVER, sizeof(dhcp_packet_t));
+}
+
+// Patches in what differs per client: chaddr, xid and ciaddr.
+static dhcp_packet_t *set_client(request_frame_t *req, uint32_t client,
+                                 uint32_t ciaddr) {
+  dhcp_packet_t *packet = (dhcp_packet_t *)(req->frame + FRAME_HEADERS);
+  uint32_t be = htonl(client);
+  memcpy(packet->chaddr + 2, &be, 4);
+  packet->xid = be;
+  packet->ciaddr = ciaddr;
+  return packet;
+}
+
+static uint32_t handle(dhcp_server_t *srv, request_frame_t *req,
+                       uint64_t *count) {
+  size_t len = dhcp_server_handle_frame(srv, req->frame, FRAME_LEN, reply,
+                                        &dst);
+  if (++*count % DHCP_SERVER_BATCH == 0) {
+    dhcp_server_flush_log(srv);
+  }
+  return len ? ((dhcp_packet_t *)(reply + FRAME_HEADERS))->yiaddr : 0;
+}
+
+static void report(const char *phase, uint32_t clients, uint64_t requests,
+                   uint64_t us, uint64_t ok) {
+  printf("%-10s %10u %10llu %12.1f %12.0f %10llu\n", phase, clients,
+         (unsigned long long)requests, us * 1000.0 / requests,
+         us ? clients * 1e6 / us : 0.0, (unsigned long long)ok);
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t clients = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  const char *lease_log = argc > 2 ? argv[2] : NULL;
+  if (clients == 0 || clients > (1u << 24) - 4) {
+    fprintf(stderr, "[-] Bad number of clients\n");
+    return EXIT_FAILURE;
+  }
+  if (lease_log) {
+    unlink(lease_log);
+  }
+
+  dhcp_server_config_t config;
+  dhcp_server_config_init(&config);
+  inet_pton(AF_INET, "10.0.0.1", &config.server);
+  config.prefix_len = 8;
+  config.first.s_addr = htonl(ntohl(config.server.s_addr) + 1);
+  config.last.s_addr = htonl(ntohl(config.first.s_addr) + clients - 1);
+  config.lease_log = lease_log;
+  dhcp_server_t *srv = dhcp_server_new(&config);
+  if (!srv) {
+    return EXIT_FAILURE;
+  }
+  const dhcp_server_stats_t *stats = dhcp_server_stats(srv);
+  printf("[*] %u clients, %.1f bytes of lease state per address, lease log "
+         "%s\n",
+         clients, dhcp_server_bytes_per_lease(srv),
+         lease_log ? lease_log : "off");
+
+  static request_frame_t discover, request, release;
+  build_frame(&discover, DHCPDISCOVER, 0);
+  build_frame(&request, DHCPREQUEST, config.server.s_addr);
+  build_frame(&release, DHCPRELEASE, 0);
+
+  printf("%-10s %10s %10s %12s %12s %10s\n", "phase", "clients", "requests",
+         "ns/request", "leases/s", "acks");
+  const char *phases[] = {"bind", "rebind"};
+  for (int phase = 0; phase < 2; phase++) {
+    uint64_t requests = 0, acks = stats->acks;
+    uint64_t start = monotonic_us();
+    for (uint32_t i = 0; i < clients; i++) {
+      set_client(&discover, i, 0);
+      uint32_t yiaddr = handle(srv, &discover, &requests);
+      set_client(&request, i, 0);
+      memcpy(request.requested, &yiaddr, 4);
+      handle(srv, &request, &requests);
+    }
+    dhcp_server_flush_log(srv);
+    report(phases[phase], clients, requests, monotonic_us() - start,
+           stats->acks - acks);
+  }
+
+  uint64_t requests = 0, releases = stats->releases;
+  uint64_t start = monotonic_us();
+  for (uint32_t i = 0; i < clients; i++) {
+    set_client(&release, i, htonl(ntohl(config.first.s_addr) + i));
+    handle(srv, &release, &requests);
+  }
+  dhcp_server_flush_log(srv);
+  report("release", clients, requests, monotonic_us() - start,
+         stats->releases - releases);
+
+  if (stats->leases || stats->naks || stats->exhausted) {
+    printf("[-] %u leases left, %llu NAKs, %llu with the pool empty\n",
+           stats->leases, (unsigned long long)stats->naks,
+           (unsigned long long)stats->exhausted);
+  }
+  if (lease_log) {
+    printf("[*] %.1f MiB of lease log\n", stats->log_bytes / 1048576.0);
+  }
+  dhcp_server_free(srv);
+  return 0;
+}
@@ -0,0 +1,122 @@
+// The status file's seqlock under contention. A writer thread publishes a
+// handle whose fields all carry the same counter as fast as it can, while
+// the main thread reads the slot back through a second, read-only mapping
+// the way dhcp_status does, and checks that no copy mixes two updates.
+// Reports the cost of one publish and one read, and how many reads had to
+// give up. No network is needed.
+//
+// Usage: status_bench [seconds] [slots]
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "dhcp.h"
+#include "network_utils.h"
+#include "status_file.h"
+
+typedef struct {
+  dhcpc_status_t *status;
+  int slots;
+  int stop;
+  uint64_t updates;
+  uint64_t busy_us;
+} writer_t;
+
+static void *writer_main(void *arg) {
+  writer_t *w = arg;
+  dhcp_client_t client;
+  memset(&client, 0, sizeof(client));
+  snprintf(client.iface.ifname, sizeof(client.iface.ifname), "bench0");
+  client.state = DHCP_STATE_BOUND;
+  client.bound_at_ms = monotonic_ms();
+
+  uint64_t start_us = monotonic_us();
+  uint32_t i = 0;
+  while (!__atomic_load_n(&w->stop, __ATOMIC_RELAXED)) {
+    i++;
+    client.xid = i;
+    client.offered_ip.s_addr = i;
+    client.lease_time = i;
+    for (int e = 0; e <= DHCPC_EVENT_EXPIRED; e++) {
+      client.event_counts[e] = i;
+    }
+    status_publish(w->status, i % w->slots, &client, 1);
+  }
+  w->busy_us = monotonic_us() - start_us;
+  w->updates = i;
+  return NULL;
+}
+
+int main(int argc, char *argv[]) {
+  int seconds = argc > 1 ? atoi(argv[1]) : 3;
+  int slots = argc > 2 ? atoi(argv[2]) : 1;
+  if (seconds < 1 || slots < 1) {
+    fprintf(stderr, "Usage: %s [seconds] [slots]\n", argv[0]);
+    return 1;
+  }
+
+  char path[64];
+  snprintf(path, sizeof(path), "/dev/shm/status_bench.%d", getpid());
+  writer_t w = {.slots = slots};
+  if (!(w.status = dhcpc_status_open(path, slots))) {
+    return 1;
+  }
+  for (int i = 0; i < slots; i++) {
+    status_claim(w.status);
+  }
+
+  int fd = open(path, O_RDONLY);
+  const status_header_t *header =
+      fd < 0 ? MAP_FAILED
+             : mmap(NULL, w.status->size, PROT_READ, MAP_SHARED, fd, 0);
+  if (header == MAP_FAILED) {
+    perror("[-] map status file");
+    return 1;
+  }
+  close(fd);
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, writer_main, &w) != 0) {
+    perror("[-] pthread_create()");
+    return 1;
+  }
+
+  printf("[*] %d s, %d slot(s)\n", seconds, slots);
+  uint64_t reads = 0, failed = 0, torn = 0;
+  uint64_t start_us = monotonic_us();
+  uint64_t end_us = start_us + seconds * 1000000ULL;
+  status_slot_t slot;
+  while (monotonic_us() < end_us) {
+    for (int r = 0; r < 1024; r++) {
+      if (status_read_slot(header, reads++ % slots, &slot) < 0) {
+        failed++;
+        continue;
+      }
+      int ok = slot.address == slot.xid && slot.lease_time == slot.xid;
+      for (int e = 0; e <= DHCPC_EVENT_EXPIRED; e++) {
+        ok &= slot.events[e] == slot.xid;
+      }
+      torn += !ok;
+    }
+  }
+  uint64_t read_us = monotonic_us() - start_us;
+  __atomic_store_n(&w.stop, 1, __ATOMIC_RELAXED);
+  pthread_join(thread, NULL);
+
+  printf("%-10s %12s %10s\n", "side", "ops", "ns/op");
+  printf("%-10s %12llu %10.1f\n", "publish", (unsigned long long)w.updates,
+         w.updates ? w.busy_us * 1e3 / w.updates : 0.0);
+  printf("%-10s %12llu %10.1f\n", "read", (unsigned long long)reads,
+         reads ? read_us * 1e3 / reads : 0.0);
+  printf("[%c] %llu torn copies, %llu reads gave up\n", torn ? '-' : '+',
+         (unsigned long long)torn, (unsigned long long)failed);
+
+  munmap((void *)header, w.status->size);
+  dhcpc_status_close(w.status);
+  return torn ? 1 : 0;
+}
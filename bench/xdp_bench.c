@@ -0,0 +1,266 @@
+// Frames per second through the AF_PACKET (select) and AF_XDP backends.
+//
+// tx: DHCPDISCOVER frames as fast as the backend takes them. AF_PACKET
+//     builds and copies every frame through sendto(); AF_XDP writes a frame
+//     template into UMEM once and only patches xid/chaddr per frame.
+// rx: a flood thread on the peer sends DHCP-sized UDP/68 frames plus one
+//     non-DHCP frame for every DHCP one; we count what the backend delivers.
+//
+// Usage: xdp_bench <client_if> <server_if> [seconds]
+// See bench/run_xdp_bench.sh for the veth setup.
+
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dhcp.h"
+#include "io_backend.h"
+#include "network_utils.h"
+#include "packet_utils.h"
+
+#define FRAME_HEADERS \
+  (sizeof(eth_header_t) + sizeof(ip_header_t) + sizeof(udp_header_t))
+#define FRAME_LEN (FRAME_HEADERS + sizeof(dhcp_packet_t))
+#define TX_BATCH 64
+
+typedef struct {
+  const char *ifname;
+  volatile int stop;
+  uint64_t sent;
+} flooder_t;
+
+static double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t rx_packets(const char *ifname) {
+  char path[128];
+  snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/rx_packets",
+           ifname);
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    return 0;
+  }
+  unsigned long long value = 0;
+  if (fscanf(f, "%llu", &value) != 1) {
+    value = 0;
+  }
+  fclose(f);
+  return value;
+}
+
+static void build_discover(uint8_t *frame, uint8_t *mac, uint32_t xid) {
+  uint8_t bcast[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+  create_header(frame, mac, bcast, INADDR_ANY, INADDR_BROADCAST,
+                DHCP_PORT_CLIENT, DHCP_PORT_SERVER, sizeof(dhcp_packet_t));
+  create_dhcp_packet((dhcp_packet_t *)(frame + FRAME_HEADERS), mac, xid,
+                     DHCPDISCOVER);
+}
+
+static io_backend_t *open_backend(io_backend_type_t type,
+                                  const iface_ctx_t *iface, int *sock) {
+  *sock = -1;
+  if (type != IO_BACKEND_XDP && (*sock = create_raw_socket(iface)) < 0) {
+    return NULL;
+  }
+  io_backend_t *io = io_backend_create(type, *sock, iface->ifindex);
+  if (!io && *sock >= 0) {
+    close(*sock);
+  }
+  return io;
+}
+
+static void close_backend(io_backend_t *io, int sock) {
+  io_backend_destroy(io);
+  if (sock >= 0) {
+    close(sock);
+  }
+}
+
+static void bench_tx(io_backend_type_t type, const char *client_if,
+                     const char *server_if, double seconds) {
+  iface_ctx_t iface;
+  if (iface_ctx_init(&iface, client_if) < 0) {
+    return;
+  }
+
+  int sock;
+  io_backend_t *io = open_backend(type, &iface, &sock);
+  if (!io) {
+    iface_ctx_close(&iface);
+    return;
+  }
+
+  uint8_t *mac = iface.mac;
+  struct sockaddr_ll dest = iface.bcast_addr;
+
+  uint8_t frame[FRAME_LEN];
+  build_discover(frame, mac, 0);
+
+  int use_template = 0;
+#ifdef HAVE_AF_XDP
+  use_template = type == IO_BACKEND_XDP &&
+                 xsk_set_tx_template(io, frame, FRAME_LEN) == 0;
+#endif
+
+  uint64_t peer_before = rx_packets(server_if);
+  uint64_t sent = 0;
+  double start = now_sec();
+  double elapsed = 0;
+
+  while (elapsed < seconds) {
+    for (int i = 0; i < TX_BATCH; i++) {
+      uint32_t xid = htonl((uint32_t)sent);
+      int ret;
+      if (use_template) {
+#ifdef HAVE_AF_XDP
+        ret = xsk_send_patched(io,
+                               FRAME_HEADERS + offsetof(dhcp_packet_t, xid),
+                               &xid, sizeof(xid));
+#else
+        ret = -1;
+#endif
+      } else {
+        build_discover(frame, mac, (uint32_t)sent);
+        ret = io_send(io, frame, FRAME_LEN, (struct sockaddr *)&dest,
+                      sizeof(dest));
+      }
+      if (ret < 0) {
+        break;
+      }
+      sent++;
+    }
+    io_flush(io);
+    elapsed = now_sec() - start;
+  }
+  usleep(100000);
+
+  uint64_t delivered = rx_packets(server_if) - peer_before;
+  printf("tx %-6s %12.0f fps sent %12.0f fps delivered %8.2f syscalls/frame\n",
+         io->ops->name, sent / elapsed, delivered / elapsed,
+         (double)io->stats.syscalls / (sent ? sent : 1));
+
+  close_backend(io, sock);
+  iface_ctx_close(&iface);
+}
+
+static void *flooder_main(void *arg) {
+  flooder_t *f = arg;
+  iface_ctx_t iface;
+  if (iface_ctx_init(&iface, f->ifname) < 0) {
+    return NULL;
+  }
+  int sock = create_raw_socket(&iface);
+  if (sock < 0) {
+    iface_ctx_close(&iface);
+    return NULL;
+  }
+
+  uint8_t *mac = iface.mac;
+  uint8_t bcast[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+  struct sockaddr_ll dest = iface.bcast_addr;
+
+  uint8_t dhcp_frame[FRAME_LEN];
+  memset(dhcp_frame, 0, sizeof(dhcp_frame));
+  create_header(dhcp_frame, mac, bcast, inet_addr("10.255.0.1"),
+                INADDR_BROADCAST, DHCP_PORT_SERVER, DHCP_PORT_CLIENT,
+                sizeof(dhcp_packet_t));
+
+  uint8_t other_frame[128];
+  create_header(other_frame, mac, bcast, inet_addr("10.255.0.1"),
+                INADDR_BROADCAST, 9, 9, sizeof(other_frame) - FRAME_HEADERS);
+
+  while (!f->stop) {
+    sendto(sock, other_frame, sizeof(other_frame), 0, (struct sockaddr *)&dest,
+           sizeof(dest));
+    if (sendto(sock, dhcp_frame, sizeof(dhcp_frame), 0,
+               (struct sockaddr *)&dest, sizeof(dest)) > 0) {
+      f->sent++;
+    }
+  }
+
+  close(sock);
+  iface_ctx_close(&iface);
+  return NULL;
+}
+
+static void bench_rx(io_backend_type_t type, const char *client_if,
+                     const char *server_if, double seconds) {
+  iface_ctx_t iface;
+  if (iface_ctx_init(&iface, client_if) < 0) {
+    return;
+  }
+
+  int sock;
+  io_backend_t *io = open_backend(type, &iface, &sock);
+  if (!io) {
+    iface_ctx_close(&iface);
+    return;
+  }
+
+  flooder_t flooder = {server_if, 0, 0};
+  pthread_t thread;
+  pthread_create(&thread, NULL, flooder_main, &flooder);
+
+  uint8_t buffer[2048];
+  uint64_t dhcp_frames = 0;
+  double start = now_sec();
+  double elapsed = 0;
+
+  while (elapsed < seconds) {
+    ssize_t n = io_recv(io, buffer, sizeof(buffer), 100);
+    if (n < 0) {
+      break;
+    }
+    if (n >= (ssize_t)FRAME_HEADERS) {
+      udp_header_t *udp = (udp_header_t *)(buffer + sizeof(eth_header_t) +
+                                           sizeof(ip_header_t));
+      if (ntohs(udp->dest) == DHCP_PORT_CLIENT) {
+        dhcp_frames++;
+      }
+    }
+    elapsed = now_sec() - start;
+  }
+
+  flooder.stop = 1;
+  pthread_join(thread, NULL);
+
+  printf("rx %-6s %12.0f fps DHCP   %12.0f fps offered %8.2f syscalls/frame\n",
+         io->ops->name, dhcp_frames / elapsed, flooder.sent / elapsed,
+         (double)io->stats.syscalls / (dhcp_frames ? dhcp_frames : 1));
+
+  close_backend(io, sock);
+  iface_ctx_close(&iface);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <client_if> <server_if> [seconds]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  double seconds = argc > 3 ? atof(argv[3]) : 3.0;
+
+  bench_tx(IO_BACKEND_SELECT, argv[1], argv[2], seconds);
+  if (io_backend_available(IO_BACKEND_XDP)) {
+    bench_tx(IO_BACKEND_XDP, argv[1], argv[2], seconds);
+  }
+
+  bench_rx(IO_BACKEND_SELECT, argv[1], argv[2], seconds);
+  if (io_backend_available(IO_BACKEND_XDP)) {
+    bench_rx(IO_BACKEND_XDP, argv[1], argv[2], seconds);
+  }
+
+  return 0;
+}
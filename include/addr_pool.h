@@ -0,0 +1,32 @@
+#ifndef ADDR_POOL_H
+#define ADDR_POOL_H
+
+#include <stdint.h>
+
+// Free addresses of a DHCP pool as a bitmap (1 = free), with a summary
+// bitmap per 64 words above it up to a single word. Allocate, take and
+// release walk one word per level, at most ADDR_POOL_LEVELS: O(1) with 1.02
+// bits per address, and the lowest free address is always handed out first.
+// Addresses are offsets from the start of the pool.
+#define ADDR_POOL_LEVELS 4
+#define ADDR_POOL_MAX (1u << (6 * ADDR_POOL_LEVELS))
+#define ADDR_POOL_NONE UINT32_MAX
+
+typedef struct {
+  uint32_t size;
+  uint32_t free;
+  int levels;
+  uint64_t *level[ADDR_POOL_LEVELS];  // [0] is the leaf bitmap
+} addr_pool_t;
+
+int addr_pool_init(addr_pool_t *pool, uint32_t size);
+void addr_pool_destroy(addr_pool_t *pool);
+
+// Returns the lowest free offset, or ADDR_POOL_NONE if the pool is empty.
+uint32_t addr_pool_alloc(addr_pool_t *pool);
+// Allocates a specific offset. Returns -1 if it is out of range or in use.
+int addr_pool_take(addr_pool_t *pool, uint32_t offset);
+void addr_pool_release(addr_pool_t *pool, uint32_t offset);
+int addr_pool_is_free(const addr_pool_t *pool, uint32_t offset);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// pcap tap for the frames the client sends and accepts. capture_frame() only
+// copies the frame into a preallocated ring; a writer thread drains it with
+// large sequential write()s and rotates the file once it reaches max_bytes,
+// keeping the previous one as <path>.1. When the ring is full frames are
+// dropped (and counted) instead of blocking the client.
+#define CAPTURE_RING_SIZE (1 << 20)  // power of two
+#define CAPTURE_SNAPLEN 2048
+#define CAPTURE_DEFAULT_MAX_BYTES (64ULL << 20)
+
+typedef struct capture {
+  char *path;
+  int fd;
+  uint64_t max_bytes;
+  uint64_t file_bytes;
+  uint8_t *ring;
+  uint64_t head;  // bytes ever queued, advanced by capture_frame()
+  uint64_t tail;  // bytes ever written, advanced by the writer
+  // Only touched by the thread calling capture_frame().
+  uint64_t frames;
+  uint64_t dropped;
+  int stop;
+  pthread_t writer;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+} capture_t;
+
+// max_bytes 0 means CAPTURE_DEFAULT_MAX_BYTES.
+capture_t *capture_open(const char *path, uint64_t max_bytes);
+// Waits for the writer to drain the ring, then closes the file.
+void capture_close(capture_t *cap);
+// ts_ns is CLOCK_REALTIME (a kernel timestamp if there is one), 0 for now.
+void capture_frame(capture_t *cap, const void *frame, size_t len,
+                   int64_t ts_ns);
+
+#endif
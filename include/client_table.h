@@ -0,0 +1,78 @@
+#ifndef CLIENT_TABLE_H
+#define CLIENT_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// State of many simulated clients (load generation against a server), kept
+// as parallel arrays in one preallocated arena instead of one dhcp_client_t
+// each. A client is a slot number; its MAC is derived from the slot, so per
+// client only what changes is stored: 2 bytes of state, 4 each of xid,
+// deadline, leased address and server id, plus 5-11 bytes of xid index.
+// Timeouts are found by scanning the earliest deadline of each block of
+// CT_BLOCK slots, and then only the blocks that have one due.
+#define CT_NONE UINT32_MAX
+#define CT_BLOCK 64
+
+typedef enum {
+  CT_FREE,
+  CT_SELECTING,   // DISCOVER sent
+  CT_REQUESTING,  // REQUEST sent
+  CT_BOUND,
+} ct_state_t;
+
+typedef struct {
+  uint32_t capacity;
+  uint32_t count;  // slots in use
+  uint32_t free_head;
+  uint32_t index_mask;
+  uint64_t epoch_ms;  // deadlines count from here
+  uint8_t *state;     // ct_state_t
+  uint8_t *tries;     // sends of the current message
+  uint32_t *xid;
+  uint32_t *deadline;  // ms since epoch_ms, 0 = none
+  uint32_t *lease;     // leased address; next free slot while CT_FREE
+  uint32_t *server;    // server identifier
+  uint32_t *index;     // open addressing xid -> slot, CT_NONE = empty
+  // Lower bound of the deadlines in each block, UINT32_MAX if none; may be
+  // stale low after a disarm until the next scan of the block.
+  uint32_t *block_min;
+  void *arena;
+  size_t arena_bytes;
+  size_t used_bytes;  // arena_bytes without the hugepage rounding
+  int hugepages;  // arena is on explicit hugepages (MAP_HUGETLB)
+} client_table_t;
+
+// hugepages asks for MAP_HUGETLB and falls back to transparent hugepages.
+int client_table_init(client_table_t *ct, uint32_t capacity, int hugepages);
+void client_table_destroy(client_table_t *ct);
+
+// Returns a zeroed slot in CT_SELECTING, or CT_NONE when the table is full.
+uint32_t client_table_alloc(client_table_t *ct);
+void client_table_free(client_table_t *ct, uint32_t slot);
+
+// Gives slot a new xid. Returns -1 if another slot is using it.
+int client_table_set_xid(client_table_t *ct, uint32_t slot, uint32_t xid);
+uint32_t client_table_lookup(const client_table_t *ct, uint32_t xid);
+
+static inline void client_table_arm(client_table_t *ct, uint32_t slot,
+                                    uint64_t deadline_ms) {
+  uint32_t deadline = (uint32_t)(deadline_ms - ct->epoch_ms);
+  ct->deadline[slot] = deadline;
+  if (deadline < ct->block_min[slot / CT_BLOCK]) {
+    ct->block_min[slot / CT_BLOCK] = deadline;
+  }
+}
+
+static inline void client_table_disarm(client_table_t *ct, uint32_t slot) {
+  ct->deadline[slot] = 0;
+}
+
+// Clears and reports every deadline at or before now_ms. Returns how many
+// expired.
+size_t client_table_expire(client_table_t *ct, uint64_t now_ms,
+                           void (*fn)(client_table_t *ct, uint32_t slot,
+                                      void *arg),
+                           void *arg);
+
+#endif
@@ -5,15 +5,26 @@
 #include <netinet/in.h>
 #include <stdint.h>
 
+#include "dhcpclient.h"
+#include "io_backend.h"
+#include "network_utils.h"
+#include "timer_wheel.h"
+
 // DHCP-options
 #define DHCP_OPTION_SUBNET_MASK 1
 #define DHCP_OPTION_ROUTER 3
 #define DHCP_OPTION_DNS_SERVER 6
+#define DHCP_OPTION_DOMAIN_NAME 15
+#define DHCP_OPTION_INTERFACE_MTU 26
 #define DHCP_OPTION_REQUESTED_IP 50
 #define DHCP_OPTION_LEASE_TIME 51
 #define DHCP_OPTION_MSG_TYPE 53
 #define DHCP_OPTION_DHCP_SERVER 54
 #define DHCP_OPTION_PARAMETER_REQUEST_LIST 55
+#define DHCP_OPTION_MAX_MSG_SIZE 57
+#define DHCP_OPTION_CLIENT_ID 61
+#define DHCP_OPTION_DOMAIN_SEARCH 119
+#define DHCP_OPTION_CLASSLESS_ROUTE 121
 #define DHCP_OPTION_END 255
 
 #define DHCP_MAGIC_COOKIE 0x63825363
@@ -34,6 +45,13 @@
 #define DHCPINFORM 8
 
 #define DHCP_OPT_LEN 312
+// Largest message we accept (and announce in option 57): a full 1500-byte
+// frame minus IP/UDP headers. Long route lists don't fit in DHCP_OPT_LEN.
+#define DHCP_MAX_MSG_LEN 1472
+
+#define DHCP_MAX_SERVERS 16
+#define DHCP_MAX_ROUTES 256
+#define DHCP_MAX_SEARCH_LEN 256
 
 typedef struct {
   uint8_t op;                     // BOOTREQUEST (1) / BOOTREPLY (2)
@@ -54,37 +72,128 @@ typedef struct {
   uint8_t options[DHCP_OPT_LEN];  // DHCP options
 } __attribute__((packed)) dhcp_packet_t;
 
+typedef struct {
+  size_t len;
+  union {
+    dhcp_packet_t packet;
+    uint8_t raw[DHCP_MAX_MSG_LEN];
+  };
+} dhcp_msg_t;
+
+// Everything a lease asks us to configure, addresses in network byte order.
+typedef struct {
+  uint32_t routers[DHCP_MAX_SERVERS];
+  uint32_t dns[DHCP_MAX_SERVERS];
+  // Option 121 if present (RFC 3442: option 3 is then ignored), otherwise a
+  // default route through the first router.
+  ipv4_route_t routes[DHCP_MAX_ROUTES];
+  uint16_t router_count;
+  uint16_t dns_count;
+  uint16_t route_count;
+  uint16_t mtu;                     // option 26, 0 if not sent
+  char search[DHCP_MAX_SEARCH_LEN];  // option 119 (or 15), space separated
+} dhcp_config_t;
+
+// How long the server takes to answer one kind of exchange, smoothed as in
+// RFC 6298.
+typedef struct {
+  uint32_t srtt_us;  // 0 until the first sample
+  uint32_t rttvar_us;
+} dhcp_rtt_t;
+
+enum { DHCP_RTT_OFFER, DHCP_RTT_ACK, DHCP_RTT_COUNT };
+
 typedef enum {
   DHCP_STATE_INIT,
   DHCP_STATE_DISCOVER_SENT,
   DHCP_STATE_OFFER_RECEIVED,
   DHCP_STATE_REQUEST_SENT,
   DHCP_STATE_BOUND,
-  DHCP_STATE_FAILED
+  DHCP_STATE_INIT_REBOOT,
+  DHCP_STATE_REBOOTING,
+  DHCP_STATE_FAILED,
+  DHCP_STATE_PROBING,  // unicast ARP to the old gateway after a link flap
+  DHCP_STATE_RELEASED,   // lease given back, the handle stays idle
+  DHCP_STATE_RENEWING,   // past T1: unicast REQUEST to the leasing server
+  DHCP_STATE_REBINDING,  // past T2: broadcast REQUEST to any server
 } dhcp_state_t;
 
-typedef struct {
+// The handle behind dhcpc_t. All state lives here so that any number of
+// clients can share a thread.
+typedef struct dhcp_client {
   int sock;
+  io_backend_t *io;
   uint32_t xid;
+  uint32_t rng;  // xorshift32 state for xids
   uint32_t lease_time;
   struct in_addr offered_ip;
   struct in_addr server_ip;
+  uint8_t server_mac[6];  // next hop the ACK came from, for RELEASE
   struct in_addr subnet_mask;
   struct in_addr router;
   struct in_addr dns;
-  uint8_t mac[6];
-  char ifname[IFNAMSIZ];
+  dhcp_config_t config;
+  const char *resolv_conf;  // rewritten on every ACK if set
+  const char *lease_file;   // likewise
+  iface_ctx_t iface;
+  // Configuration handed to a pipeline: jobs not yet back through
+  // dhcpc_pipeline_process(), the sequence number of the last one, and the
+  // event to emit once they are all back.
+  dhcpc_pipeline_t *pipeline;
+  int config_pending;
+  uint64_t config_seq;
+  dhcpc_event_t deferred_event;
   dhcp_state_t state;
   int timeout_secs;
   int retries;
+  int attempt;
+  int retransmit_policy;  // DHCPC_RETRANSMIT_*
+  int sends;              // of the current DISCOVER or REQUEST
+  // DHCPC_RETRANSMIT_ADAPTIVE: response time estimates (also kept in the
+  // lease file), timeout doublings since the last clean sample, and when the
+  // acquisition gives up.
+  dhcp_rtt_t rtt[DHCP_RTT_COUNT];
+  int rto_backoff[DHCP_RTT_COUNT];
+  uint64_t give_up_at_ms;
+  int log_level;
+  int configure;
+  uint64_t bound_at_ms;
+  // Exchange timing, CLOCK_REALTIME ns: kernel TX timestamp of the last
+  // request (0 until it is read from the error queue) and when we sent it.
+  int64_t tx_ts_ns;
+  int64_t tx_user_ns;
+  uint32_t offer_us;  // DISCOVER -> OFFER
+  uint32_t ack_us;    // REQUEST -> ACK
+  dhcpc_lease_cb on_lease;
+  void *cb_arg;
+  dhcpc_hooks_t *hooks;
+  // Slot in the status file, -1 without one, and what goes into it besides
+  // the fields above.
+  dhcpc_status_t *status;
+  int status_slot;
+  uint8_t last_event;  // dhcpc_event_t + 1, 0 before the first
+  uint32_t event_counts[DHCPC_EVENT_EXPIRED + 1];
+  struct capture *capture;  // also io->capture, NULL if off
+  // Event loop plumbing: everything below is registered with epoll_fd,
+  // and so is the wheel's timerfd unless the wheel is shared.
+  int epoll_fd;
+  timer_wheel_t *wheel;
+  int own_wheel;
+  tw_timer_t retransmit;  // current exchange, DNA probes, retry after FAILED
+  tw_timer_t t1;          // renew, and renewal retries until T2
+  tw_timer_t t2;          // rebind, and rebinding retries until expiry
+  tw_timer_t expiry;
+  // Link monitoring
+  int monitor;
+  int carrier;
+  int ever_bound;
+  nl_sock_t link_events;
+  int arp_sock;
+  uint8_t router_mac[6];
+  int router_mac_valid;
+  int router_mac_pending;  // ARP request for the gateway outstanding
+  int dna_probes_left;
+  uint64_t reconnect_start_ms;  // 0 unless recovering from a link event
 } dhcp_client_t;
 
-void dhcp_client_run(const char *ifname, int timeout_secs, int retries);
-dhcp_client_t *dhcp_client_init(const char *ifname);
-int dhcp_send_discover(dhcp_client_t *client);
-int dhcp_receive_offer(dhcp_client_t *client);
-void dhcp_client_cleanup(dhcp_client_t *client);
-int dhcp_send_request(dhcp_client_t *client);
-int dhcp_receive_ack(dhcp_client_t *client);
-
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,70 @@
+#ifndef DHCP_SERVER_H
+#define DHCP_SERVER_H
+
+#include <linux/if_packet.h>
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A small DHCP server for load tests (bin/dhcp_server). One packet socket,
+// requests taken DHCP_SERVER_BATCH at a time with recvmmsg() and the replies
+// sent with one sendmmsg(). Addresses come from an addr_pool_t; leases sit
+// in an array indexed by pool offset, with an open-addressing chaddr index
+// next to it. Every ACK, RELEASE and DECLINE is appended to a lease log,
+// which is written once per batch and compacted when the server starts.
+// Relayed requests (giaddr set) are not answered.
+#define DHCP_SERVER_BATCH 64
+
+typedef struct {
+  const char *ifname;  // NULL: no socket, only dhcp_server_handle_frame()
+  struct in_addr server;  // server identifier and source address
+  int prefix_len;
+  struct in_addr first;  // pool
+  struct in_addr last;
+  struct in_addr router;  // option 3, INADDR_ANY = none
+  struct in_addr dns;     // option 6, INADDR_ANY = none
+  uint32_t lease_secs;
+  const char *lease_log;  // NULL = leases are not kept across restarts
+  int sync;               // fdatasync() the log before a batch is answered
+  int verbose;            // one line per lease
+} dhcp_server_config_t;
+
+typedef struct {
+  uint64_t received;
+  uint64_t ignored;  // not for us, malformed or relayed
+  uint64_t offers;
+  uint64_t acks;
+  uint64_t naks;
+  uint64_t releases;
+  uint64_t declines;
+  uint64_t exhausted;  // DISCOVERs that found the pool empty
+  uint64_t log_bytes;
+  uint32_t leases;  // offered or bound
+} dhcp_server_stats_t;
+
+typedef struct dhcp_server dhcp_server_t;
+
+void dhcp_server_config_init(dhcp_server_config_t *config);
+// Replays and compacts the lease log, then opens the socket.
+dhcp_server_t *dhcp_server_new(const dhcp_server_config_t *config);
+void dhcp_server_free(dhcp_server_t *srv);
+
+int dhcp_server_get_fd(const dhcp_server_t *srv);
+// Answers everything queued on the socket. Returns the number of requests
+// read, or -1 on a socket error.
+int dhcp_server_process(dhcp_server_t *srv);
+
+// The engine without the socket, for benchmarks: takes one request frame
+// and writes the reply frame and where to send it. Returns the length of
+// the reply, 0 if there is none. Log records are buffered until
+// dhcp_server_flush_log().
+size_t dhcp_server_handle_frame(dhcp_server_t *srv, const uint8_t *frame,
+                                size_t len, uint8_t *reply,
+                                struct sockaddr_ll *dst);
+int dhcp_server_flush_log(dhcp_server_t *srv);
+
+const dhcp_server_stats_t *dhcp_server_stats(const dhcp_server_t *srv);
+// Bytes of lease state per pool address: lease array, index and bitmap.
+double dhcp_server_bytes_per_lease(const dhcp_server_t *srv);
+
+#endif
@@ -0,0 +1,227 @@
+#ifndef DHCPCLIENT_H
+#define DHCPCLIENT_H
+
+// libdhcpclient: a non-blocking DHCPv4 client meant to be driven from the
+// embedder's own event loop, one handle per interface.
+//
+//   dhcpc_t *c = dhcpc_new(&config);
+//   dhcpc_start(c);
+//   while (...) {
+//     struct pollfd pfd = {dhcpc_get_fd(c), POLLIN, 0};
+//     poll(&pfd, 1, dhcpc_next_timeout_ms(c));
+//     dhcpc_process(c, pfd.revents);
+//   }
+//   dhcpc_free(c);
+//
+// dhcpc_get_fd() is an epoll fd covering every socket and the timer of the
+// handle, so it can be added to the embedder's own epoll set; it also becomes
+// readable when the next timeout expires. Handles share no state, so any
+// number of them can run in one thread.
+//
+// Timers live on a hierarchical timing wheel. By default every handle has its
+// own; processes running many handles can share one through
+// dhcpc_config_t.timers instead, so all their timers cost a single timerfd
+// and expirations landing on the same tick share one wakeup.
+//
+// Installing a lease (one netlink batch, resolv.conf, an fsync()ed lease
+// file) is the one slow step left in the loop. A dhcpc_pipeline_t moves it
+// onto a worker thread: handles sharing one hand every ACK over and carry on,
+// and report BOUND or RENEWED once dhcpc_pipeline_process() sees the job
+// come back.
+
+#include <netinet/in.h>
+#include <stdint.h>
+
+typedef struct dhcp_client dhcpc_t;
+typedef struct timer_wheel dhcpc_timers_t;
+typedef struct dhcpc_pipeline dhcpc_pipeline_t;
+typedef struct dhcpc_hooks dhcpc_hooks_t;
+typedef struct dhcpc_status dhcpc_status_t;
+
+enum {
+  DHCPC_LOG_ERROR,  // errors on stderr only
+  DHCPC_LOG_INFO,   // protocol progress on stdout (the CLI default)
+  DHCPC_LOG_DEBUG,  // packet dumps and internals on stderr
+};
+
+// What a DISCOVER or REQUEST that goes unanswered for timeout_secs leads to.
+// Either way the exchange fails after `retries` sends in all.
+enum {
+  DHCPC_RETRANSMIT_RESTART,  // start over with a new DISCOVER and xid
+  // RFC 2131 4.1: send the same message again, same xid, doubling the
+  // timeout each time up to 64 s, randomized by up to +-1 s
+  DHCPC_RETRANSMIT_BACKOFF,
+  // Like BACKOFF, but the first wait comes from the server's measured
+  // response time (RFC 6298: smoothed RTT + 4 * variance, doubled on every
+  // timeout) and timeout_secs only caps it. The estimate is kept in
+  // lease_file between runs. The client gives up after retries *
+  // timeout_secs instead of after `retries` sends.
+  DHCPC_RETRANSMIT_ADAPTIVE,
+};
+
+typedef enum {
+  DHCPC_EVENT_BOUND,      // new lease acquired and configured
+  DHCPC_EVENT_RENEWED,    // existing lease confirmed (renewal, reboot, DNA)
+  DHCPC_EVENT_LINK_DOWN,  // carrier lost; the lease is kept for now
+  DHCPC_EVENT_FAILED,     // retries exhausted, the handle is idle
+  DHCPC_EVENT_EXPIRED,    // not renewed in time; back to DISCOVER
+} dhcpc_event_t;
+
+typedef struct {
+  struct in_addr address;
+  struct in_addr netmask;
+  struct in_addr router;  // default gateway, 0 if none
+  struct in_addr server;
+  uint32_t lease_time;
+  const uint32_t *dns;  // dns_count addresses, network byte order
+  int dns_count;
+  int route_count;
+  uint16_t mtu;        // 0 if the server sent none
+  const char *search;  // space separated, may be empty
+  // Server response times from kernel timestamps, so our own scheduling
+  // delay is not included. offer_us is 0 after an INIT-REBOOT.
+  uint32_t offer_us;  // DISCOVER -> OFFER
+  uint32_t ack_us;    // REQUEST -> ACK
+} dhcpc_lease_t;
+
+// lease is NULL for DHCPC_EVENT_FAILED and only valid during the call.
+typedef void (*dhcpc_lease_cb)(dhcpc_t *client, dhcpc_event_t event,
+                               const dhcpc_lease_t *lease, void *arg);
+
+typedef struct {
+  const char *ifname;
+  const char *io_backend;   // "select" (default), "uring" or "xdp"
+  int timeout_secs;         // per exchange, default 5
+  int retries;              // default 3
+  int retransmit;           // DHCPC_RETRANSMIT_*, default RESTART
+  int monitor;              // follow link state and renew instead of idling
+  int configure;            // install address/routes/MTU (default on)
+  const char *resolv_conf;  // rewritten on every ACK if set
+  // Rewritten on every ACK with what dhcpc_release() needs, so a later
+  // process can still give the lease back. NULL to keep none.
+  const char *lease_file;
+  int log_level;            // DHCPC_LOG_*
+  uint32_t seed;            // xid generator seed, 0 = random
+  dhcpc_timers_t *timers;   // shared wheel, NULL for one per handle
+  // Shared configuration stage, NULL to configure inline.
+  dhcpc_pipeline_t *pipeline;
+  // Notifications and commands run on every event, NULL for none.
+  dhcpc_hooks_t *hooks;
+  // Shared status file the handle keeps its state in, NULL for none.
+  dhcpc_status_t *status;
+  // pcap of the frames sent and accepted, written by a background thread;
+  // rotated to <capture_file>.1 at capture_max_bytes (0 = 64 MiB).
+  const char *capture_file;
+  uint64_t capture_max_bytes;
+  dhcpc_lease_cb on_lease;
+  void *cb_arg;
+} dhcpc_config_t;
+
+// Fills in the defaults; callers then set ifname and whatever else they need.
+void dhcpc_config_init(dhcpc_config_t *config);
+
+dhcpc_t *dhcpc_new(const dhcpc_config_t *config);
+void dhcpc_free(dhcpc_t *client);
+
+// Sends the first DISCOVER. Returns -1 if it could not be sent.
+int dhcpc_start(dhcpc_t *client);
+
+int dhcpc_get_fd(const dhcpc_t *client);
+// Milliseconds until dhcpc_process() has timer work to do, -1 if none.
+int dhcpc_next_timeout_ms(const dhcpc_t *client);
+// Handles everything that is ready: received frames, link events and expired
+// timers. events are the poll bits seen on dhcpc_get_fd() (0 after a
+// timeout) and only serve as a hint. Returns -1 once the client has failed.
+int dhcpc_process(dhcpc_t *client, uint32_t events);
+
+// Holds a lease: bound, or renewing or rebinding it.
+int dhcpc_is_bound(const dhcpc_t *client);
+
+// Gives the lease back: a unicast DHCPRELEASE to the server, then removes
+// the address and routes installed for it and the lease file. The handle
+// stays idle afterwards. A handle that holds no lease itself releases the one
+// recorded in config.lease_file, without sending anything else. Returns -1
+// if there was nothing to release or the RELEASE could not be sent.
+int dhcpc_release(dhcpc_t *client);
+
+// A wheel shared by several handles. Its fd is a timerfd to poll next to the
+// handles' fds; dhcpc_timers_process() then runs the timers of all of them.
+// Handles using it leave their timers out of dhcpc_get_fd() and
+// dhcpc_next_timeout_ms(), and must be freed before the wheel.
+dhcpc_timers_t *dhcpc_timers_new(void);
+void dhcpc_timers_free(dhcpc_timers_t *timers);
+int dhcpc_timers_get_fd(const dhcpc_timers_t *timers);
+int dhcpc_timers_next_timeout_ms(const dhcpc_timers_t *timers);
+// Returns the number of timers that fired.
+int dhcpc_timers_process(dhcpc_timers_t *timers);
+
+// A configuration stage with room for depth jobs in flight; past that, an
+// ACK is configured inline again. Its fd is an eventfd that becomes readable
+// when finished jobs are waiting; dhcpc_pipeline_process() then emits their
+// events. Every handle using a pipeline must be driven from the thread that
+// calls dhcpc_pipeline_process(), and be freed before the pipeline.
+dhcpc_pipeline_t *dhcpc_pipeline_new(int depth);
+void dhcpc_pipeline_free(dhcpc_pipeline_t *pipeline);
+int dhcpc_pipeline_get_fd(const dhcpc_pipeline_t *pipeline);
+// Returns the number of finished jobs handled.
+int dhcpc_pipeline_process(dhcpc_pipeline_t *pipeline);
+
+typedef struct {
+  uint32_t depth;           // jobs queued or running now
+  uint32_t max_depth;       // most jobs ever queued at once
+  uint32_t done_depth;      // finished jobs not yet processed
+  uint32_t max_done_depth;
+  uint64_t jobs;            // handed to the worker
+  uint64_t inline_jobs;     // configured inline because the stage was full
+  uint64_t busy_us;         // worker time spent configuring
+  uint32_t max_wait_us;     // longest a job sat in the queue
+  uint32_t max_service_us;  // longest a job took to run
+} dhcpc_pipeline_stats_t;
+
+void dhcpc_pipeline_get_stats(const dhcpc_pipeline_t *pipeline,
+                              dhcpc_pipeline_stats_t *stats);
+
+// Post-bind hooks: everything that has to happen once a lease is in place,
+// run without holding up the event loop. On BOUND, a readiness notification
+// goes to ready_fd (an eventfd is incremented, a pipe gets "IFACE ADDRESS"
+// and a newline) and to an sd_notify() socket (READY=1). On every event each
+// command runs through /bin/sh -c with the lease in DHCP_* environment
+// variables. The commands are started, all at once, by a helper process
+// that dhcpc_hooks_new() forks while the caller is still small, so nothing
+// is forked from the client afterwards. How long each hook took is logged
+// at DHCPC_LOG_INFO when it finishes.
+#define DHCPC_MAX_HOOK_COMMANDS 16
+
+typedef struct {
+  const char *const *commands;
+  int command_count;
+  int ready_fd;               // -1 for none; set non-blocking
+  const char *notify_socket;  // usually getenv("NOTIFY_SOCKET"), or NULL
+  int log_level;              // DHCPC_LOG_*
+} dhcpc_hooks_config_t;
+
+void dhcpc_hooks_config_init(dhcpc_hooks_config_t *config);
+// Call before opening anything the commands must not inherit.
+dhcpc_hooks_t *dhcpc_hooks_new(const dhcpc_hooks_config_t *config);
+// Waits for the commands still running, then for the helper.
+void dhcpc_hooks_free(dhcpc_hooks_t *hooks);
+// Readable when commands have finished; dhcpc_hooks_process() reports them
+// and returns how many.
+int dhcpc_hooks_get_fd(const dhcpc_hooks_t *hooks);
+int dhcpc_hooks_process(dhcpc_hooks_t *hooks);
+// Commands started and not yet reported.
+int dhcpc_hooks_pending(const dhcpc_hooks_t *hooks);
+
+// Status file: a fixed-layout table (status_file.h) that every handle
+// using it rewrites, under a seqlock, after each call that may have changed
+// it: state, lease, expiry and frame and event counters. Other processes
+// map it read-only and poll any number of clients without a syscall to
+// them, and never hold a client up (see dhcp_status). The file is created
+// at path with room for `slots` handles, and removed again by
+// dhcpc_status_close(). Handles using it must be freed first.
+dhcpc_status_t *dhcpc_status_open(const char *path, int slots);
+void dhcpc_status_close(dhcpc_status_t *status);
+
+const char *dhcpc_event_name(dhcpc_event_t event);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef HOOKS_H
+#define HOOKS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "dhcpclient.h"
+
+// Messages between the client and the helper, one per SOCK_SEQPACKET
+// record. A request carries the environment for the command as
+// "KEY=VALUE\0" strings.
+#define HOOK_ENV_MAX 2048
+
+typedef struct {
+  uint32_t seq;
+  uint16_t command;  // index into the configured commands
+  uint16_t env_len;
+  uint8_t event;     // dhcpc_event_t
+  char env[HOOK_ENV_MAX];
+} hook_request_t;
+
+typedef struct {
+  uint32_t seq;
+  uint16_t command;
+  uint8_t event;
+  int status;           // as from waitpid(), -1 if it could not start
+  uint64_t elapsed_us;  // fork to exit, measured by the helper
+} hook_result_t;
+
+struct dhcpc_hooks {
+  char *commands[DHCPC_MAX_HOOK_COMMANDS];
+  int command_count;
+  int ready_fd;
+  int ready_eventfd;  // ready_fd is an eventfd
+  int notify_sock;
+  char notify_path[108];
+  int log_level;
+  pid_t helper;
+  int sock;  // our end of the socketpair
+  uint32_t seq;
+  int running;
+  hook_request_t req;  // built by hooks_run(), too big for its stack
+};
+
+// In dhcp.c's event path: notifications inline, commands handed to the
+// helper. lease is NULL for DHCPC_EVENT_FAILED.
+void hooks_run(dhcpc_hooks_t *hooks, const char *ifname, dhcpc_event_t event,
+               const dhcpc_lease_t *lease);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef IO_BACKEND_H
+#define IO_BACKEND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+typedef enum {
+  IO_BACKEND_SELECT,
+  IO_BACKEND_URING,
+  IO_BACKEND_XDP
+} io_backend_type_t;
+
+typedef struct {
+  uint64_t syscalls;   // syscalls issued by the backend itself
+  uint64_t tx_frames;  // frames handed to the kernel
+  uint64_t rx_frames;  // frames returned to the caller
+} io_stats_t;
+
+typedef struct io_backend io_backend_t;
+struct capture;
+
+typedef struct {
+  const char *name;
+  // Queues (or sends) one frame. May be deferred until the next recv/flush.
+  int (*send)(io_backend_t *io, const void *buf, size_t len,
+              const struct sockaddr *addr, socklen_t addrlen);
+  // Copies the next frame into buf. Returns its length, 0 on timeout, -1 on
+  // error. A timeout of 0 only takes what is already queued, without waiting.
+  ssize_t (*recv)(io_backend_t *io, uint8_t *buf, size_t len, int timeout_ms);
+  // Pushes any deferred sends to the kernel.
+  int (*flush)(io_backend_t *io);
+  void (*destroy)(io_backend_t *io);
+} io_backend_ops_t;
+
+struct io_backend {
+  const io_backend_ops_t *ops;
+  int sock;
+  int poll_fd;  // becomes readable when recv() has a frame for us
+  io_stats_t stats;
+  // Kernel RX timestamp of the last frame recv() returned (CLOCK_REALTIME
+  // ns), 0 if the socket has none (timestamps off, or AF_XDP).
+  int64_t rx_ts_ns;
+  // pcap tap (capture.h) for frames sent and accepted, NULL if off.
+  struct capture *capture;
+};
+
+// sock is the bound AF_PACKET socket; the XDP backend opens its own AF_XDP
+// socket on ifindex instead and ignores it.
+io_backend_t *io_backend_create(io_backend_type_t type, int sock,
+                                int ifindex);
+void io_backend_destroy(io_backend_t *io);
+int io_backend_parse_type(const char *name, io_backend_type_t *type);
+int io_backend_available(io_backend_type_t type);
+
+static inline int io_send(io_backend_t *io, const void *buf, size_t len,
+                          const struct sockaddr *addr, socklen_t addrlen) {
+  return io->ops->send(io, buf, len, addr, addrlen);
+}
+
+static inline ssize_t io_recv(io_backend_t *io, uint8_t *buf, size_t len,
+                              int timeout_ms) {
+  return io->ops->recv(io, buf, len, timeout_ms);
+}
+
+static inline int io_flush(io_backend_t *io) { return io->ops->flush(io); }
+
+#ifdef HAVE_IO_URING
+io_backend_t *io_uring_backend_create(int sock);
+#endif
+
+#ifdef HAVE_AF_XDP
+io_backend_t *xsk_backend_create(int ifindex);
+// Copies frame into every UMEM TX chunk once, so xsk_send_patched() only has
+// to rewrite the bytes that change between frames (xid, chaddr, ...).
+int xsk_set_tx_template(io_backend_t *io, const void *frame, size_t len);
+int xsk_send_patched(io_backend_t *io, size_t patch_off, const void *patch,
+                     size_t patch_len);
+#endif
+
+#endif
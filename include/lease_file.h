@@ -0,0 +1,31 @@
+#ifndef LEASE_FILE_H
+#define LEASE_FILE_H
+
+#include <netinet/in.h>
+#include <stdint.h>
+
+#include "dhcp.h"
+
+// What it takes to give a lease back after the process that got it is gone
+// (dhcp_client --release): where to send the RELEASE, and what was
+// installed for it. Also the server's response times, which the next run
+// starts its timeouts from. One "key value" pair per line.
+typedef struct {
+  struct in_addr address;
+  int prefix_len;
+  struct in_addr server;
+  uint8_t server_mac[6];  // next hop the ACK came from (server or relay)
+  int64_t expires;        // CLOCK_REALTIME seconds
+  int route_count;
+  ipv4_route_t routes[DHCP_MAX_ROUTES];
+  dhcp_rtt_t rtt[DHCP_RTT_COUNT];  // server response times, 0 if unknown
+} lease_record_t;
+
+// Replaced atomically, like resolv.conf. Without an address only the
+// response times are written: the lease is gone but they still hold.
+int lease_file_write(const char *path, const lease_record_t *lease);
+// Returns -1 if the file is missing or has no address; the response times
+// are filled in either way.
+int lease_file_read(const char *path, lease_record_t *lease);
+
+#endif
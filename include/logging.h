@@ -1,13 +1,23 @@
 #ifndef LOGGING_H
 #define LOGGING_H
 
-extern int verbose_flag;
+#include <stdio.h>
 
-#define DEBUG_PRINT(format, ...)                         \
+#include "dhcpclient.h"
+
+// level is the owning client's DHCPC_LOG_* setting; there is no global one.
+#define LOG_INFO(level, ...)          \
+  do {                                \
+    if ((level) >= DHCPC_LOG_INFO) {  \
+      printf(__VA_ARGS__);            \
+    }                                 \
+  } while (0)
+
+#define DEBUG_PRINT(level, format, ...)                  \
   do {                                                   \
-    if (verbose_flag) {                                  \
+    if ((level) >= DHCPC_LOG_DEBUG) {                    \
       fprintf(stderr, "[DEBUG] " format, ##__VA_ARGS__); \
     }                                                    \
   } while (0)
 
-#endif
\ No newline at end of file
+#endif
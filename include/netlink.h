@@ -0,0 +1,40 @@
+#ifndef NETLINK_H
+#define NETLINK_H
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NL_BUF_SIZE 16384
+// Requests per sendmsg in nl_talk_batch(), bounded by how many ACKs the
+// socket receive buffer can queue.
+#define NL_BATCH_MAX_MSGS 256
+
+typedef struct {
+  int fd;
+  uint32_t seq;
+} nl_sock_t;
+
+// Called for every non-control message in a reply; return <0 to abort.
+typedef int (*nl_msg_cb)(const struct nlmsghdr *nlh, void *arg);
+
+int nl_open(nl_sock_t *nl, uint32_t groups);
+void nl_close(nl_sock_t *nl);
+
+// Appends an attribute to the message at nlh; returns -1 if it doesn't fit
+// in maxlen bytes.
+int nl_addattr(struct nlmsghdr *nlh, size_t maxlen, int type, const void *data,
+               size_t len);
+void nl_parse_attrs(struct rtattr *tb[], int max, struct rtattr *rta, int len);
+
+// Sends one request and reads until its ACK, NLMSG_DONE or an error.
+int nl_talk(nl_sock_t *nl, struct nlmsghdr *req, nl_msg_cb cb, void *arg);
+
+// Sends len bytes of back-to-back requests, one sendmsg per
+// NL_BATCH_MAX_MSGS, and collects an ACK for each. The kernel applies them in
+// order. Returns how many were rejected (errno is set from the first
+// rejection), or -1 on socket errors.
+int nl_talk_batch(nl_sock_t *nl, void *batch, size_t len);
+
+#endif
@@ -1,8 +1,13 @@
 #ifndef NETWORK_UTILS_H
 #define NETWORK_UTILS_H
 
+#include <linux/if_packet.h>
+#include <net/if.h>
 #include <netinet/in.h>
 #include <stdint.h>
+#include <sys/socket.h>
+
+#include "netlink.h"
 
 #define DHCP_PORT_SERVER 67
 #define DHCP_PORT_CLIENT 68
@@ -34,12 +39,87 @@ typedef struct {
   uint16_t check;
 } __attribute__((packed)) udp_header_t;
 
-void get_mac_addr(const char *ifname, uint8_t *mac);
-int create_raw_socket(const char *ifname);
-void bring_interface_up(const char *ifname);
+typedef struct {
+  uint16_t htype;
+  uint16_t ptype;
+  uint8_t hlen;
+  uint8_t plen;
+  uint16_t oper;
+  uint8_t sha[6];
+  uint32_t spa;
+  uint8_t tha[6];
+  uint32_t tpa;
+} __attribute__((packed)) arp_packet_t;
+
+// 9 bytes per route so a full option 121 fits in a few cache lines.
+typedef struct {
+  uint32_t dst;      // network byte order
+  uint32_t gateway;  // network byte order, 0 = directly connected
+  uint8_t prefix_len;
+} __attribute__((packed)) ipv4_route_t;
+
+#ifndef IFF_LOWER_UP
+#define IFF_LOWER_UP 0x10000
+#endif
+
+// Everything the packet path needs to know about the interface, looked up
+// once at start-up and refreshed only from RTM_NEWLINK notifications.
+typedef struct {
+  char ifname[IFNAMSIZ];
+  int ifindex;
+  uint8_t mac[6];
+  int mtu;
+  unsigned int flags;             // IFF_* incl. IFF_LOWER_UP (carrier)
+  struct sockaddr_ll bcast_addr;  // sendto() destination for broadcasts
+  nl_sock_t nl;                   // rtnetlink socket for queries/config
+} iface_ctx_t;
+
+int iface_ctx_init(iface_ctx_t *ctx, const char *ifname);
+int iface_ctx_refresh(iface_ctx_t *ctx);
+// Applies an RTM_NEWLINK message; returns 1 if it was for this interface.
+int iface_ctx_update(iface_ctx_t *ctx, const struct nlmsghdr *nlh);
+int iface_ctx_bring_up(iface_ctx_t *ctx);
+// Returns 1 if addr is configured on the interface, 0 if not, -1 on error.
+int iface_ctx_has_addr(iface_ctx_t *ctx, struct in_addr addr);
+void iface_ctx_close(iface_ctx_t *ctx);
+
+int create_raw_socket(const iface_ctx_t *ctx);
+int create_arp_socket(const iface_ctx_t *ctx);
+
+// Software RX and TX timestamps (SO_TIMESTAMPING, or RX only through
+// SO_TIMESTAMPNS on old kernels). They are taken in the network stack, so
+// they exclude our own wakeup and scheduling delay. All are CLOCK_REALTIME ns.
+#define TS_CMSG_SPACE 128
+int sock_enable_timestamps(int sock);
+// RX timestamp from a recvmsg() control buffer, 0 if there is none.
+int64_t cmsg_timestamp_ns(const struct msghdr *msg);
+// Drains the error queue and returns the newest TX timestamp, 0 if none.
+int64_t sock_read_tx_timestamp(int sock);
+// ARP socket is non-blocking. arp_send() broadcasts a request for target,
+// or unicasts it to dst_mac (RFC 4436 reachability). arp_recv_reply() drains
+// the socket and returns 1 if a reply from target (and from src_mac, if set)
+// was among the frames, storing its MAC in reply_mac.
+int arp_send(int sock, const iface_ctx_t *ctx, struct in_addr sender,
+             struct in_addr target, const uint8_t *dst_mac);
+int arp_recv_reply(int sock, struct in_addr target, const uint8_t *src_mac,
+                   uint8_t *reply_mac);
 uint16_t checksum(uint16_t *addr, int len);
+uint64_t monotonic_ms(void);
+uint64_t monotonic_us(void);
+int64_t realtime_ns(void);
 
-void set_ip_addr(const char *ifname, struct in_addr ip, struct in_addr mask);
-void add_default_router(const char *ifname, struct in_addr gateway);
+// Installs the address, the MTU (if mtu > 0) and all routes with a single
+// netlink sendmsg. Existing entries are replaced, so reapplying the same
+// lease is harmless. lifetime_secs of 0 means forever. Returns the number of
+// changes the kernel rejected, or -1 if the batch could not be sent.
+int iface_ctx_configure(iface_ctx_t *ctx, struct in_addr addr, int prefix_len,
+                        uint32_t lifetime_secs, int mtu,
+                        const ipv4_route_t *routes, int route_count);
+// Undoes iface_ctx_configure() (except the MTU) in one batch. Entries the
+// kernel already dropped, such as routes through a gateway that went away
+// with the address, do not count as failures.
+int iface_ctx_unconfigure(iface_ctx_t *ctx, struct in_addr addr,
+                          int prefix_len, const ipv4_route_t *routes,
+                          int route_count);
 
 #endif
\ No newline at end of file
@@ -4,17 +4,32 @@
 #include <stdint.h>
 
 #include "dhcp.h"
+#include "io_backend.h"
+#include "network_utils.h"
 
 void create_dhcp_packet(dhcp_packet_t *packet, uint8_t *mac, uint32_t xid,
                         uint8_t msg_type);
+// Where to append to the options of a packet from create_dhcp_packet(). A
+// byte scan for END would stop inside a MAC containing 0xff.
+uint8_t *dhcp_options_end(dhcp_packet_t *packet);
 void create_header(uint8_t *buffer, uint8_t *src_mac, uint8_t *dst_mac,
                    uint32_t src_ip, uint32_t dst_ip, uint16_t src_port,
                    uint16_t dst_port, uint16_t udp_len);
-int send_dhcp_packet(int sock, uint8_t *src_mac, dhcp_packet_t *dhcp_packet,
-                     const char *ifname);
-int receive_dhcp_packet(int sock, dhcp_packet_t *dhcp_packet,
+int send_dhcp_packet(io_backend_t *io, const iface_ctx_t *iface,
+                     dhcp_packet_t *dhcp_packet);
+// From an address we hold to dst through the next hop dst_mac (RELEASE).
+int send_dhcp_unicast(io_backend_t *io, const iface_ctx_t *iface,
+                      dhcp_packet_t *dhcp_packet, const uint8_t *dst_mac,
+                      struct in_addr src, struct in_addr dst);
+// Checks that frame is a DHCP reply for expected_xid and copies its payload
+// into msg. Returns 0 if it is, otherwise the PROBE_DROP_* reason.
+int dhcp_parse_frame(const uint8_t *frame, size_t n_bytes,
+                     uint32_t expected_xid, dhcp_msg_t *msg);
+const char *dhcp_drop_reason(int reason);
+// Blocking variant for the benchmarks: waits up to timeout_secs for a reply.
+int receive_dhcp_packet(io_backend_t *io, dhcp_msg_t *msg,
                         uint32_t expected_xid, int timeout_secs);
-int parse_options(dhcp_packet_t *packet, dhcp_client_t *client);
+int parse_options(const dhcp_msg_t *msg, dhcp_client_t *client);
 
 void print_dhcp_packet(const dhcp_packet_t *packet, const char *type);
 
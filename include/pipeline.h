@@ -0,0 +1,55 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <netinet/in.h>
+#include <stdint.h>
+
+#include "dhcp.h"
+#include "dhcpclient.h"
+#include "network_utils.h"
+
+// Everything an ACK asks us to install, copied out of the handle so the
+// configuration stage never touches it.
+typedef struct {
+  dhcp_client_t *client;
+  uint64_t queued_us;
+  uint32_t xid;
+  int ifindex;
+  int mtu;  // the interface's MTU when the job was made
+  int configure;
+  int log_level;
+  struct in_addr address;
+  int prefix_len;
+  uint32_t lease_time;
+  struct in_addr server;
+  uint8_t server_mac[6];
+  const char *resolv_conf;
+  const char *lease_file;
+  dhcp_rtt_t rtt[DHCP_RTT_COUNT];
+  dhcp_config_t config;
+} config_job_t;
+
+typedef struct {
+  dhcp_client_t *client;  // NULL once the handle was freed
+  int failed;             // changes the kernel rejected
+  int mtu;                // the interface's MTU afterwards
+} config_done_t;
+
+void config_job_init(config_job_t *job, const dhcp_client_t *client);
+// Address, MTU and routes in one netlink batch through iface (whose
+// ifindex and mtu must match the job's), then resolv.conf and the lease file.
+// Returns the number of changes the kernel rejected.
+int config_job_run(const config_job_t *job, iface_ctx_t *iface);
+
+// Queues the handle's current lease. Returns -1 if `depth` jobs are already
+// in flight.
+int pipeline_submit(dhcpc_pipeline_t *pipeline, dhcp_client_t *client);
+// Waits until the stage has finished every job of client. With forget, their
+// completions are dropped instead of reaching dhcp_config_done().
+void pipeline_wait(dhcpc_pipeline_t *pipeline, dhcp_client_t *client,
+                   int forget);
+
+// In dhcp.c: a job of client has finished.
+void dhcp_config_done(dhcp_client_t *client, const config_done_t *done);
+
+#endif
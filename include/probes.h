@@ -0,0 +1,119 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+// USDT (SystemTap SDT) probes, provider "dhcp". Each site is one nop plus an
+// ELF note; bpftrace/perf/stap patch it when they attach, e.g.
+//   bpftrace -e 'usdt:./bin/dhcp_client:dhcp:msg { printf("%x %d\n",
+//                arg0, arg2); }'
+//
+//   dhcp:tx       xid, chaddr, msg_type, ts_ns
+//   dhcp:rx       xid, chaddr, len, ts_ns
+//   dhcp:rx_drop  reason (PROBE_DROP_*), expected xid, len, ts_ns
+//   dhcp:msg      xid, chaddr, msg_type, ts_ns
+//   dhcp:state    xid, old state, new state, ts_ns
+//   dhcp:config   xid, address, route count, rejected changes, duration_ns
+//
+// xid is in host byte order, chaddr points at the 6-byte client MAC and ts_ns
+// is CLOCK_MONOTONIC. Every probe has a semaphore that tracers raise while
+// attached; arguments that cost a syscall are only computed when
+// DHCP_PROBE_ENABLED() says someone is listening.
+
+#include <stdint.h>
+#include <time.h>
+
+enum {
+  PROBE_DROP_SHORT = 1,   // shorter than eth/IP/UDP headers
+  PROBE_DROP_NOT_IP,      // ethertype
+  PROBE_DROP_NOT_UDP,     // IP protocol
+  PROBE_DROP_PORT,        // not UDP/68
+  PROBE_DROP_SHORT_DHCP,  // shorter than the fixed BOOTP header
+  PROBE_DROP_COOKIE,      // bad magic cookie
+  PROBE_DROP_XID,         // somebody else's transaction
+  PROBE_DROP_TIMEOUT,     // deadline passed, len is 0
+};
+
+#define DHCP_PROBE_LIST(X) X(tx) X(rx) X(rx_drop) X(msg) X(state) X(config)
+
+#if defined(HAVE_SYS_SDT_H)
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define DHCP_PROBES 1
+#define DHCP_PROBE4(name, a1, a2, a3, a4) \
+  STAP_PROBE4(dhcp, name, a1, a2, a3, a4)
+#define DHCP_PROBE5(name, a1, a2, a3, a4, a5) \
+  STAP_PROBE5(dhcp, name, a1, a2, a3, a4, a5)
+
+#elif (defined(__x86_64__) || defined(__aarch64__)) && defined(__GNUC__)
+
+// Same note layout as sys/sdt.h for when its header isn't installed. All
+// arguments are widened to 8 bytes, so every spec reads "8@<operand>".
+#define DHCP_PROBES 1
+#define _DHCP_PROBE_ARGS4 "8@%[a1] 8@%[a2] 8@%[a3] 8@%[a4]"
+#define _DHCP_PROBE_ARGS5 _DHCP_PROBE_ARGS4 " 8@%[a5]"
+#define _DHCP_PROBE(name, args, ...)                       \
+  __asm__ __volatile__(                                    \
+      "990: nop\n"                                         \
+      ".pushsection .note.stapsdt,\"\",\"note\"\n"         \
+      ".balign 4\n"                                        \
+      ".4byte 992f-991f, 994f-993f, 3\n"                   \
+      "991: .asciz \"stapsdt\"\n"                          \
+      "992: .balign 4\n"                                   \
+      "993: .8byte 990b\n"                                 \
+      ".8byte _.stapsdt.base\n"                            \
+      ".8byte dhcp_" #name "_semaphore\n"                  \
+      ".asciz \"dhcp\"\n"                                  \
+      ".asciz \"" #name "\"\n"                             \
+      ".asciz \"" args "\"\n"                              \
+      "994: .balign 4\n"                                   \
+      ".popsection\n"                                      \
+      ".ifndef _.stapsdt.base\n"                           \
+      ".pushsection .stapsdt.base,\"aG\",\"progbits\","    \
+      ".stapsdt.base,comdat\n"                             \
+      ".weak _.stapsdt.base\n"                             \
+      ".hidden _.stapsdt.base\n"                           \
+      "_.stapsdt.base: .space 1\n"                         \
+      ".size _.stapsdt.base, 1\n"                          \
+      ".popsection\n"                                      \
+      ".endif\n" ::__VA_ARGS__)
+#define DHCP_PROBE4(name, v1, v2, v3, v4)                           \
+  _DHCP_PROBE(name, _DHCP_PROBE_ARGS4, [a1] "nor"((uint64_t)(v1)), \
+              [a2] "nor"((uint64_t)(v2)), [a3] "nor"((uint64_t)(v3)), \
+              [a4] "nor"((uint64_t)(v4)))
+#define DHCP_PROBE5(name, v1, v2, v3, v4, v5)                       \
+  _DHCP_PROBE(name, _DHCP_PROBE_ARGS5, [a1] "nor"((uint64_t)(v1)), \
+              [a2] "nor"((uint64_t)(v2)), [a3] "nor"((uint64_t)(v3)), \
+              [a4] "nor"((uint64_t)(v4)), [a5] "nor"((uint64_t)(v5)))
+
+#endif
+
+#ifdef DHCP_PROBES
+
+#define DHCP_PROBE_DECLARE(name) \
+  extern volatile unsigned short dhcp_##name##_semaphore;
+DHCP_PROBE_LIST(DHCP_PROBE_DECLARE)
+
+#define DHCP_PROBE_ENABLED(name) __builtin_expect(dhcp_##name##_semaphore, 0)
+
+#else
+
+#define DHCP_PROBE4(name, a1, a2, a3, a4) \
+  do {                                    \
+  } while (0)
+#define DHCP_PROBE5(name, a1, a2, a3, a4, a5) \
+  do {                                        \
+  } while (0)
+#define DHCP_PROBE_ENABLED(name) 0
+
+#endif
+
+// Probe timestamp, skipped (0) when nobody is attached to that probe.
+#define DHCP_PROBE_TS(name) (DHCP_PROBE_ENABLED(name) ? probe_now_ns() : 0)
+
+static inline uint64_t probe_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef RESOLV_CONF_H
+#define RESOLV_CONF_H
+
+#include <stdint.h>
+
+// Writes nameserver/search lines to a temporary file next to path and
+// renames it into place, so readers never see a half-written file.
+// dns holds count addresses in network byte order; search may be empty.
+int resolv_conf_write(const char *path, const uint32_t *dns, int count,
+                      const char *search);
+
+#endif
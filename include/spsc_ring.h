@@ -0,0 +1,75 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bounded single-producer single-consumer queue of fixed-size slots. The
+// producer fills a slot in place (reserve, then publish) and the consumer
+// reads it in place (peek, then pop), so nothing is copied twice and no
+// lock is taken. head is only written by the producer and tail only by the
+// consumer, each on its own cache line.
+typedef struct {
+  uint8_t *slots;
+  uint32_t slot_size;
+  uint32_t mask;
+  uint32_t head __attribute__((aligned(64)));  // next slot to fill
+  uint32_t tail __attribute__((aligned(64)));  // next slot to read
+} spsc_ring_t;
+
+// capacity is rounded up to a power of two.
+static inline int spsc_ring_init(spsc_ring_t *r, uint32_t capacity,
+                                 uint32_t slot_size) {
+  uint32_t size = 1;
+  while (size < capacity) {
+    size <<= 1;
+  }
+  memset(r, 0, sizeof(spsc_ring_t));
+  if (!(r->slots = calloc(size, slot_size))) {
+    return -1;
+  }
+  r->slot_size = slot_size;
+  r->mask = size - 1;
+  return 0;
+}
+
+static inline void spsc_ring_destroy(spsc_ring_t *r) {
+  free(r->slots);
+  r->slots = NULL;
+}
+
+static inline void *spsc_ring_slot(const spsc_ring_t *r, uint32_t i) {
+  return r->slots + (size_t)(i & r->mask) * r->slot_size;
+}
+
+// Producer: the next free slot, or NULL if the ring is full.
+static inline void *spsc_ring_reserve(spsc_ring_t *r) {
+  uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+  if (r->head - tail > r->mask) {
+    return NULL;
+  }
+  return spsc_ring_slot(r, r->head);
+}
+
+static inline void spsc_ring_publish(spsc_ring_t *r) {
+  __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+// Consumer: the oldest slot, or NULL if the ring is empty.
+static inline void *spsc_ring_peek(spsc_ring_t *r) {
+  uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+  return r->tail == head ? NULL : spsc_ring_slot(r, r->tail);
+}
+
+static inline void spsc_ring_pop(spsc_ring_t *r) {
+  __atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+}
+
+// From either side; may be stale by the time it is used.
+static inline uint32_t spsc_ring_depth(const spsc_ring_t *r) {
+  return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) -
+         __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef STATUS_FILE_H
+#define STATUS_FILE_H
+
+#include <net/if.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dhcp.h"
+#include "dhcpclient.h"
+
+// Layout of a status file: a header, then slot_count slots of slot_size
+// bytes, one per handle. Readers map it read-only and must use slot_size
+// (not sizeof) to step through slots, since later versions only append
+// fields. Addresses are in network byte order, times CLOCK_REALTIME.
+#define STATUS_MAGIC "DHCPSTAT"
+#define STATUS_VERSION 1
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t slot_size;
+  uint32_t slot_count;
+  uint32_t pid;  // of the writer
+  uint32_t reserved[9];
+} status_header_t;
+
+// Seqlock: seq is odd while the writer is in the middle of an update. A
+// reader copies the slot and retries if seq was odd or changed meanwhile.
+typedef struct {
+  uint32_t seq;
+  uint8_t in_use;
+  uint8_t state;       // dhcp_state_t
+  uint8_t last_event;  // dhcpc_event_t + 1, 0 before the first
+  uint8_t holds_lease;
+  char ifname[IFNAMSIZ];
+  uint8_t mac[6];
+  uint16_t mtu;
+  uint32_t xid;
+  uint32_t address;
+  uint32_t netmask;
+  uint32_t router;
+  uint32_t server;
+  uint32_t dns;
+  uint32_t lease_time;
+  uint32_t offer_us;
+  uint32_t ack_us;
+  int64_t bound_at;    // seconds, 0 if never bound
+  int64_t expires;     // seconds, 0 without a lease
+  int64_t updated_ns;
+  uint64_t tx_frames;
+  uint64_t rx_frames;
+  uint32_t events[DHCPC_EVENT_EXPIRED + 1];  // per dhcpc_event_t
+} __attribute__((aligned(64))) status_slot_t;
+
+struct dhcpc_status {
+  char *path;
+  int fd;
+  status_header_t *header;
+  size_t size;
+  uint8_t *claimed;  // per slot, this process only
+};
+
+// Takes a free slot, -1 if there is none.
+int status_claim(dhcpc_status_t *status);
+void status_release(dhcpc_status_t *status, int slot);
+// Copies what client shows now into its slot.
+void status_publish(dhcpc_status_t *status, int slot,
+                    const dhcp_client_t *client, int holds_lease);
+
+// Reader side: a consistent copy of slot i of a mapped file, or -1 if the
+// writer kept changing it.
+int status_read_slot(const status_header_t *header, uint32_t i,
+                     status_slot_t *out);
+const char *status_state_name(int state);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Hierarchical timing wheel (Varghese & Lauck) behind a single timerfd.
+// Six levels of 64 slots cover 2^36 ticks; a timer sits in the lowest level
+// whose current rotation contains its expiry and moves down one level each
+// time the level above turns over. Schedule and cancel are O(1), and a tick
+// only touches the timers that are due or cascading, however many are
+// pending. Timers beyond the top level's current rotation wait on an
+// overflow list until it turns over, and are placed again then; an infinite
+// lease's T1 and T2 live there. Everything due by the time the timerfd is
+// read fires in one timer_wheel_run(), so expirations that land on the same
+// tick coalesce into one wakeup.
+#define TW_LEVELS 6
+#define TW_SLOT_BITS 6
+#define TW_SLOTS (1 << TW_SLOT_BITS)
+#define TW_OVERFLOW (TW_LEVELS * TW_SLOTS)
+
+typedef struct tw_timer tw_timer_t;
+typedef void (*tw_callback)(tw_timer_t *timer, void *arg);
+
+struct tw_timer {
+  tw_timer_t *next;
+  tw_timer_t **pprev;  // NULL while not scheduled
+  uint64_t expires;    // tick
+  uint16_t slot;       // level * TW_SLOTS + index, or TW_OVERFLOW
+  tw_callback cb;
+  void *arg;
+};
+
+typedef struct timer_wheel {
+  uint64_t now;  // next tick to process
+  uint64_t start_ms;
+  uint32_t tick_ms;
+  uint64_t armed_tick;  // what timer_fd is set to, UINT64_MAX if disarmed
+  int timer_fd;
+  uint64_t bitmap[TW_LEVELS];  // non-empty slots
+  tw_timer_t *slots[TW_LEVELS][TW_SLOTS];
+  tw_timer_t *overflow;  // expiring after the top level's rotation
+} timer_wheel_t;
+
+// timer_fd is only created with_fd; wheels driven by timer_wheel_advance()
+// alone (simulations, benchmarks) don't need one.
+int timer_wheel_init(timer_wheel_t *tw, uint32_t tick_ms, int with_fd);
+void timer_wheel_destroy(timer_wheel_t *tw);
+// Milliseconds until the wheel needs timer_wheel_run(), -1 if idle.
+int timer_wheel_next_timeout_ms(const timer_wheel_t *tw);
+// Reads the timerfd, fires everything due by now and re-arms. Returns the
+// number of timers fired.
+int timer_wheel_run(timer_wheel_t *tw);
+// Fires everything due up to and including tick, without touching the
+// clock or the timerfd.
+int timer_wheel_advance(timer_wheel_t *tw, uint64_t tick);
+
+void tw_timer_init(tw_timer_t *t, tw_callback cb, void *arg);
+// (Re)schedules t delay_ms from now, rounded up to whole ticks.
+void tw_timer_schedule(timer_wheel_t *tw, tw_timer_t *t, uint64_t delay_ms);
+void tw_timer_schedule_tick(timer_wheel_t *tw, tw_timer_t *t,
+                            uint64_t expires);
+void tw_timer_cancel(timer_wheel_t *tw, tw_timer_t *t);
+
+static inline int tw_timer_pending(const tw_timer_t *t) {
+  return t->pprev != NULL;
+}
+
+#endif
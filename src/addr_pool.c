@@ -0,0 +1,96 @@
+#include "addr_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int addr_pool_init(addr_pool_t *pool, uint32_t size) {
+  memset(pool, 0, sizeof(addr_pool_t));
+  if (size == 0 || size > ADDR_POOL_MAX) {
+    fprintf(stderr, "[-] address pool size out of range\n");
+    return -1;
+  }
+
+  uint32_t bits = size;
+  do {
+    uint32_t words = (bits + 63) / 64;
+    uint64_t *level = calloc(words, sizeof(uint64_t));
+    if (!level) {
+      perror("[-] calloc() address pool");
+      addr_pool_destroy(pool);
+      return -1;
+    }
+    // Bit i of a level is set when word i of the level below has any.
+    for (uint32_t i = 0; i < bits; i++) {
+      level[i / 64] |= 1ULL << (i % 64);
+    }
+    pool->level[pool->levels++] = level;
+    bits = words;
+  } while (bits > 1);
+
+  pool->size = size;
+  pool->free = size;
+  return 0;
+}
+
+void addr_pool_destroy(addr_pool_t *pool) {
+  for (int i = 0; i < pool->levels; i++) {
+    free(pool->level[i]);
+  }
+  memset(pool, 0, sizeof(addr_pool_t));
+}
+
+// Clears the bit of offset and, where that empties a word, the bit of that
+// word one level up.
+static void clear_bit(addr_pool_t *pool, uint32_t offset) {
+  for (int k = 0; k < pool->levels; k++) {
+    uint64_t *word = &pool->level[k][offset / 64];
+    *word &= ~(1ULL << (offset % 64));
+    if (*word) {
+      break;
+    }
+    offset /= 64;
+  }
+  pool->free--;
+}
+
+uint32_t addr_pool_alloc(addr_pool_t *pool) {
+  if (!pool->free) {
+    return ADDR_POOL_NONE;
+  }
+  uint32_t offset = 0;
+  for (int k = pool->levels - 1; k >= 0; k--) {
+    offset = offset * 64 + __builtin_ctzll(pool->level[k][offset]);
+  }
+  clear_bit(pool, offset);
+  return offset;
+}
+
+int addr_pool_is_free(const addr_pool_t *pool, uint32_t offset) {
+  return offset < pool->size &&
+         (pool->level[0][offset / 64] >> (offset % 64) & 1);
+}
+
+int addr_pool_take(addr_pool_t *pool, uint32_t offset) {
+  if (!addr_pool_is_free(pool, offset)) {
+    return -1;
+  }
+  clear_bit(pool, offset);
+  return 0;
+}
+
+void addr_pool_release(addr_pool_t *pool, uint32_t offset) {
+  if (offset >= pool->size || addr_pool_is_free(pool, offset)) {
+    return;
+  }
+  for (int k = 0; k < pool->levels; k++) {
+    uint64_t *word = &pool->level[k][offset / 64];
+    int was_empty = *word == 0;
+    *word |= 1ULL << (offset % 64);
+    if (!was_empty) {
+      break;
+    }
+    offset /= 64;
+  }
+  pool->free++;
+}
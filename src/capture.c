@@ -0,0 +1,280 @@
+#include "capture.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "network_utils.h"
+
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+#define PCAP_LINKTYPE_ETHERNET 1
+// Writes wait this long for the rest of an exchange unless the ring is
+// half full, so a DHCP handshake costs one write() instead of four.
+#define CAPTURE_BATCH_MS 100
+#define CAPTURE_IDLE_MS 1000
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version_major;
+  uint16_t version_minor;
+  int32_t thiszone;
+  uint32_t sigfigs;
+  uint32_t snaplen;
+  uint32_t linktype;
+} pcap_file_header_t;
+
+typedef struct {
+  uint32_t ts_sec;
+  uint32_t ts_nsec;
+  uint32_t incl_len;
+  uint32_t orig_len;
+} pcap_record_t;
+
+static int write_all(int fd, const uint8_t *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    buf += n;
+    len -= n;
+  }
+  return 0;
+}
+
+static int capture_open_file(capture_t *cap) {
+  cap->fd = open(cap->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (cap->fd < 0) {
+    perror("[-] open() capture file");
+    return -1;
+  }
+
+  pcap_file_header_t hdr = {PCAP_MAGIC_NSEC, 2, 4, 0, 0, CAPTURE_SNAPLEN,
+                            PCAP_LINKTYPE_ETHERNET};
+  if (write_all(cap->fd, (const uint8_t *)&hdr, sizeof(hdr)) < 0) {
+    perror("[-] write() capture file");
+    return -1;
+  }
+  cap->file_bytes = sizeof(hdr);
+  return 0;
+}
+
+static void capture_rotate(capture_t *cap) {
+  char old_path[4096];
+  snprintf(old_path, sizeof(old_path), "%s.1", cap->path);
+
+  close(cap->fd);
+  cap->file_bytes = 0;  // a failed reopen must not stall the drain loop
+  if (rename(cap->path, old_path) < 0) {
+    perror("[-] rename() capture file");
+  }
+  capture_open_file(cap);
+}
+
+// Copies len bytes at ring offset pos (which may wrap) to or from buf.
+static void ring_copy_in(capture_t *cap, uint64_t pos, const void *buf,
+                         size_t len) {
+  size_t off = pos & (CAPTURE_RING_SIZE - 1);
+  size_t first = CAPTURE_RING_SIZE - off < len ? CAPTURE_RING_SIZE - off : len;
+  memcpy(cap->ring + off, buf, first);
+  memcpy(cap->ring, (const uint8_t *)buf + first, len - first);
+}
+
+static void ring_copy_out(const capture_t *cap, uint64_t pos, void *buf,
+                          size_t len) {
+  size_t off = pos & (CAPTURE_RING_SIZE - 1);
+  size_t first = CAPTURE_RING_SIZE - off < len ? CAPTURE_RING_SIZE - off : len;
+  memcpy(buf, cap->ring + off, first);
+  memcpy((uint8_t *)buf + first, cap->ring, len - first);
+}
+
+// Writes [tail, end) of the ring, which is at most two contiguous spans.
+static int capture_write_span(capture_t *cap, uint64_t tail, uint64_t end) {
+  size_t off = tail & (CAPTURE_RING_SIZE - 1);
+  size_t len = end - tail;
+  size_t first = CAPTURE_RING_SIZE - off < len ? CAPTURE_RING_SIZE - off : len;
+
+  if (write_all(cap->fd, cap->ring + off, first) < 0 ||
+      write_all(cap->fd, cap->ring, len - first) < 0) {
+    perror("[-] write() capture file");
+    return -1;
+  }
+  cap->file_bytes += len;
+  return 0;
+}
+
+// Writes out everything queued, splitting only at record boundaries so each
+// rotated file is a valid capture on its own.
+static void capture_drain(capture_t *cap) {
+  uint64_t head = __atomic_load_n(&cap->head, __ATOMIC_ACQUIRE);
+  uint64_t tail = cap->tail;
+
+  while (tail < head) {
+    uint64_t end = tail;
+    while (end < head) {
+      pcap_record_t rec;
+      ring_copy_out(cap, end, &rec, sizeof(rec));
+      uint64_t rec_len = sizeof(rec) + rec.incl_len;
+      // A file always takes at least one record, however small the cap.
+      if (cap->file_bytes + (end - tail) + rec_len > cap->max_bytes &&
+          cap->file_bytes + (end - tail) > sizeof(pcap_file_header_t)) {
+        break;
+      }
+      end += rec_len;
+    }
+
+    if (end == tail) {
+      capture_rotate(cap);
+      continue;
+    }
+    if (cap->fd >= 0) {
+      capture_write_span(cap, tail, end);
+    }
+    tail = end;
+    __atomic_store_n(&cap->tail, tail, __ATOMIC_RELEASE);
+  }
+}
+
+static uint64_t capture_used(capture_t *cap) {
+  return __atomic_load_n(&cap->head, __ATOMIC_ACQUIRE) - cap->tail;
+}
+
+static void capture_wait(capture_t *cap, int ms) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += ms / 1000;
+  ts.tv_nsec += (ms % 1000) * 1000000L;
+  if (ts.tv_nsec >= 1000000000L) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000L;
+  }
+  pthread_cond_timedwait(&cap->wake, &cap->lock, &ts);
+}
+
+static void *capture_writer(void *arg) {
+  capture_t *cap = arg;
+
+  pthread_mutex_lock(&cap->lock);
+  while (!cap->stop) {
+    uint64_t used = capture_used(cap);
+    if (used == 0) {
+      // The timeout only covers a wakeup lost to a stale tail in
+      // capture_frame().
+      capture_wait(cap, CAPTURE_IDLE_MS);
+      continue;
+    }
+    if (used < CAPTURE_RING_SIZE / 2) {
+      capture_wait(cap, CAPTURE_BATCH_MS);
+    }
+    pthread_mutex_unlock(&cap->lock);
+    capture_drain(cap);
+    pthread_mutex_lock(&cap->lock);
+  }
+  pthread_mutex_unlock(&cap->lock);
+
+  capture_drain(cap);
+  return NULL;
+}
+
+capture_t *capture_open(const char *path, uint64_t max_bytes) {
+  capture_t *cap = calloc(1, sizeof(capture_t));
+  if (!cap) {
+    perror("calloc");
+    return NULL;
+  }
+  cap->fd = -1;
+  cap->max_bytes = max_bytes ? max_bytes : CAPTURE_DEFAULT_MAX_BYTES;
+
+  if (!(cap->path = strdup(path)) ||
+      !(cap->ring = malloc(CAPTURE_RING_SIZE))) {
+    perror("malloc");
+    free(cap->path);
+    free(cap);
+    return NULL;
+  }
+  // Touch every page now so capture_frame() never faults one in.
+  memset(cap->ring, 0, CAPTURE_RING_SIZE);
+
+  if (capture_open_file(cap) < 0) {
+    if (cap->fd >= 0) {
+      close(cap->fd);
+    }
+    free(cap->ring);
+    free(cap->path);
+    free(cap);
+    return NULL;
+  }
+
+  pthread_mutex_init(&cap->lock, NULL);
+  pthread_cond_init(&cap->wake, NULL);
+  int err = pthread_create(&cap->writer, NULL, capture_writer, cap);
+  if (err) {
+    fprintf(stderr, "[-] pthread_create() capture writer: %s\n",
+            strerror(err));
+    close(cap->fd);
+    free(cap->ring);
+    free(cap->path);
+    free(cap);
+    return NULL;
+  }
+  return cap;
+}
+
+void capture_close(capture_t *cap) {
+  if (!cap) {
+    return;
+  }
+
+  pthread_mutex_lock(&cap->lock);
+  cap->stop = 1;
+  pthread_cond_signal(&cap->wake);
+  pthread_mutex_unlock(&cap->lock);
+  pthread_join(cap->writer, NULL);
+
+  if (cap->fd >= 0) {
+    close(cap->fd);
+  }
+  pthread_cond_destroy(&cap->wake);
+  pthread_mutex_destroy(&cap->lock);
+  free(cap->ring);
+  free(cap->path);
+  free(cap);
+}
+
+void capture_frame(capture_t *cap, const void *frame, size_t len,
+                   int64_t ts_ns) {
+  size_t caplen = len > CAPTURE_SNAPLEN ? CAPTURE_SNAPLEN : len;
+  uint64_t need = sizeof(pcap_record_t) + caplen;
+  uint64_t head = cap->head;
+  uint64_t used = head - __atomic_load_n(&cap->tail, __ATOMIC_ACQUIRE);
+
+  if (CAPTURE_RING_SIZE - used < need) {
+    cap->dropped++;
+    return;
+  }
+
+  if (!ts_ns) {
+    ts_ns = realtime_ns();
+  }
+  pcap_record_t rec = {ts_ns / 1000000000, ts_ns % 1000000000, caplen, len};
+  ring_copy_in(cap, head, &rec, sizeof(rec));
+  ring_copy_in(cap, head + sizeof(rec), frame, caplen);
+  __atomic_store_n(&cap->head, head + need, __ATOMIC_RELEASE);
+  cap->frames++;
+
+  // Only the transitions the writer may be sleeping through need a wakeup;
+  // everything else rides along with the next batch.
+  if (used == 0 || (used < CAPTURE_RING_SIZE / 2 &&
+                    used + need >= CAPTURE_RING_SIZE / 2)) {
+    pthread_mutex_lock(&cap->lock);
+    pthread_cond_signal(&cap->wake);
+    pthread_mutex_unlock(&cap->lock);
+  }
+}
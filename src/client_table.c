@@ -0,0 +1,207 @@
+#include "client_table.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "network_utils.h"
+
+#define HUGEPAGE_SIZE (2UL << 20)
+
+static size_t align_up(size_t n, size_t a) { return (n + a - 1) & ~(a - 1); }
+
+static uint32_t index_home(const client_table_t *ct, uint32_t xid) {
+  // Fibonacci hashing, then the high bits scaled onto the table.
+  return (uint32_t)(((uint64_t)(xid * 2654435769u) * (ct->index_mask + 1)) >>
+                    32);
+}
+
+int client_table_init(client_table_t *ct, uint32_t capacity, int hugepages) {
+  memset(ct, 0, sizeof(client_table_t));
+  if (capacity == 0 || capacity > (1u << 30)) {
+    fprintf(stderr, "[-] client table capacity out of range\n");
+    return -1;
+  }
+
+  // Load factor at most 3/4, so probes stay short at any fill level.
+  uint32_t index_size = 1;
+  while (index_size < capacity + capacity / 3) {
+    index_size <<= 1;
+  }
+  size_t slots = align_up(capacity, CT_BLOCK);
+  size_t blocks = slots / CT_BLOCK;
+
+  size_t off_tries = align_up(slots, 64);
+  size_t off_xid = off_tries + align_up(slots, 64);
+  size_t off_deadline = off_xid + align_up(slots * 4, 64);
+  size_t off_lease = off_deadline + align_up(slots * 4, 64);
+  size_t off_server = off_lease + align_up(slots * 4, 64);
+  size_t off_index = off_server + align_up(slots * 4, 64);
+  size_t off_block_min = off_index + align_up((size_t)index_size * 4, 64);
+  size_t bytes = off_block_min + blocks * 4;
+
+  void *arena = MAP_FAILED;
+  if (hugepages) {
+    ct->arena_bytes = align_up(bytes, HUGEPAGE_SIZE);
+    arena = mmap(NULL, ct->arena_bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    ct->hugepages = arena != MAP_FAILED;
+  }
+  if (arena == MAP_FAILED) {
+    ct->arena_bytes = bytes;
+    arena = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED) {
+      perror("[-] mmap() client table");
+      return -1;
+    }
+    if (hugepages) {
+      madvise(arena, bytes, MADV_HUGEPAGE);
+    }
+  }
+
+  uint8_t *base = arena;
+  ct->arena = arena;
+  ct->used_bytes = bytes;
+  ct->capacity = capacity;
+  ct->index_mask = index_size - 1;
+  ct->state = base;
+  ct->tries = base + off_tries;
+  ct->xid = (uint32_t *)(base + off_xid);
+  ct->deadline = (uint32_t *)(base + off_deadline);
+  ct->lease = (uint32_t *)(base + off_lease);
+  ct->server = (uint32_t *)(base + off_server);
+  ct->index = (uint32_t *)(base + off_index);
+  ct->block_min = (uint32_t *)(base + off_block_min);
+  // Deadlines are never 0, so 0 can mean none.
+  ct->epoch_ms = monotonic_ms() - 1;
+
+  memset(ct->index, 0xff, (size_t)index_size * 4);
+  memset(ct->block_min, 0xff, blocks * 4);
+  for (uint32_t i = 0; i < capacity; i++) {
+    ct->lease[i] = i + 1;
+  }
+  ct->lease[capacity - 1] = CT_NONE;
+  ct->free_head = 0;
+  return 0;
+}
+
+void client_table_destroy(client_table_t *ct) {
+  if (ct->arena) {
+    munmap(ct->arena, ct->arena_bytes);
+  }
+  memset(ct, 0, sizeof(client_table_t));
+}
+
+uint32_t client_table_lookup(const client_table_t *ct, uint32_t xid) {
+  uint32_t i = index_home(ct, xid);
+  for (;;) {
+    uint32_t slot = ct->index[i];
+    if (slot == CT_NONE || ct->xid[slot] == xid) {
+      return slot;
+    }
+    i = (i + 1) & ct->index_mask;
+  }
+}
+
+// Backward-shift deletion: pull later entries of the probe run into the hole
+// unless that would move them in front of their home bucket.
+static void index_remove(client_table_t *ct, uint32_t slot) {
+  uint32_t mask = ct->index_mask;
+  uint32_t i = index_home(ct, ct->xid[slot]);
+  while (ct->index[i] != slot) {
+    if (ct->index[i] == CT_NONE) {
+      return;
+    }
+    i = (i + 1) & mask;
+  }
+
+  for (uint32_t j = (i + 1) & mask; ct->index[j] != CT_NONE;
+       j = (j + 1) & mask) {
+    uint32_t home = index_home(ct, ct->xid[ct->index[j]]);
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      ct->index[i] = ct->index[j];
+      i = j;
+    }
+  }
+  ct->index[i] = CT_NONE;
+}
+
+int client_table_set_xid(client_table_t *ct, uint32_t slot, uint32_t xid) {
+  uint32_t i = index_home(ct, xid);
+  while (ct->index[i] != CT_NONE) {
+    if (ct->xid[ct->index[i]] == xid) {
+      return ct->index[i] == slot ? 0 : -1;
+    }
+    i = (i + 1) & ct->index_mask;
+  }
+
+  index_remove(ct, slot);
+  // The hole may have moved the free bucket we found.
+  i = index_home(ct, xid);
+  while (ct->index[i] != CT_NONE) {
+    i = (i + 1) & ct->index_mask;
+  }
+  ct->xid[slot] = xid;
+  ct->index[i] = slot;
+  return 0;
+}
+
+uint32_t client_table_alloc(client_table_t *ct) {
+  uint32_t slot = ct->free_head;
+  if (slot == CT_NONE) {
+    return CT_NONE;
+  }
+  ct->free_head = ct->lease[slot];
+  ct->count++;
+
+  ct->state[slot] = CT_SELECTING;
+  ct->tries[slot] = 0;
+  ct->deadline[slot] = 0;
+  ct->lease[slot] = 0;
+  ct->server[slot] = 0;
+  return slot;
+}
+
+void client_table_free(client_table_t *ct, uint32_t slot) {
+  index_remove(ct, slot);
+  ct->state[slot] = CT_FREE;
+  ct->deadline[slot] = 0;
+  ct->lease[slot] = ct->free_head;
+  ct->free_head = slot;
+  ct->count--;
+}
+
+size_t client_table_expire(client_table_t *ct, uint64_t now_ms,
+                           void (*fn)(client_table_t *ct, uint32_t slot,
+                                      void *arg),
+                           void *arg) {
+  uint32_t now = (uint32_t)(now_ms - ct->epoch_ms);
+  uint32_t *deadline = ct->deadline;
+  uint32_t blocks = (ct->capacity + CT_BLOCK - 1) / CT_BLOCK;
+  size_t expired = 0;
+
+  for (uint32_t block = 0; block < blocks; block++) {
+    if (ct->block_min[block] > now) {
+      continue;
+    }
+    uint32_t first = block * CT_BLOCK;
+    // d - 1 wraps 0 (no deadline) to UINT32_MAX.
+    for (uint32_t slot = first; slot < first + CT_BLOCK; slot++) {
+      if (deadline[slot] - 1 < now) {
+        deadline[slot] = 0;
+        expired++;
+        fn(ct, slot, arg);
+      }
+    }
+    // After the callbacks, which may have re-armed slots of this block.
+    uint32_t min = UINT32_MAX;
+    for (uint32_t slot = first; slot < first + CT_BLOCK; slot++) {
+      if (deadline[slot] && deadline[slot] < min) {
+        min = deadline[slot];
+      }
+    }
+    ct->block_min[block] = min;
+  }
+  return expired;
+}
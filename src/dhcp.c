@@ -8,16 +8,136 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/random.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "capture.h"
+#include "dhcpclient.h"
+#include "hooks.h"
+#include "lease_file.h"
+#include "logging.h"
 #include "network_utils.h"
 #include "packet_utils.h"
+#include "pipeline.h"
+#include "probes.h"
+#include "status_file.h"
 
-dhcp_client_t *dhcp_client_init(const char *ifname) {
-  srand(time(NULL));
+// Reachability probes of the previous gateway after a link flap.
+#define DNA_PROBE_COUNT 3
+#define DNA_PROBE_TIMEOUT_MS 100
+// Timer resolution: expirations within one tick share a wakeup.
+#define DHCP_TICK_MS 10
+// Cap on the doubling retransmission timeout (RFC 2131 4.1).
+#define DHCP_BACKOFF_MAX_MS 64000
+// Adaptive timeouts: the first wait before any sample (RFC 6298 2.1), and a
+// floor so sub-millisecond local servers still get a few ticks.
+#define DHCP_RTO_INITIAL_MS 1000
+#define DHCP_RTO_MIN_MS 100
+#define DHCP_RTO_MAX_BACKOFF 16
+
+static uint32_t dhcp_next_xid(dhcp_client_t *client) {
+  uint32_t x = client->rng;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  client->rng = x;
+  return x;
+}
+
+static void dhcp_set_state(dhcp_client_t *client, dhcp_state_t state) {
+  DHCP_PROBE4(state, client->xid, client->state, state, DHCP_PROBE_TS(state));
+  client->state = state;
+}
+
+static void dhcp_arm_timer(dhcp_client_t *client, uint64_t delay_ms) {
+  tw_timer_schedule(client->wheel, &client->retransmit, delay_ms);
+}
+
+static void dhcp_disarm_timer(dhcp_client_t *client) {
+  tw_timer_cancel(client->wheel, &client->retransmit);
+}
+
+// Schedules a lease timer at an absolute time measured from bound_at_ms, so
+// every (re)bind computes the same deadlines for the same lease.
+static void dhcp_arm_lease_timer(dhcp_client_t *client, tw_timer_t *timer,
+                                 uint64_t at_ms) {
+  uint64_t now = monotonic_ms();
+  tw_timer_schedule(client->wheel, timer, at_ms > now ? at_ms - now : 0);
+}
+
+static void dhcp_cancel_timers(dhcp_client_t *client) {
+  tw_timer_cancel(client->wheel, &client->retransmit);
+  tw_timer_cancel(client->wheel, &client->t1);
+  tw_timer_cancel(client->wheel, &client->t2);
+  tw_timer_cancel(client->wheel, &client->expiry);
+}
+
+static int dhcp_watch_fd(dhcp_client_t *client, int fd) {
+  struct epoll_event ev = {.events = EPOLLIN, .data.fd = fd};
+  if (epoll_ctl(client->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    perror("[-] epoll_ctl()");
+    return -1;
+  }
+  return 0;
+}
+
+static void dhcp_on_timer(tw_timer_t *timer, void *arg);
+static int dhcp_holds_lease(const dhcp_client_t *client);
+
+// At the end of every entry point, next to io_flush().
+static void dhcp_publish(dhcp_client_t *client) {
+  if (client->status_slot >= 0) {
+    status_publish(client->status, client->status_slot, client,
+                   dhcp_holds_lease(client));
+  }
+}
+
+static int dhcp_open_backend(dhcp_client_t *client,
+                             io_backend_type_t io_type) {
+  if (io_type == IO_BACKEND_XDP) {
+    client->io =
+        io_backend_create(io_type, client->sock, client->iface.ifindex);
+    if (client->io) {
+      return 0;
+    }
+    io_type = IO_BACKEND_SELECT;
+    fprintf(stderr, "[-] Falling back to select backend\n");
+  }
+
+  if ((client->sock = create_raw_socket(&client->iface)) < 0) {
+    fprintf(stderr, "[-] Failed to create socket\n");
+    return -1;
+  }
+
+  client->io = io_backend_create(io_type, client->sock, client->iface.ifindex);
+  if (!client->io && io_type != IO_BACKEND_SELECT) {
+    fprintf(stderr, "[-] Falling back to select backend\n");
+    client->io = io_backend_create(IO_BACKEND_SELECT, client->sock,
+                                   client->iface.ifindex);
+  }
+  return client->io ? 0 : -1;
+}
+
+void dhcpc_config_init(dhcpc_config_t *config) {
+  memset(config, 0, sizeof(dhcpc_config_t));
+  config->io_backend = "select";
+  config->timeout_secs = 5;
+  config->retries = 3;
+  config->configure = 1;
+  config->log_level = DHCPC_LOG_INFO;
+}
+
+dhcpc_t *dhcpc_new(const dhcpc_config_t *config) {
+  io_backend_type_t io_type = IO_BACKEND_SELECT;
+  if (config->io_backend &&
+      io_backend_parse_type(config->io_backend, &io_type) != 0) {
+    fprintf(stderr, "[-] Unknown I/O backend '%s'\n", config->io_backend);
+    return NULL;
+  }
 
   dhcp_client_t *client = malloc(sizeof(dhcp_client_t));
   if (!client) {
@@ -26,66 +146,246 @@ dhcp_client_t *dhcp_client_init(const char *ifname) {
   }
 
   memset(client, 0, sizeof(dhcp_client_t));
-  strncpy(client->ifname, ifname, IFNAMSIZ - 1);
-  client->ifname[IFNAMSIZ - 1] = '\0';
+  client->sock = -1;
+  client->arp_sock = -1;
+  client->epoll_fd = -1;
+  client->link_events.fd = -1;
+  client->iface.nl.fd = -1;
+  client->status_slot = -1;
+  client->timeout_secs = config->timeout_secs;
+  client->retries = config->retries;
+  client->retransmit_policy = config->retransmit;
+  client->monitor = config->monitor;
+  client->configure = config->configure;
+  client->resolv_conf = config->resolv_conf;
+  client->lease_file = config->lease_file;
+  // Response times measured by an earlier run, lease or not.
+  if (client->lease_file) {
+    lease_record_t lease;
+    memset(&lease, 0, sizeof(lease));
+    lease_file_read(client->lease_file, &lease);
+    memcpy(client->rtt, lease.rtt, sizeof(client->rtt));
+  }
+  client->pipeline = config->pipeline;
+  client->hooks = config->hooks;
+  client->log_level = config->log_level;
+  client->on_lease = config->on_lease;
+  client->cb_arg = config->cb_arg;
 
-  bring_interface_up(client->ifname);
-  get_mac_addr(client->ifname, client->mac);
+  client->rng = config->seed;
+  if (!client->rng && getrandom(&client->rng, sizeof(client->rng), 0) < 0) {
+    client->rng = (uint32_t)monotonic_us();
+  }
+  client->rng |= 1;  // xorshift never leaves 0
+  client->xid = dhcp_next_xid(client);
 
-  client->xid = rand() % 0xffffffff;
+  if (iface_ctx_init(&client->iface, config->ifname) < 0) {
+    dhcpc_free(client);
+    return NULL;
+  }
+  iface_ctx_bring_up(&client->iface);
 
-  if ((client->sock = create_raw_socket(ifname)) < 0) {
-    fprintf(stderr, "[-] Failed to create socket\n");
-    free(client);
+  LOG_INFO(client->log_level, "MAC: %02X:%02X:%02X:%02X:%02X:%02X\n",
+           client->iface.mac[0], client->iface.mac[1], client->iface.mac[2],
+           client->iface.mac[3], client->iface.mac[4], client->iface.mac[5]);
+
+  if (dhcp_open_backend(client, io_type) < 0) {
+    dhcpc_free(client);
+    return NULL;
+  }
+  // AF_XDP frames never become skbs, so that backend has no stamps at all.
+  if (client->sock >= 0) {
+    sock_enable_timestamps(client->sock);
+  }
+  if (config->capture_file) {
+    if (!(client->capture = capture_open(config->capture_file,
+                                         config->capture_max_bytes))) {
+      dhcpc_free(client);
+      return NULL;
+    }
+    client->io->capture = client->capture;
+    LOG_INFO(client->log_level, "[*] Capturing to %s\n",
+             config->capture_file);
+  }
+
+  if ((client->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+    perror("[-] epoll_create1()");
+    dhcpc_free(client);
+    return NULL;
+  }
+  if (dhcp_watch_fd(client, client->io->poll_fd) < 0) {
+    dhcpc_free(client);
     return NULL;
   }
 
+  client->wheel = config->timers;
+  if (!client->wheel) {
+    if (!(client->wheel = dhcpc_timers_new())) {
+      dhcpc_free(client);
+      return NULL;
+    }
+    client->own_wheel = 1;
+    if (dhcp_watch_fd(client, client->wheel->timer_fd) < 0) {
+      dhcpc_free(client);
+      return NULL;
+    }
+  }
+  tw_timer_init(&client->retransmit, dhcp_on_timer, client);
+  tw_timer_init(&client->t1, dhcp_on_timer, client);
+  tw_timer_init(&client->t2, dhcp_on_timer, client);
+  tw_timer_init(&client->expiry, dhcp_on_timer, client);
+
+  if (config->status) {
+    client->status = config->status;
+    if ((client->status_slot = status_claim(client->status)) < 0) {
+      fprintf(stderr, "[-] Status file full, %s not listed\n",
+              client->iface.ifname);
+    }
+    dhcp_publish(client);
+  }
   return client;
 }
 
-void dhcp_client_cleanup(dhcp_client_t *client) {
+void dhcpc_free(dhcpc_t *client) {
   if (client) {
-    if (client->sock > 0) {
+    if (client->config_pending) {
+      pipeline_wait(client->pipeline, client, 1);
+    }
+    io_backend_destroy(client->io);
+    if (client->capture) {
+      LOG_INFO(client->log_level, "[*] Captured %llu frames, %llu dropped\n",
+               (unsigned long long)client->capture->frames,
+               (unsigned long long)client->capture->dropped);
+      capture_close(client->capture);
+    }
+    if (client->sock >= 0) {
       close(client->sock);
     }
+    if (client->arp_sock >= 0) {
+      close(client->arp_sock);
+    }
+    if (client->own_wheel) {
+      dhcpc_timers_free(client->wheel);
+    } else if (client->wheel) {
+      // A shared wheel outlives us and must not keep our timers.
+      dhcp_cancel_timers(client);
+    }
+    if (client->epoll_fd >= 0) {
+      close(client->epoll_fd);
+    }
+    nl_close(&client->link_events);
+    iface_ctx_close(&client->iface);
+    if (client->status_slot >= 0) {
+      status_release(client->status, client->status_slot);
+    }
     free(client);
   }
 }
 
-int dhcp_send_discover(dhcp_client_t *client) {
-  dhcp_packet_t discover_packet;
-  create_dhcp_packet(&discover_packet, client->mac, client->xid, DHCPDISCOVER);
+// Requests are stamped twice: just before the send, and by the kernel when
+// the frame leaves, which process() picks up from the error queue.
+static void dhcp_mark_sent(dhcp_client_t *client) {
+  client->tx_user_ns = realtime_ns();
+  client->tx_ts_ns = 0;
+}
 
-  printf("[*] Sending DHCPDISCOVER, xid: 0x%08X\n", client->xid);
+// Server response time of the exchange the current reply completes. With
+// kernel stamps on both ends, time spent in our send path and our wakeup
+// after the reply arrived are reported separately instead of included.
+static uint32_t dhcp_measure_reply(dhcp_client_t *client,
+                                   const char *exchange) {
+  int64_t now = realtime_ns();
+  int64_t rx = client->io->rx_ts_ns ? client->io->rx_ts_ns : now;
+  int64_t tx = client->tx_ts_ns ? client->tx_ts_ns : client->tx_user_ns;
+  int64_t server_us = rx > tx ? (rx - tx) / 1000 : 0;
 
-  if (send_dhcp_packet(client->sock, client->mac, &discover_packet,
-                       client->ifname) < 0) {
-    fprintf(stderr, "[-] Failed to send DHCPDISCOVER\n");
-    return -1;
+  if (client->io->rx_ts_ns && client->tx_ts_ns) {
+    LOG_INFO(client->log_level,
+             "    %s: %lld us (send path %lld us, wakeup %lld us)\n",
+             exchange, (long long)server_us,
+             (long long)(client->tx_ts_ns - client->tx_user_ns) / 1000,
+             (long long)(now - rx) / 1000);
+  } else {
+    LOG_INFO(client->log_level, "    %s: %lld us (userspace clock)\n",
+             exchange, (long long)server_us);
   }
-  return 0;
+  return (uint32_t)server_us;
 }
 
-int dhcp_receive_offer(dhcp_client_t *client) {
-  dhcp_packet_t offer_packet;
+// RFC 6298 with the server's response time as the RTT. A reply to a request
+// sent more than once could belong to any copy (they share the xid), so it
+// is not a sample (Karn).
+static void dhcp_rtt_sample(dhcp_client_t *client, int exchange,
+                            uint32_t rtt_us) {
+  dhcp_rtt_t *rtt = &client->rtt[exchange];
+  if (client->sends > 1) {
+    return;
+  }
+  if (!rtt->srtt_us) {
+    rtt->srtt_us = rtt_us;
+    rtt->rttvar_us = rtt_us / 2;
+  } else {
+    uint32_t err = rtt->srtt_us > rtt_us ? rtt->srtt_us - rtt_us
+                                         : rtt_us - rtt->srtt_us;
+    rtt->rttvar_us = rtt->rttvar_us - rtt->rttvar_us / 4 + err / 4;
+    rtt->srtt_us = rtt->srtt_us - rtt->srtt_us / 8 + rtt_us / 8;
+  }
+  if (!rtt->srtt_us) {
+    rtt->srtt_us = 1;  // 0 means no sample
+  }
+  client->rto_backoff[exchange] = 0;
+  DEBUG_PRINT(client->log_level, "%s time: %u us, smoothed %u us +- %u us\n",
+              exchange == DHCP_RTT_OFFER ? "OFFER" : "ACK", rtt_us,
+              rtt->srtt_us, rtt->rttvar_us);
+}
 
-  if (receive_dhcp_packet(client->sock, &offer_packet, client->xid,
-                          client->timeout_secs) == 0) {
-    if (parse_options(&offer_packet, client) == DHCPOFFER) {
-      return 0;
+// How long to wait for the reply to a DISCOVER or REQUEST: timeout_secs, or
+// with the adaptive policy SRTT + 4 * RTTVAR (at least one tick), doubled
+// for every timeout since the last sample and capped at timeout_secs.
+static uint64_t dhcp_rto_ms(const dhcp_client_t *client, int exchange) {
+  uint64_t bound_ms = client->timeout_secs * 1000ULL;
+  if (client->retransmit_policy != DHCPC_RETRANSMIT_ADAPTIVE) {
+    return bound_ms;
+  }
+
+  const dhcp_rtt_t *rtt = &client->rtt[exchange];
+  uint64_t rto_ms = DHCP_RTO_INITIAL_MS;
+  if (rtt->srtt_us) {
+    uint64_t var_us = 4ULL * rtt->rttvar_us;
+    if (var_us < DHCP_TICK_MS * 1000) {
+      var_us = DHCP_TICK_MS * 1000;
+    }
+    rto_ms = (rtt->srtt_us + var_us + 999) / 1000;
+    if (rto_ms < DHCP_RTO_MIN_MS) {
+      rto_ms = DHCP_RTO_MIN_MS;
     }
   }
-  return -1;
+  rto_ms <<= client->rto_backoff[exchange];
+  return rto_ms < bound_ms ? rto_ms : bound_ms;
 }
 
-int dhcp_send_request(dhcp_client_t *client) {
-  dhcp_packet_t request_packet;
-  create_dhcp_packet(&request_packet, client->mac, client->xid, DHCPREQUEST);
+static int dhcp_send_discover(dhcp_client_t *client) {
+  dhcp_packet_t discover_packet;
+  create_dhcp_packet(&discover_packet, client->iface.mac, client->xid,
+                     DHCPDISCOVER);
+
+  LOG_INFO(client->log_level, "[*] Sending DHCPDISCOVER, xid: 0x%08X\n",
+           client->xid);
 
-  uint8_t *opt = request_packet.options;
-  while (*opt != DHCP_OPTION_END) {
-    opt++;
+  dhcp_mark_sent(client);
+  if (send_dhcp_packet(client->io, &client->iface, &discover_packet) < 0) {
+    fprintf(stderr, "[-] Failed to send DHCPDISCOVER\n");
+    return -1;
   }
+  return 0;
+}
+
+static int dhcp_send_request(dhcp_client_t *client) {
+  dhcp_packet_t request_packet;
+  create_dhcp_packet(&request_packet, client->iface.mac, client->xid,
+                     DHCPREQUEST);
+
+  uint8_t *opt = dhcp_options_end(&request_packet);
 
   *opt++ = DHCP_OPTION_REQUESTED_IP;
   *opt++ = 4;
@@ -99,79 +399,943 @@ int dhcp_send_request(dhcp_client_t *client) {
 
   *opt = DHCP_OPTION_END;
 
-  printf("[*] Sending DHCPREQUEST, xid: 0x%08X\n", client->xid);
-  printf("    Requesting IP: %s\n", inet_ntoa(client->offered_ip));
-  printf("    To server: %s\n", inet_ntoa(client->server_ip));
+  LOG_INFO(client->log_level, "[*] Sending DHCPREQUEST, xid: 0x%08X\n",
+           client->xid);
+  LOG_INFO(client->log_level, "    Requesting IP: %s\n",
+           inet_ntoa(client->offered_ip));
+  LOG_INFO(client->log_level, "    To server: %s\n",
+           inet_ntoa(client->server_ip));
 
-  if (send_dhcp_packet(client->sock, client->mac, &request_packet,
-                       client->ifname) < 0) {
+  dhcp_mark_sent(client);
+  if (send_dhcp_packet(client->io, &client->iface, &request_packet) < 0) {
     fprintf(stderr, "[-] Failed to send DHCPREQUEST\n");
     return -1;
   }
   return 0;
 }
 
-int dhcp_receive_ack(dhcp_client_t *client) {
-  dhcp_packet_t ack_packet;
+// INIT-REBOOT (RFC 2131 4.3.2): broadcast REQUEST for the previous address,
+// no server identifier.
+static int dhcp_send_reboot_request(dhcp_client_t *client) {
+  dhcp_packet_t request_packet;
+  create_dhcp_packet(&request_packet, client->iface.mac, client->xid,
+                     DHCPREQUEST);
 
-  if (receive_dhcp_packet(client->sock, &ack_packet, client->xid,
-                          client->timeout_secs) == 0) {
-    int msg_type = parse_options(&ack_packet, client);
+  uint8_t *opt = dhcp_options_end(&request_packet);
 
-    if (msg_type == DHCPACK) {
-      set_ip_addr(client->ifname, client->offered_ip, client->subnet_mask);
+  *opt++ = DHCP_OPTION_REQUESTED_IP;
+  *opt++ = 4;
+  memcpy(opt, &client->offered_ip.s_addr, 4);
+  opt += 4;
 
-      if (client->router.s_addr != 0) {
-        add_default_router(client->ifname, client->router);
-      }
+  *opt = DHCP_OPTION_END;
 
-      return 0;
-    } else if (msg_type == DHCPNAK) {
-      printf("[-] Request denied\n");
-      return -1;
+  LOG_INFO(client->log_level,
+           "[*] Sending DHCPREQUEST (INIT-REBOOT), xid: 0x%08X\n",
+           client->xid);
+  LOG_INFO(client->log_level, "    Requesting IP: %s\n",
+           inet_ntoa(client->offered_ip));
+
+  dhcp_mark_sent(client);
+  if (send_dhcp_packet(client->io, &client->iface, &request_packet) < 0) {
+    fprintf(stderr, "[-] Failed to send DHCPREQUEST\n");
+    return -1;
+  }
+  return 0;
+}
+
+// RENEWING and REBINDING (RFC 2131 4.3.2, 4.4.5): ciaddr set, neither a
+// requested address nor a server identifier. At T1 the REQUEST goes only to
+// the server that granted the lease, at T2 it is broadcast from our address.
+static int dhcp_send_renew_request(dhcp_client_t *client, int rebind) {
+  static const uint8_t broadcast_mac[] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+  struct in_addr broadcast = {INADDR_BROADCAST};
+  dhcp_packet_t request_packet;
+  create_dhcp_packet(&request_packet, client->iface.mac, client->xid,
+                     DHCPREQUEST);
+  request_packet.flags = 0;
+  request_packet.ciaddr = client->offered_ip.s_addr;
+
+  LOG_INFO(client->log_level, "[*] Sending DHCPREQUEST (%s), xid: 0x%08X\n",
+           rebind ? "REBINDING" : "RENEWING", client->xid);
+  LOG_INFO(client->log_level, "    Client IP: %s\n",
+           inet_ntoa(client->offered_ip));
+  if (!rebind) {
+    LOG_INFO(client->log_level, "    To server: %s\n",
+             inet_ntoa(client->server_ip));
+  }
+
+  dhcp_mark_sent(client);
+  if (send_dhcp_unicast(client->io, &client->iface, &request_packet,
+                        rebind ? broadcast_mac : client->server_mac,
+                        client->offered_ip,
+                        rebind ? broadcast : client->server_ip) < 0) {
+    fprintf(stderr, "[-] Failed to send DHCPREQUEST\n");
+    return -1;
+  }
+  return 0;
+}
+
+static int mask_to_prefix_len(struct in_addr mask) {
+  return __builtin_popcount(mask.s_addr);
+}
+
+// Address, MTU and every route in one netlink batch, then resolv.conf and
+// the lease file: on the pipeline if there is room, otherwise right here.
+static void dhcp_apply_config(dhcp_client_t *client) {
+  if (client->pipeline && pipeline_submit(client->pipeline, client) == 0) {
+    client->config_pending++;
+    return;
+  }
+  // Older jobs of ours must not land after this one.
+  if (client->config_pending) {
+    pipeline_wait(client->pipeline, client, 0);
+  }
+  config_job_t job;
+  config_job_init(&job, client);
+  config_job_run(&job, &client->iface);
+}
+
+static void print_io_stats(const dhcp_client_t *client) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  long cpu_us = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000L +
+                usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+
+  DEBUG_PRINT(
+      client->log_level,
+      "I/O backend: %s, syscalls: %llu, tx: %llu, rx: %llu, CPU: %ld us\n",
+      client->io->ops->name, (unsigned long long)client->io->stats.syscalls,
+      (unsigned long long)client->io->stats.tx_frames,
+      (unsigned long long)client->io->stats.rx_frames, cpu_us);
+}
+
+static void dhcp_emit(dhcp_client_t *client, dhcpc_event_t event) {
+  client->last_event = event + 1;
+  client->event_counts[event]++;
+  if (!client->on_lease && !client->hooks) {
+    return;
+  }
+  if (event == DHCPC_EVENT_FAILED) {
+    if (client->hooks) {
+      hooks_run(client->hooks, client->iface.ifname, event, NULL);
+    }
+    if (client->on_lease) {
+      client->on_lease(client, event, NULL, client->cb_arg);
     }
+    return;
+  }
+
+  dhcpc_lease_t lease;
+  lease.address = client->offered_ip;
+  lease.netmask = client->subnet_mask;
+  lease.router = client->router;
+  lease.server = client->server_ip;
+  lease.lease_time = client->lease_time;
+  lease.dns = client->config.dns;
+  lease.dns_count = client->config.dns_count;
+  lease.route_count = client->config.route_count;
+  lease.mtu = client->config.mtu;
+  lease.search = client->config.search;
+  lease.offer_us = client->offer_us;
+  lease.ack_us = client->ack_us;
+  if (client->hooks) {
+    hooks_run(client->hooks, client->iface.ifname, event, &lease);
+  }
+  if (client->on_lease) {
+    client->on_lease(client, event, &lease, client->cb_arg);
   }
-  return -1;
 }
 
-void dhcp_client_run(const char *ifname, int timeout_secs, int retries) {
-  printf("Starting DHCP client on interface: %s\n", ifname);
+static void dhcp_learn_router_mac(dhcp_client_t *client) {
+  client->router_mac_valid = 0;
+  client->router_mac_pending =
+      client->arp_sock >= 0 && client->router.s_addr != 0 &&
+      arp_send(client->arp_sock, &client->iface, client->offered_ip,
+               client->router, NULL) == 0;
+}
 
-  dhcp_client_t *client = dhcp_client_init(ifname);
-  if (!client) {
+static void dhcp_start_discover(dhcp_client_t *client);
+static void dhcp_start_reboot(dhcp_client_t *client);
+
+static void dhcp_reconnect(dhcp_client_t *client, const char *reason,
+                           int try_dna) {
+  LOG_INFO(client->log_level, "[*] %s, reconnecting\n", reason);
+  client->reconnect_start_ms = monotonic_ms();
+
+  // A link that went down leaves ENETDOWN pending on the packet socket, which
+  // would fail the first send below. Reading SO_ERROR clears it.
+  if (client->sock >= 0) {
+    int err;
+    socklen_t err_len = sizeof(err);
+    getsockopt(client->sock, SOL_SOCKET, SO_ERROR, &err, &err_len);
+  }
+
+  // Detecting Network Attachment (RFC 4436): if the old gateway still answers
+  // a unicast ARP from its old MAC we are on the same link and keep the lease.
+  if (try_dna && client->router_mac_valid && client->arp_sock >= 0) {
+    dhcp_set_state(client, DHCP_STATE_PROBING);
+    client->dna_probes_left = DNA_PROBE_COUNT - 1;
+    arp_send(client->arp_sock, &client->iface, client->offered_ip,
+             client->router, client->router_mac);
+    dhcp_arm_timer(client, DNA_PROBE_TIMEOUT_MS);
+  } else {
+    dhcp_start_reboot(client);
+  }
+}
+
+static void dhcp_bound(dhcp_client_t *client, const char *how) {
+  dhcpc_event_t event = client->state == DHCP_STATE_REQUEST_SENT
+                            ? DHCPC_EVENT_BOUND
+                            : DHCPC_EVENT_RENEWED;
+
+  // A reachable gateway only confirms the lease we had; T1 does not move.
+  if (client->state != DHCP_STATE_PROBING) {
+    client->bound_at_ms = monotonic_ms();
+  }
+  dhcp_set_state(client, DHCP_STATE_BOUND);
+  dhcp_disarm_timer(client);
+
+  if (client->reconnect_start_ms) {
+    LOG_INFO(client->log_level, "[+] Connectivity restored in %llu ms (%s)\n",
+             (unsigned long long)(monotonic_ms() - client->reconnect_start_ms),
+             how);
+    client->reconnect_start_ms = 0;
+  }
+  if (!client->ever_bound) {
+    client->ever_bound = 1;
+    print_io_stats(client);
+  }
+
+  if (client->monitor) {
+    dhcp_learn_router_mac(client);
+    // T1 = lease / 2 and T2 = lease * 7 / 8 (RFC 2131 4.4.5): renew, then
+    // rebind with a REQUEST for the same address.
+    if (client->lease_time) {
+      uint64_t lease_ms = client->lease_time * 1000ULL;
+      dhcp_arm_lease_timer(client, &client->t1,
+                           client->bound_at_ms + lease_ms / 2);
+      dhcp_arm_lease_timer(client, &client->t2,
+                           client->bound_at_ms + lease_ms / 8 * 7);
+      dhcp_arm_lease_timer(client, &client->expiry,
+                           client->bound_at_ms + lease_ms);
+    }
+  }
+
+  // Not before the pipeline has installed the lease. A BOUND still waiting
+  // is not downgraded by a RENEWED behind it.
+  if (client->config_pending) {
+    if (!(client->config_pending > 1 &&
+          client->deferred_event == DHCPC_EVENT_BOUND)) {
+      client->deferred_event = event;
+    }
     return;
   }
-  client->timeout_secs = timeout_secs;
-  client->retries = retries;
+  dhcp_emit(client, event);
+}
 
-  for (int attempt = 1; attempt < client->retries; attempt++) {
-    printf("[*] Attempt %d\\%d\n", attempt, client->retries);
+void dhcp_config_done(dhcp_client_t *client, const config_done_t *done) {
+  client->iface.mtu = done->mtu;
+  if (--client->config_pending == 0 && dhcpc_is_bound(client)) {
+    dhcp_emit(client, client->deferred_event);
+  }
+  dhcp_publish(client);
+}
 
-    if (dhcp_send_discover(client) < 0) {
-      continue;
+// Out of attempts. A monitoring client that once held a lease keeps trying
+// every timeout_secs; anything else is done for good.
+static int dhcp_failed_for_good(const dhcp_client_t *client) {
+  return client->state == DHCP_STATE_FAILED &&
+         !(client->monitor && client->ever_bound);
+}
+
+static void dhcp_fail(dhcp_client_t *client) {
+  dhcp_set_state(client, DHCP_STATE_FAILED);
+  dhcp_disarm_timer(client);
+
+  if (client->reconnect_start_ms) {
+    fprintf(stderr, "[-] Reconnect failed after %llu ms\n",
+            (unsigned long long)(monotonic_ms() - client->reconnect_start_ms));
+    client->reconnect_start_ms = 0;
+  }
+  if (!dhcp_failed_for_good(client)) {
+    dhcp_arm_timer(client, client->timeout_secs * 1000ULL);
+    return;
+  }
+
+  dhcp_cancel_timers(client);
+  print_io_stats(client);
+  dhcp_emit(client, DHCPC_EVENT_FAILED);
+}
+
+// No answer to a renewal: the lease is still good, so try again at half the
+// time left until T2 (or until expiry once past T2), but no more often than
+// one exchange timeout. Past the last retry the next stage takes over.
+static void dhcp_retry_renewal(dhcp_client_t *client) {
+  uint64_t now = monotonic_ms();
+  uint64_t lease_ms = client->lease_time * 1000ULL;
+  uint64_t t2_at = client->bound_at_ms + lease_ms / 8 * 7;
+  uint64_t end_at = client->bound_at_ms + lease_ms;
+  if (now >= end_at) {
+    return;
+  }
+
+  tw_timer_t *timer = now < t2_at ? &client->t1 : &client->t2;
+  uint64_t left = (now < t2_at ? t2_at : end_at) - now;
+  uint64_t delay = left / 2;
+  if (delay < client->timeout_secs * 1000ULL) {
+    delay = client->timeout_secs * 1000ULL;
+  }
+  if (delay < left) {
+    tw_timer_schedule(client->wheel, timer, delay);
+  }
+}
+
+static void dhcp_start_discover(dhcp_client_t *client) {
+  if (client->attempt == 0) {
+    client->give_up_at_ms =
+        monotonic_ms() + client->retries * client->timeout_secs * 1000ULL;
+  }
+  while (++client->attempt < client->retries) {
+    LOG_INFO(client->log_level, "[*] Attempt %d\\%d\n", client->attempt,
+             client->retries);
+
+    dhcp_set_state(client, DHCP_STATE_INIT);
+    client->xid = dhcp_next_xid(client);
+
+    if (dhcp_send_discover(client) == 0) {
+      dhcp_set_state(client, DHCP_STATE_DISCOVER_SENT);
+      client->sends = 1;
+      dhcp_arm_timer(client, dhcp_rto_ms(client, DHCP_RTT_OFFER));
+      return;
     }
+  }
+  dhcp_fail(client);
+}
+
+// Starting over gives up whatever lease is left.
+static void dhcp_restart_discover(dhcp_client_t *client) {
+  tw_timer_cancel(client->wheel, &client->t1);
+  tw_timer_cancel(client->wheel, &client->t2);
+  tw_timer_cancel(client->wheel, &client->expiry);
+  client->attempt = 0;
+  dhcp_start_discover(client);
+}
 
-    if (dhcp_receive_offer(client) == 0) {
-      printf("[+] Successfully received DHCPOFFER\n");
+static void dhcp_start_reboot(dhcp_client_t *client) {
+  dhcp_set_state(client, DHCP_STATE_INIT_REBOOT);
+  client->xid = dhcp_next_xid(client);
+
+  if (dhcp_send_reboot_request(client) < 0) {
+    dhcp_set_state(client, DHCP_STATE_INIT);
+    dhcp_restart_discover(client);
+    return;
+  }
+  dhcp_set_state(client, DHCP_STATE_REBOOTING);
+  client->sends = 1;
+  dhcp_arm_timer(client, client->timeout_secs * 1000ULL);
+}
+
+// A failed send is retried like an unanswered one; the lease is still good.
+static void dhcp_start_renew(dhcp_client_t *client, int rebind) {
+  dhcp_set_state(client,
+                 rebind ? DHCP_STATE_REBINDING : DHCP_STATE_RENEWING);
+  client->xid = dhcp_next_xid(client);
+  client->sends = 1;
+  if (dhcp_send_renew_request(client, rebind) < 0) {
+    dhcp_retry_renewal(client);
+    return;
+  }
+  dhcp_arm_timer(client, client->timeout_secs * 1000ULL);
+}
+
+// src_mac is the Ethernet source of the frame msg came in.
+static void dhcp_handle_msg(dhcp_client_t *client, const dhcp_msg_t *msg,
+                            const uint8_t *src_mac) {
+  int msg_type = parse_options(msg, client);
+
+  switch (client->state) {
+    case DHCP_STATE_DISCOVER_SENT:
+      if (msg_type != DHCPOFFER) {
+        break;
+      }
+      dhcp_set_state(client, DHCP_STATE_OFFER_RECEIVED);
+      client->offer_us = dhcp_measure_reply(client, "DISCOVER->OFFER");
+      dhcp_rtt_sample(client, DHCP_RTT_OFFER, client->offer_us);
+      LOG_INFO(client->log_level, "[+] Successfully received DHCPOFFER\n");
       if (dhcp_send_request(client) < 0) {
-        continue;
+        dhcp_start_discover(client);
+        break;
       }
+      dhcp_set_state(client, DHCP_STATE_REQUEST_SENT);
+      client->sends = 1;
+      dhcp_arm_timer(client, dhcp_rto_ms(client, DHCP_RTT_ACK));
+      break;
 
-      if (dhcp_receive_ack(client) == 0) {
-        printf("[+] DHCP process completed successfully!\n");
-        printf("IP: %s\n", inet_ntoa(client->offered_ip));
-        printf("Mask: %s\n", inet_ntoa(client->subnet_mask));
-        printf("Router: %s\n", inet_ntoa(client->router));
-        printf("DNS: %s\n", inet_ntoa(client->dns));
+    case DHCP_STATE_REQUEST_SENT:
+      if (msg_type == DHCPACK || msg_type == DHCPNAK) {
+        client->ack_us = dhcp_measure_reply(client, "REQUEST->ACK");
+        dhcp_rtt_sample(client, DHCP_RTT_ACK, client->ack_us);
+      }
+      if (msg_type == DHCPACK) {
+        memcpy(client->server_mac, src_mac, 6);
+        dhcp_apply_config(client);
+        dhcp_bound(client, "DISCOVER");
+      } else if (msg_type == DHCPNAK) {
+        LOG_INFO(client->log_level, "[-] Request denied\n");
+        dhcp_start_discover(client);
+      }
+      break;
 
-        dhcp_client_cleanup(client);
-        return;
+    case DHCP_STATE_REBOOTING:
+    case DHCP_STATE_RENEWING:
+    case DHCP_STATE_REBINDING:
+      if (msg_type == DHCPACK || msg_type == DHCPNAK) {
+        client->offer_us = 0;
+        client->ack_us = dhcp_measure_reply(client, "REQUEST->ACK");
+        dhcp_rtt_sample(client, DHCP_RTT_ACK, client->ack_us);
+      }
+      if (msg_type == DHCPACK) {
+        const char *how = client->state == DHCP_STATE_REBOOTING ? "INIT-REBOOT"
+                          : client->state == DHCP_STATE_RENEWING
+                              ? "RENEWING"
+                              : "REBINDING";
+        memcpy(client->server_mac, src_mac, 6);
+        dhcp_apply_config(client);
+        dhcp_bound(client, how);
+      } else if (msg_type == DHCPNAK) {
+        LOG_INFO(client->log_level, "[-] Request denied\n");
+        dhcp_set_state(client, DHCP_STATE_INIT);
+        dhcp_restart_discover(client);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+// The same DISCOVER or REQUEST again, so a late reply to an earlier copy
+// still counts.
+static void dhcp_retransmit(dhcp_client_t *client) {
+  int discover = client->state == DHCP_STATE_DISCOVER_SENT;
+  int exchange = discover ? DHCP_RTT_OFFER : DHCP_RTT_ACK;
+  int adaptive = client->retransmit_policy == DHCPC_RETRANSMIT_ADAPTIVE;
+  uint64_t now = monotonic_ms();
+
+  if (adaptive ? now >= client->give_up_at_ms
+               : ++client->attempt >= client->retries) {
+    dhcp_fail(client);
+    return;
+  }
+  if (adaptive) {
+    if (client->rto_backoff[exchange] < DHCP_RTO_MAX_BACKOFF) {
+      client->rto_backoff[exchange]++;
+    }
+    LOG_INFO(client->log_level, "[*] Retransmitting %s\n",
+             discover ? "DHCPDISCOVER" : "DHCPREQUEST");
+  } else {
+    LOG_INFO(client->log_level, "[*] Attempt %d\\%d\n", client->attempt,
+             client->retries);
+  }
+
+  if ((discover ? dhcp_send_discover(client) : dhcp_send_request(client)) <
+      0) {
+    dhcp_fail(client);
+    return;
+  }
+
+  uint64_t delay;
+  if (adaptive) {
+    client->sends++;
+    delay = dhcp_rto_ms(client, exchange);
+    if (delay > client->give_up_at_ms - now) {
+      delay = client->give_up_at_ms - now;
+    }
+  } else {
+    delay = client->timeout_secs * 1000ULL << client->sends++;
+    if (delay > DHCP_BACKOFF_MAX_MS) {
+      delay = DHCP_BACKOFF_MAX_MS;
+    }
+    // +-1 s, but at most a quarter of the delay so short timeouts keep
+    // their order.
+    uint64_t jitter = delay / 4 < 1000 ? delay / 4 : 1000;
+    delay = delay - jitter + dhcp_next_xid(client) % (2 * jitter + 1);
+  }
+  dhcp_arm_timer(client, delay);
+}
+
+static void dhcp_handle_timeout(dhcp_client_t *client) {
+  switch (client->state) {
+    case DHCP_STATE_DISCOVER_SENT:
+    case DHCP_STATE_REQUEST_SENT:
+      DHCP_PROBE4(rx_drop, PROBE_DROP_TIMEOUT, client->xid, 0,
+                  DHCP_PROBE_TS(rx_drop));
+      if (client->state == DHCP_STATE_REQUEST_SENT) {
+        LOG_INFO(client->log_level, "[-] Failed to receive ACK/NAK\n");
+      }
+      if (client->retransmit_policy != DHCPC_RETRANSMIT_RESTART) {
+        dhcp_retransmit(client);
+      } else {
+        dhcp_start_discover(client);
+      }
+      break;
+
+    case DHCP_STATE_REBOOTING:
+      DHCP_PROBE4(rx_drop, PROBE_DROP_TIMEOUT, client->xid, 0,
+                  DHCP_PROBE_TS(rx_drop));
+      dhcp_set_state(client, DHCP_STATE_INIT);
+      dhcp_restart_discover(client);
+      break;
+
+    // Stays in its state; T1 or T2 brings the next try.
+    case DHCP_STATE_RENEWING:
+    case DHCP_STATE_REBINDING:
+      DHCP_PROBE4(rx_drop, PROBE_DROP_TIMEOUT, client->xid, 0,
+                  DHCP_PROBE_TS(rx_drop));
+      LOG_INFO(client->log_level, "[-] Lease not renewed\n");
+      dhcp_retry_renewal(client);
+      break;
+
+    case DHCP_STATE_PROBING:
+      if (client->dna_probes_left-- > 0) {
+        arp_send(client->arp_sock, &client->iface, client->offered_ip,
+                 client->router, client->router_mac);
+        dhcp_arm_timer(client, DNA_PROBE_TIMEOUT_MS);
       } else {
-        printf("[-] Failed to receive ACK/NAK\n");
+        dhcp_start_reboot(client);
+      }
+      break;
+
+    case DHCP_STATE_FAILED:
+      if (client->carrier) {
+        dhcp_reconnect(client, "Lease not renewed", 0);
       }
+      break;
+
+    default:
+      break;
+  }
+}
+
+static void dhcp_handle_lease_timer(dhcp_client_t *client,
+                                    const tw_timer_t *timer) {
+  if (timer == &client->expiry) {
+    LOG_INFO(client->log_level, "[-] Lease expired\n");
+    client->router_mac_valid = 0;  // DNA must not bring it back
+    dhcp_emit(client, DHCPC_EVENT_EXPIRED);
+    // A reconnect in progress is already asking for a new lease.
+    if (client->carrier && !client->reconnect_start_ms) {
+      dhcp_set_state(client, DHCP_STATE_INIT);
+      dhcp_restart_discover(client);
+    }
+    return;
+  }
+
+  // T1 and T2 (and their retries) only act on a lease we hold; a reconnect
+  // in progress has its own exchange.
+  if (!dhcpc_is_bound(client) || !client->carrier) {
+    return;
+  }
+  int rebind = timer == &client->t2;
+  LOG_INFO(client->log_level, "[*] %s lease\n",
+           rebind ? "Rebinding" : "Renewing");
+  // T2 is already past, so T1 cannot race it any more.
+  if (rebind) {
+    tw_timer_cancel(client->wheel, &client->t1);
+  }
+  dhcp_start_renew(client, rebind);
+}
+
+// Timers can fire from dhcpc_timers_process() on a shared wheel, outside
+// dhcpc_process(), so each one flushes what it queued.
+static void dhcp_on_timer(tw_timer_t *timer, void *arg) {
+  dhcp_client_t *client = arg;
+
+  if (timer == &client->retransmit) {
+    dhcp_handle_timeout(client);
+  } else {
+    dhcp_handle_lease_timer(client, timer);
+  }
+  io_flush(client->io);
+  dhcp_publish(client);
+}
+
+static void dhcp_handle_arp(dhcp_client_t *client) {
+  uint8_t mac[6];
+
+  if (client->state == DHCP_STATE_PROBING) {
+    if (arp_recv_reply(client->arp_sock, client->router, client->router_mac,
+                       NULL) == 1) {
+      // The kernel drops routes through a link that went down.
+      dhcp_apply_config(client);
+      dhcp_bound(client, "gateway reachable, lease kept");
+    }
+  } else if (arp_recv_reply(client->arp_sock, client->router, NULL, mac) ==
+                 1 &&
+             client->router_mac_pending) {
+    memcpy(client->router_mac, mac, sizeof(mac));
+    client->router_mac_valid = 1;
+    client->router_mac_pending = 0;
+    DEBUG_PRINT(client->log_level,
+                "Router MAC: %02X:%02X:%02X:%02X:%02X:%02X\n", mac[0], mac[1],
+                mac[2], mac[3], mac[4], mac[5]);
+  }
+}
+
+static int iface_has_carrier(const iface_ctx_t *iface) {
+  return (iface->flags & (IFF_UP | IFF_LOWER_UP)) == (IFF_UP | IFF_LOWER_UP);
+}
+
+// Returns a reason string if the event invalidates our connectivity. *try_dna
+// is cleared when the lease itself is gone and only a new ACK can restore it.
+static const char *dhcp_handle_link_event(dhcp_client_t *client,
+                                          const struct nlmsghdr *nlh,
+                                          int *try_dna) {
+  if (nlh->nlmsg_type == RTM_NEWLINK) {
+    if (!iface_ctx_update(&client->iface, nlh)) {
+      return NULL;
+    }
+    int now_up = iface_has_carrier(&client->iface);
+    int was_up = client->carrier;
+    client->carrier = now_up;
+
+    if (was_up && !now_up) {
+      LOG_INFO(client->log_level, "[-] Carrier lost on %s\n",
+               client->iface.ifname);
+      // Nothing can be sent until the carrier returns, which restarts the
+      // exchange anyway.
+      dhcp_disarm_timer(client);
+      if (client->ever_bound) {
+        dhcp_emit(client, DHCPC_EVENT_LINK_DOWN);
+      }
+    } else if (!was_up && now_up) {
+      return "Carrier up";
+    }
+  } else if (nlh->nlmsg_type == RTM_DELADDR) {
+    struct ifaddrmsg *ifa = NLMSG_DATA(nlh);
+    struct rtattr *tb[IFA_MAX + 1];
+    nl_parse_attrs(tb, IFA_MAX, IFA_RTA(ifa), IFA_PAYLOAD(nlh));
+
+    if ((int)ifa->ifa_index == client->iface.ifindex && tb[IFA_LOCAL] &&
+        *(uint32_t *)RTA_DATA(tb[IFA_LOCAL]) == client->offered_ip.s_addr &&
+        client->carrier && dhcpc_is_bound(client)) {
+      *try_dna = 0;
+      return "Leased address removed";
+    }
+  }
+  return NULL;
+}
+
+static void dhcp_handle_link_events(dhcp_client_t *client) {
+  uint8_t buf[NL_BUF_SIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
+  const char *reason = NULL;
+  int try_dna = 1;
+
+  while (1) {
+    ssize_t len = recv(client->link_events.fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (len < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == ENOBUFS) {
+        // Dropped notifications: resync from the kernel.
+        int was_up = client->carrier;
+        iface_ctx_refresh(&client->iface);
+        client->carrier = iface_has_carrier(&client->iface);
+        if (!was_up && client->carrier) {
+          reason = "Carrier up";
+        }
+        continue;
+      }
+      break;
+    }
+
+    for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len);
+         nlh = NLMSG_NEXT(nlh, len)) {
+      const char *r = dhcp_handle_link_event(client, nlh, &try_dna);
+      if (r) {
+        reason = r;
+      }
+    }
+  }
+
+  // Address lifetime updates and other tools can briefly replace the
+  // address, so make sure it is really gone.
+  if (reason && !try_dna &&
+      iface_ctx_has_addr(&client->iface, client->offered_ip) == 1) {
+    reason = NULL;
+  }
+  // Act once per batch so a burst of notifications costs one reconnect.
+  if (reason && client->carrier && client->state != DHCP_STATE_RELEASED) {
+    if (client->ever_bound) {
+      dhcp_reconnect(client, reason, try_dna);
+    } else {
+      dhcp_restart_discover(client);
+    }
+  }
+}
+
+static int dhcp_start_monitor(dhcp_client_t *client) {
+  if (nl_open(&client->link_events, RTMGRP_LINK | RTMGRP_IPV4_IFADDR) < 0) {
+    return -1;
+  }
+  if ((client->arp_sock = create_arp_socket(&client->iface)) < 0) {
+    return -1;
+  }
+  if (dhcp_watch_fd(client, client->link_events.fd) < 0 ||
+      dhcp_watch_fd(client, client->arp_sock) < 0) {
+    return -1;
+  }
+
+  iface_ctx_refresh(&client->iface);
+  client->carrier = iface_has_carrier(&client->iface);
+  LOG_INFO(client->log_level, "[*] Monitoring link state on %s\n",
+           client->iface.ifname);
+  return 0;
+}
+
+int dhcpc_start(dhcpc_t *client) {
+  client->carrier = 1;
+  if (client->monitor && dhcp_start_monitor(client) < 0) {
+    return -1;
+  }
+
+  client->attempt = 0;
+  dhcp_start_discover(client);
+  io_flush(client->io);
+  dhcp_publish(client);
+  return dhcp_failed_for_good(client) ? -1 : 0;
+}
+
+int dhcpc_get_fd(const dhcpc_t *client) { return client->epoll_fd; }
+
+int dhcpc_next_timeout_ms(const dhcpc_t *client) {
+  return client->own_wheel ? timer_wheel_next_timeout_ms(client->wheel) : -1;
+}
+
+int dhcpc_process(dhcpc_t *client, uint32_t events) {
+  (void)events;
+  uint8_t frame[2048];
+  dhcp_msg_t msg;
+  ssize_t n_bytes;
+
+  // Before the frames: a request's TX stamp is always queued before the
+  // reply to it can arrive.
+  if (client->sock >= 0) {
+    int64_t tx_ts = sock_read_tx_timestamp(client->sock);
+    if (tx_ts) {
+      client->tx_ts_ns = tx_ts;
     }
   }
-  fprintf(stderr, "[-] DHCP process failed after %d attempts.\n",
-          client->retries);
-  dhcp_client_cleanup(client);
-}
\ No newline at end of file
+
+  if (client->link_events.fd >= 0) {
+    dhcp_handle_link_events(client);
+  }
+  if (client->arp_sock >= 0) {
+    dhcp_handle_arp(client);
+  }
+
+  while ((n_bytes = io_recv(client->io, frame, sizeof(frame), 0)) > 0) {
+    int reason = dhcp_parse_frame(frame, n_bytes, client->xid, &msg);
+    if (reason) {
+      DEBUG_PRINT(client->log_level, "Dropped %zd byte frame: %s\n", n_bytes,
+                  dhcp_drop_reason(reason));
+      continue;
+    }
+    if (client->capture) {
+      capture_frame(client->capture, frame, n_bytes, client->io->rx_ts_ns);
+    }
+    dhcp_handle_msg(client, &msg, ((const eth_header_t *)frame)->src_mac);
+  }
+
+  // After the frames, so a reply that raced its timeout still counts.
+  if (client->own_wheel) {
+    timer_wheel_run(client->wheel);
+  }
+
+  io_flush(client->io);
+  dhcp_publish(client);
+  return dhcp_failed_for_good(client) ? -1 : 0;
+}
+
+// A lease we can still give back: bound, being renewed or reconnected, or
+// not yet expired after the retries ran out.
+static int dhcp_holds_lease(const dhcp_client_t *client) {
+  switch (client->state) {
+    case DHCP_STATE_BOUND:
+    case DHCP_STATE_RENEWING:
+    case DHCP_STATE_REBINDING:
+    case DHCP_STATE_PROBING:
+      return 1;
+    case DHCP_STATE_INIT_REBOOT:
+    case DHCP_STATE_REBOOTING:
+      return client->ever_bound;
+    case DHCP_STATE_FAILED:
+      return tw_timer_pending(&client->expiry);
+    default:
+      return 0;
+  }
+}
+
+// Keeps only the server's response times in the lease file, for the next
+// run's timeouts.
+static void dhcp_drop_lease_file(dhcp_client_t *client) {
+  lease_record_t lease;
+  memset(&lease, 0, sizeof(lease));
+  memcpy(lease.rtt, client->rtt, sizeof(lease.rtt));
+  if (!lease.rtt[DHCP_RTT_OFFER].srtt_us && !lease.rtt[DHCP_RTT_ACK].srtt_us) {
+    unlink(client->lease_file);
+  } else {
+    lease_file_write(client->lease_file, &lease);
+  }
+}
+
+// Takes over the lease a previous process recorded in the lease file.
+static int dhcp_load_lease(dhcp_client_t *client) {
+  lease_record_t lease;
+  if (!client->lease_file || lease_file_read(client->lease_file, &lease) < 0) {
+    LOG_INFO(client->log_level, "[*] No lease to release\n");
+    return -1;
+  }
+  if (lease.expires <= realtime_ns() / 1000000000) {
+    LOG_INFO(client->log_level, "[*] Lease already expired\n");
+    dhcp_drop_lease_file(client);
+    return -1;
+  }
+
+  client->offered_ip = lease.address;
+  client->subnet_mask.s_addr =
+      htonl(lease.prefix_len ? ~0u << (32 - lease.prefix_len) : 0);
+  client->server_ip = lease.server;
+  memcpy(client->server_mac, lease.server_mac, 6);
+  client->config.route_count = lease.route_count;
+  memcpy(client->config.routes, lease.routes,
+         lease.route_count * sizeof(ipv4_route_t));
+  return 0;
+}
+
+// RFC 2131 4.4.6: unicast to the server with ciaddr set; nothing comes back.
+static int dhcp_send_release(dhcp_client_t *client) {
+  dhcp_packet_t packet;
+  client->xid = dhcp_next_xid(client);
+  create_dhcp_packet(&packet, client->iface.mac, client->xid, DHCPRELEASE);
+  packet.flags = 0;
+  packet.ciaddr = client->offered_ip.s_addr;
+
+  // Only 53, the client identifier and 54: a RELEASE carries neither a
+  // parameter request list nor a maximum message size.
+  uint8_t *opt = packet.options;
+  memset(opt, 0, sizeof(packet.options));
+  *opt++ = DHCP_OPTION_MSG_TYPE;
+  *opt++ = 1;
+  *opt++ = DHCPRELEASE;
+  *opt++ = DHCP_OPTION_CLIENT_ID;
+  *opt++ = 7;
+  *opt++ = DHCP_HTYPE_ETHERNET;
+  memcpy(opt, client->iface.mac, 6);
+  opt += 6;
+  *opt++ = DHCP_OPTION_DHCP_SERVER;
+  *opt++ = 4;
+  memcpy(opt, &client->server_ip.s_addr, 4);
+  opt += 4;
+  *opt = DHCP_OPTION_END;
+
+  LOG_INFO(client->log_level, "[*] Sending DHCPRELEASE, xid: 0x%08X\n",
+           client->xid);
+  LOG_INFO(client->log_level, "    Releasing IP: %s\n",
+           inet_ntoa(client->offered_ip));
+  LOG_INFO(client->log_level, "    To server: %s\n",
+           inet_ntoa(client->server_ip));
+
+  if (send_dhcp_unicast(client->io, &client->iface, &packet,
+                        client->server_mac, client->offered_ip,
+                        client->server_ip) < 0) {
+    fprintf(stderr, "[-] Failed to send DHCPRELEASE\n");
+    return -1;
+  }
+  return 0;
+}
+
+int dhcpc_release(dhcpc_t *client) {
+  if (!dhcp_holds_lease(client) && dhcp_load_lease(client) < 0) {
+    return -1;
+  }
+
+  dhcp_cancel_timers(client);
+  // Nothing may be installed after it was removed.
+  if (client->config_pending) {
+    pipeline_wait(client->pipeline, client, 0);
+  }
+  int ret = dhcp_send_release(client);
+  io_flush(client->io);
+  dhcp_set_state(client, DHCP_STATE_RELEASED);
+  client->ever_bound = 0;
+  client->router_mac_valid = 0;
+
+  if (client->configure) {
+    iface_ctx_unconfigure(&client->iface, client->offered_ip,
+                          mask_to_prefix_len(client->subnet_mask),
+                          client->config.routes, client->config.route_count);
+  }
+  if (client->lease_file) {
+    dhcp_drop_lease_file(client);
+  }
+  dhcp_publish(client);
+  return ret;
+}
+
+int dhcpc_is_bound(const dhcpc_t *client) {
+  return client->state == DHCP_STATE_BOUND ||
+         client->state == DHCP_STATE_RENEWING ||
+         client->state == DHCP_STATE_REBINDING;
+}
+
+const char *dhcpc_event_name(dhcpc_event_t event) {
+  switch (event) {
+    case DHCPC_EVENT_BOUND:
+      return "bound";
+    case DHCPC_EVENT_RENEWED:
+      return "renewed";
+    case DHCPC_EVENT_LINK_DOWN:
+      return "link-down";
+    case DHCPC_EVENT_FAILED:
+      return "failed";
+    case DHCPC_EVENT_EXPIRED:
+      return "expired";
+  }
+  return "unknown";
+}
+
+dhcpc_timers_t *dhcpc_timers_new(void) {
+  timer_wheel_t *tw = malloc(sizeof(timer_wheel_t));
+  if (!tw) {
+    perror("malloc");
+    return NULL;
+  }
+  if (timer_wheel_init(tw, DHCP_TICK_MS, 1) < 0) {
+    free(tw);
+    return NULL;
+  }
+  return tw;
+}
+
+void dhcpc_timers_free(dhcpc_timers_t *timers) {
+  if (timers) {
+    timer_wheel_destroy(timers);
+    free(timers);
+  }
+}
+
+int dhcpc_timers_get_fd(const dhcpc_timers_t *timers) {
+  return timers->timer_fd;
+}
+
+int dhcpc_timers_next_timeout_ms(const dhcpc_timers_t *timers) {
+  return timer_wheel_next_timeout_ms(timers);
+}
+
+int dhcpc_timers_process(dhcpc_timers_t *timers) {
+  return timer_wheel_run(timers);
+}
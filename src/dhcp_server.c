@@ -0,0 +1,837 @@
+#define _GNU_SOURCE  // recvmmsg(), sendmmsg()
+
+#include "dhcp_server.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "addr_pool.h"
+#include "dhcp.h"
+#include "network_utils.h"
+#include "packet_utils.h"
+
+#define RX_FRAME 2048
+#define TX_FRAME                                                  \
+  (sizeof(eth_header_t) + sizeof(ip_header_t) + sizeof(udp_header_t) + \
+   sizeof(dhcp_packet_t))
+#define OFFER_SECS 30
+// Leases the expiry hand looks at per request. Expired leases are also
+// dropped when their client comes back and when the pool runs out.
+#define SWEEP_STEP 4
+#define LOG_BUF_RECORDS 1024
+#define LOG_MAGIC "DHCPLOG1"
+#define SOCKET_BUFFER (8 << 20)
+#define NO_LEASE UINT32_MAX
+
+enum { LEASE_FREE, LEASE_OFFERED, LEASE_BOUND, LEASE_DECLINED };
+enum { LOG_BOUND = 1, LOG_FREE, LOG_DECLINED };
+
+typedef struct {
+  uint8_t chaddr[6];
+  uint8_t state;  // LEASE_*
+  uint8_t pad;
+  uint32_t expires;  // CLOCK_REALTIME seconds
+} lease_t;
+
+// The lease log is LOG_MAGIC followed by these, oldest first. A record cut
+// short by a crash is ignored.
+typedef struct {
+  uint32_t addr;  // network byte order
+  uint32_t expires;
+  uint8_t chaddr[6];
+  uint8_t type;  // LOG_*
+  uint8_t pad;
+} lease_log_record_t;
+
+typedef struct {
+  uint8_t msg_type;
+  uint32_t requested;  // option 50, network byte order
+  uint32_t server_id;  // option 54
+} request_opts_t;
+
+struct dhcp_server {
+  dhcp_server_config_t config;
+  uint32_t first;  // host byte order
+  uint32_t subnet;
+  uint32_t mask;
+  addr_pool_t pool;
+  lease_t *leases;  // by pool offset
+  uint32_t *index;  // chaddr -> offset, NO_LEASE = empty
+  uint32_t index_mask;
+  int index_bits;
+  uint32_t sweep;
+  uint32_t now;
+  iface_ctx_t iface;
+  int sock;
+  int log_fd;
+  lease_log_record_t *log_buf;
+  size_t log_count;
+  dhcp_server_stats_t stats;
+  uint8_t (*rx)[RX_FRAME];
+  uint8_t (*tx)[TX_FRAME];
+  struct mmsghdr rx_msgs[DHCP_SERVER_BATCH];
+  struct mmsghdr tx_msgs[DHCP_SERVER_BATCH];
+  struct iovec rx_iov[DHCP_SERVER_BATCH];
+  struct iovec tx_iov[DHCP_SERVER_BATCH];
+  struct sockaddr_ll tx_dst[DHCP_SERVER_BATCH];
+};
+
+void dhcp_server_config_init(dhcp_server_config_t *config) {
+  memset(config, 0, sizeof(dhcp_server_config_t));
+  config->lease_secs = 3600;
+}
+
+static uint32_t index_home(const dhcp_server_t *srv, const uint8_t *chaddr) {
+  uint64_t key = 0;
+  memcpy(&key, chaddr, 6);
+  return (uint32_t)((key * 0x9e3779b97f4a7c15ULL) >> (64 - srv->index_bits));
+}
+
+static uint32_t index_lookup(const dhcp_server_t *srv,
+                             const uint8_t *chaddr) {
+  uint32_t i = index_home(srv, chaddr);
+  for (;;) {
+    uint32_t offset = srv->index[i];
+    if (offset == NO_LEASE ||
+        memcmp(srv->leases[offset].chaddr, chaddr, 6) == 0) {
+      return offset;
+    }
+    i = (i + 1) & srv->index_mask;
+  }
+}
+
+static void index_insert(dhcp_server_t *srv, uint32_t offset) {
+  uint32_t i = index_home(srv, srv->leases[offset].chaddr);
+  while (srv->index[i] != NO_LEASE) {
+    i = (i + 1) & srv->index_mask;
+  }
+  srv->index[i] = offset;
+}
+
+// Backward-shift deletion, as in client_table.c.
+static void index_remove(dhcp_server_t *srv, uint32_t offset) {
+  uint32_t mask = srv->index_mask;
+  uint32_t i = index_home(srv, srv->leases[offset].chaddr);
+  while (srv->index[i] != offset) {
+    if (srv->index[i] == NO_LEASE) {
+      return;
+    }
+    i = (i + 1) & mask;
+  }
+
+  for (uint32_t j = (i + 1) & mask; srv->index[j] != NO_LEASE;
+       j = (j + 1) & mask) {
+    uint32_t home = index_home(srv, srv->leases[srv->index[j]].chaddr);
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      srv->index[i] = srv->index[j];
+      i = j;
+    }
+  }
+  srv->index[i] = NO_LEASE;
+}
+
+static uint32_t addr_offset(const dhcp_server_t *srv, uint32_t addr) {
+  uint32_t offset = ntohl(addr) - srv->first;
+  return offset < srv->pool.size ? offset : NO_LEASE;
+}
+
+static uint32_t offset_addr(const dhcp_server_t *srv, uint32_t offset) {
+  return htonl(srv->first + offset);
+}
+
+// offset must already be taken from the pool.
+static void lease_assign(dhcp_server_t *srv, uint32_t offset,
+                         const uint8_t *chaddr, int state, uint32_t expires) {
+  lease_t *lease = &srv->leases[offset];
+  memcpy(lease->chaddr, chaddr, 6);
+  lease->state = state;
+  lease->expires = expires;
+  index_insert(srv, offset);
+  srv->stats.leases++;
+}
+
+static void lease_drop(dhcp_server_t *srv, uint32_t offset) {
+  lease_t *lease = &srv->leases[offset];
+  if (lease->state == LEASE_FREE) {
+    return;
+  }
+  if (lease->state != LEASE_DECLINED) {
+    index_remove(srv, offset);
+    srv->stats.leases--;
+  }
+  memset(lease, 0, sizeof(lease_t));
+  addr_pool_release(&srv->pool, offset);
+}
+
+static int lease_expired(const dhcp_server_t *srv, uint32_t offset) {
+  const lease_t *lease = &srv->leases[offset];
+  return lease->state != LEASE_FREE && lease->expires <= srv->now;
+}
+
+static void sweep(dhcp_server_t *srv, uint32_t steps) {
+  while (steps--) {
+    if (lease_expired(srv, srv->sweep)) {
+      lease_drop(srv, srv->sweep);
+    }
+    if (++srv->sweep == srv->pool.size) {
+      srv->sweep = 0;
+    }
+  }
+}
+
+// The client's current lease, if it has one that has not run out.
+static uint32_t find_lease(dhcp_server_t *srv, const uint8_t *chaddr) {
+  uint32_t offset = index_lookup(srv, chaddr);
+  if (offset != NO_LEASE && lease_expired(srv, offset)) {
+    lease_drop(srv, offset);
+    return NO_LEASE;
+  }
+  return offset;
+}
+
+// The requested offset if it can be had, else the lowest free one.
+static uint32_t alloc_offset(dhcp_server_t *srv, uint32_t requested) {
+  if (requested != NO_LEASE) {
+    if (lease_expired(srv, requested)) {
+      lease_drop(srv, requested);
+    }
+    if (addr_pool_take(&srv->pool, requested) == 0) {
+      return requested;
+    }
+  }
+  uint32_t offset = addr_pool_alloc(&srv->pool);
+  if (offset == ADDR_POOL_NONE) {
+    sweep(srv, srv->pool.size);
+    offset = addr_pool_alloc(&srv->pool);
+  }
+  return offset == ADDR_POOL_NONE ? NO_LEASE : offset;
+}
+
+static void log_append(dhcp_server_t *srv, uint32_t offset, int type) {
+  if (srv->log_fd < 0) {
+    return;
+  }
+  if (srv->log_count == LOG_BUF_RECORDS) {
+    dhcp_server_flush_log(srv);
+  }
+  lease_log_record_t *record = &srv->log_buf[srv->log_count++];
+  memset(record, 0, sizeof(lease_log_record_t));
+  record->addr = offset_addr(srv, offset);
+  record->expires = srv->leases[offset].expires;
+  memcpy(record->chaddr, srv->leases[offset].chaddr, 6);
+  record->type = type;
+}
+
+int dhcp_server_flush_log(dhcp_server_t *srv) {
+  if (srv->log_fd < 0 || srv->log_count == 0) {
+    return 0;
+  }
+  const uint8_t *buf = (const uint8_t *)srv->log_buf;
+  size_t left = srv->log_count * sizeof(lease_log_record_t);
+  srv->log_count = 0;
+  while (left > 0) {
+    ssize_t n = write(srv->log_fd, buf, left);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("[-] write() lease log");
+      return -1;
+    }
+    buf += n;
+    left -= n;
+    srv->stats.log_bytes += n;
+  }
+  if (srv->config.sync && fdatasync(srv->log_fd) < 0) {
+    perror("[-] fdatasync() lease log");
+    return -1;
+  }
+  return 0;
+}
+
+static void log_lease(const dhcp_server_t *srv, const char *what,
+                      uint32_t offset) {
+  char addr[INET_ADDRSTRLEN];
+  uint32_t ip = offset_addr(srv, offset);
+  const uint8_t *mac = srv->leases[offset].chaddr;
+  printf("[*] %s %s %02x:%02x:%02x:%02x:%02x:%02x\n", what,
+         inet_ntop(AF_INET, &ip, addr, sizeof(addr)), mac[0], mac[1], mac[2],
+         mac[3], mac[4], mac[5]);
+}
+
+static uint8_t *put_option(uint8_t *opt, uint8_t code, const void *value,
+                           uint8_t len) {
+  *opt++ = code;
+  *opt++ = len;
+  memcpy(opt, value, len);
+  return opt + len;
+}
+
+// Fills reply (a frame of TX_FRAME bytes) and dst. RFC 2131 4.1: a renewing
+// client (ciaddr set) gets a unicast to ciaddr, one that asked for it or a
+// NAK gets a broadcast, and anyone else a unicast to chaddr and yiaddr.
+static size_t build_reply(const dhcp_server_t *srv, const dhcp_packet_t *req,
+                          uint8_t type, uint32_t yiaddr, uint8_t *frame,
+                          struct sockaddr_ll *dst) {
+  static const uint8_t bcast[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+  dhcp_packet_t *reply =
+      (dhcp_packet_t *)(frame + sizeof(eth_header_t) + sizeof(ip_header_t) +
+                        sizeof(udp_header_t));
+  memset(reply, 0, sizeof(dhcp_packet_t));
+  reply->op = BOOTREPLY;
+  reply->htype = DHCP_HTYPE_ETHERNET;
+  reply->hlen = DHCP_HLEN_ETHERNET;
+  reply->xid = req->xid;
+  reply->flags = req->flags;
+  if (type == DHCPACK) {
+    reply->ciaddr = req->ciaddr;
+  }
+  reply->yiaddr = yiaddr;
+  memcpy(reply->chaddr, req->chaddr, 16);
+  reply->magic_cookie = htonl(DHCP_MAGIC_COOKIE);
+
+  uint32_t server = srv->config.server.s_addr;
+  uint8_t *opt = reply->options;
+  opt = put_option(opt, DHCP_OPTION_MSG_TYPE, &type, 1);
+  opt = put_option(opt, DHCP_OPTION_DHCP_SERVER, &server, 4);
+  if (type != DHCPNAK) {
+    uint32_t lease_secs = htonl(srv->config.lease_secs);
+    uint32_t mask = htonl(srv->mask);
+    opt = put_option(opt, DHCP_OPTION_LEASE_TIME, &lease_secs, 4);
+    opt = put_option(opt, DHCP_OPTION_SUBNET_MASK, &mask, 4);
+    if (srv->config.router.s_addr) {
+      opt = put_option(opt, DHCP_OPTION_ROUTER, &srv->config.router, 4);
+    }
+    if (srv->config.dns.s_addr) {
+      opt = put_option(opt, DHCP_OPTION_DNS_SERVER, &srv->config.dns, 4);
+    }
+  }
+  *opt = DHCP_OPTION_END;
+
+  const uint8_t *dst_mac = req->chaddr;
+  uint32_t dst_ip = yiaddr;
+  if (type == DHCPACK && req->ciaddr) {
+    dst_ip = req->ciaddr;
+  } else if (type == DHCPNAK || (ntohs(req->flags) & 0x8000)) {
+    dst_mac = bcast;
+    dst_ip = INADDR_BROADCAST;
+  }
+  create_header(frame, (uint8_t *)srv->iface.mac, (uint8_t *)dst_mac, server,
+                dst_ip, DHCP_PORT_SERVER, DHCP_PORT_CLIENT,
+                sizeof(dhcp_packet_t));
+
+  memset(dst, 0, sizeof(struct sockaddr_ll));
+  dst->sll_family = AF_PACKET;
+  dst->sll_protocol = htons(ETH_P_IP);
+  dst->sll_ifindex = srv->iface.ifindex;
+  dst->sll_halen = 6;
+  memcpy(dst->sll_addr, dst_mac, 6);
+  return TX_FRAME;
+}
+
+// Checks that frame is a BOOTREQUEST to port 67 and reads the options the
+// server acts on. Returns the request, or NULL.
+static const dhcp_packet_t *parse_request(const uint8_t *frame, size_t len,
+                                          request_opts_t *opts) {
+  if (len < sizeof(eth_header_t) + sizeof(ip_header_t)) {
+    return NULL;
+  }
+  const eth_header_t *eth = (const eth_header_t *)frame;
+  const ip_header_t *ip = (const ip_header_t *)(frame + sizeof(eth_header_t));
+  size_t ip_len = ip->ihl * 4;
+  size_t headers = sizeof(eth_header_t) + ip_len + sizeof(udp_header_t);
+  if (ntohs(eth->eth_type) != ETH_P_IP || ip_len < sizeof(ip_header_t) ||
+      ip->protocol != IPPROTO_UDP || (ntohs(ip->frag_off) & 0x3fff) ||
+      len < headers + offsetof(dhcp_packet_t, options)) {
+    return NULL;
+  }
+  const udp_header_t *udp =
+      (const udp_header_t *)(frame + sizeof(eth_header_t) + ip_len);
+  const dhcp_packet_t *req = (const dhcp_packet_t *)(frame + headers);
+  if (ntohs(udp->dest) != DHCP_PORT_SERVER || req->op != BOOTREQUEST ||
+      req->htype != DHCP_HTYPE_ETHERNET || req->hlen != DHCP_HLEN_ETHERNET ||
+      req->magic_cookie != htonl(DHCP_MAGIC_COOKIE)) {
+    return NULL;
+  }
+
+  memset(opts, 0, sizeof(request_opts_t));
+  const uint8_t *opt = req->options;
+  const uint8_t *end = frame + len;
+  while (opt + 2 <= end && *opt != DHCP_OPTION_END) {
+    if (*opt == 0) {
+      opt++;
+      continue;
+    }
+    if (opt + 2 + opt[1] > end) {
+      break;
+    }
+    if (opt[0] == DHCP_OPTION_MSG_TYPE && opt[1] == 1) {
+      opts->msg_type = opt[2];
+    } else if (opt[0] == DHCP_OPTION_REQUESTED_IP && opt[1] == 4) {
+      memcpy(&opts->requested, opt + 2, 4);
+    } else if (opt[0] == DHCP_OPTION_DHCP_SERVER && opt[1] == 4) {
+      memcpy(&opts->server_id, opt + 2, 4);
+    }
+    opt += 2 + opt[1];
+  }
+  return opts->msg_type ? req : NULL;
+}
+
+static size_t handle_discover(dhcp_server_t *srv, const dhcp_packet_t *req,
+                              const request_opts_t *opts, uint8_t *reply,
+                              struct sockaddr_ll *dst) {
+  uint32_t offset = find_lease(srv, req->chaddr);
+  if (offset == NO_LEASE) {
+    offset = alloc_offset(srv, addr_offset(srv, opts->requested));
+    if (offset == NO_LEASE) {
+      srv->stats.exhausted++;
+      return 0;
+    }
+    lease_assign(srv, offset, req->chaddr, LEASE_OFFERED,
+                 srv->now + OFFER_SECS);
+  } else if (srv->leases[offset].state == LEASE_OFFERED) {
+    srv->leases[offset].expires = srv->now + OFFER_SECS;
+  }
+  srv->stats.offers++;
+  return build_reply(srv, req, DHCPOFFER, offset_addr(srv, offset), reply,
+                     dst);
+}
+
+static size_t handle_request(dhcp_server_t *srv, const dhcp_packet_t *req,
+                             const request_opts_t *opts, uint8_t *reply,
+                             struct sockaddr_ll *dst) {
+  uint32_t server = srv->config.server.s_addr;
+  uint32_t offset = find_lease(srv, req->chaddr);
+  if (opts->server_id && opts->server_id != server) {
+    // The client took another server's offer.
+    if (offset != NO_LEASE && srv->leases[offset].state == LEASE_OFFERED) {
+      lease_drop(srv, offset);
+    }
+    return 0;
+  }
+
+  uint32_t requested = opts->requested ? opts->requested : req->ciaddr;
+  uint32_t wanted = addr_offset(srv, requested);
+  if (offset == NO_LEASE && !opts->server_id && wanted != NO_LEASE) {
+    // INIT-REBOOT or renewal that we have no record of, e.g. after a
+    // restart without a lease log: the address is the client's if free.
+    if (lease_expired(srv, wanted)) {
+      lease_drop(srv, wanted);
+    }
+    if (addr_pool_take(&srv->pool, wanted) == 0) {
+      lease_assign(srv, wanted, req->chaddr, LEASE_BOUND, 0);
+      offset = wanted;
+    }
+  } else if (offset == NO_LEASE && !opts->server_id &&
+             (ntohl(requested) & srv->mask) == srv->subnet) {
+    // On our subnet but outside the pool: not ours to refuse.
+    return 0;
+  }
+
+  if (offset == NO_LEASE || offset != wanted) {
+    srv->stats.naks++;
+    return build_reply(srv, req, DHCPNAK, 0, reply, dst);
+  }
+  lease_t *lease = &srv->leases[offset];
+  lease->state = LEASE_BOUND;
+  lease->expires = srv->now + srv->config.lease_secs;
+  log_append(srv, offset, LOG_BOUND);
+  if (srv->config.verbose) {
+    log_lease(srv, "DHCPACK", offset);
+  }
+  srv->stats.acks++;
+  return build_reply(srv, req, DHCPACK, requested, reply, dst);
+}
+
+static void handle_release(dhcp_server_t *srv, const dhcp_packet_t *req) {
+  uint32_t offset = index_lookup(srv, req->chaddr);
+  if (offset == NO_LEASE || offset != addr_offset(srv, req->ciaddr)) {
+    return;
+  }
+  if (srv->config.verbose) {
+    log_lease(srv, "DHCPRELEASE", offset);
+  }
+  log_append(srv, offset, LOG_FREE);
+  lease_drop(srv, offset);
+  srv->stats.releases++;
+}
+
+// The address is in use by someone else: keep it out of the pool for a
+// lease time.
+static void handle_decline(dhcp_server_t *srv, const dhcp_packet_t *req,
+                           const request_opts_t *opts) {
+  uint32_t offset = index_lookup(srv, req->chaddr);
+  if (offset == NO_LEASE || offset != addr_offset(srv, opts->requested)) {
+    return;
+  }
+  if (srv->config.verbose) {
+    log_lease(srv, "DHCPDECLINE", offset);
+  }
+  lease_t *lease = &srv->leases[offset];
+  index_remove(srv, offset);
+  srv->stats.leases--;
+  memset(lease->chaddr, 0, 6);
+  lease->state = LEASE_DECLINED;
+  lease->expires = srv->now + srv->config.lease_secs;
+  log_append(srv, offset, LOG_DECLINED);
+  srv->stats.declines++;
+}
+
+size_t dhcp_server_handle_frame(dhcp_server_t *srv, const uint8_t *frame,
+                                size_t len, uint8_t *reply,
+                                struct sockaddr_ll *dst) {
+  request_opts_t opts;
+  const dhcp_packet_t *req = parse_request(frame, len, &opts);
+  srv->stats.received++;
+  if (!req || req->giaddr) {
+    srv->stats.ignored++;
+    return 0;
+  }
+
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+  srv->now = (uint32_t)ts.tv_sec;
+  sweep(srv, SWEEP_STEP);
+
+  switch (opts.msg_type) {
+    case DHCPDISCOVER:
+      return handle_discover(srv, req, &opts, reply, dst);
+    case DHCPREQUEST:
+      return handle_request(srv, req, &opts, reply, dst);
+    case DHCPRELEASE:
+      handle_release(srv, req);
+      return 0;
+    case DHCPDECLINE:
+      handle_decline(srv, req, &opts);
+      return 0;
+    default:
+      srv->stats.ignored++;
+      return 0;
+  }
+}
+
+static void replay_record(dhcp_server_t *srv,
+                          const lease_log_record_t *record) {
+  uint32_t offset = addr_offset(srv, record->addr);
+  if (offset == NO_LEASE) {
+    return;  // the pool has changed since
+  }
+  lease_drop(srv, offset);
+  if (record->type == LOG_BOUND) {
+    // One lease per client: a later address replaces an earlier one.
+    uint32_t previous = index_lookup(srv, record->chaddr);
+    if (previous != NO_LEASE) {
+      lease_drop(srv, previous);
+    }
+    addr_pool_take(&srv->pool, offset);
+    lease_assign(srv, offset, record->chaddr, LEASE_BOUND, record->expires);
+  } else if (record->type == LOG_DECLINED) {
+    addr_pool_take(&srv->pool, offset);
+    srv->leases[offset].state = LEASE_DECLINED;
+    srv->leases[offset].expires = record->expires;
+  }
+}
+
+static int log_replay(dhcp_server_t *srv, const char *path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return 0;
+    }
+    perror("[-] open() lease log");
+    return -1;
+  }
+
+  char magic[sizeof(LOG_MAGIC) - 1];
+  ssize_t n = read(fd, magic, sizeof(magic));
+  if (n == 0) {
+    close(fd);
+    return 0;
+  }
+  if (n != (ssize_t)sizeof(magic) || memcmp(magic, LOG_MAGIC, n) != 0) {
+    fprintf(stderr, "[-] %s is not a lease log\n", path);
+    close(fd);
+    return -1;
+  }
+
+  size_t have = 0;
+  uint8_t *buf = (uint8_t *)srv->log_buf;
+  size_t size = LOG_BUF_RECORDS * sizeof(lease_log_record_t);
+  while ((n = read(fd, buf + have, size - have)) > 0) {
+    have += n;
+    size_t whole = have / sizeof(lease_log_record_t);
+    for (size_t i = 0; i < whole; i++) {
+      replay_record(srv, &srv->log_buf[i]);
+    }
+    have -= whole * sizeof(lease_log_record_t);
+    memmove(buf, buf + whole * sizeof(lease_log_record_t), have);
+  }
+  close(fd);
+  if (n < 0) {
+    perror("[-] read() lease log");
+    return -1;
+  }
+
+  // What ran out while the server was down.
+  srv->now = (uint32_t)time(NULL);
+  sweep(srv, srv->pool.size);
+  return 0;
+}
+
+// Rewrites the log with one record per live lease, then leaves it open for
+// appending.
+static int log_compact(dhcp_server_t *srv, const char *path) {
+  char tmp_path[4096];
+  if (snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path) >=
+      (int)sizeof(tmp_path)) {
+    fprintf(stderr, "[-] lease log path too long\n");
+    return -1;
+  }
+  if ((srv->log_fd = mkstemp(tmp_path)) < 0) {
+    perror("[-] mkstemp() lease log");
+    return -1;
+  }
+  fchmod(srv->log_fd, 0644);
+
+  int sync = srv->config.sync;
+  srv->config.sync = 0;
+  int ok = write(srv->log_fd, LOG_MAGIC, sizeof(LOG_MAGIC) - 1) ==
+           (ssize_t)sizeof(LOG_MAGIC) - 1;
+  for (uint32_t offset = 0; ok && offset < srv->pool.size; offset++) {
+    int state = srv->leases[offset].state;
+    if (state == LEASE_BOUND || state == LEASE_DECLINED) {
+      log_append(srv, offset, state == LEASE_BOUND ? LOG_BOUND : LOG_DECLINED);
+    }
+  }
+  srv->config.sync = sync;
+  if (!ok || dhcp_server_flush_log(srv) < 0 || fsync(srv->log_fd) < 0 ||
+      rename(tmp_path, path) < 0) {
+    perror("[-] compact lease log");
+    close(srv->log_fd);
+    srv->log_fd = -1;
+    unlink(tmp_path);
+    return -1;
+  }
+  srv->stats.log_bytes = 0;
+  return 0;
+}
+
+static int open_socket(dhcp_server_t *srv) {
+  // IPv4, UDP, not a fragment, destination port 67.
+  struct sock_filter code[] = {
+      BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, 8),
+      BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 23),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 6),
+      BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 20),
+      BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 4, 0),
+      BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 14),
+      BPF_STMT(BPF_LD | BPF_H | BPF_IND, 16),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, DHCP_PORT_SERVER, 0, 1),
+      BPF_STMT(BPF_RET | BPF_K, 0x40000),
+      BPF_STMT(BPF_RET | BPF_K, 0),
+  };
+  struct sock_fprog prog = {sizeof(code) / sizeof(code[0]), code};
+
+  // Protocol 0 until the filter is on, so nothing unfiltered is queued.
+  if ((srv->sock = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, 0)) < 0) {
+    perror("[-] socket()");
+    return -1;
+  }
+  if (setsockopt(srv->sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog,
+                 sizeof(prog)) < 0) {
+    perror("[-] setsockopt() SO_ATTACH_FILTER");
+    return -1;
+  }
+  int rcvbuf = SOCKET_BUFFER;
+  if (setsockopt(srv->sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf,
+                 sizeof(rcvbuf)) < 0) {
+    setsockopt(srv->sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  }
+
+  struct sockaddr_ll sll;
+  memset(&sll, 0, sizeof(sll));
+  sll.sll_family = AF_PACKET;
+  sll.sll_ifindex = srv->iface.ifindex;
+  sll.sll_protocol = htons(ETH_P_IP);
+  if (bind(srv->sock, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+    perror("[-] bind()");
+    return -1;
+  }
+  return 0;
+}
+
+dhcp_server_t *dhcp_server_new(const dhcp_server_config_t *config) {
+  uint32_t first = ntohl(config->first.s_addr);
+  uint32_t last = ntohl(config->last.s_addr);
+  uint32_t mask = config->prefix_len ? ~0u << (32 - config->prefix_len) : 0;
+  uint32_t subnet = ntohl(config->server.s_addr) & mask;
+  if (config->prefix_len < 1 || config->prefix_len > 30 || last < first ||
+      (first & mask) != subnet || (last & mask) != subnet) {
+    fprintf(stderr, "[-] The pool must lie in the server's subnet\n");
+    return NULL;
+  }
+
+  dhcp_server_t *srv = calloc(1, sizeof(dhcp_server_t));
+  if (!srv) {
+    perror("[-] calloc() server");
+    return NULL;
+  }
+  srv->config = *config;
+  srv->first = first;
+  srv->mask = mask;
+  srv->subnet = subnet;
+  srv->sock = -1;
+  srv->log_fd = -1;
+  srv->iface.nl.fd = -1;
+  if (addr_pool_init(&srv->pool, last - first + 1) < 0) {
+    dhcp_server_free(srv);
+    return NULL;
+  }
+
+  uint32_t index_size = 64;
+  srv->index_bits = 6;
+  while (index_size < srv->pool.size + srv->pool.size / 3) {
+    index_size <<= 1;
+    srv->index_bits++;
+  }
+  srv->index_mask = index_size - 1;
+  srv->leases = calloc(srv->pool.size, sizeof(lease_t));
+  srv->index = malloc((size_t)index_size * sizeof(uint32_t));
+  srv->log_buf = malloc(LOG_BUF_RECORDS * sizeof(lease_log_record_t));
+  srv->rx = malloc(DHCP_SERVER_BATCH * RX_FRAME);
+  srv->tx = malloc(DHCP_SERVER_BATCH * TX_FRAME);
+  if (!srv->leases || !srv->index || !srv->log_buf || !srv->rx || !srv->tx) {
+    perror("[-] malloc() server");
+    dhcp_server_free(srv);
+    return NULL;
+  }
+  memset(srv->index, 0xff, (size_t)index_size * sizeof(uint32_t));
+
+  if (config->lease_log && (log_replay(srv, config->lease_log) < 0 ||
+                            log_compact(srv, config->lease_log) < 0)) {
+    dhcp_server_free(srv);
+    return NULL;
+  }
+
+  if (config->ifname) {
+    if (iface_ctx_init(&srv->iface, config->ifname) < 0) {
+      srv->iface.nl.fd = -1;
+      dhcp_server_free(srv);
+      return NULL;
+    }
+    if (open_socket(srv) < 0) {
+      dhcp_server_free(srv);
+      return NULL;
+    }
+  }
+
+  for (int i = 0; i < DHCP_SERVER_BATCH; i++) {
+    srv->rx_iov[i] = (struct iovec){srv->rx[i], RX_FRAME};
+    srv->rx_msgs[i].msg_hdr.msg_iov = &srv->rx_iov[i];
+    srv->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+    srv->tx_iov[i] = (struct iovec){srv->tx[i], TX_FRAME};
+    srv->tx_msgs[i].msg_hdr.msg_iov = &srv->tx_iov[i];
+    srv->tx_msgs[i].msg_hdr.msg_iovlen = 1;
+    srv->tx_msgs[i].msg_hdr.msg_name = &srv->tx_dst[i];
+    srv->tx_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_ll);
+  }
+  return srv;
+}
+
+void dhcp_server_free(dhcp_server_t *srv) {
+  if (!srv) {
+    return;
+  }
+  dhcp_server_flush_log(srv);
+  if (srv->log_fd >= 0) {
+    close(srv->log_fd);
+  }
+  if (srv->sock >= 0) {
+    close(srv->sock);
+  }
+  if (srv->iface.nl.fd >= 0) {
+    iface_ctx_close(&srv->iface);
+  }
+  addr_pool_destroy(&srv->pool);
+  free(srv->leases);
+  free(srv->index);
+  free(srv->log_buf);
+  free(srv->rx);
+  free(srv->tx);
+  free(srv);
+}
+
+int dhcp_server_get_fd(const dhcp_server_t *srv) { return srv->sock; }
+
+static void send_replies(dhcp_server_t *srv, int count) {
+  int sent = 0;
+  while (sent < count) {
+    int n = sendmmsg(srv->sock, srv->tx_msgs + sent, count - sent, 0);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("[-] sendmmsg()");
+      return;
+    }
+    sent += n;
+  }
+}
+
+int dhcp_server_process(dhcp_server_t *srv) {
+  int total = 0;
+  for (;;) {
+    int n = recvmmsg(srv->sock, srv->rx_msgs, DHCP_SERVER_BATCH,
+                     MSG_DONTWAIT, NULL);
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+        break;
+      }
+      perror("[-] recvmmsg()");
+      return -1;
+    }
+
+    int replies = 0;
+    for (int i = 0; i < n; i++) {
+      if (dhcp_server_handle_frame(srv, srv->rx[i], srv->rx_msgs[i].msg_len,
+                                   srv->tx[replies],
+                                   &srv->tx_dst[replies]) > 0) {
+        replies++;
+      }
+    }
+    // An ACK goes out only after its lease is in the log.
+    dhcp_server_flush_log(srv);
+    send_replies(srv, replies);
+    total += n;
+    if (n < DHCP_SERVER_BATCH) {
+      break;
+    }
+  }
+  return total;
+}
+
+const dhcp_server_stats_t *dhcp_server_stats(const dhcp_server_t *srv) {
+  return &srv->stats;
+}
+
+double dhcp_server_bytes_per_lease(const dhcp_server_t *srv) {
+  size_t bytes = (size_t)srv->pool.size * sizeof(lease_t) +
+                 (size_t)(srv->index_mask + 1) * sizeof(uint32_t);
+  uint32_t bits = srv->pool.size;
+  for (int k = 0; k < srv->pool.levels; k++) {
+    bits = (bits + 63) / 64;
+    bytes += (size_t)bits * sizeof(uint64_t);
+  }
+  return (double)bytes / srv->pool.size;
+}
@@ -0,0 +1,369 @@
+#include "hooks.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "logging.h"
+#include "network_utils.h"
+
+#define HOOK_MAX_RUNNING 256
+
+typedef struct {
+  pid_t pid;
+  uint32_t seq;
+  uint16_t command;
+  uint8_t event;
+  uint64_t started_us;
+} hook_child_t;
+
+void dhcpc_hooks_config_init(dhcpc_hooks_config_t *config) {
+  memset(config, 0, sizeof(dhcpc_hooks_config_t));
+  config->ready_fd = -1;
+  config->log_level = DHCPC_LOG_INFO;
+}
+
+static void helper_report(int sock, const hook_child_t *child, int status) {
+  hook_result_t result;
+  memset(&result, 0, sizeof(result));
+  result.seq = child->seq;
+  result.command = child->command;
+  result.event = child->event;
+  result.status = status;
+  result.elapsed_us = monotonic_us() - child->started_us;
+  send(sock, &result, sizeof(result), MSG_NOSIGNAL);
+}
+
+static pid_t helper_spawn(const char *command, const hook_request_t *req,
+                          size_t env_len, const sigset_t *old_mask) {
+  pid_t pid = fork();
+  if (pid != 0) {
+    return pid;
+  }
+  sigprocmask(SIG_SETMASK, old_mask, NULL);
+  for (size_t off = 0; off < env_len;) {
+    char *var = (char *)req->env + off;
+    putenv(var);
+    off += strlen(var) + 1;
+  }
+  execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+  _exit(127);
+}
+
+// The helper: starts a command per request and reports each one as it
+// exits, until the client closes its end and the last command is done.
+static void helper_main(dhcpc_hooks_t *hooks, int sock) {
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  sigset_t mask, old_mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &mask, &old_mask);
+  int sig_fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+  if (sig_fd < 0) {
+    perror("[-] signalfd() hook helper");
+    _exit(1);
+  }
+
+  static hook_child_t children[HOOK_MAX_RUNNING];
+  static hook_request_t req;
+  int running = 0;
+  int open = 1;
+  while (open || running > 0) {
+    struct pollfd pfds[2] = {{.fd = open ? sock : -1, .events = POLLIN},
+                             {.fd = sig_fd, .events = POLLIN}};
+    if (poll(pfds, 2, -1) < 0 && errno != EINTR) {
+      perror("[-] poll() hook helper");
+      break;
+    }
+
+    if (pfds[0].revents) {
+      ssize_t n = recv(sock, &req, sizeof(req), 0);
+      if (n <= 0) {
+        open = 0;
+      } else if (n >= (ssize_t)offsetof(hook_request_t, env) &&
+                 req.command < hooks->command_count) {
+        hook_child_t child = {.seq = req.seq,
+                              .command = req.command,
+                              .event = req.event,
+                              .started_us = monotonic_us()};
+        size_t env_len = n - offsetof(hook_request_t, env);
+        if (running == HOOK_MAX_RUNNING ||
+            (child.pid = helper_spawn(hooks->commands[req.command], &req,
+                                      env_len, &old_mask)) < 0) {
+          helper_report(sock, &child, -1);
+        } else {
+          children[running++] = child;
+        }
+      }
+    }
+
+    if (pfds[1].revents) {
+      struct signalfd_siginfo info;
+      while (read(sig_fd, &info, sizeof(info)) > 0) {
+      }
+      int status;
+      pid_t pid;
+      while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (int i = 0; i < running; i++) {
+          if (children[i].pid == pid) {
+            helper_report(sock, &children[i], status);
+            children[i] = children[--running];
+            break;
+          }
+        }
+      }
+    }
+  }
+  _exit(0);
+}
+
+dhcpc_hooks_t *dhcpc_hooks_new(const dhcpc_hooks_config_t *config) {
+  if (config->command_count < 0 ||
+      config->command_count > DHCPC_MAX_HOOK_COMMANDS) {
+    fprintf(stderr, "[-] At most %d hook commands\n",
+            DHCPC_MAX_HOOK_COMMANDS);
+    return NULL;
+  }
+  dhcpc_hooks_t *hooks = calloc(1, sizeof(dhcpc_hooks_t));
+  if (!hooks) {
+    perror("calloc");
+    return NULL;
+  }
+  hooks->ready_fd = config->ready_fd;
+  hooks->notify_sock = -1;
+  hooks->sock = -1;
+  hooks->helper = -1;
+  hooks->log_level = config->log_level;
+
+  if (hooks->ready_fd >= 0) {
+    char link[64], target[64];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", hooks->ready_fd);
+    ssize_t n = readlink(link, target, sizeof(target) - 1);
+    if (n < 0) {
+      perror("[-] ready fd");
+      dhcpc_hooks_free(hooks);
+      return NULL;
+    }
+    target[n] = '\0';
+    hooks->ready_eventfd = strstr(target, "eventfd") != NULL;
+    fcntl(hooks->ready_fd, F_SETFL,
+          fcntl(hooks->ready_fd, F_GETFL) | O_NONBLOCK);
+  }
+
+  // "@name" is in the abstract namespace.
+  const char *path = config->notify_socket;
+  if (path && (path[0] == '/' || path[0] == '@')) {
+    if (strlen(path) >= sizeof(hooks->notify_path) ||
+        (hooks->notify_sock =
+             socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0) {
+      fprintf(stderr, "[-] Cannot use notify socket %s\n", path);
+      dhcpc_hooks_free(hooks);
+      return NULL;
+    }
+    strcpy(hooks->notify_path, path);
+  }
+
+  for (int i = 0; i < config->command_count; i++) {
+    if (!(hooks->commands[i] = strdup(config->commands[i]))) {
+      perror("strdup");
+      dhcpc_hooks_free(hooks);
+      return NULL;
+    }
+    hooks->command_count++;
+  }
+  if (hooks->command_count == 0) {
+    return hooks;
+  }
+
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0) {
+    perror("[-] socketpair() hooks");
+    dhcpc_hooks_free(hooks);
+    return NULL;
+  }
+  // Unflushed output would otherwise be written twice.
+  fflush(stdout);
+  fflush(stderr);
+  if ((hooks->helper = fork()) < 0) {
+    perror("[-] fork() hook helper");
+    close(fds[0]);
+    close(fds[1]);
+    dhcpc_hooks_free(hooks);
+    return NULL;
+  }
+  if (hooks->helper == 0) {
+    close(fds[0]);
+    helper_main(hooks, fds[1]);
+  }
+  close(fds[1]);
+  hooks->sock = fds[0];
+  fcntl(hooks->sock, F_SETFL, O_NONBLOCK);
+  return hooks;
+}
+
+void dhcpc_hooks_free(dhcpc_hooks_t *hooks) {
+  if (!hooks) {
+    return;
+  }
+  if (hooks->sock >= 0) {
+    close(hooks->sock);
+  }
+  if (hooks->helper > 0) {
+    waitpid(hooks->helper, NULL, 0);
+  }
+  if (hooks->notify_sock >= 0) {
+    close(hooks->notify_sock);
+  }
+  for (int i = 0; i < hooks->command_count; i++) {
+    free(hooks->commands[i]);
+  }
+  free(hooks);
+}
+
+int dhcpc_hooks_get_fd(const dhcpc_hooks_t *hooks) { return hooks->sock; }
+
+int dhcpc_hooks_pending(const dhcpc_hooks_t *hooks) { return hooks->running; }
+
+int dhcpc_hooks_process(dhcpc_hooks_t *hooks) {
+  hook_result_t result;
+  int n = 0;
+  while (hooks->sock >= 0 &&
+         recv(hooks->sock, &result, sizeof(result), 0) ==
+             (ssize_t)sizeof(result)) {
+    hooks->running--;
+    n++;
+    const char *command = hooks->commands[result.command];
+    if (result.status < 0) {
+      fprintf(stderr, "[-] Hook '%s' (%s) could not be started\n", command,
+              dhcpc_event_name(result.event));
+    } else if (WIFEXITED(result.status)) {
+      LOG_INFO(hooks->log_level, "[+] Hook '%s' (%s): exit %d in %.1f ms\n",
+               command, dhcpc_event_name(result.event),
+               WEXITSTATUS(result.status), result.elapsed_us / 1000.0);
+    } else {
+      LOG_INFO(hooks->log_level, "[-] Hook '%s' (%s): signal %d in %.1f ms\n",
+               command, dhcpc_event_name(result.event),
+               WTERMSIG(result.status), result.elapsed_us / 1000.0);
+    }
+  }
+  return n;
+}
+
+static void env_add(hook_request_t *req, const char *format, ...) {
+  size_t room = sizeof(req->env) - req->env_len;
+  va_list ap;
+  va_start(ap, format);
+  int n = vsnprintf(req->env + req->env_len, room, format, ap);
+  va_end(ap);
+  if (n >= 0 && (size_t)n < room) {
+    req->env_len += n + 1;
+  }
+}
+
+static void hooks_notify(dhcpc_hooks_t *hooks, const char *ifname,
+                         const dhcpc_lease_t *lease) {
+  char addr[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &lease->address, addr, sizeof(addr));
+
+  if (hooks->ready_fd >= 0) {
+    uint64_t start_us = monotonic_us();
+    char line[IFNAMSIZ + INET_ADDRSTRLEN + 2];
+    uint64_t one = 1;
+    int len = snprintf(line, sizeof(line), "%s %s\n", ifname, addr);
+    ssize_t n = hooks->ready_eventfd ? write(hooks->ready_fd, &one, 8)
+                                     : write(hooks->ready_fd, line, len);
+    if (n < 0) {
+      perror("[-] write() ready fd");
+    } else {
+      LOG_INFO(hooks->log_level, "[+] Hook ready-fd: %llu us\n",
+               (unsigned long long)(monotonic_us() - start_us));
+    }
+  }
+
+  if (hooks->notify_sock >= 0) {
+    uint64_t start_us = monotonic_us();
+    struct sockaddr_un sun = {.sun_family = AF_UNIX};
+    strcpy(sun.sun_path, hooks->notify_path);
+    if (sun.sun_path[0] == '@') {
+      sun.sun_path[0] = '\0';
+    }
+    socklen_t sun_len =
+        offsetof(struct sockaddr_un, sun_path) + strlen(hooks->notify_path);
+    char msg[128];
+    int len = snprintf(msg, sizeof(msg), "READY=1\nSTATUS=%s bound to %s\n",
+                       ifname, addr);
+    if (sendto(hooks->notify_sock, msg, len, MSG_NOSIGNAL,
+               (struct sockaddr *)&sun, sun_len) < 0) {
+      perror("[-] sendto() notify socket");
+    } else {
+      LOG_INFO(hooks->log_level, "[+] Hook sd_notify: %llu us\n",
+               (unsigned long long)(monotonic_us() - start_us));
+    }
+  }
+}
+
+void hooks_run(dhcpc_hooks_t *hooks, const char *ifname, dhcpc_event_t event,
+               const dhcpc_lease_t *lease) {
+  if (event == DHCPC_EVENT_BOUND) {
+    hooks_notify(hooks, ifname, lease);
+  }
+  if (hooks->sock < 0) {
+    return;
+  }
+
+  hook_request_t *req = &hooks->req;
+  req->event = event;
+  req->env_len = 0;
+  env_add(req, "DHCP_EVENT=%s", dhcpc_event_name(event));
+  env_add(req, "DHCP_INTERFACE=%s", ifname);
+  if (lease) {
+    char addr[INET_ADDRSTRLEN];
+    env_add(req, "DHCP_ADDRESS=%s",
+            inet_ntop(AF_INET, &lease->address, addr, sizeof(addr)));
+    env_add(req, "DHCP_PREFIX_LEN=%d",
+            __builtin_popcount(lease->netmask.s_addr));
+    env_add(req, "DHCP_ROUTER=%s",
+            lease->router.s_addr
+                ? inet_ntop(AF_INET, &lease->router, addr, sizeof(addr))
+                : "");
+    env_add(req, "DHCP_SERVER=%s",
+            inet_ntop(AF_INET, &lease->server, addr, sizeof(addr)));
+    env_add(req, "DHCP_LEASE_TIME=%u", lease->lease_time);
+    env_add(req, "DHCP_MTU=%u", lease->mtu);
+    env_add(req, "DHCP_SEARCH=%s", lease->search ? lease->search : "");
+    char dns[16 * INET_ADDRSTRLEN] = "";
+    size_t len = 0;
+    for (int i = 0; i < lease->dns_count && len + INET_ADDRSTRLEN < sizeof(dns);
+         i++) {
+      inet_ntop(AF_INET, &lease->dns[i], addr, sizeof(addr));
+      len += snprintf(dns + len, sizeof(dns) - len, "%s%s", i ? " " : "",
+                      addr);
+    }
+    env_add(req, "DHCP_DNS=%s", dns);
+  }
+
+  for (int i = 0; i < hooks->command_count; i++) {
+    req->seq = ++hooks->seq;
+    req->command = i;
+    if (send(hooks->sock, req, offsetof(hook_request_t, env) + req->env_len,
+             MSG_NOSIGNAL) < 0) {
+      perror("[-] send() hook helper");
+      return;
+    }
+    hooks->running++;
+  }
+}
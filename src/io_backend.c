@@ -0,0 +1,195 @@
+#include "io_backend.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+#include "network_utils.h"
+
+typedef struct {
+  io_backend_t base;
+} select_backend_t;
+
+static int select_send(io_backend_t *io, const void *buf, size_t len,
+                       const struct sockaddr *addr, socklen_t addrlen) {
+  io->stats.syscalls++;
+  ssize_t sent = sendto(io->sock, buf, len, 0, addr, addrlen);
+  if (sent < 0) {
+    perror("[-] sendto() in select_send");
+    return -1;
+  }
+  io->stats.tx_frames++;
+  return 0;
+}
+
+// recv() plus the RX timestamp, if the socket has them enabled.
+static ssize_t select_recvmsg(io_backend_t *io, uint8_t *buf, size_t len,
+                              int flags) {
+  uint8_t control[TS_CMSG_SPACE];
+  struct iovec iov = {buf, len};
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t n_bytes = recvmsg(io->sock, &msg, flags);
+  if (n_bytes >= 0) {
+    io->rx_ts_ns = cmsg_timestamp_ns(&msg);
+  }
+  return n_bytes;
+}
+
+static ssize_t select_recv(io_backend_t *io, uint8_t *buf, size_t len,
+                           int timeout_ms) {
+  // Called from an event loop that already knows the socket is readable.
+  while (timeout_ms == 0) {
+    io->stats.syscalls++;
+    ssize_t n_bytes = select_recvmsg(io, buf, len, MSG_DONTWAIT);
+    if (n_bytes < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == ENETDOWN) {
+        return 0;
+      }
+      perror("[-] recv() in select_recv");
+      return -1;
+    }
+    io->stats.rx_frames++;
+    return n_bytes;
+  }
+
+  while (1) {
+    fd_set readfds;
+    struct timeval tv;
+
+    FD_ZERO(&readfds);
+    FD_SET(io->sock, &readfds);
+
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+    io->stats.syscalls++;
+    int retval = select(io->sock + 1, &readfds, NULL, NULL, &tv);
+    if (retval == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("[-] select() error");
+      return -1;
+    }
+
+    if (retval == 0) {
+      return 0;
+    }
+
+    io->stats.syscalls++;
+    ssize_t n_bytes = select_recvmsg(io, buf, len, 0);
+    if (n_bytes < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      perror("[-] recv() in select_recv");
+      return -1;
+    }
+
+    io->stats.rx_frames++;
+    return n_bytes;
+  }
+}
+
+static int select_flush(io_backend_t *io) {
+  (void)io;
+  return 0;
+}
+
+static void select_destroy(io_backend_t *io) { free(io); }
+
+static const io_backend_ops_t select_ops = {
+    .name = "select",
+    .send = select_send,
+    .recv = select_recv,
+    .flush = select_flush,
+    .destroy = select_destroy,
+};
+
+static io_backend_t *select_backend_create(int sock) {
+  select_backend_t *sb = calloc(1, sizeof(select_backend_t));
+  if (!sb) {
+    perror("calloc");
+    return NULL;
+  }
+  sb->base.ops = &select_ops;
+  sb->base.sock = sock;
+  sb->base.poll_fd = sock;
+  return &sb->base;
+}
+
+io_backend_t *io_backend_create(io_backend_type_t type, int sock,
+                                int ifindex) {
+  switch (type) {
+    case IO_BACKEND_XDP:
+#ifdef HAVE_AF_XDP
+      return xsk_backend_create(ifindex);
+#else
+      (void)ifindex;
+      fprintf(stderr, "[-] AF_XDP backend not compiled in\n");
+      return NULL;
+#endif
+    case IO_BACKEND_URING:
+#ifdef HAVE_IO_URING
+      return io_uring_backend_create(sock);
+#else
+      fprintf(stderr, "[-] io_uring backend not compiled in\n");
+      return NULL;
+#endif
+    case IO_BACKEND_SELECT:
+    default:
+      return select_backend_create(sock);
+  }
+}
+
+void io_backend_destroy(io_backend_t *io) {
+  if (io) {
+    io_flush(io);
+    io->ops->destroy(io);
+  }
+}
+
+int io_backend_parse_type(const char *name, io_backend_type_t *type) {
+  if (strcmp(name, "select") == 0) {
+    *type = IO_BACKEND_SELECT;
+  } else if (strcmp(name, "uring") == 0 || strcmp(name, "io_uring") == 0) {
+    *type = IO_BACKEND_URING;
+  } else if (strcmp(name, "xdp") == 0 || strcmp(name, "af_xdp") == 0) {
+    *type = IO_BACKEND_XDP;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+int io_backend_available(io_backend_type_t type) {
+  switch (type) {
+    case IO_BACKEND_XDP:
+#ifdef HAVE_AF_XDP
+      return 1;
+#else
+      return 0;
+#endif
+    case IO_BACKEND_URING:
+#ifdef HAVE_IO_URING
+      return 1;
+#else
+      return 0;
+#endif
+    case IO_BACKEND_SELECT:
+    default:
+      return 1;
+  }
+}
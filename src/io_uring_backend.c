@@ -0,0 +1,556 @@
+#ifdef HAVE_IO_URING
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "io_backend.h"
+#include "network_utils.h"
+
+#define URING_ENTRIES 64
+#define URING_BUF_COUNT 64  // must be a power of two
+#define URING_BUF_SIZE 2048
+#define URING_BGID 0
+#define URING_TX_SLOTS 8
+
+// user_data layout: tag in the upper 32 bits, argument in the lower 32.
+#define URING_TAG_RECV 1ULL
+#define URING_TAG_TIMEOUT 2ULL
+#define URING_TAG_TX 3ULL
+#define URING_TAG_CANCEL 4ULL
+#define URING_UDATA(tag, arg) (((tag) << 32) | (uint32_t)(arg))
+
+typedef struct {
+  int busy;
+  struct msghdr msg;
+  struct iovec iov;
+  struct sockaddr_storage addr;
+  uint8_t data[URING_BUF_SIZE];
+} uring_tx_slot_t;
+
+typedef struct {
+  io_backend_t base;
+  int ring_fd;
+
+  void *sq_ring;
+  void *cq_ring;
+  size_t sq_ring_sz;
+  size_t cq_ring_sz;
+  struct io_uring_sqe *sqes;
+  size_t sqes_sz;
+
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned sq_mask;
+  unsigned *sq_array;
+  unsigned sq_local_tail;
+  unsigned sq_pending;
+
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned cq_mask;
+  struct io_uring_cqe *cqes;
+
+  struct io_uring_buf_ring *br;
+  size_t br_sz;
+  uint8_t *bufs;
+  uint16_t br_tail;
+
+  // Template for the multishot recvmsg: no address, room for timestamps.
+  struct msghdr recv_msg;
+
+  // Completed receives not yet handed to the caller.
+  struct {
+    uint16_t bid;
+    uint16_t off;  // payload offset past the recvmsg header and cmsgs
+    uint32_t len;
+    int64_t ts_ns;
+  } ready[URING_BUF_COUNT];
+  unsigned ready_head;
+  unsigned ready_count;
+
+  int recv_armed;
+  uint32_t timeout_seq;
+  int timeout_pending;
+  struct __kernel_timespec timeout_ts;
+
+  uring_tx_slot_t tx[URING_TX_SLOTS];
+} uring_backend_t;
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                              unsigned flags) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                      NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg,
+                                 unsigned nr_args) {
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static int uring_enter(uring_backend_t *u, unsigned min_complete) {
+  unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+
+  __atomic_store_n(u->sq_tail, u->sq_local_tail, __ATOMIC_RELEASE);
+
+  while (1) {
+    u->base.stats.syscalls++;
+    int ret =
+        sys_io_uring_enter(u->ring_fd, u->sq_pending, min_complete, flags);
+    if (ret >= 0) {
+      u->sq_pending -=
+          (unsigned)ret < u->sq_pending ? (unsigned)ret : u->sq_pending;
+      return 0;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    perror("[-] io_uring_enter()");
+    return -1;
+  }
+}
+
+static struct io_uring_sqe *uring_get_sqe(uring_backend_t *u) {
+  unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+  if (u->sq_local_tail - head > u->sq_mask) {
+    if (uring_enter(u, 0) < 0) {
+      return NULL;
+    }
+    head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    if (u->sq_local_tail - head > u->sq_mask) {
+      return NULL;
+    }
+  }
+
+  unsigned idx = u->sq_local_tail & u->sq_mask;
+  struct io_uring_sqe *sqe = &u->sqes[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  u->sq_array[idx] = idx;
+  u->sq_local_tail++;
+  u->sq_pending++;
+  return sqe;
+}
+
+static void uring_recycle_buf(uring_backend_t *u, uint16_t bid) {
+  struct io_uring_buf *buf = &u->br->bufs[u->br_tail & (URING_BUF_COUNT - 1)];
+  buf->addr = (uint64_t)(uintptr_t)(u->bufs + (size_t)bid * URING_BUF_SIZE);
+  buf->len = URING_BUF_SIZE;
+  buf->bid = bid;
+  u->br_tail++;
+  __atomic_store_n(&u->br->tail, u->br_tail, __ATOMIC_RELEASE);
+}
+
+static int uring_arm_recv(uring_backend_t *u) {
+  struct io_uring_sqe *sqe = uring_get_sqe(u);
+  if (!sqe) {
+    return -1;
+  }
+  // recvmsg rather than recv so each frame carries its kernel timestamp.
+  u->recv_msg.msg_controllen = TS_CMSG_SPACE;
+  sqe->opcode = IORING_OP_RECVMSG;
+  sqe->fd = u->base.sock;
+  sqe->addr = (uint64_t)(uintptr_t)&u->recv_msg;
+  sqe->len = 1;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = URING_BGID;
+  sqe->user_data = URING_UDATA(URING_TAG_RECV, 0);
+  u->recv_armed = 1;
+  return 0;
+}
+
+static int uring_arm_timeout(uring_backend_t *u, int timeout_ms) {
+  struct io_uring_sqe *sqe = uring_get_sqe(u);
+  if (!sqe) {
+    return -1;
+  }
+  u->timeout_seq++;
+  u->timeout_ts.tv_sec = timeout_ms / 1000;
+  u->timeout_ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+  sqe->opcode = IORING_OP_TIMEOUT;
+  sqe->fd = -1;
+  sqe->addr = (uint64_t)(uintptr_t)&u->timeout_ts;
+  sqe->len = 1;
+  sqe->user_data = URING_UDATA(URING_TAG_TIMEOUT, u->timeout_seq);
+  u->timeout_pending = 1;
+  return 0;
+}
+
+// Queues removal of the outstanding timer; it rides along with the next
+// submission instead of costing a syscall of its own.
+static void uring_cancel_timeout(uring_backend_t *u) {
+  if (!u->timeout_pending) {
+    return;
+  }
+  struct io_uring_sqe *sqe = uring_get_sqe(u);
+  if (!sqe) {
+    return;
+  }
+  sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+  sqe->fd = -1;
+  sqe->addr = URING_UDATA(URING_TAG_TIMEOUT, u->timeout_seq);
+  sqe->user_data = URING_UDATA(URING_TAG_CANCEL, 0);
+  u->timeout_pending = 0;
+}
+
+// Each buffer holds an io_uring_recvmsg_out header, the control messages
+// (sized by the template) and then the frame.
+static void uring_queue_frame(uring_backend_t *u, uint16_t bid, uint32_t res) {
+  uint8_t *buf = u->bufs + (size_t)bid * URING_BUF_SIZE;
+  struct io_uring_recvmsg_out *out = (struct io_uring_recvmsg_out *)buf;
+  size_t off = sizeof(*out) + u->recv_msg.msg_controllen;
+
+  if (res < off) {
+    uring_recycle_buf(u, bid);
+    return;
+  }
+
+  struct msghdr cmsgs;
+  memset(&cmsgs, 0, sizeof(cmsgs));
+  cmsgs.msg_control = buf + sizeof(*out);
+  cmsgs.msg_controllen = out->controllen;
+
+  unsigned slot = (u->ready_head + u->ready_count) & (URING_BUF_COUNT - 1);
+  u->ready[slot].bid = bid;
+  u->ready[slot].off = (uint16_t)off;
+  u->ready[slot].len =
+      res - off < out->payloadlen ? res - off : out->payloadlen;
+  u->ready[slot].ts_ns = cmsg_timestamp_ns(&cmsgs);
+  u->ready_count++;
+}
+
+// Drains the completion queue. Returns 1 if the current timeout fired.
+static int uring_reap(uring_backend_t *u) {
+  int timed_out = 0;
+  unsigned head = *u->cq_head;
+  unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+
+  for (; head != tail; head++) {
+    struct io_uring_cqe *cqe = &u->cqes[head & u->cq_mask];
+    uint64_t tag = cqe->user_data >> 32;
+    uint32_t arg = (uint32_t)cqe->user_data;
+
+    switch (tag) {
+      case URING_TAG_RECV:
+        // ENOBUFS and ENETDOWN (link flap) just end the multishot recv, which
+        // is re-armed on the next wait.
+        if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+          uring_queue_frame(u, cqe->flags >> IORING_CQE_BUFFER_SHIFT,
+                            (uint32_t)cqe->res);
+        } else if (cqe->res < 0 && cqe->res != -ENOBUFS &&
+                   cqe->res != -ENETDOWN) {
+          fprintf(stderr, "[-] io_uring recv: %s\n", strerror(-cqe->res));
+        }
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+          u->recv_armed = 0;
+        }
+        break;
+      case URING_TAG_TIMEOUT:
+        if (arg == u->timeout_seq && u->timeout_pending) {
+          u->timeout_pending = 0;
+          timed_out = 1;
+        }
+        break;
+      case URING_TAG_TX:
+        if (arg < URING_TX_SLOTS) {
+          u->tx[arg].busy = 0;
+        }
+        if (cqe->res < 0) {
+          fprintf(stderr, "[-] io_uring sendmsg: %s\n", strerror(-cqe->res));
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+
+  if (!u->recv_armed && u->ready_count < URING_BUF_COUNT) {
+    uring_arm_recv(u);
+  }
+  return timed_out;
+}
+
+static int uring_send(io_backend_t *io, const void *buf, size_t len,
+                      const struct sockaddr *addr, socklen_t addrlen) {
+  uring_backend_t *u = (uring_backend_t *)io;
+
+  if (len > URING_BUF_SIZE || addrlen > sizeof(struct sockaddr_storage)) {
+    fprintf(stderr, "[-] io_uring send: frame too large\n");
+    return -1;
+  }
+
+  int slot = -1;
+  while (slot < 0) {
+    for (int i = 0; i < URING_TX_SLOTS; i++) {
+      if (!u->tx[i].busy) {
+        slot = i;
+        break;
+      }
+    }
+    if (slot < 0) {
+      if (uring_enter(u, 1) < 0) {
+        return -1;
+      }
+      uring_reap(u);
+    }
+  }
+
+  uring_tx_slot_t *tx = &u->tx[slot];
+  memcpy(tx->data, buf, len);
+  memset(&tx->msg, 0, sizeof(tx->msg));
+  tx->iov.iov_base = tx->data;
+  tx->iov.iov_len = len;
+  tx->msg.msg_iov = &tx->iov;
+  tx->msg.msg_iovlen = 1;
+  if (addr) {
+    memcpy(&tx->addr, addr, addrlen);
+    tx->msg.msg_name = &tx->addr;
+    tx->msg.msg_namelen = addrlen;
+  }
+
+  struct io_uring_sqe *sqe = uring_get_sqe(u);
+  if (!sqe) {
+    return -1;
+  }
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = io->sock;
+  sqe->addr = (uint64_t)(uintptr_t)&tx->msg;
+  sqe->len = 1;
+  sqe->user_data = URING_UDATA(URING_TAG_TX, slot);
+  tx->busy = 1;
+
+  io->stats.tx_frames++;
+  return 0;
+}
+
+static ssize_t uring_recv(io_backend_t *io, uint8_t *buf, size_t len,
+                          int timeout_ms) {
+  uring_backend_t *u = (uring_backend_t *)io;
+
+  uring_reap(u);
+
+  if (u->ready_count == 0 && timeout_ms == 0) {
+    // Nothing to wait for, but the re-armed recv and queued sends still have
+    // to reach the kernel for the ring fd to signal the next frame.
+    if (u->sq_pending && uring_enter(u, 0) < 0) {
+      return -1;
+    }
+    return 0;
+  }
+
+  if (u->ready_count == 0) {
+    // Deferred sends, the multishot re-arm and the wait timer all go to the
+    // kernel in a single io_uring_enter().
+    if (uring_arm_timeout(u, timeout_ms) < 0) {
+      return -1;
+    }
+    while (u->ready_count == 0) {
+      if (uring_enter(u, 1) < 0) {
+        return -1;
+      }
+      if (uring_reap(u) && u->ready_count == 0) {
+        return 0;
+      }
+    }
+    uring_cancel_timeout(u);
+  } else if (u->sq_pending) {
+    if (uring_enter(u, 0) < 0) {
+      return -1;
+    }
+  }
+
+  uint16_t bid = u->ready[u->ready_head].bid;
+  size_t off = u->ready[u->ready_head].off;
+  size_t n_bytes = u->ready[u->ready_head].len;
+  io->rx_ts_ns = u->ready[u->ready_head].ts_ns;
+  u->ready_head = (u->ready_head + 1) & (URING_BUF_COUNT - 1);
+  u->ready_count--;
+
+  if (n_bytes > len) {
+    n_bytes = len;
+  }
+  memcpy(buf, u->bufs + (size_t)bid * URING_BUF_SIZE + off, n_bytes);
+  uring_recycle_buf(u, bid);
+
+  io->stats.rx_frames++;
+  return (ssize_t)n_bytes;
+}
+
+static int uring_flush(io_backend_t *io) {
+  uring_backend_t *u = (uring_backend_t *)io;
+  if (u->sq_pending == 0) {
+    return 0;
+  }
+  return uring_enter(u, 0);
+}
+
+static void uring_destroy(io_backend_t *io) {
+  uring_backend_t *u = (uring_backend_t *)io;
+
+  if (u->sqes) {
+    munmap(u->sqes, u->sqes_sz);
+  }
+  if (u->cq_ring && u->cq_ring != u->sq_ring) {
+    munmap(u->cq_ring, u->cq_ring_sz);
+  }
+  if (u->sq_ring) {
+    munmap(u->sq_ring, u->sq_ring_sz);
+  }
+  if (u->ring_fd >= 0) {
+    close(u->ring_fd);
+  }
+  if (u->br) {
+    munmap(u->br, u->br_sz);
+  }
+  free(u->bufs);
+  free(u);
+}
+
+static const io_backend_ops_t uring_ops = {
+    .name = "uring",
+    .send = uring_send,
+    .recv = uring_recv,
+    .flush = uring_flush,
+    .destroy = uring_destroy,
+};
+
+static int uring_map_rings(uring_backend_t *u, struct io_uring_params *p) {
+  u->sq_ring_sz = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+  u->cq_ring_sz = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+
+  if (p->features & IORING_FEAT_SINGLE_MMAP) {
+    if (u->cq_ring_sz > u->sq_ring_sz) {
+      u->sq_ring_sz = u->cq_ring_sz;
+    }
+    u->cq_ring_sz = u->sq_ring_sz;
+  }
+
+  u->sq_ring = mmap(NULL, u->sq_ring_sz, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQ_RING);
+  if (u->sq_ring == MAP_FAILED) {
+    u->sq_ring = NULL;
+    return -1;
+  }
+
+  if (p->features & IORING_FEAT_SINGLE_MMAP) {
+    u->cq_ring = u->sq_ring;
+  } else {
+    u->cq_ring =
+        mmap(NULL, u->cq_ring_sz, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_CQ_RING);
+    if (u->cq_ring == MAP_FAILED) {
+      u->cq_ring = NULL;
+      return -1;
+    }
+  }
+
+  u->sqes_sz = p->sq_entries * sizeof(struct io_uring_sqe);
+  u->sqes = mmap(NULL, u->sqes_sz, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQES);
+  if (u->sqes == MAP_FAILED) {
+    u->sqes = NULL;
+    return -1;
+  }
+
+  uint8_t *sq = u->sq_ring;
+  u->sq_head = (unsigned *)(sq + p->sq_off.head);
+  u->sq_tail = (unsigned *)(sq + p->sq_off.tail);
+  u->sq_mask = *(unsigned *)(sq + p->sq_off.ring_mask);
+  u->sq_array = (unsigned *)(sq + p->sq_off.array);
+  u->sq_local_tail = *u->sq_tail;
+
+  uint8_t *cq = u->cq_ring;
+  u->cq_head = (unsigned *)(cq + p->cq_off.head);
+  u->cq_tail = (unsigned *)(cq + p->cq_off.tail);
+  u->cq_mask = *(unsigned *)(cq + p->cq_off.ring_mask);
+  u->cqes = (struct io_uring_cqe *)(cq + p->cq_off.cqes);
+
+  return 0;
+}
+
+static int uring_setup_buffers(uring_backend_t *u) {
+  u->br_sz = URING_BUF_COUNT * sizeof(struct io_uring_buf);
+  u->br = mmap(NULL, u->br_sz, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (u->br == MAP_FAILED) {
+    u->br = NULL;
+    return -1;
+  }
+
+  u->bufs = malloc((size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+  if (!u->bufs) {
+    return -1;
+  }
+
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uint64_t)(uintptr_t)u->br;
+  reg.ring_entries = URING_BUF_COUNT;
+  reg.bgid = URING_BGID;
+
+  if (sys_io_uring_register(u->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) <
+      0) {
+    perror("[-] io_uring_register() PBUF_RING");
+    return -1;
+  }
+
+  for (uint16_t bid = 0; bid < URING_BUF_COUNT; bid++) {
+    uring_recycle_buf(u, bid);
+  }
+  return 0;
+}
+
+io_backend_t *io_uring_backend_create(int sock) {
+  uring_backend_t *u = calloc(1, sizeof(uring_backend_t));
+  if (!u) {
+    perror("calloc");
+    return NULL;
+  }
+  u->base.ops = &uring_ops;
+  u->base.sock = sock;
+
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+
+  u->ring_fd = sys_io_uring_setup(URING_ENTRIES, &params);
+  if (u->ring_fd < 0) {
+    perror("[-] io_uring_setup()");
+    free(u);
+    return NULL;
+  }
+  // The ring fd polls readable whenever the completion queue is not empty.
+  u->base.poll_fd = u->ring_fd;
+
+  if (uring_map_rings(u, &params) < 0) {
+    perror("[-] mmap() io_uring rings");
+    uring_destroy(&u->base);
+    return NULL;
+  }
+
+  if (uring_setup_buffers(u) < 0) {
+    uring_destroy(&u->base);
+    return NULL;
+  }
+
+  // The multishot receive is armed here and submitted together with the
+  // first send, so it stays posted for the lifetime of the backend.
+  if (uring_arm_recv(u) < 0) {
+    uring_destroy(&u->base);
+    return NULL;
+  }
+
+  return &u->base;
+}
+
+#endif
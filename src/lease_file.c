@@ -0,0 +1,143 @@
+#include "lease_file.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *rtt_keys[DHCP_RTT_COUNT] = {"rtt_offer", "rtt_ack"};
+
+int lease_file_write(const char *path, const lease_record_t *lease) {
+  char tmp_path[4096];
+  if (snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path) >=
+      (int)sizeof(tmp_path)) {
+    fprintf(stderr, "[-] lease file path too long\n");
+    return -1;
+  }
+
+  int fd = mkstemp(tmp_path);
+  if (fd < 0) {
+    perror("[-] mkstemp() lease file");
+    return -1;
+  }
+  fchmod(fd, 0644);
+
+  FILE *f = fdopen(fd, "w");
+  if (!f) {
+    perror("[-] fdopen() lease file");
+    close(fd);
+    unlink(tmp_path);
+    return -1;
+  }
+
+  char addr[INET_ADDRSTRLEN];
+  const uint8_t *mac = lease->server_mac;
+  fprintf(f, "# Generated by dhcp_client\n");
+  if (lease->address.s_addr) {
+    fprintf(f, "address %s/%d\n",
+            inet_ntop(AF_INET, &lease->address, addr, sizeof(addr)),
+            lease->prefix_len);
+    fprintf(f, "server %s\n",
+            inet_ntop(AF_INET, &lease->server, addr, sizeof(addr)));
+    fprintf(f, "server_mac %02x:%02x:%02x:%02x:%02x:%02x\n", mac[0], mac[1],
+            mac[2], mac[3], mac[4], mac[5]);
+    fprintf(f, "expires %lld\n", (long long)lease->expires);
+  }
+  for (int i = 0; i < lease->route_count; i++) {
+    uint32_t dst = lease->routes[i].dst;  // the struct is packed
+    uint32_t via = lease->routes[i].gateway;
+    char gateway[INET_ADDRSTRLEN];
+    fprintf(f, "route %s/%d %s\n", inet_ntop(AF_INET, &dst, addr, sizeof(addr)),
+            lease->routes[i].prefix_len,
+            inet_ntop(AF_INET, &via, gateway, sizeof(gateway)));
+  }
+  for (int i = 0; i < DHCP_RTT_COUNT; i++) {
+    if (lease->rtt[i].srtt_us) {
+      fprintf(f, "%s %u %u\n", rtt_keys[i], lease->rtt[i].srtt_us,
+              lease->rtt[i].rttvar_us);
+    }
+  }
+
+  if (fflush(f) != 0 || fsync(fd) < 0) {
+    perror("[-] write lease file");
+    fclose(f);
+    unlink(tmp_path);
+    return -1;
+  }
+  fclose(f);
+
+  if (rename(tmp_path, path) < 0) {
+    perror("[-] rename() lease file");
+    unlink(tmp_path);
+    return -1;
+  }
+  return 0;
+}
+
+// Parses "a.b.c.d/len".
+static int parse_prefix(const char *text, uint32_t *addr, int *prefix_len) {
+  char buf[INET_ADDRSTRLEN + 4];
+  snprintf(buf, sizeof(buf), "%s", text);
+  char *slash = strchr(buf, '/');
+  if (!slash) {
+    return -1;
+  }
+  *slash = '\0';
+  *prefix_len = atoi(slash + 1);
+  if (*prefix_len < 0 || *prefix_len > 32) {
+    return -1;
+  }
+  return inet_pton(AF_INET, buf, addr) == 1 ? 0 : -1;
+}
+
+int lease_file_read(const char *path, lease_record_t *lease) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    return -1;
+  }
+  memset(lease, 0, sizeof(lease_record_t));
+
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    char key[32], value[64], extra[64];
+    int fields = sscanf(line, "%31s %63s %63s", key, value, extra);
+    if (fields < 2 || key[0] == '#') {
+      continue;
+    }
+
+    if (!strcmp(key, "address")) {
+      parse_prefix(value, &lease->address.s_addr, &lease->prefix_len);
+    } else if (!strcmp(key, "server")) {
+      inet_pton(AF_INET, value, &lease->server);
+    } else if (!strcmp(key, "server_mac")) {
+      uint8_t *mac = lease->server_mac;
+      sscanf(value, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", &mac[0], &mac[1],
+             &mac[2], &mac[3], &mac[4], &mac[5]);
+    } else if (!strcmp(key, "expires")) {
+      lease->expires = strtoll(value, NULL, 10);
+    } else if (!strcmp(key, "route") && fields == 3 &&
+               lease->route_count < DHCP_MAX_ROUTES) {
+      uint32_t dst, gateway;
+      int prefix_len;
+      if (parse_prefix(value, &dst, &prefix_len) == 0 &&
+          inet_pton(AF_INET, extra, &gateway) == 1) {
+        ipv4_route_t *route = &lease->routes[lease->route_count++];
+        route->dst = dst;
+        route->gateway = gateway;
+        route->prefix_len = prefix_len;
+      }
+    } else if (fields == 3) {
+      for (int i = 0; i < DHCP_RTT_COUNT; i++) {
+        if (!strcmp(key, rtt_keys[i])) {
+          lease->rtt[i].srtt_us = strtoul(value, NULL, 10);
+          lease->rtt[i].rttvar_us = strtoul(extra, NULL, 10);
+        }
+      }
+    }
+  }
+  fclose(f);
+
+  return lease->address.s_addr ? 0 : -1;
+}
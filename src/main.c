@@ -1,18 +1,25 @@
+#include <arpa/inet.h>
+#include <errno.h>
 #include <getopt.h>
+#include <net/if.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
-#include "dhcp.h"
-#include "logging.h"
+#include "dhcpclient.h"
+#include "io_backend.h"
 
-int verbose_flag = 0;
+// Hard limit on SIGTERM/SIGINT handling; the RELEASE itself needs no reply.
+#define SHUTDOWN_BUDGET_SECS 2
 
-typedef struct {
-  char *interface;
-  int timeout;
-  int retries;
-} client_config_t;
+static volatile sig_atomic_t stop_signal;
+
+static void on_stop_signal(int sig) { stop_signal = sig; }
+
+static const char *hook_commands[DHCPC_MAX_HOOK_COMMANDS];
 
 void print_usage(const char *program_name) {
   printf("Usage: %s [OPTIONS] <interface>\n", program_name);
@@ -22,35 +29,71 @@ void print_usage(const char *program_name) {
   printf("  -v, --verbose           Enable verbose output\n");
   printf("  -t, --timeout           Set timeout in seconds (default: 5)\n");
   printf("  -r, --retries           Set number of retries (default: 3)\n");
+  printf("  -T, --retransmit POLICY On timeout: restart (new DISCOVER),\n");
+  printf("                          backoff (resend, doubling the timeout)\n");
+  printf("                          or adaptive (backoff from the measured\n");
+  printf("                          server response time, -t as the cap)\n");
+  printf("  -I, --io BACKEND        I/O backend: select, uring, xdp\n");
+  printf("                          (default: select)\n");
+  printf("  -R, --resolv-conf FILE  Write DNS servers and search to FILE\n");
+  printf("  -m, --monitor           Stay up and reconnect after link flaps\n");
+  printf("  -w, --capture FILE      Save sent and accepted frames as pcap\n");
+  printf("  -C, --capture-size MB   Rotate to FILE.1 at MB (default: 64)\n");
+  printf("  -l, --lease-file FILE   Where the lease is kept for --release\n");
+  printf("                          (default: /run/dhcp_client.IFACE.lease)\n");
+  printf("  -X, --release           Release the lease in the lease file\n");
+  printf("  -S, --status FILE       Keep state and lease in FILE for\n");
+  printf("                          dhcp_status, '-' for none (default:\n");
+  printf("                          /run/dhcp_client.IFACE.status)\n");
+  printf("  -e, --exec CMD          Run CMD through /bin/sh on every event,\n");
+  printf("                          lease in DHCP_* variables (repeatable)\n");
+  printf("  -F, --ready-fd FD       Signal FD (pipe or eventfd) once bound;\n");
+  printf("                          $NOTIFY_SOCKET also gets READY=1\n");
   printf("  -h, --help              Show this help message\n");
 }
 
-int parse_args(int argc, char **argv, client_config_t *config) {
-  config->interface = NULL;
-  config->timeout = 5;
-  config->retries = 3;
+int parse_args(int argc, char **argv, dhcpc_config_t *config,
+               dhcpc_hooks_config_t *hooks, int *release,
+               const char **status_file) {
+  io_backend_type_t io_type;
+
+  dhcpc_config_init(config);
+  dhcpc_hooks_config_init(hooks);
+  hooks->commands = hook_commands;
 
   struct option long_options[] = {{"help", no_argument, 0, 'h'},
                                   {"interface", required_argument, 0, 'i'},
                                   {"verbose", no_argument, 0, 'v'},
                                   {"timeout", required_argument, 0, 't'},
                                   {"retries", required_argument, 0, 'r'},
+                                  {"retransmit", required_argument, 0, 'T'},
+                                  {"io", required_argument, 0, 'I'},
+                                  {"monitor", no_argument, 0, 'm'},
+                                  {"resolv-conf", required_argument, 0, 'R'},
+                                  {"capture", required_argument, 0, 'w'},
+                                  {"capture-size", required_argument, 0, 'C'},
+                                  {"lease-file", required_argument, 0, 'l'},
+                                  {"release", no_argument, 0, 'X'},
+                                  {"status", required_argument, 0, 'S'},
+                                  {"exec", required_argument, 0, 'e'},
+                                  {"ready-fd", required_argument, 0, 'F'},
                                   {NULL, 0, NULL, 0}};
   int opt;
   int options_index = 0;
 
-  while ((opt = getopt_long(argc, argv, "i:vt:r:h", long_options,
+  while ((opt = getopt_long(argc, argv,
+                            "i:vt:r:T:I:mR:w:C:l:XS:e:F:h", long_options,
                             &options_index)) != -1) {
     switch (opt) {
       case 'i':
-        config->interface = optarg;
+        config->ifname = optarg;
         break;
       case 'v':
-        verbose_flag = 1;
+        config->log_level = DHCPC_LOG_DEBUG;
         break;
       case 't':
-        config->timeout = atoi(optarg);
-        if (config->timeout <= 0) {
+        config->timeout_secs = atoi(optarg);
+        if (config->timeout_secs <= 0) {
           fprintf(stderr, "Error: Timeout must be positive\n");
           return -1;
         }
@@ -62,6 +105,70 @@ int parse_args(int argc, char **argv, client_config_t *config) {
           return -1;
         }
         break;
+      case 'T':
+        if (!strcmp(optarg, "restart")) {
+          config->retransmit = DHCPC_RETRANSMIT_RESTART;
+        } else if (!strcmp(optarg, "backoff")) {
+          config->retransmit = DHCPC_RETRANSMIT_BACKOFF;
+        } else if (!strcmp(optarg, "adaptive")) {
+          config->retransmit = DHCPC_RETRANSMIT_ADAPTIVE;
+        } else {
+          fprintf(stderr, "Error: Unknown retransmit policy '%s'\n", optarg);
+          return -1;
+        }
+        break;
+      case 'I':
+        if (io_backend_parse_type(optarg, &io_type) != 0) {
+          fprintf(stderr, "Error: Unknown I/O backend '%s'\n", optarg);
+          return -1;
+        }
+        if (!io_backend_available(io_type)) {
+          fprintf(stderr, "Error: I/O backend '%s' is not compiled in\n",
+                  optarg);
+          return -1;
+        }
+        config->io_backend = optarg;
+        break;
+      case 'm':
+        config->monitor = 1;
+        break;
+      case 'R':
+        config->resolv_conf = optarg;
+        break;
+      case 'w':
+        config->capture_file = optarg;
+        break;
+      case 'C':
+        if (atoi(optarg) <= 0) {
+          fprintf(stderr, "Error: Capture size must be positive\n");
+          return -1;
+        }
+        config->capture_max_bytes = (uint64_t)atoi(optarg) << 20;
+        break;
+      case 'l':
+        config->lease_file = optarg;
+        break;
+      case 'X':
+        *release = 1;
+        break;
+      case 'S':
+        *status_file = optarg;
+        break;
+      case 'e':
+        if (hooks->command_count == DHCPC_MAX_HOOK_COMMANDS) {
+          fprintf(stderr, "Error: At most %d hook commands\n",
+                  DHCPC_MAX_HOOK_COMMANDS);
+          return -1;
+        }
+        hook_commands[hooks->command_count++] = optarg;
+        break;
+      case 'F':
+        hooks->ready_fd = atoi(optarg);
+        if (hooks->ready_fd < 0) {
+          fprintf(stderr, "Error: Bad ready fd\n");
+          return -1;
+        }
+        break;
       case 'h':
         print_usage(argv[0]);
         exit(EXIT_SUCCESS);
@@ -74,9 +181,9 @@ int parse_args(int argc, char **argv, client_config_t *config) {
     }
   }
 
-  if (config->interface == NULL) {
+  if (config->ifname == NULL) {
     if (optind < argc) {
-      config->interface = argv[optind];
+      config->ifname = argv[optind];
     } else {
       fprintf(stderr, "Error: Interface name is required\n");
       print_usage(argv[0]);
@@ -93,23 +200,150 @@ int parse_args(int argc, char **argv, client_config_t *config) {
   return 0;
 }
 
+static void print_lease(const dhcpc_lease_t *lease) {
+  struct in_addr dns = {lease->dns_count ? lease->dns[0] : 0};
+
+  printf("IP: %s\n", inet_ntoa(lease->address));
+  printf("Mask: %s\n", inet_ntoa(lease->netmask));
+  printf("Router: %s\n", inet_ntoa(lease->router));
+  printf("DNS: %s\n", inet_ntoa(dns));
+}
+
+static void on_lease(dhcpc_t *client, dhcpc_event_t event,
+                     const dhcpc_lease_t *lease, void *arg) {
+  const dhcpc_config_t *config = arg;
+  (void)client;
+
+  if (event == DHCPC_EVENT_BOUND) {
+    printf("[+] DHCP process completed successfully!\n");
+    print_lease(lease);
+  } else if (event == DHCPC_EVENT_FAILED) {
+    fprintf(stderr, "[-] DHCP process failed after %d attempts.\n",
+            config->retries);
+  }
+}
+
 int main(int argc, char *argv[]) {
-  client_config_t config;
+  dhcpc_config_t config;
+  dhcpc_hooks_config_t hooks_config;
+  int release = 0;
+  const char *status_file = NULL;
 
-  if (parse_args(argc, argv, &config) != 0) {
+  if (parse_args(argc, argv, &config, &hooks_config, &release,
+                 &status_file) != 0) {
     exit(EXIT_FAILURE);
   }
 
-  if (verbose_flag) {
+  char lease_path[IFNAMSIZ + 32];
+  if (!config.lease_file) {
+    snprintf(lease_path, sizeof(lease_path), "/run/dhcp_client.%s.lease",
+             config.ifname);
+    config.lease_file = lease_path;
+  }
+
+  if (release) {
+    dhcpc_t *client = dhcpc_new(&config);
+    if (!client) {
+      exit(EXIT_FAILURE);
+    }
+    int ret = dhcpc_release(client);
+    dhcpc_free(client);
+    return ret < 0 ? EXIT_FAILURE : 0;
+  }
+
+  // Forked before any socket is open, and before our signal handlers.
+  hooks_config.notify_socket = getenv("NOTIFY_SOCKET");
+  hooks_config.log_level = config.log_level;
+  if (hooks_config.command_count || hooks_config.ready_fd >= 0 ||
+      hooks_config.notify_socket) {
+    if (!(config.hooks = dhcpc_hooks_new(&hooks_config))) {
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  char status_path[IFNAMSIZ + 32];
+  if (!status_file) {
+    snprintf(status_path, sizeof(status_path), "/run/dhcp_client.%s.status",
+             config.ifname);
+    status_file = status_path;
+  }
+  // Only for the orchestrator's benefit, so we carry on without it.
+  if (strcmp(status_file, "-") != 0 &&
+      !(config.status = dhcpc_status_open(status_file, 1))) {
+    fprintf(stderr, "[-] Running without a status file\n");
+  }
+
+  // No SA_RESTART, so a signal cuts poll() short; a second one kills.
+  struct sigaction sa = {.sa_handler = on_stop_signal,
+                         .sa_flags = SA_RESETHAND};
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGTERM, &sa, NULL);
+  sigaction(SIGINT, &sa, NULL);
+
+  if (config.log_level >= DHCPC_LOG_DEBUG) {
     printf("DHCP Client Configuration:\n");
-    printf("  Interface: %s\n", config.interface);
-    printf("  Verbose: %s\n", verbose_flag ? "enabled" : "disabled");
-    printf("  Timeout: %d seconds\n", config.timeout);
+    printf("  Interface: %s\n", config.ifname);
+    printf("  Verbose: enabled\n");
+    printf("  Timeout: %d seconds\n", config.timeout_secs);
     printf("  Retries: %d\n", config.retries);
+    printf("  I/O backend: %s\n", config.io_backend);
+    printf("  Monitor: %s\n", config.monitor ? "enabled" : "disabled");
     printf("\n");
   }
 
-  dhcp_client_run(config.interface, config.timeout, config.retries);
+  config.on_lease = on_lease;
+  config.cb_arg = &config;
 
-  return 0;
-}
\ No newline at end of file
+  printf("Starting DHCP client on interface: %s\n", config.ifname);
+
+  dhcpc_t *client = dhcpc_new(&config);
+  if (!client) {
+    dhcpc_status_close(config.status);
+    dhcpc_hooks_free(config.hooks);
+    return EXIT_FAILURE;
+  }
+
+  int ret = 0;
+  int bound = 0;
+  int hooks_fd = config.hooks ? dhcpc_hooks_get_fd(config.hooks) : -1;
+  if (dhcpc_start(client) < 0) {
+    ret = EXIT_FAILURE;
+  } else {
+    // Without --monitor the first lease is all we came for, once its
+    // hooks are done.
+    while (!stop_signal &&
+           (config.monitor || !dhcpc_is_bound(client) ||
+            (config.hooks && dhcpc_hooks_pending(config.hooks)))) {
+      struct pollfd pfds[2] = {{.fd = dhcpc_get_fd(client), .events = POLLIN},
+                               {.fd = hooks_fd, .events = POLLIN}};
+      if (poll(pfds, 2, dhcpc_next_timeout_ms(client)) < 0 &&
+          errno != EINTR) {
+        perror("[-] poll()");
+        break;
+      }
+      if (pfds[1].revents) {
+        dhcpc_hooks_process(config.hooks);
+      }
+      if (dhcpc_process(client, pfds[0].revents) < 0) {
+        // Losing a lease we once had under --monitor is not a failed start.
+        if (!bound) {
+          ret = EXIT_FAILURE;
+        }
+        break;
+      }
+      bound |= dhcpc_is_bound(client);
+    }
+  }
+
+  if (stop_signal) {
+    printf("[*] Caught %s, releasing the lease\n", strsignal(stop_signal));
+    // SIGALRM's default action ends a shutdown that cannot finish in time.
+    alarm(SHUTDOWN_BUDGET_SECS);
+    dhcpc_release(client);
+  }
+
+  dhcpc_free(client);
+  dhcpc_status_close(config.status);
+  dhcpc_hooks_free(config.hooks);
+  return ret;
+}
@@ -0,0 +1,210 @@
+#include "netlink.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+int nl_open(nl_sock_t *nl, uint32_t groups) {
+  nl->seq = 0;
+  if ((nl->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE)) <
+      0) {
+    perror("[-] socket() NETLINK_ROUTE");
+    return -1;
+  }
+
+  struct sockaddr_nl sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.nl_family = AF_NETLINK;
+  sa.nl_groups = groups;
+
+  // ACKs carry only the request header, not the whole request back. Each
+  // still costs about 1 KB of receive buffer, so make room for a full chunk
+  // of nl_talk_batch() (capped by rmem_max unless we have CAP_NET_ADMIN).
+  int one = 1;
+  int rcvbuf = NL_BATCH_MAX_MSGS * 2048;
+  setsockopt(nl->fd, SOL_NETLINK, NETLINK_CAP_ACK, &one, sizeof(one));
+  if (setsockopt(nl->fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf,
+                 sizeof(rcvbuf)) < 0) {
+    setsockopt(nl->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  }
+
+  if (bind(nl->fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+    perror("[-] bind() NETLINK_ROUTE");
+    close(nl->fd);
+    nl->fd = -1;
+    return -1;
+  }
+  return 0;
+}
+
+void nl_close(nl_sock_t *nl) {
+  if (nl->fd >= 0) {
+    close(nl->fd);
+    nl->fd = -1;
+  }
+}
+
+int nl_addattr(struct nlmsghdr *nlh, size_t maxlen, int type, const void *data,
+               size_t len) {
+  size_t attr_len = RTA_LENGTH(len);
+  if (NLMSG_ALIGN(nlh->nlmsg_len) + RTA_ALIGN(attr_len) > maxlen) {
+    fprintf(stderr, "[-] netlink message too long\n");
+    return -1;
+  }
+
+  struct rtattr *rta =
+      (struct rtattr *)((uint8_t *)nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+  rta->rta_type = type;
+  rta->rta_len = attr_len;
+  if (len) {
+    memcpy(RTA_DATA(rta), data, len);
+  }
+  nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + RTA_ALIGN(attr_len);
+  return 0;
+}
+
+void nl_parse_attrs(struct rtattr *tb[], int max, struct rtattr *rta,
+                    int len) {
+  memset(tb, 0, sizeof(struct rtattr *) * (max + 1));
+  for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+    if (rta->rta_type <= max) {
+      tb[rta->rta_type] = rta;
+    }
+  }
+}
+
+int nl_talk(nl_sock_t *nl, struct nlmsghdr *req, nl_msg_cb cb, void *arg) {
+  req->nlmsg_seq = ++nl->seq;
+  req->nlmsg_flags |= NLM_F_REQUEST | NLM_F_ACK;
+
+  struct sockaddr_nl kernel = {.nl_family = AF_NETLINK};
+  if (sendto(nl->fd, req, req->nlmsg_len, 0, (struct sockaddr *)&kernel,
+             sizeof(kernel)) < 0) {
+    perror("[-] sendto() netlink");
+    return -1;
+  }
+
+  uint8_t buf[NL_BUF_SIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
+
+  while (1) {
+    ssize_t len = recv(nl->fd, buf, sizeof(buf), 0);
+    if (len < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("[-] recv() netlink");
+      return -1;
+    }
+
+    for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len);
+         nlh = NLMSG_NEXT(nlh, len)) {
+      // Multicast notifications can be interleaved with our reply.
+      if (nlh->nlmsg_seq != nl->seq) {
+        continue;
+      }
+      if (nlh->nlmsg_type == NLMSG_DONE) {
+        return 0;
+      }
+      if (nlh->nlmsg_type == NLMSG_ERROR) {
+        struct nlmsgerr *err = NLMSG_DATA(nlh);
+        if (err->error == 0) {
+          return 0;
+        }
+        errno = -err->error;
+        return -1;
+      }
+      if (cb && cb(nlh, arg) < 0) {
+        return -1;
+      }
+    }
+  }
+}
+
+// Sends one chunk of a batch and waits for all of its ACKs.
+static int nl_send_chunk(nl_sock_t *nl, uint8_t *chunk, size_t len,
+                         uint32_t first_seq, int count, int *first_error) {
+  struct sockaddr_nl kernel = {.nl_family = AF_NETLINK};
+  if (sendto(nl->fd, chunk, len, 0, (struct sockaddr *)&kernel,
+             sizeof(kernel)) < 0) {
+    perror("[-] sendto() netlink batch");
+    return -1;
+  }
+
+  uint8_t buf[NL_BUF_SIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
+  int acked = 0;
+  int failed = 0;
+
+  while (acked < count) {
+    ssize_t n = recv(nl->fd, buf, sizeof(buf), 0);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("[-] recv() netlink batch");
+      return -1;
+    }
+
+    for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, n);
+         nlh = NLMSG_NEXT(nlh, n)) {
+      if (nlh->nlmsg_type != NLMSG_ERROR ||
+          nlh->nlmsg_seq - first_seq >= (uint32_t)count) {
+        continue;
+      }
+      struct nlmsgerr *err = NLMSG_DATA(nlh);
+      acked++;
+      if (err->error != 0 && !failed++ && !*first_error) {
+        *first_error = -err->error;
+      }
+    }
+  }
+  return failed;
+}
+
+int nl_talk_batch(nl_sock_t *nl, void *batch, size_t len) {
+  uint8_t *chunk = batch;
+  uint32_t first_seq = nl->seq + 1;
+  size_t chunk_len = 0;
+  int count = 0;
+  int failed = 0;
+  int first_error = 0;
+
+  size_t remaining = len;
+  for (struct nlmsghdr *nlh = batch; NLMSG_OK(nlh, remaining);
+       nlh = NLMSG_NEXT(nlh, remaining)) {
+    size_t msg_len = NLMSG_ALIGN(nlh->nlmsg_len);
+
+    if (count == NL_BATCH_MAX_MSGS) {
+      int ret =
+          nl_send_chunk(nl, chunk, chunk_len, first_seq, count, &first_error);
+      if (ret < 0) {
+        return -1;
+      }
+      failed += ret;
+      chunk += chunk_len;
+      chunk_len = 0;
+      first_seq = nl->seq + 1;
+      count = 0;
+    }
+
+    nlh->nlmsg_seq = ++nl->seq;
+    nlh->nlmsg_flags |= NLM_F_REQUEST | NLM_F_ACK;
+    chunk_len += msg_len;
+    count++;
+  }
+
+  if (count) {
+    int ret =
+        nl_send_chunk(nl, chunk, chunk_len, first_seq, count, &first_error);
+    if (ret < 0) {
+      return -1;
+    }
+    failed += ret;
+  }
+
+  if (failed) {
+    errno = first_error;
+  }
+  return failed;
+}
@@ -1,60 +1,206 @@
 #include "network_utils.h"
 
 #include <arpa/inet.h>
+#include <errno.h>
+#include <linux/errqueue.h>
 #include <linux/if_packet.h>
+#include <linux/net_tstamp.h>
 #include <net/if.h>
-#include <net/route.h>
+#include <net/if_arp.h>
 #include <netinet/ether.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <time.h>
 #include <unistd.h>
 
-void get_mac_addr(const char *ifname, uint8_t *mac) {
-  int fd = 0;
+uint64_t monotonic_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+uint64_t monotonic_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
-  if ((fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))) < 0) {
-    perror("[-] socket() in get_mac_addr()");
-    return;
+int64_t realtime_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int iface_ctx_update(iface_ctx_t *ctx, const struct nlmsghdr *nlh) {
+  if (nlh->nlmsg_type != RTM_NEWLINK ||
+      nlh->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg))) {
+    return 0;
   }
 
-  struct ifreq ifr;
-  strncpy(ifr.ifr_name, ifname, IFNAMSIZ);
+  struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+  struct rtattr *tb[IFLA_MAX + 1];
+  nl_parse_attrs(tb, IFLA_MAX, IFLA_RTA(ifi), IFLA_PAYLOAD(nlh));
 
-  if (ioctl(fd, SIOCGIFHWADDR, &ifr) < 0) {
-    perror("[-] ioctl()");
-    close(fd);
-    return;
+  if (ctx->ifindex != 0 && ifi->ifi_index != ctx->ifindex) {
+    return 0;
+  }
+  if (ctx->ifindex == 0 &&
+      (!tb[IFLA_IFNAME] ||
+       strncmp(RTA_DATA(tb[IFLA_IFNAME]), ctx->ifname, IFNAMSIZ) != 0)) {
+    return 0;
   }
 
-  memcpy(mac, ifr.ifr_hwaddr.sa_data, 6);
-  printf("MAC: %02X:%02X:%02X:%02X:%02X:%02X\n", mac[0], mac[1], mac[2], mac[3],
-         mac[4], mac[5]);
+  ctx->ifindex = ifi->ifi_index;
+  ctx->flags = ifi->ifi_flags;
+  if (tb[IFLA_MTU]) {
+    ctx->mtu = *(uint32_t *)RTA_DATA(tb[IFLA_MTU]);
+  }
+  if (tb[IFLA_ADDRESS] && RTA_PAYLOAD(tb[IFLA_ADDRESS]) == ETH_ALEN) {
+    memcpy(ctx->mac, RTA_DATA(tb[IFLA_ADDRESS]), ETH_ALEN);
+  }
+
+  memset(&ctx->bcast_addr, 0, sizeof(ctx->bcast_addr));
+  ctx->bcast_addr.sll_family = AF_PACKET;
+  ctx->bcast_addr.sll_protocol = htons(ETH_P_IP);
+  ctx->bcast_addr.sll_ifindex = ctx->ifindex;
+  ctx->bcast_addr.sll_halen = ETH_ALEN;
+  memset(ctx->bcast_addr.sll_addr, 0xff, ETH_ALEN);
 
-  close(fd);
+  return 1;
 }
 
-int create_raw_socket(const char *ifname) {
-  int sock = 0;
-  if ((sock = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))) < 0) {
-    perror("[-] socket()");
+static int iface_ctx_link_cb(const struct nlmsghdr *nlh, void *arg) {
+  iface_ctx_update(arg, nlh);
+  return 0;
+}
+
+int iface_ctx_refresh(iface_ctx_t *ctx) {
+  struct {
+    struct nlmsghdr nlh;
+    struct ifinfomsg ifi;
+    uint8_t attrs[64];
+  } req;
+
+  memset(&req, 0, sizeof(req));
+  req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+  req.nlh.nlmsg_type = RTM_GETLINK;
+  req.ifi.ifi_family = AF_UNSPEC;
+  req.ifi.ifi_index = ctx->ifindex;
+  if (ctx->ifindex == 0) {
+    nl_addattr(&req.nlh, sizeof(req), IFLA_IFNAME, ctx->ifname,
+               strlen(ctx->ifname) + 1);
+  }
+
+  if (nl_talk(&ctx->nl, &req.nlh, iface_ctx_link_cb, ctx) < 0) {
+    fprintf(stderr, "[-] RTM_GETLINK %s: %s\n", ctx->ifname, strerror(errno));
     return -1;
   }
+  if (ctx->ifindex == 0) {
+    fprintf(stderr, "[-] Interface %s not found\n", ctx->ifname);
+    return -1;
+  }
+  return 0;
+}
 
-  struct ifreq ifr;
-  strncpy(ifr.ifr_name, ifname, IFNAMSIZ);
+int iface_ctx_init(iface_ctx_t *ctx, const char *ifname) {
+  memset(ctx, 0, sizeof(iface_ctx_t));
+  strncpy(ctx->ifname, ifname, IFNAMSIZ - 1);
 
-  if (ioctl(sock, SIOCGIFINDEX, &ifr) < 0) {
-    perror("[-] ioctl() SIOCGIFINDEX");
-    close(sock);
+  if (nl_open(&ctx->nl, 0) < 0) {
+    return -1;
+  }
+
+  if (iface_ctx_refresh(ctx) < 0) {
+    nl_close(&ctx->nl);
+    return -1;
+  }
+  return 0;
+}
+
+int iface_ctx_bring_up(iface_ctx_t *ctx) {
+  if (ctx->flags & IFF_UP) {
+    return 0;
+  }
+
+  struct {
+    struct nlmsghdr nlh;
+    struct ifinfomsg ifi;
+  } req;
+
+  memset(&req, 0, sizeof(req));
+  req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+  req.nlh.nlmsg_type = RTM_NEWLINK;
+  req.ifi.ifi_family = AF_UNSPEC;
+  req.ifi.ifi_index = ctx->ifindex;
+  req.ifi.ifi_flags = IFF_UP;
+  req.ifi.ifi_change = IFF_UP;
+
+  if (nl_talk(&ctx->nl, &req.nlh, NULL, NULL) < 0) {
+    perror("[-] RTM_NEWLINK IFF_UP");
+    return -1;
+  }
+  ctx->flags |= IFF_UP;
+  return 0;
+}
+
+typedef struct {
+  int ifindex;
+  uint32_t addr;
+  int found;
+} addr_lookup_t;
+
+static int iface_ctx_addr_cb(const struct nlmsghdr *nlh, void *arg) {
+  addr_lookup_t *lookup = arg;
+  if (nlh->nlmsg_type != RTM_NEWADDR) {
+    return 0;
+  }
+
+  struct ifaddrmsg *ifa = NLMSG_DATA(nlh);
+  struct rtattr *tb[IFA_MAX + 1];
+  nl_parse_attrs(tb, IFA_MAX, IFA_RTA(ifa), IFA_PAYLOAD(nlh));
+
+  if ((int)ifa->ifa_index == lookup->ifindex && tb[IFA_LOCAL] &&
+      *(uint32_t *)RTA_DATA(tb[IFA_LOCAL]) == lookup->addr) {
+    lookup->found = 1;
+  }
+  return 0;
+}
+
+int iface_ctx_has_addr(iface_ctx_t *ctx, struct in_addr addr) {
+  struct {
+    struct nlmsghdr nlh;
+    struct ifaddrmsg ifa;
+  } req;
+
+  memset(&req, 0, sizeof(req));
+  req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+  req.nlh.nlmsg_type = RTM_GETADDR;
+  req.nlh.nlmsg_flags = NLM_F_DUMP;
+  req.ifa.ifa_family = AF_INET;
+
+  addr_lookup_t lookup = {ctx->ifindex, addr.s_addr, 0};
+  if (nl_talk(&ctx->nl, &req.nlh, iface_ctx_addr_cb, &lookup) < 0) {
+    fprintf(stderr, "[-] RTM_GETADDR %s: %s\n", ctx->ifname, strerror(errno));
+    return -1;
+  }
+  return lookup.found;
+}
+
+void iface_ctx_close(iface_ctx_t *ctx) { nl_close(&ctx->nl); }
+
+int create_raw_socket(const iface_ctx_t *ctx) {
+  int sock = 0;
+  if ((sock = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))) < 0) {
+    perror("[-] socket()");
     return -1;
   }
 
   struct sockaddr_ll sll;
   memset(&sll, 0, sizeof(sll));
   sll.sll_family = AF_PACKET;
-  sll.sll_ifindex = ifr.ifr_ifindex;
+  sll.sll_ifindex = ctx->ifindex;
   sll.sll_protocol = htons(ETH_P_ALL);
 
   if (bind(sock, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
@@ -78,86 +224,302 @@ int create_raw_socket(const char *ifname) {
   return sock;
 }
 
-void bring_interface_up(const char *ifname) {
-  int fd = socket(AF_INET, SOCK_DGRAM, 0);
-  if (fd < 0) {
-    perror("[-] socket() in func bring_interface_up");
-    close(fd);
-    return;
+int sock_enable_timestamps(int sock) {
+  int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE |
+              SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_TSONLY;
+  if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) ==
+      0) {
+    return 0;
   }
 
-  struct ifreq ifr = {0};
-  strncpy(ifr.ifr_name, ifname, IFNAMSIZ);
-  ioctl(fd, SIOCGIFFLAGS, &ifr);
-  ifr.ifr_flags |= IFF_UP;
-  ioctl(fd, SIOCSIFFLAGS, &ifr);
-  close(fd);
+  // RX only: replies are still stamped, requests fall back to the clock.
+  int one = 1;
+  if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) < 0) {
+    perror("[-] setsockopt() SO_TIMESTAMPNS");
+    return -1;
+  }
+  return 0;
 }
 
-void set_ip_addr(const char *ifname, struct in_addr ip, struct in_addr mask) {
-  int fd = socket(AF_INET, SOCK_DGRAM, 0);
-  if (fd < 0) {
-    perror("[-] socket() in set_ip_addr");
-    close(fd);
-    return;
+int64_t cmsg_timestamp_ns(const struct msghdr *msg) {
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR((struct msghdr *)msg); cmsg;
+       cmsg = CMSG_NXTHDR((struct msghdr *)msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET) {
+      continue;
+    }
+    const struct timespec *ts = NULL;
+    if (cmsg->cmsg_type == SCM_TIMESTAMPING) {
+      // ts[0] is the software stamp; [1] is unused and [2] is hardware.
+      ts = &((const struct scm_timestamping *)CMSG_DATA(cmsg))->ts[0];
+    } else if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+      ts = (const struct timespec *)CMSG_DATA(cmsg);
+    }
+    if (ts && (ts->tv_sec || ts->tv_nsec)) {
+      return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+    }
   }
+  return 0;
+}
 
-  struct ifreq ifr = {0};
-  struct sockaddr_in *addr;
+int64_t sock_read_tx_timestamp(int sock) {
+  int64_t latest = 0;
+  uint8_t control[TS_CMSG_SPACE];
+
+  while (1) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return latest;
+    }
+    int64_t ts = cmsg_timestamp_ns(&msg);
+    if (ts) {
+      latest = ts;
+    }
+  }
+}
 
-  strncpy(ifr.ifr_name, ifname, IFNAMSIZ);
+int create_arp_socket(const iface_ctx_t *ctx) {
+  int sock = socket(AF_PACKET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                    htons(ETH_P_ARP));
+  if (sock < 0) {
+    perror("[-] socket() ARP");
+    return -1;
+  }
 
-  addr = (struct sockaddr_in *)&ifr.ifr_addr;
-  addr->sin_addr = ip;
-  addr->sin_family = AF_INET;
+  struct sockaddr_ll sll;
+  memset(&sll, 0, sizeof(sll));
+  sll.sll_family = AF_PACKET;
+  sll.sll_ifindex = ctx->ifindex;
+  sll.sll_protocol = htons(ETH_P_ARP);
 
-  if (ioctl(fd, SIOCSIFADDR, &ifr) < 0) {
-    perror("[-] ioctl() SIOCSIFADDR");
+  if (bind(sock, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+    perror("[-] bind() ARP");
+    close(sock);
+    return -1;
   }
+  return sock;
+}
 
-  addr->sin_addr = mask;
-  if (ioctl(fd, SIOCSIFNETMASK, &ifr) < 0) {
-    perror("[-] ioctl() SIOCSIFNETMASK");
+int arp_send(int sock, const iface_ctx_t *ctx, struct in_addr sender,
+             struct in_addr target, const uint8_t *dst_mac) {
+  arp_packet_t req;
+  memset(&req, 0, sizeof(req));
+  req.htype = htons(ARPHRD_ETHER);
+  req.ptype = htons(ETH_P_IP);
+  req.hlen = ETH_ALEN;
+  req.plen = 4;
+  req.oper = htons(ARPOP_REQUEST);
+  memcpy(req.sha, ctx->mac, ETH_ALEN);
+  req.spa = sender.s_addr;
+  req.tpa = target.s_addr;
+
+  struct sockaddr_ll dest;
+  memset(&dest, 0, sizeof(dest));
+  dest.sll_family = AF_PACKET;
+  dest.sll_protocol = htons(ETH_P_ARP);
+  dest.sll_ifindex = ctx->ifindex;
+  dest.sll_halen = ETH_ALEN;
+  if (dst_mac) {
+    memcpy(dest.sll_addr, dst_mac, ETH_ALEN);
+  } else {
+    memset(dest.sll_addr, 0xff, ETH_ALEN);
   }
 
-  close(fd);
+  // While the carrier settles sends fail with ENETDOWN; count that probe as
+  // lost rather than giving up early.
+  if (sendto(sock, &req, sizeof(req), 0, (struct sockaddr *)&dest,
+             sizeof(dest)) < 0 &&
+      errno != ENETDOWN) {
+    perror("[-] sendto() ARP");
+    return -1;
+  }
+  return 0;
 }
 
-void add_default_router(const char *ifname, struct in_addr gateway) {
-  int fd = socket(AF_INET, SOCK_DGRAM, 0);
-  if (fd < 0) {
-    perror("[-] socket() in func add_default_router");
-    close(fd);
-    return;
+int arp_recv_reply(int sock, struct in_addr target, const uint8_t *src_mac,
+                   uint8_t *reply_mac) {
+  int found = 0;
+
+  while (1) {
+    arp_packet_t reply;
+    ssize_t n = recv(sock, &reply, sizeof(reply), 0);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == ENETDOWN) {
+        return found;
+      }
+      perror("[-] recv() ARP");
+      return -1;
+    }
+    if (n < (ssize_t)sizeof(reply) || reply.oper != htons(ARPOP_REPLY) ||
+        reply.spa != target.s_addr) {
+      continue;
+    }
+    if (src_mac && memcmp(reply.sha, src_mac, ETH_ALEN) != 0) {
+      continue;
+    }
+    if (reply_mac) {
+      memcpy(reply_mac, reply.sha, ETH_ALEN);
+    }
+    found = 1;
   }
+}
 
-  struct rtentry route;
-  memset(&route, 0, sizeof(route));
-
-  struct sockaddr_in *addr;
-
-  addr = (struct sockaddr_in *)&route.rt_dst;
-  addr->sin_family = AF_INET;
-  addr->sin_addr.s_addr = INADDR_ANY;
-
-  addr = (struct sockaddr_in *)&route.rt_genmask;
-  addr->sin_family = AF_INET;
-  addr->sin_addr.s_addr = INADDR_ANY;
+// Upper bound for one route message: rtmsg + RTA_DST, RTA_GATEWAY, RTA_OIF.
+#define ROUTE_MSG_SPACE \
+  (NLMSG_SPACE(sizeof(struct rtmsg)) + 3 * RTA_SPACE(sizeof(uint32_t)))
+#define ADDR_MSG_SPACE 128
+#define LINK_MSG_SPACE 64
+#define ADDR_LIFETIME_FOREVER 0xffffffffu
+
+int iface_ctx_configure(iface_ctx_t *ctx, struct in_addr addr, int prefix_len,
+                        uint32_t lifetime_secs, int mtu,
+                        const ipv4_route_t *routes, int route_count) {
+  size_t cap =
+      ADDR_MSG_SPACE + LINK_MSG_SPACE + (size_t)route_count * ROUTE_MSG_SPACE;
+  uint8_t *batch = calloc(1, cap);
+  if (!batch) {
+    perror("[-] calloc() netlink batch");
+    return -1;
+  }
+  size_t len = 0;
+  struct nlmsghdr *nlh;
+
+  // Address first: the prefix route it creates makes the gateways reachable
+  // for the routes that follow.
+  nlh = (struct nlmsghdr *)batch;
+  nlh->nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+  nlh->nlmsg_type = RTM_NEWADDR;
+  nlh->nlmsg_flags = NLM_F_CREATE | NLM_F_REPLACE;
+  struct ifaddrmsg *ifa = NLMSG_DATA(nlh);
+  ifa->ifa_family = AF_INET;
+  ifa->ifa_prefixlen = prefix_len;
+  ifa->ifa_scope = RT_SCOPE_UNIVERSE;
+  ifa->ifa_index = ctx->ifindex;
+
+  uint32_t bcast = addr.s_addr | htonl(prefix_len ? ~0u >> prefix_len : ~0u);
+  struct ifa_cacheinfo lifetime = {0};
+  lifetime.ifa_prefered = lifetime.ifa_valid =
+      lifetime_secs ? lifetime_secs : ADDR_LIFETIME_FOREVER;
+
+  nl_addattr(nlh, ADDR_MSG_SPACE, IFA_LOCAL, &addr.s_addr, 4);
+  nl_addattr(nlh, ADDR_MSG_SPACE, IFA_ADDRESS, &addr.s_addr, 4);
+  if (prefix_len < 31) {
+    nl_addattr(nlh, ADDR_MSG_SPACE, IFA_BROADCAST, &bcast, 4);
+  }
+  nl_addattr(nlh, ADDR_MSG_SPACE, IFA_CACHEINFO, &lifetime, sizeof(lifetime));
+  len += NLMSG_ALIGN(nlh->nlmsg_len);
+
+  if (mtu > 0 && mtu != ctx->mtu) {
+    nlh = (struct nlmsghdr *)(batch + len);
+    nlh->nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    nlh->nlmsg_type = RTM_NEWLINK;
+    struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+    ifi->ifi_family = AF_UNSPEC;
+    ifi->ifi_index = ctx->ifindex;
+    uint32_t value = mtu;
+    nl_addattr(nlh, LINK_MSG_SPACE, IFLA_MTU, &value, sizeof(value));
+    len += NLMSG_ALIGN(nlh->nlmsg_len);
+  }
 
-  addr = (struct sockaddr_in *)&route.rt_gateway;
-  addr->sin_family = AF_INET;
-  addr->sin_addr = gateway;
+  uint32_t oif = ctx->ifindex;
+  for (int i = 0; i < route_count; i++) {
+    nlh = (struct nlmsghdr *)(batch + len);
+    nlh->nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+    nlh->nlmsg_type = RTM_NEWROUTE;
+    nlh->nlmsg_flags = NLM_F_CREATE | NLM_F_REPLACE;
+    struct rtmsg *rtm = NLMSG_DATA(nlh);
+    rtm->rtm_family = AF_INET;
+    rtm->rtm_dst_len = routes[i].prefix_len;
+    rtm->rtm_table = RT_TABLE_MAIN;
+    rtm->rtm_protocol = RTPROT_DHCP;
+    rtm->rtm_scope = routes[i].gateway ? RT_SCOPE_UNIVERSE : RT_SCOPE_LINK;
+    rtm->rtm_type = RTN_UNICAST;
+
+    if (routes[i].prefix_len) {
+      nl_addattr(nlh, ROUTE_MSG_SPACE, RTA_DST, &routes[i].dst, 4);
+    }
+    if (routes[i].gateway) {
+      nl_addattr(nlh, ROUTE_MSG_SPACE, RTA_GATEWAY, &routes[i].gateway, 4);
+    }
+    nl_addattr(nlh, ROUTE_MSG_SPACE, RTA_OIF, &oif, sizeof(oif));
+    len += NLMSG_ALIGN(nlh->nlmsg_len);
+  }
 
-  route.rt_flags = RTF_UP | RTF_GATEWAY;
-  route.rt_dev = (char *)ifname;
+  int failed = nl_talk_batch(&ctx->nl, batch, len);
+  if (failed > 0) {
+    fprintf(stderr, "[-] %d of the address/MTU/route changes failed: %s\n",
+            failed, strerror(errno));
+  }
+  if (failed == 0 && mtu > 0) {
+    ctx->mtu = mtu;
+  }
+  free(batch);
+  return failed;
+}
 
-  if (ioctl(fd, SIOCADDRT, &route) < 0) {
-    perror("ioctl() SIOCADDRT");
-    close(fd);
-    return;
+int iface_ctx_unconfigure(iface_ctx_t *ctx, struct in_addr addr,
+                          int prefix_len, const ipv4_route_t *routes,
+                          int route_count) {
+  size_t cap = ADDR_MSG_SPACE + (size_t)route_count * ROUTE_MSG_SPACE;
+  uint8_t *batch = calloc(1, cap);
+  if (!batch) {
+    perror("[-] calloc() netlink batch");
+    return -1;
+  }
+  size_t len = 0;
+  struct nlmsghdr *nlh;
+
+  // Routes first, while their gateways are still reachable.
+  uint32_t oif = ctx->ifindex;
+  for (int i = 0; i < route_count; i++) {
+    nlh = (struct nlmsghdr *)(batch + len);
+    nlh->nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+    nlh->nlmsg_type = RTM_DELROUTE;
+    struct rtmsg *rtm = NLMSG_DATA(nlh);
+    rtm->rtm_family = AF_INET;
+    rtm->rtm_dst_len = routes[i].prefix_len;
+    rtm->rtm_table = RT_TABLE_MAIN;
+    rtm->rtm_protocol = RTPROT_DHCP;
+    rtm->rtm_scope = RT_SCOPE_NOWHERE;
+
+    if (routes[i].prefix_len) {
+      nl_addattr(nlh, ROUTE_MSG_SPACE, RTA_DST, &routes[i].dst, 4);
+    }
+    if (routes[i].gateway) {
+      nl_addattr(nlh, ROUTE_MSG_SPACE, RTA_GATEWAY, &routes[i].gateway, 4);
+    }
+    nl_addattr(nlh, ROUTE_MSG_SPACE, RTA_OIF, &oif, sizeof(oif));
+    len += NLMSG_ALIGN(nlh->nlmsg_len);
   }
 
-  close(fd);
+  nlh = (struct nlmsghdr *)(batch + len);
+  nlh->nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+  nlh->nlmsg_type = RTM_DELADDR;
+  struct ifaddrmsg *ifa = NLMSG_DATA(nlh);
+  ifa->ifa_family = AF_INET;
+  ifa->ifa_prefixlen = prefix_len;
+  ifa->ifa_index = ctx->ifindex;
+  nl_addattr(nlh, ADDR_MSG_SPACE, IFA_LOCAL, &addr.s_addr, 4);
+  len += NLMSG_ALIGN(nlh->nlmsg_len);
+
+  int failed = nl_talk_batch(&ctx->nl, batch, len);
+  if (failed > 0 && errno != ESRCH && errno != EADDRNOTAVAIL) {
+    fprintf(stderr, "[-] %d of the address/route removals failed: %s\n",
+            failed, strerror(errno));
+  } else if (failed > 0) {
+    failed = 0;
+  }
+  free(batch);
+  return failed;
 }
 
 uint16_t checksum(uint16_t *addr, int len) {
@@ -8,13 +8,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
-#include <sys/select.h>
 #include <time.h>
 
+#include "capture.h"
 #include "dhcp.h"
+#include "io_backend.h"
 #include "logging.h"
 #include "network_utils.h"
+#include "probes.h"
 
 void create_dhcp_packet(dhcp_packet_t *packet, uint8_t *mac, uint32_t xid,
                         uint8_t msg_type) {
@@ -35,21 +36,39 @@ void create_dhcp_packet(dhcp_packet_t *packet, uint8_t *mac, uint32_t xid,
   *opt++ = 1;
   *opt++ = msg_type;
 
-  *opt++ = 61;
+  *opt++ = DHCP_OPTION_CLIENT_ID;
   *opt++ = 7;
   *opt++ = 1;
   memcpy(opt, mac, 6);
   opt += 6;
 
+  *opt++ = DHCP_OPTION_MAX_MSG_SIZE;
+  *opt++ = 2;
+  *opt++ = DHCP_MAX_MSG_LEN >> 8;
+  *opt++ = DHCP_MAX_MSG_LEN & 0xff;
+
+  // RFC 3442: 121 goes before 3 so servers that truncate keep it.
   *opt++ = DHCP_OPTION_PARAMETER_REQUEST_LIST;
-  *opt++ = 3;
+  *opt++ = 7;
   *opt++ = DHCP_OPTION_SUBNET_MASK;
+  *opt++ = DHCP_OPTION_CLASSLESS_ROUTE;
   *opt++ = DHCP_OPTION_ROUTER;
   *opt++ = DHCP_OPTION_DNS_SERVER;
+  *opt++ = DHCP_OPTION_DOMAIN_NAME;
+  *opt++ = DHCP_OPTION_DOMAIN_SEARCH;
+  *opt++ = DHCP_OPTION_INTERFACE_MTU;
 
   *opt++ = DHCP_OPTION_END;
 };
 
+uint8_t *dhcp_options_end(dhcp_packet_t *packet) {
+  uint8_t *opt = packet->options;
+  while (*opt != DHCP_OPTION_END) {
+    opt += 2 + opt[1];
+  }
+  return opt;
+}
+
 void create_header(uint8_t *buffer, uint8_t *src_mac, uint8_t *dst_mac,
                    uint32_t src_ip, uint32_t dst_ip, uint16_t src_port,
                    uint16_t dst_port, uint16_t udp_len) {
@@ -63,7 +82,7 @@ void create_header(uint8_t *buffer, uint8_t *src_mac, uint8_t *dst_mac,
   ip->ihl = 5;
   ip->tos = 0;
   ip->tot_len = htons(sizeof(ip_header_t) + sizeof(udp_header_t) + udp_len);
-  ip->id = htons(rand() % 0xFFFF);
+  ip->id = 0;  // never fragmented
   ip->frag_off = 0;
   ip->ttl = 64;
   ip->protocol = IPPROTO_UDP;
@@ -80,164 +99,357 @@ void create_header(uint8_t *buffer, uint8_t *src_mac, uint8_t *dst_mac,
   udp->check = 0;
 }
 
-int send_dhcp_packet(int sock, uint8_t *src_mac, dhcp_packet_t *dhcp_packet,
-                     const char *ifname) {
+static int send_dhcp_frame(io_backend_t *io, const iface_ctx_t *iface,
+                           dhcp_packet_t *dhcp_packet, const uint8_t *dst_mac,
+                           uint32_t src_ip, uint32_t dst_ip) {
   uint8_t buffer[1500];
-  uint8_t broadcast_mac[] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
 
-  create_header(buffer, src_mac, broadcast_mac, INADDR_ANY, INADDR_BROADCAST,
-                DHCP_PORT_CLIENT, DHCP_PORT_SERVER, sizeof(dhcp_packet_t));
+  create_header(buffer, (uint8_t *)iface->mac, (uint8_t *)dst_mac, src_ip,
+                dst_ip, DHCP_PORT_CLIENT, DHCP_PORT_SERVER,
+                sizeof(dhcp_packet_t));
 
   memcpy(buffer + sizeof(eth_header_t) + sizeof(ip_header_t) +
              sizeof(udp_header_t),
          dhcp_packet, sizeof(dhcp_packet_t));
 
-  struct ifreq ifr;
-  strncpy(ifr.ifr_name, ifname, IFNAMSIZ);
-  if (ioctl(sock, SIOCGIFINDEX, &ifr) < 0) {
-    perror("[-] ioctl() SIOCGIFINDEX in send_dhcp_packet");
+  size_t len = sizeof(eth_header_t) + sizeof(ip_header_t) +
+               sizeof(udp_header_t) + sizeof(dhcp_packet_t);
+
+  // create_dhcp_packet() always puts option 53 first.
+  DHCP_PROBE4(tx, ntohl(dhcp_packet->xid), dhcp_packet->chaddr,
+              dhcp_packet->options[2], DHCP_PROBE_TS(tx));
+
+  // Stamped before the send, which on veth can run the peer's reply first.
+  int64_t tx_ns = io->capture ? realtime_ns() : 0;
+  if (io_send(io, buffer, len, (const struct sockaddr *)&iface->bcast_addr,
+              sizeof(iface->bcast_addr)) < 0) {
     return -1;
   }
+  if (io->capture) {
+    capture_frame(io->capture, buffer, len, tx_ns);
+  }
+
+  return 0;
+}
 
-  struct sockaddr_ll dest_addr;
-  memset(&dest_addr, 0, sizeof(dest_addr));
-  dest_addr.sll_family = AF_PACKET;
-  dest_addr.sll_protocol = htons(ETH_P_IP);
-  dest_addr.sll_ifindex = ifr.ifr_ifindex;
-  dest_addr.sll_halen = ETH_ALEN;
-  memcpy(dest_addr.sll_addr, broadcast_mac, ETH_ALEN);
+int send_dhcp_packet(io_backend_t *io, const iface_ctx_t *iface,
+                     dhcp_packet_t *dhcp_packet) {
+  static const uint8_t broadcast_mac[] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+  return send_dhcp_frame(io, iface, dhcp_packet, broadcast_mac, INADDR_ANY,
+                         INADDR_BROADCAST);
+}
 
-  DEBUG_PRINT("[DEBUG] Interface index: %d\n", dest_addr.sll_ifindex);
+int send_dhcp_unicast(io_backend_t *io, const iface_ctx_t *iface,
+                      dhcp_packet_t *dhcp_packet, const uint8_t *dst_mac,
+                      struct in_addr src, struct in_addr dst) {
+  return send_dhcp_frame(io, iface, dhcp_packet, dst_mac, src.s_addr,
+                         dst.s_addr);
+}
 
-  ssize_t sent = sendto(sock, buffer,
-                        sizeof(eth_header_t) + sizeof(ip_header_t) +
-                            sizeof(udp_header_t) + sizeof(dhcp_packet_t),
-                        0, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
+int dhcp_parse_frame(const uint8_t *frame, size_t n_bytes,
+                     uint32_t expected_xid, dhcp_msg_t *msg) {
+  size_t headers_size =
+      sizeof(eth_header_t) + sizeof(ip_header_t) + sizeof(udp_header_t);
+  int reason = 0;
+
+  const eth_header_t *eth = (const eth_header_t *)frame;
+  const ip_header_t *ip = (const ip_header_t *)(frame + sizeof(eth_header_t));
+  const udp_header_t *udp =
+      (const udp_header_t *)(frame + sizeof(eth_header_t) +
+                             sizeof(ip_header_t));
+  const dhcp_packet_t *recv_packet =
+      (const dhcp_packet_t *)(frame + headers_size);
+
+  if (n_bytes < headers_size) {
+    reason = PROBE_DROP_SHORT;
+  } else if (htons(eth->eth_type) != ETH_P_IP) {
+    reason = PROBE_DROP_NOT_IP;
+  } else if (ip->protocol != IPPROTO_UDP) {
+    reason = PROBE_DROP_NOT_UDP;
+  } else if (ntohs(udp->dest) != DHCP_PORT_CLIENT) {
+    reason = PROBE_DROP_PORT;
+  } else if (n_bytes < headers_size + 240) {
+    reason = PROBE_DROP_SHORT_DHCP;
+  } else if (recv_packet->magic_cookie != htonl(DHCP_MAGIC_COOKIE)) {
+    reason = PROBE_DROP_COOKIE;
+  } else if (recv_packet->xid != htonl(expected_xid)) {
+    reason = PROBE_DROP_XID;
+  }
 
-  if (sent < 0) {
-    perror("[-] sendto() in create_header");
-    return -1;
+  if (reason) {
+    DHCP_PROBE4(rx_drop, reason, expected_xid, n_bytes,
+                DHCP_PROBE_TS(rx_drop));
+    return reason;
   }
 
-  DEBUG_PRINT("Sent %zd bytes successfully\n", sent);
+  size_t payload_len = n_bytes - headers_size;
+  if (payload_len > sizeof(msg->raw)) {
+    payload_len = sizeof(msg->raw);
+  }
+  // Zero-fill up to a full dhcp_packet_t so short replies read as padded.
+  if (payload_len < sizeof(dhcp_packet_t)) {
+    memset(msg->raw + payload_len, 0, sizeof(dhcp_packet_t) - payload_len);
+  }
+  memcpy(msg->raw, recv_packet, payload_len);
+  msg->len = payload_len;
 
+  DHCP_PROBE4(rx, expected_xid, msg->packet.chaddr, payload_len,
+              DHCP_PROBE_TS(rx));
   return 0;
 }
 
-int receive_dhcp_packet(int sock, dhcp_packet_t *dhcp_packet,
+const char *dhcp_drop_reason(int reason) {
+  switch (reason) {
+    case PROBE_DROP_SHORT:
+      return "too short";
+    case PROBE_DROP_NOT_IP:
+      return "not IP";
+    case PROBE_DROP_NOT_UDP:
+      return "not UDP";
+    case PROBE_DROP_PORT:
+      return "not DHCP client port";
+    case PROBE_DROP_SHORT_DHCP:
+      return "too short for DHCP";
+    case PROBE_DROP_COOKIE:
+      return "bad magic cookie";
+    case PROBE_DROP_XID:
+      return "xid mismatch";
+    case PROBE_DROP_TIMEOUT:
+      return "timeout";
+  }
+  return "unknown";
+}
+
+int receive_dhcp_packet(io_backend_t *io, dhcp_msg_t *msg,
                         uint32_t expected_xid, int timeout_secs) {
-  uint8_t buffer[1500];
+  uint8_t buffer[2048];
+  uint64_t deadline = monotonic_ms() + (uint64_t)timeout_secs * 1000;
 
   while (1) {
-    fd_set readfds;
-    struct timeval tv;
-    int retval;
-
-    FD_ZERO(&readfds);
-    FD_SET(sock, &readfds);
-
-    tv.tv_sec = timeout_secs;
-    tv.tv_usec = 0;
+    uint64_t now = monotonic_ms();
+    int remaining_ms = now < deadline ? (int)(deadline - now) : 0;
 
-    retval = select(sock + 1, &readfds, NULL, NULL, &tv);
+    ssize_t n_bytes = io_recv(io, buffer, sizeof(buffer), remaining_ms);
 
-    if (retval == -1) {
-      if (errno == EINTR) {
-        continue;
-      }
-
-      perror("[-] select() error");
+    if (n_bytes < 0) {
       return -1;
     }
 
-    if (retval == 0) {
-      DEBUG_PRINT(
-          "Timeout reached. No DHCP packet received after %d seconds.\n",
-          timeout_secs);
+    if (n_bytes == 0) {
+      DHCP_PROBE4(rx_drop, PROBE_DROP_TIMEOUT, expected_xid, 0,
+                  DHCP_PROBE_TS(rx_drop));
       return -1;
     }
 
-    if (FD_ISSET(sock, &readfds)) {
-      ssize_t n_bytes = recv(sock, buffer, sizeof(buffer), 0);
-      if (n_bytes < 0) {
-        perror("[-] recv in receive_dhcp_packet");
-        return -1;
+    if (dhcp_parse_frame(buffer, n_bytes, expected_xid, msg) == 0) {
+      if (io->capture) {
+        capture_frame(io->capture, buffer, n_bytes, io->rx_ts_ns);
       }
+      return 0;
+    }
+  }
+}
 
-      DEBUG_PRINT("Received %zd bytes\n", n_bytes);
-
-      if (n_bytes < (ssize_t)(sizeof(eth_header_t) + sizeof(ip_header_t) +
-                              sizeof(udp_header_t))) {
-        DEBUG_PRINT("Packet too small, skipping\n");
+// Concatenates every instance of an option (RFC 3396) into out. Returns the
+// total length, truncated to cap.
+static size_t collect_option(const uint8_t *opt, const uint8_t *end,
+                             uint8_t code, uint8_t *out, size_t cap) {
+  size_t total = 0;
 
-        continue;
+  while (opt < end && *opt != DHCP_OPTION_END) {
+    if (*opt == 0) {
+      opt++;
+      continue;
+    }
+    if (opt + 2 > end || opt + 2 + opt[1] > end) {
+      break;
+    }
+    if (opt[0] == code) {
+      size_t len = opt[1];
+      if (len > cap - total) {
+        len = cap - total;
       }
+      memcpy(out + total, opt + 2, len);
+      total += len;
+    }
+    opt += 2 + opt[1];
+  }
+  return total;
+}
 
-      eth_header_t *eth = (eth_header_t *)buffer;
-      if (htons(eth->eth_type) != ETH_P_IP) {
-        DEBUG_PRINT("Not IP packet, skipping\n");
-        continue;
-      }
+static uint16_t parse_addr_list(const uint8_t *data, size_t len,
+                                uint32_t *addrs) {
+  uint16_t count = 0;
+  for (size_t i = 0; i + 4 <= len && count < DHCP_MAX_SERVERS; i += 4) {
+    memcpy(&addrs[count++], data + i, 4);
+  }
+  return count;
+}
 
-      ip_header_t *ip = (ip_header_t *)(buffer + sizeof(eth_header_t));
-      if (ip->protocol != IPPROTO_UDP) {
-        DEBUG_PRINT("Not UDP packet, skipping\n");
+// RFC 3442: <prefix len> <significant octets of dst> <gateway>, repeated.
+// A malformed option is dropped as a whole.
+static uint16_t parse_classless_routes(const uint8_t *data, size_t len,
+                                       ipv4_route_t *routes) {
+  uint16_t count = 0;
+  size_t i = 0;
+
+  while (i < len && count < DHCP_MAX_ROUTES) {
+    uint8_t prefix_len = data[i++];
+    size_t dst_len = (prefix_len + 7) / 8;
+    if (prefix_len > 32 || i + dst_len + 4 > len) {
+      return 0;
+    }
+
+    ipv4_route_t *route = &routes[count++];
+    route->dst = 0;
+    memcpy(&route->dst, data + i, dst_len);
+    memcpy(&route->gateway, data + i + dst_len, 4);
+    route->prefix_len = prefix_len;
+    i += dst_len + 4;
+  }
+  return count;
+}
 
+// Decodes an RFC 1035 name list with compression pointers (option 119) into
+// "a.example b.example". Stops at the first malformed or oversized name.
+static void parse_search_list(const uint8_t *data, size_t len, char *out,
+                              size_t cap) {
+  size_t out_len = 0;
+  size_t pos = 0;
+  out[0] = '\0';
+
+  while (pos < len) {
+    char name[256];
+    size_t name_len = 0;
+    size_t p = pos;
+    size_t next = 0;
+    int jumps = 0;
+
+    while (1) {
+      if (p >= len) {
+        return;
+      }
+      uint8_t c = data[p];
+      if (c == 0) {
+        if (!jumps) {
+          next = p + 1;
+        }
+        break;
+      }
+      if ((c & 0xc0) == 0xc0) {
+        if (p + 1 >= len || ++jumps > 16) {
+          return;
+        }
+        if (jumps == 1) {
+          next = p + 2;
+        }
+        p = ((c & 0x3f) << 8) | data[p + 1];
         continue;
       }
+      if (p + 1 + c > len || name_len + c + 1 >= sizeof(name)) {
+        return;
+      }
+      if (name_len) {
+        name[name_len++] = '.';
+      }
+      memcpy(name + name_len, data + p + 1, c);
+      name_len += c;
+      p += 1 + c;
+    }
+    pos = next;
 
-      udp_header_t *udp =
-          (udp_header_t *)(buffer + sizeof(eth_header_t) + sizeof(ip_header_t));
-      DEBUG_PRINT("UDP dest port: %d (expected: %d)\n", ntohs(udp->dest),
-                  DHCP_PORT_CLIENT);
-      if (ntohs(udp->dest) != DHCP_PORT_CLIENT) {
-        DEBUG_PRINT("Not DHCP client port, skipping\n");
+    if (out_len + name_len + 2 > cap) {
+      return;
+    }
+    if (out_len) {
+      out[out_len++] = ' ';
+    }
+    memcpy(out + out_len, name, name_len);
+    out_len += name_len;
+    out[out_len] = '\0';
+  }
+}
 
-        continue;
-      }
+static void parse_config(const uint8_t *options, const uint8_t *end,
+                         dhcp_client_t *client) {
+  dhcp_config_t *config = &client->config;
+  uint8_t data[DHCP_MAX_MSG_LEN];
+  size_t len;
 
-      size_t headers_size =
-          sizeof(eth_header_t) + sizeof(ip_header_t) + sizeof(udp_header_t);
+  memset(config, 0, sizeof(dhcp_config_t));
 
-      if (n_bytes < (ssize_t)(headers_size + 240)) {
-        DEBUG_PRINT(
-            "Packet too small for DHCP, headers: %zu, total received: "
-            "%zd\n",
-            headers_size, n_bytes);
-        continue;
-      }
+  len = collect_option(options, end, DHCP_OPTION_ROUTER, data, sizeof(data));
+  config->router_count = parse_addr_list(data, len, config->routers);
 
-      dhcp_packet_t *recv_packet =
-          (dhcp_packet_t *)(buffer + sizeof(eth_header_t) +
-                            sizeof(ip_header_t) + sizeof(udp_header_t));
+  len = collect_option(options, end, DHCP_OPTION_DNS_SERVER, data,
+                       sizeof(data));
+  config->dns_count = parse_addr_list(data, len, config->dns);
 
-      if (recv_packet->magic_cookie != htonl(DHCP_MAGIC_COOKIE)) {
-        continue;
-      }
+  len = collect_option(options, end, DHCP_OPTION_CLASSLESS_ROUTE, data,
+                       sizeof(data));
+  config->route_count = parse_classless_routes(data, len, config->routes);
 
-      if (recv_packet->xid != htonl(expected_xid)) {
-        continue;
+  client->router.s_addr = 0;
+  if (config->route_count) {
+    for (int i = 0; i < config->route_count; i++) {
+      if (config->routes[i].prefix_len == 0) {
+        client->router.s_addr = config->routes[i].gateway;
       }
+    }
+  } else if (config->router_count) {
+    client->router.s_addr = config->routers[0];
+    config->routes[0].gateway = config->routers[0];
+    config->route_count = 1;
+  }
+  client->dns.s_addr = config->dns_count ? config->dns[0] : 0;
+
+  len = collect_option(options, end, DHCP_OPTION_DOMAIN_SEARCH, data,
+                       sizeof(data));
+  parse_search_list(data, len, config->search, sizeof(config->search));
+  if (!config->search[0]) {
+    len = collect_option(options, end, DHCP_OPTION_DOMAIN_NAME, data,
+                         sizeof(config->search) - 1);
+    memcpy(config->search, data, len);
+    config->search[len] = '\0';
+  }
 
-      DEBUG_PRINT("Ethernet type: 0x%04X\n", htons(eth->eth_type));
-      DEBUG_PRINT("IP protocol: %d\n", ip->protocol);
-      DEBUG_PRINT("UDP dest port: %d\n", ntohs(udp->dest));
-      DEBUG_PRINT("DHCP magic cookie: 0x%08X\n", recv_packet->magic_cookie);
-      DEBUG_PRINT("Expected XID: 0x%08X, Received XID: 0x%08X\n",
-                  htonl(expected_xid), recv_packet->xid);
+  len = collect_option(options, end, DHCP_OPTION_INTERFACE_MTU, data, 2);
+  if (len == 2) {
+    config->mtu = (data[0] << 8) | data[1];
+  }
 
-      memcpy(dhcp_packet, recv_packet, sizeof(dhcp_packet_t));
-      return 0;
+  if (client->log_level >= DHCPC_LOG_DEBUG) {
+    char dst[INET_ADDRSTRLEN], gw[INET_ADDRSTRLEN];
+    for (int i = 0; i < config->router_count; i++) {
+      inet_ntop(AF_INET, &config->routers[i], gw, sizeof(gw));
+      printf("    Router: %s\n", gw);
+    }
+    for (int i = 0; i < config->dns_count; i++) {
+      inet_ntop(AF_INET, &config->dns[i], gw, sizeof(gw));
+      printf("    DNS: %s\n", gw);
+    }
+    for (int i = 0; i < config->route_count; i++) {
+      inet_ntop(AF_INET, &config->routes[i].dst, dst, sizeof(dst));
+      inet_ntop(AF_INET, &config->routes[i].gateway, gw, sizeof(gw));
+      printf("    Route: %s/%d via %s\n", dst, config->routes[i].prefix_len,
+             gw);
+    }
+    if (config->mtu) {
+      printf("    MTU: %u\n", config->mtu);
+    }
+    if (config->search[0]) {
+      printf("    Search: %s\n", config->search);
     }
   }
-  return -1;
 }
 
-int parse_options(dhcp_packet_t *packet, dhcp_client_t *client) {
-  uint8_t *options = packet->options;
+int parse_options(const dhcp_msg_t *msg, dhcp_client_t *client) {
+  const dhcp_packet_t *packet = &msg->packet;
+  const uint8_t *end = msg->raw + msg->len;
+  const uint8_t *options = packet->options;
   uint8_t msg_type = 0;
 
-  while (*options != DHCP_OPTION_END) {
+  while (options + 2 <= end && *options != DHCP_OPTION_END) {
     if (*options == 0) {
       options++;
       continue;
@@ -253,9 +465,12 @@ int parse_options(dhcp_packet_t *packet, dhcp_client_t *client) {
     options += len;
   }
 
+  DHCP_PROBE4(msg, ntohl(packet->xid), packet->chaddr, msg_type,
+              DHCP_PROBE_TS(msg));
+
   options = packet->options;
 
-  while (*options != DHCP_OPTION_END) {
+  while (options + 2 <= end && *options != DHCP_OPTION_END) {
     if (*options == 0) {
       options++;
       continue;
@@ -263,84 +478,77 @@ int parse_options(dhcp_packet_t *packet, dhcp_client_t *client) {
 
     uint8_t code = *options++;
     uint8_t len = *options++;
+    if (options + len > end) {
+      break;
+    }
 
     switch (code) {
       case DHCP_OPTION_MSG_TYPE:
         switch (*options) {
           case DHCPOFFER:
-            printf("[+] Received DHCPOFFER!\n");
-            printf("    Offered IP: %s\n",
-                   inet_ntoa(*(struct in_addr *)&packet->yiaddr));
+            LOG_INFO(client->log_level, "[+] Received DHCPOFFER!\n");
+            LOG_INFO(client->log_level, "    Offered IP: %s\n",
+                     inet_ntoa(*(struct in_addr *)&packet->yiaddr));
             client->offered_ip = *(struct in_addr *)&packet->yiaddr;
             client->server_ip = *(struct in_addr *)&packet->siaddr;
 
-            if (verbose_flag) {
+            if (client->log_level >= DHCPC_LOG_DEBUG) {
               print_dhcp_packet(packet, "OFFER");
             }
             break;
 
           case DHCPACK:
-            printf("[+] Received DHCPACK!\n");
-            printf("    Assigned IP: %s\n",
-                   inet_ntoa(*(struct in_addr *)&packet->yiaddr));
+            LOG_INFO(client->log_level, "[+] Received DHCPACK!\n");
+            LOG_INFO(client->log_level, "    Assigned IP: %s\n",
+                     inet_ntoa(*(struct in_addr *)&packet->yiaddr));
             client->offered_ip = *(struct in_addr *)&packet->yiaddr;
             client->server_ip = *(struct in_addr *)&packet->siaddr;
 
-            if (verbose_flag) {
+            if (client->log_level >= DHCPC_LOG_DEBUG) {
               print_dhcp_packet(packet, "ACK");
             }
             break;
 
           case DHCPNAK:
-            printf("[!] Received DHCPNAK!\n");
-            if (verbose_flag) {
+            LOG_INFO(client->log_level, "[!] Received DHCPNAK!\n");
+            if (client->log_level >= DHCPC_LOG_DEBUG) {
               print_dhcp_packet(packet, "NAK");
             }
             break;
 
           default:
-            printf("[*] Received DHCP message type: %d\n", *options);
+            LOG_INFO(client->log_level, "[*] Received DHCP message type: %d\n",
+                     *options);
         }
         break;
 
       case DHCP_OPTION_SUBNET_MASK:
         if (len == 4) {
           client->subnet_mask = *(struct in_addr *)options;
-          DEBUG_PRINT("    Subnet Mask: %s\n", inet_ntoa(client->subnet_mask));
-        }
-        break;
-
-      case DHCP_OPTION_ROUTER:
-        if (len >= 4) {
-          client->router = *(struct in_addr *)options;
-          DEBUG_PRINT("    Router: %s\n", inet_ntoa(client->router));
-        }
-        break;
-
-      case DHCP_OPTION_DNS_SERVER:
-        if (len >= 4) {
-          client->dns = *(struct in_addr *)options;
-          DEBUG_PRINT("    DNS: %s\n", inet_ntoa(client->dns));
+          DEBUG_PRINT(client->log_level, "    Subnet Mask: %s\n",
+                      inet_ntoa(client->subnet_mask));
         }
         break;
 
       case DHCP_OPTION_LEASE_TIME:
         if (len == 4) {
           client->lease_time = ntohl(*(uint32_t *)options);
-          DEBUG_PRINT("    Lease Time: %u seconds\n", client->lease_time);
+          DEBUG_PRINT(client->log_level, "    Lease Time: %u seconds\n",
+                      client->lease_time);
         }
         break;
 
       case DHCP_OPTION_DHCP_SERVER:
         if (len == 4) {
           client->server_ip = *(struct in_addr *)options;
-          DEBUG_PRINT("    Server IP: %s\n", inet_ntoa(client->server_ip));
+          DEBUG_PRINT(client->log_level, "    Server IP: %s\n",
+                      inet_ntoa(client->server_ip));
         }
         break;
 
       case DHCP_OPTION_REQUESTED_IP:
         if (len == 4) {
-          DEBUG_PRINT("    Requested IP: %s\n",
+          DEBUG_PRINT(client->log_level, "    Requested IP: %s\n",
                       inet_ntoa(*(struct in_addr *)options));
         }
         break;
@@ -349,6 +557,11 @@ int parse_options(dhcp_packet_t *packet, dhcp_client_t *client) {
     options += len;
   }
 
+  // Routers, DNS and routes may be split over several option instances.
+  if (msg_type == DHCPOFFER || msg_type == DHCPACK) {
+    parse_config(packet->options, end, client);
+  }
+
   return msg_type;
 }
 
@@ -0,0 +1,309 @@
+#include "pipeline.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "lease_file.h"
+#include "logging.h"
+#include "probes.h"
+#include "resolv_conf.h"
+#include "spsc_ring.h"
+
+// The configuration stage: one worker thread with its own netlink socket.
+// Jobs go in through one ring and come back through another; an eventfd per
+// direction wakes the side that sleeps.
+struct dhcpc_pipeline {
+  spsc_ring_t jobs;  // config_job_t, event loop -> worker
+  spsc_ring_t done;  // config_done_t, worker -> event loop
+  uint32_t limit;    // jobs in flight, counting unprocessed completions
+  int job_fd;
+  int done_fd;
+  pthread_t thread;
+  int stop;
+  iface_ctx_t iface;  // the worker's; ifindex and mtu are set per job
+  // Event loop side
+  uint64_t submitted;
+  uint64_t processed;
+  uint64_t inline_jobs;
+  uint32_t max_depth;
+  uint32_t max_done_depth;
+  // Worker side, read with __atomic
+  uint64_t finished;
+  uint64_t busy_us;
+  uint32_t max_wait_us;
+  uint32_t max_service_us;
+};
+
+void config_job_init(config_job_t *job, const dhcp_client_t *client) {
+  job->client = (dhcp_client_t *)client;
+  job->queued_us = monotonic_us();
+  job->xid = client->xid;
+  job->ifindex = client->iface.ifindex;
+  job->mtu = client->iface.mtu;
+  job->configure = client->configure;
+  job->log_level = client->log_level;
+  job->address = client->offered_ip;
+  job->prefix_len = __builtin_popcount(client->subnet_mask.s_addr);
+  job->lease_time = client->lease_time;
+  job->server = client->server_ip;
+  memcpy(job->server_mac, client->server_mac, 6);
+  job->resolv_conf = client->resolv_conf;
+  job->lease_file = client->lease_file;
+  memcpy(job->rtt, client->rtt, sizeof(job->rtt));
+  // Only the routes in use; the table is most of the struct.
+  const dhcp_config_t *config = &client->config;
+  memcpy(&job->config, config, offsetof(dhcp_config_t, routes));
+  memcpy(job->config.routes, config->routes,
+         config->route_count * sizeof(ipv4_route_t));
+  memcpy(&job->config.router_count, &config->router_count,
+         sizeof(dhcp_config_t) - offsetof(dhcp_config_t, router_count));
+}
+
+int config_job_run(const config_job_t *job, iface_ctx_t *iface) {
+  const dhcp_config_t *config = &job->config;
+  uint64_t start_us = monotonic_us();
+  int failed = 0;
+
+  if (job->configure) {
+    failed = iface_ctx_configure(iface, job->address, job->prefix_len,
+                                 job->lease_time, config->mtu, config->routes,
+                                 config->route_count);
+  }
+
+  if (job->resolv_conf && config->dns_count) {
+    resolv_conf_write(job->resolv_conf, config->dns, config->dns_count,
+                      config->search);
+  }
+  if (job->lease_file) {
+    lease_record_t lease;
+    lease.address = job->address;
+    lease.prefix_len = job->prefix_len;
+    lease.server = job->server;
+    memcpy(lease.server_mac, job->server_mac, 6);
+    lease.expires = realtime_ns() / 1000000000 + job->lease_time;
+    lease.route_count = config->route_count;
+    memcpy(lease.routes, config->routes,
+           config->route_count * sizeof(ipv4_route_t));
+    memcpy(lease.rtt, job->rtt, sizeof(lease.rtt));
+    lease_file_write(job->lease_file, &lease);
+  }
+
+  uint64_t elapsed_us = monotonic_us() - start_us;
+  DHCP_PROBE5(config, job->xid, ntohl(job->address.s_addr),
+              config->route_count, failed, elapsed_us * 1000);
+  DEBUG_PRINT(job->log_level, "Configured address, %d routes%s in %llu us\n",
+              config->route_count, config->mtu ? ", MTU" : "",
+              (unsigned long long)elapsed_us);
+  return failed;
+}
+
+static void update_max(uint32_t *max, uint32_t value) {
+  if (value > __atomic_load_n(max, __ATOMIC_RELAXED)) {
+    __atomic_store_n(max, value, __ATOMIC_RELAXED);
+  }
+}
+
+static void *pipeline_main(void *arg) {
+  dhcpc_pipeline_t *p = arg;
+  uint64_t count;
+
+  for (;;) {
+    config_job_t *job;
+    while ((job = spsc_ring_peek(&p->jobs))) {
+      uint64_t start_us = monotonic_us();
+      // Never full: submissions stop at limit unprocessed completions.
+      config_done_t *done = spsc_ring_reserve(&p->done);
+      p->iface.ifindex = job->ifindex;
+      p->iface.mtu = job->mtu;
+      done->client = job->client;
+      done->failed = config_job_run(job, &p->iface);
+      done->mtu = p->iface.mtu;
+
+      uint64_t end_us = monotonic_us();
+      update_max(&p->max_wait_us, (uint32_t)(start_us - job->queued_us));
+      update_max(&p->max_service_us, (uint32_t)(end_us - start_us));
+      __atomic_store_n(&p->busy_us, p->busy_us + (end_us - start_us),
+                       __ATOMIC_RELAXED);
+      spsc_ring_pop(&p->jobs);
+      spsc_ring_publish(&p->done);
+      __atomic_store_n(&p->finished, p->finished + 1, __ATOMIC_RELEASE);
+
+      count = 1;
+      if (write(p->done_fd, &count, sizeof(count)) < 0) {
+        perror("[-] write() pipeline eventfd");
+      }
+    }
+    if (__atomic_load_n(&p->stop, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+    // Blocks until the event loop queues more (or asks us to stop).
+    if (read(p->job_fd, &count, sizeof(count)) < 0 && errno != EINTR) {
+      perror("[-] read() pipeline eventfd");
+      break;
+    }
+  }
+  return NULL;
+}
+
+dhcpc_pipeline_t *dhcpc_pipeline_new(int depth) {
+  if (depth <= 0) {
+    fprintf(stderr, "[-] pipeline depth must be positive\n");
+    return NULL;
+  }
+  dhcpc_pipeline_t *p = NULL;
+  if (posix_memalign((void **)&p, 64, sizeof(dhcpc_pipeline_t)) != 0) {
+    perror("[-] posix_memalign() pipeline");
+    return NULL;
+  }
+  memset(p, 0, sizeof(dhcpc_pipeline_t));
+  p->limit = depth;
+  p->job_fd = -1;
+  p->done_fd = -1;
+  p->iface.nl.fd = -1;
+
+  if (spsc_ring_init(&p->jobs, depth, sizeof(config_job_t)) < 0 ||
+      spsc_ring_init(&p->done, depth, sizeof(config_done_t)) < 0) {
+    perror("[-] calloc() pipeline rings");
+    dhcpc_pipeline_free(p);
+    return NULL;
+  }
+  if ((p->job_fd = eventfd(0, EFD_CLOEXEC)) < 0 ||
+      (p->done_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+    perror("[-] eventfd()");
+    dhcpc_pipeline_free(p);
+    return NULL;
+  }
+  if (nl_open(&p->iface.nl, 0) < 0) {
+    dhcpc_pipeline_free(p);
+    return NULL;
+  }
+  if (pthread_create(&p->thread, NULL, pipeline_main, p) != 0) {
+    fprintf(stderr, "[-] pthread_create() pipeline failed\n");
+    p->stop = 1;  // nothing to join
+    dhcpc_pipeline_free(p);
+    return NULL;
+  }
+  return p;
+}
+
+void dhcpc_pipeline_free(dhcpc_pipeline_t *p) {
+  if (!p) {
+    return;
+  }
+  if (!p->stop) {
+    uint64_t one = 1;
+    __atomic_store_n(&p->stop, 1, __ATOMIC_RELEASE);
+    if (write(p->job_fd, &one, sizeof(one)) < 0) {
+      perror("[-] write() pipeline eventfd");
+    }
+    pthread_join(p->thread, NULL);
+  }
+  if (p->job_fd >= 0) {
+    close(p->job_fd);
+  }
+  if (p->done_fd >= 0) {
+    close(p->done_fd);
+  }
+  nl_close(&p->iface.nl);
+  spsc_ring_destroy(&p->jobs);
+  spsc_ring_destroy(&p->done);
+  free(p);
+}
+
+int dhcpc_pipeline_get_fd(const dhcpc_pipeline_t *p) { return p->done_fd; }
+
+int pipeline_submit(dhcpc_pipeline_t *p, dhcp_client_t *client) {
+  config_job_t *job;
+  if (p->submitted - p->processed >= p->limit ||
+      !(job = spsc_ring_reserve(&p->jobs))) {
+    p->inline_jobs++;
+    return -1;
+  }
+  config_job_init(job, client);
+  spsc_ring_publish(&p->jobs);
+  client->config_seq = ++p->submitted;
+  update_max(&p->max_depth, spsc_ring_depth(&p->jobs));
+
+  uint64_t one = 1;
+  if (write(p->job_fd, &one, sizeof(one)) < 0) {
+    perror("[-] write() pipeline eventfd");
+  }
+  return 0;
+}
+
+// Sleeps on done_fd. The worker counts a job as finished before it writes
+// the eventfd, so draining it and then checking again cannot miss a wakeup.
+// Completions of other handles may have been drained along the way; the
+// eventfd is left readable for dhcpc_pipeline_process() in that case.
+void pipeline_wait(dhcpc_pipeline_t *p, dhcp_client_t *client, int forget) {
+  uint64_t count, drained = 0;
+  while (__atomic_load_n(&p->finished, __ATOMIC_ACQUIRE) < client->config_seq) {
+    if (read(p->done_fd, &count, sizeof(count)) == sizeof(count)) {
+      drained += count;
+      continue;
+    }
+    struct pollfd pfd = {.fd = p->done_fd, .events = POLLIN};
+    if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+      perror("[-] poll() pipeline eventfd");
+      break;
+    }
+  }
+  if (drained && write(p->done_fd, &drained, sizeof(drained)) < 0) {
+    perror("[-] write() pipeline eventfd");
+  }
+  if (!forget) {
+    return;
+  }
+  // Unprocessed completions are ours to change until they are popped.
+  uint32_t head = __atomic_load_n(&p->done.head, __ATOMIC_ACQUIRE);
+  for (uint32_t i = p->done.tail; i != head; i++) {
+    config_done_t *done = spsc_ring_slot(&p->done, i);
+    if (done->client == client) {
+      done->client = NULL;
+    }
+  }
+  client->config_pending = 0;
+}
+
+int dhcpc_pipeline_process(dhcpc_pipeline_t *p) {
+  uint64_t count;
+  if (read(p->done_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+    perror("[-] read() pipeline eventfd");
+  }
+  update_max(&p->max_done_depth, spsc_ring_depth(&p->done));
+
+  int n = 0;
+  config_done_t *done;
+  while ((done = spsc_ring_peek(&p->done))) {
+    config_done_t copy = *done;
+    spsc_ring_pop(&p->done);
+    p->processed++;
+    n++;
+    // After the pop: the callback may queue another job.
+    if (copy.client) {
+      dhcp_config_done(copy.client, &copy);
+    }
+  }
+  return n;
+}
+
+void dhcpc_pipeline_get_stats(const dhcpc_pipeline_t *p,
+                              dhcpc_pipeline_stats_t *stats) {
+  uint64_t finished = __atomic_load_n(&p->finished, __ATOMIC_ACQUIRE);
+  stats->depth = (uint32_t)(p->submitted - finished);
+  stats->max_depth = p->max_depth;
+  stats->done_depth = spsc_ring_depth(&p->done);
+  stats->max_done_depth = p->max_done_depth;
+  stats->jobs = p->submitted;
+  stats->inline_jobs = p->inline_jobs;
+  stats->busy_us = __atomic_load_n(&p->busy_us, __ATOMIC_RELAXED);
+  stats->max_wait_us = __atomic_load_n(&p->max_wait_us, __ATOMIC_RELAXED);
+  stats->max_service_us =
+      __atomic_load_n(&p->max_service_us, __ATOMIC_RELAXED);
+}
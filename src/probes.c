@@ -0,0 +1,11 @@
+#include "probes.h"
+
+#ifdef DHCP_PROBES
+
+// Tracers find these through the probe notes and bump them while attached.
+#define DHCP_PROBE_DEFINE(name)                        \
+  volatile unsigned short dhcp_##name##_semaphore      \
+      __attribute__((section(".probes"), used)) = 0;
+DHCP_PROBE_LIST(DHCP_PROBE_DEFINE)
+
+#endif
@@ -0,0 +1,58 @@
+#include "resolv_conf.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int resolv_conf_write(const char *path, const uint32_t *dns, int count,
+                      const char *search) {
+  char tmp_path[4096];
+  if (snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path) >=
+      (int)sizeof(tmp_path)) {
+    fprintf(stderr, "[-] resolv.conf path too long\n");
+    return -1;
+  }
+
+  int fd = mkstemp(tmp_path);
+  if (fd < 0) {
+    perror("[-] mkstemp() resolv.conf");
+    return -1;
+  }
+  fchmod(fd, 0644);
+
+  FILE *f = fdopen(fd, "w");
+  if (!f) {
+    perror("[-] fdopen() resolv.conf");
+    close(fd);
+    unlink(tmp_path);
+    return -1;
+  }
+
+  fprintf(f, "# Generated by dhcp_client\n");
+  if (search && search[0]) {
+    fprintf(f, "search %s\n", search);
+  }
+  for (int i = 0; i < count; i++) {
+    char addr[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &dns[i], addr, sizeof(addr));
+    fprintf(f, "nameserver %s\n", addr);
+  }
+
+  if (fflush(f) != 0 || fsync(fd) < 0) {
+    perror("[-] write resolv.conf");
+    fclose(f);
+    unlink(tmp_path);
+    return -1;
+  }
+  fclose(f);
+
+  if (rename(tmp_path, path) < 0) {
+    perror("[-] rename() resolv.conf");
+    unlink(tmp_path);
+    return -1;
+  }
+  return 0;
+}
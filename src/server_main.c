@@ -0,0 +1,216 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dhcp_server.h"
+#include "network_utils.h"
+
+static volatile sig_atomic_t stop_signal;
+
+static void on_stop_signal(int sig) { stop_signal = sig; }
+
+void print_usage(const char *program_name) {
+  printf("Usage: %s [OPTIONS] <interface>\n", program_name);
+  printf("DHCP server for load tests\n\n");
+  printf("Options:\n");
+  printf("  -s, --server ADDR/LEN   Server address and subnet\n");
+  printf("                          (default: 10.0.0.1/16)\n");
+  printf("  -p, --pool FIRST-LAST   Addresses to lease\n");
+  printf("                          (default: the rest of the subnet)\n");
+  printf("  -L, --lease-time SECS   Lease time (default: 3600)\n");
+  printf("  -g, --router ADDR       Router to announce (option 3)\n");
+  printf("  -d, --dns ADDR          DNS server to announce (option 6)\n");
+  printf("  -f, --lease-log FILE    Append-only lease database\n");
+  printf("  -S, --sync              fdatasync() the log before each batch\n");
+  printf("                          of replies\n");
+  printf("  -v, --verbose           One line per lease, rates every second\n");
+  printf("  -h, --help              Show this help message\n");
+}
+
+static int parse_addr(const char *text, struct in_addr *addr) {
+  if (inet_pton(AF_INET, text, addr) != 1) {
+    fprintf(stderr, "Error: Bad address '%s'\n", text);
+    return -1;
+  }
+  return 0;
+}
+
+int parse_args(int argc, char **argv, dhcp_server_config_t *config) {
+  dhcp_server_config_init(config);
+  const char *server = "10.0.0.1/16";
+  const char *pool = NULL;
+
+  struct option long_options[] = {{"help", no_argument, 0, 'h'},
+                                  {"server", required_argument, 0, 's'},
+                                  {"pool", required_argument, 0, 'p'},
+                                  {"lease-time", required_argument, 0, 'L'},
+                                  {"router", required_argument, 0, 'g'},
+                                  {"dns", required_argument, 0, 'd'},
+                                  {"lease-log", required_argument, 0, 'f'},
+                                  {"sync", no_argument, 0, 'S'},
+                                  {"verbose", no_argument, 0, 'v'},
+                                  {NULL, 0, NULL, 0}};
+  int opt;
+  int options_index = 0;
+
+  while ((opt = getopt_long(argc, argv, "s:p:L:g:d:f:Svh", long_options,
+                            &options_index)) != -1) {
+    switch (opt) {
+      case 's':
+        server = optarg;
+        break;
+      case 'p':
+        pool = optarg;
+        break;
+      case 'L':
+        if (atoi(optarg) <= 0) {
+          fprintf(stderr, "Error: Lease time must be positive\n");
+          return -1;
+        }
+        config->lease_secs = atoi(optarg);
+        break;
+      case 'g':
+        if (parse_addr(optarg, &config->router) < 0) {
+          return -1;
+        }
+        break;
+      case 'd':
+        if (parse_addr(optarg, &config->dns) < 0) {
+          return -1;
+        }
+        break;
+      case 'f':
+        config->lease_log = optarg;
+        break;
+      case 'S':
+        config->sync = 1;
+        break;
+      case 'v':
+        config->verbose = 1;
+        break;
+      case 'h':
+        print_usage(argv[0]);
+        exit(EXIT_SUCCESS);
+        break;
+      case '?':
+        return -1;
+      default:
+        break;
+    }
+  }
+
+  if (optind >= argc) {
+    fprintf(stderr, "Error: Interface name is required\n");
+    print_usage(argv[0]);
+    return -1;
+  }
+  config->ifname = argv[optind];
+
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%s", server);
+  char *slash = strchr(buf, '/');
+  if (!slash) {
+    fprintf(stderr, "Error: Server address needs a prefix length\n");
+    return -1;
+  }
+  *slash = '\0';
+  config->prefix_len = atoi(slash + 1);
+  if (parse_addr(buf, &config->server) < 0) {
+    return -1;
+  }
+
+  if (pool) {
+    snprintf(buf, sizeof(buf), "%s", pool);
+    char *dash = strchr(buf, '-');
+    if (!dash) {
+      fprintf(stderr, "Error: Pool must be FIRST-LAST\n");
+      return -1;
+    }
+    *dash = '\0';
+    if (parse_addr(buf, &config->first) < 0 ||
+        parse_addr(dash + 1, &config->last) < 0) {
+      return -1;
+    }
+  } else if (config->prefix_len > 0 && config->prefix_len <= 30) {
+    // Everything above the server address up to the broadcast address.
+    uint32_t mask = ~0u << (32 - config->prefix_len);
+    uint32_t host = ntohl(config->server.s_addr);
+    config->first.s_addr = htonl(host + 1);
+    config->last.s_addr = htonl((host | ~mask) - 1);
+  }
+  return 0;
+}
+
+static void print_stats(const dhcp_server_stats_t *stats, double secs,
+                        const dhcp_server_stats_t *last) {
+  printf("[*] %8.0f offers/s %8.0f acks/s %6llu naks %6llu releases "
+         "%10u leases\n",
+         (stats->offers - last->offers) / secs,
+         (stats->acks - last->acks) / secs, (unsigned long long)stats->naks,
+         (unsigned long long)stats->releases, stats->leases);
+}
+
+int main(int argc, char *argv[]) {
+  dhcp_server_config_t config;
+  if (parse_args(argc, argv, &config) < 0) {
+    return EXIT_FAILURE;
+  }
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_stop_signal;
+  sigaction(SIGTERM, &sa, NULL);
+  sigaction(SIGINT, &sa, NULL);
+
+  dhcp_server_t *srv = dhcp_server_new(&config);
+  if (!srv) {
+    return EXIT_FAILURE;
+  }
+  const dhcp_server_stats_t *stats = dhcp_server_stats(srv);
+  char first[INET_ADDRSTRLEN], last[INET_ADDRSTRLEN];
+  printf("[*] Serving %s-%s on %s, %u leases from the log, "
+         "%.1f bytes per address\n",
+         inet_ntop(AF_INET, &config.first, first, sizeof(first)),
+         inet_ntop(AF_INET, &config.last, last, sizeof(last)), config.ifname,
+         stats->leases, dhcp_server_bytes_per_lease(srv));
+  fflush(stdout);
+
+  dhcp_server_stats_t prev = *stats;
+  uint64_t prev_ms = monotonic_ms();
+  struct pollfd pfd = {.fd = dhcp_server_get_fd(srv), .events = POLLIN};
+  while (!stop_signal) {
+    if (poll(&pfd, 1, 1000) < 0 && errno != EINTR) {
+      perror("[-] poll()");
+      break;
+    }
+    if (pfd.revents && dhcp_server_process(srv) < 0) {
+      break;
+    }
+
+    uint64_t now_ms = monotonic_ms();
+    if (config.verbose && now_ms - prev_ms >= 1000) {
+      print_stats(stats, (now_ms - prev_ms) / 1000.0, &prev);
+      fflush(stdout);
+      prev = *stats;
+      prev_ms = now_ms;
+    }
+  }
+
+  printf("[*] %llu requests: %llu offers, %llu acks, %llu naks, "
+         "%llu releases, %llu declines, %llu ignored, %llu with the pool "
+         "empty\n",
+         (unsigned long long)stats->received,
+         (unsigned long long)stats->offers, (unsigned long long)stats->acks,
+         (unsigned long long)stats->naks,
+         (unsigned long long)stats->releases,
+         (unsigned long long)stats->declines,
+         (unsigned long long)stats->ignored,
+         (unsigned long long)stats->exhausted);
+  dhcp_server_free(srv);
+  return 0;
+}
@@ -0,0 +1,216 @@
+#include "status_file.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "network_utils.h"
+
+static status_slot_t *status_slot(const status_header_t *header, uint32_t i) {
+  return (status_slot_t *)((char *)header + header->header_size +
+                           (size_t)i * header->slot_size);
+}
+
+// Built under a temporary name and renamed into place, so a reader never
+// maps a file whose header is still being written.
+dhcpc_status_t *dhcpc_status_open(const char *path, int slots) {
+  if (slots < 1) {
+    fprintf(stderr, "[-] Status file needs at least one slot\n");
+    return NULL;
+  }
+  dhcpc_status_t *status = calloc(1, sizeof(dhcpc_status_t));
+  if (!status || !(status->path = strdup(path)) ||
+      !(status->claimed = calloc(slots, 1))) {
+    perror("[-] malloc");
+    if (status) {
+      free(status->path);
+    }
+    free(status);
+    return NULL;
+  }
+  status->fd = -1;
+
+  char tmp_path[4096];
+  if (snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path) >=
+      (int)sizeof(tmp_path)) {
+    fprintf(stderr, "[-] status file path too long\n");
+    goto fail;
+  }
+  if ((status->fd = mkstemp(tmp_path)) < 0) {
+    perror("[-] mkstemp() status file");
+    goto fail;
+  }
+  fchmod(status->fd, 0644);
+
+  status->size =
+      sizeof(status_header_t) + (size_t)slots * sizeof(status_slot_t);
+  if (ftruncate(status->fd, status->size) < 0) {
+    perror("[-] ftruncate() status file");
+    goto fail_unlink;
+  }
+  status->header = mmap(NULL, status->size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, status->fd, 0);
+  if (status->header == MAP_FAILED) {
+    perror("[-] mmap() status file");
+    status->header = NULL;
+    goto fail_unlink;
+  }
+
+  status_header_t *header = status->header;
+  memcpy(header->magic, STATUS_MAGIC, sizeof(header->magic));
+  header->version = STATUS_VERSION;
+  header->header_size = sizeof(status_header_t);
+  header->slot_size = sizeof(status_slot_t);
+  header->slot_count = slots;
+  header->pid = getpid();
+
+  if (rename(tmp_path, path) < 0) {
+    perror("[-] rename() status file");
+    goto fail_unlink;
+  }
+  return status;
+
+fail_unlink:
+  unlink(tmp_path);
+fail:
+  if (status->header) {
+    munmap(status->header, status->size);
+  }
+  if (status->fd >= 0) {
+    close(status->fd);
+  }
+  free(status->claimed);
+  free(status->path);
+  free(status);
+  return NULL;
+}
+
+void dhcpc_status_close(dhcpc_status_t *status) {
+  if (status) {
+    // A client started in our place may already have renamed its own file
+    // over the path; that one stays.
+    struct stat ours, named;
+    if (fstat(status->fd, &ours) == 0 && stat(status->path, &named) == 0 &&
+        ours.st_dev == named.st_dev && ours.st_ino == named.st_ino) {
+      unlink(status->path);
+    }
+    munmap(status->header, status->size);
+    close(status->fd);
+    free(status->claimed);
+    free(status->path);
+    free(status);
+  }
+}
+
+// Handles may be created from several threads; each slot has one writer.
+int status_claim(dhcpc_status_t *status) {
+  for (uint32_t i = 0; i < status->header->slot_count; i++) {
+    if (!__atomic_exchange_n(&status->claimed[i], 1, __ATOMIC_ACQ_REL)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void status_release(dhcpc_status_t *status, int slot) {
+  status_slot_t *s = status_slot(status->header, slot);
+  uint32_t seq = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+
+  __atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memset((char *)s + sizeof(s->seq), 0, sizeof(*s) - sizeof(s->seq));
+  __atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+  __atomic_store_n(&status->claimed[slot], 0, __ATOMIC_RELEASE);
+}
+
+// The writer side of the seqlock: no syscalls and no locks, so it is cheap
+// enough to run at the end of every dhcpc_process() call.
+void status_publish(dhcpc_status_t *status, int slot,
+                    const dhcp_client_t *client, int holds_lease) {
+  status_slot_t *s = status_slot(status->header, slot);
+  uint32_t seq = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+  int64_t now_ns = realtime_ns();
+
+  __atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  s->in_use = 1;
+  s->state = client->state;
+  s->last_event = client->last_event;
+  s->holds_lease = holds_lease;
+  memcpy(s->ifname, client->iface.ifname, sizeof(s->ifname));
+  memcpy(s->mac, client->iface.mac, sizeof(s->mac));
+  s->mtu = client->iface.mtu;
+  s->xid = client->xid;
+  s->address = client->offered_ip.s_addr;
+  s->netmask = client->subnet_mask.s_addr;
+  s->router = client->router.s_addr;
+  s->server = client->server_ip.s_addr;
+  s->dns = client->dns.s_addr;
+  s->lease_time = client->lease_time;
+  s->offer_us = client->offer_us;
+  s->ack_us = client->ack_us;
+  s->bound_at = 0;
+  if (client->bound_at_ms) {
+    s->bound_at = now_ns / 1000000000 -
+                  (int64_t)(monotonic_ms() - client->bound_at_ms) / 1000;
+  }
+  s->expires = holds_lease ? s->bound_at + client->lease_time : 0;
+  s->updated_ns = now_ns;
+  s->tx_frames = client->io ? client->io->stats.tx_frames : 0;
+  s->rx_frames = client->io ? client->io->stats.rx_frames : 0;
+  memcpy(s->events, client->event_counts, sizeof(s->events));
+
+  __atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+int status_read_slot(const status_header_t *header, uint32_t i,
+                     status_slot_t *out) {
+  const status_slot_t *s = status_slot(header, i);
+  size_t len = header->slot_size < sizeof(*out) ? header->slot_size
+                                                : sizeof(*out);
+
+  for (int tries = 0; tries < 1000; tries++) {
+    uint32_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1) {
+      sched_yield();
+      continue;
+    }
+    // The copy may be torn; the recheck below throws such copies away.
+    memcpy(out, s, len);
+    memset((char *)out + len, 0, sizeof(*out) - len);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq) {
+      out->seq = seq;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+const char *status_state_name(int state) {
+  static const char *names[] = {
+      [DHCP_STATE_INIT] = "INIT",
+      [DHCP_STATE_DISCOVER_SENT] = "DISCOVER_SENT",
+      [DHCP_STATE_OFFER_RECEIVED] = "OFFER_RECEIVED",
+      [DHCP_STATE_REQUEST_SENT] = "REQUEST_SENT",
+      [DHCP_STATE_BOUND] = "BOUND",
+      [DHCP_STATE_INIT_REBOOT] = "INIT_REBOOT",
+      [DHCP_STATE_REBOOTING] = "REBOOTING",
+      [DHCP_STATE_FAILED] = "FAILED",
+      [DHCP_STATE_PROBING] = "PROBING",
+      [DHCP_STATE_RELEASED] = "RELEASED",
+      [DHCP_STATE_RENEWING] = "RENEWING",
+      [DHCP_STATE_REBINDING] = "REBINDING",
+  };
+  if (state < 0 || state >= (int)(sizeof(names) / sizeof(names[0])) ||
+      !names[state]) {
+    return "UNKNOWN";
+  }
+  return names[state];
+}
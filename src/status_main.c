@@ -0,0 +1,262 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <glob.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "network_utils.h"
+#include "status_file.h"
+
+#define DEFAULT_PATTERN "/run/dhcp_client.*.status"
+
+typedef struct {
+  char *path;
+  int fd;  // kept to notice when the file is unlinked
+  const status_header_t *header;
+  size_t size;
+} status_map_t;
+
+typedef struct {
+  status_map_t *maps;
+  int count;
+  int capacity;
+} status_set_t;
+
+void print_usage(const char *program_name) {
+  printf("Usage: %s [OPTIONS] [FILE...]\n", program_name);
+  printf("Print the state of every client in the given status files\n");
+  printf("(default: %s)\n\n", DEFAULT_PATTERN);
+  printf("Options:\n");
+  printf("  -w, --watch MS          Print again every MS milliseconds,\n");
+  printf("                          picking up new files and dropping\n");
+  printf("                          removed ones\n");
+  printf("  -h, --help              Show this help message\n");
+}
+
+// Mapped once; every pass after that reads the slots from memory.
+static int status_map(const char *path, status_map_t *map) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "[-] open() %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(status_header_t)) {
+    fprintf(stderr, "[-] %s: not a status file\n", path);
+    close(fd);
+    return -1;
+  }
+  void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    fprintf(stderr, "[-] mmap() %s: %s\n", path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  const status_header_t *header = addr;
+  if (memcmp(header->magic, STATUS_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != STATUS_VERSION ||
+      header->slot_size < offsetof(status_slot_t, events) ||
+      header->header_size + (size_t)header->slot_count * header->slot_size >
+          (size_t)st.st_size) {
+    fprintf(stderr, "[-] %s: not a version %d status file\n", path,
+            STATUS_VERSION);
+    munmap(addr, st.st_size);
+    close(fd);
+    return -1;
+  }
+  if (!(map->path = strdup(path))) {
+    perror("[-] malloc");
+    munmap(addr, st.st_size);
+    close(fd);
+    return -1;
+  }
+  map->fd = fd;
+  map->header = header;
+  map->size = st.st_size;
+  return 0;
+}
+
+static void status_unmap(status_map_t *map) {
+  munmap((void *)map->header, map->size);
+  close(map->fd);
+  free(map->path);
+}
+
+static int cmp_path(const void *a, const void *b) {
+  return strcmp(((const status_map_t *)a)->path,
+                ((const status_map_t *)b)->path);
+}
+
+// Drops files that were unlinked (the client exited, or a new one renamed
+// its file over the path) and maps the paths not mapped yet, in path order.
+// Returns how many of those could not be mapped; with quiet, missing ones
+// are skipped without a message.
+static int status_refresh(status_set_t *set, char **paths, int path_count,
+                          int quiet) {
+  for (int i = 0; i < set->count;) {
+    struct stat st;
+    if (fstat(set->maps[i].fd, &st) == 0 && st.st_nlink > 0) {
+      i++;
+      continue;
+    }
+    status_unmap(&set->maps[i]);
+    set->maps[i] = set->maps[--set->count];
+  }
+
+  int failed = 0;
+  for (int i = 0; i < path_count; i++) {
+    int mapped = 0;
+    for (int j = 0; j < set->count && !mapped; j++) {
+      mapped = !strcmp(set->maps[j].path, paths[i]);
+    }
+    if (mapped) {
+      continue;
+    }
+    if (set->count == set->capacity) {
+      int capacity = set->capacity ? 2 * set->capacity : 16;
+      status_map_t *maps = realloc(set->maps, capacity * sizeof(*maps));
+      if (!maps) {
+        perror("[-] malloc");
+        return failed + path_count - i;
+      }
+      set->maps = maps;
+      set->capacity = capacity;
+    }
+    if (quiet && access(paths[i], F_OK) < 0) {
+      failed++;
+    } else if (status_map(paths[i], &set->maps[set->count]) == 0) {
+      set->count++;
+    } else {
+      failed++;
+    }
+  }
+  qsort(set->maps, set->count, sizeof(*set->maps), cmp_path);
+  return failed;
+}
+
+static void print_slot(const status_slot_t *s, uint32_t pid, int alive,
+                       int64_t now) {
+  char address[INET_ADDRSTRLEN + 3] = "-";
+  char router[INET_ADDRSTRLEN] = "-";
+  char server[INET_ADDRSTRLEN] = "-";
+  char expires[24] = "-";
+  char event[16] = "-";
+
+  if (s->address) {
+    inet_ntop(AF_INET, &s->address, address, sizeof(address));
+    snprintf(address + strlen(address), 4, "/%d",
+             __builtin_popcount(s->netmask));
+  }
+  if (s->router) {
+    inet_ntop(AF_INET, &s->router, router, sizeof(router));
+  }
+  if (s->server) {
+    inet_ntop(AF_INET, &s->server, server, sizeof(server));
+  }
+  if (s->expires) {
+    snprintf(expires, sizeof(expires), "%llds",
+             (long long)(s->expires - now));
+  }
+  if (s->last_event) {
+    snprintf(event, sizeof(event), "%s",
+             dhcpc_event_name((dhcpc_event_t)(s->last_event - 1)));
+  }
+
+  uint32_t events = 0;
+  for (int i = 0; i <= DHCPC_EVENT_EXPIRED; i++) {
+    events += s->events[i];
+  }
+  printf("%-16s %-14s %-18s %-15s %-15s %10s %-9s %6u %8llu %8llu %7u%s\n",
+         s->ifname, status_state_name(s->state), address, router, server,
+         expires, event, events, (unsigned long long)s->tx_frames,
+         (unsigned long long)s->rx_frames, pid, alive ? "" : " (gone)");
+}
+
+static void print_all(const status_map_t *maps, int count) {
+  int64_t now = realtime_ns() / 1000000000;
+  status_slot_t slot;
+
+  printf("%-16s %-14s %-18s %-15s %-15s %10s %-9s %6s %8s %8s %7s\n", "IFACE",
+         "STATE", "ADDRESS", "ROUTER", "SERVER", "EXPIRES", "LAST", "EVENTS",
+         "TX", "RX", "PID");
+  for (int i = 0; i < count; i++) {
+    const status_header_t *header = maps[i].header;
+    // A file left behind by a client that was killed: its slots are stale.
+    int alive = kill(header->pid, 0) == 0 || errno != ESRCH;
+    for (uint32_t j = 0; j < header->slot_count; j++) {
+      if (status_read_slot(header, j, &slot) < 0) {
+        fprintf(stderr, "[-] %s: slot %u kept changing\n", maps[i].path, j);
+      } else if (slot.in_use) {
+        print_slot(&slot, header->pid, alive, now);
+      }
+    }
+  }
+  fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+  struct option long_options[] = {{"help", no_argument, 0, 'h'},
+                                  {"watch", required_argument, 0, 'w'},
+                                  {NULL, 0, NULL, 0}};
+  int watch_ms = 0;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "w:h", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'w':
+        watch_ms = atoi(optarg);
+        if (watch_ms <= 0) {
+          fprintf(stderr, "Error: Interval must be positive\n");
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'h':
+        print_usage(argv[0]);
+        return 0;
+      default:
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  status_set_t set;
+  memset(&set, 0, sizeof(set));
+  int ret = 0;
+  for (int pass = 0; pass == 0 || watch_ms; pass++) {
+    if (pass) {
+      usleep(watch_ms * 1000);
+      printf("\n");
+    }
+    // Without explicit files, clients started since the last pass are found
+    // by globbing again.
+    glob_t found;
+    memset(&found, 0, sizeof(found));
+    char **paths = argv + optind;
+    int path_count = argc - optind;
+    if (!path_count) {
+      glob(DEFAULT_PATTERN, 0, NULL, &found);
+      paths = found.gl_pathv;
+      path_count = found.gl_pathc;
+    }
+    // Only the first pass complains about files that are missing.
+    if (status_refresh(&set, paths, path_count, pass > 0) && !pass) {
+      ret = EXIT_FAILURE;
+    }
+    globfree(&found);
+    print_all(set.maps, set.count);
+  }
+
+  for (int i = 0; i < set.count; i++) {
+    status_unmap(&set.maps[i]);
+  }
+  free(set.maps);
+  return ret;
+}
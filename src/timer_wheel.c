@@ -0,0 +1,276 @@
+#include "timer_wheel.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "network_utils.h"
+
+#define TW_MASK (TW_SLOTS - 1)
+#define TW_NONE UINT64_MAX
+#define LEVEL_SHIFT(level) (TW_SLOT_BITS * (level))
+#define TW_ROTATION_MASK ((1ULL << LEVEL_SHIFT(TW_LEVELS)) - 1)
+
+int timer_wheel_init(timer_wheel_t *tw, uint32_t tick_ms, int with_fd) {
+  memset(tw, 0, sizeof(timer_wheel_t));
+  tw->tick_ms = tick_ms ? tick_ms : 1;
+  tw->start_ms = monotonic_ms();
+  tw->armed_tick = TW_NONE;
+  tw->timer_fd = -1;
+
+  if (with_fd && (tw->timer_fd = timerfd_create(
+                      CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0) {
+    perror("[-] timerfd_create()");
+    return -1;
+  }
+  return 0;
+}
+
+void timer_wheel_destroy(timer_wheel_t *tw) {
+  if (tw->timer_fd >= 0) {
+    close(tw->timer_fd);
+    tw->timer_fd = -1;
+  }
+}
+
+void tw_timer_init(tw_timer_t *t, tw_callback cb, void *arg) {
+  memset(t, 0, sizeof(tw_timer_t));
+  t->cb = cb;
+  t->arg = arg;
+}
+
+static void tw_push(tw_timer_t **head, tw_timer_t *t) {
+  t->next = *head;
+  if (t->next) {
+    t->next->pprev = &t->next;
+  }
+  t->pprev = head;
+  *head = t;
+}
+
+// Puts t in the lowest level whose current rotation (relative to tw->now)
+// contains its expiry. Past expiries fire on the next tick; ones beyond the
+// top level's rotation go on the overflow list until it turns over.
+static void tw_link(timer_wheel_t *tw, tw_timer_t *t) {
+  uint64_t place = t->expires < tw->now ? tw->now : t->expires;
+  if (place > (tw->now | TW_ROTATION_MASK)) {
+    tw_push(&tw->overflow, t);
+    t->slot = TW_OVERFLOW;
+    return;
+  }
+
+  int level = 0;
+  while (level < TW_LEVELS - 1 && (place >> LEVEL_SHIFT(level + 1)) !=
+                                      (tw->now >> LEVEL_SHIFT(level + 1))) {
+    level++;
+  }
+  int index = (place >> LEVEL_SHIFT(level)) & TW_MASK;
+
+  tw_push(&tw->slots[level][index], t);
+  t->slot = level * TW_SLOTS + index;
+  tw->bitmap[level] |= 1ULL << index;
+}
+
+static void tw_unlink(timer_wheel_t *tw, tw_timer_t *t) {
+  *t->pprev = t->next;
+  if (t->next) {
+    t->next->pprev = t->pprev;
+  }
+  t->next = NULL;
+  t->pprev = NULL;
+  if (t->slot == TW_OVERFLOW) {
+    return;
+  }
+
+  int level = t->slot / TW_SLOTS;
+  int index = t->slot % TW_SLOTS;
+  if (!tw->slots[level][index]) {
+    tw->bitmap[level] &= ~(1ULL << index);
+  }
+}
+
+// First tick at which a slot fires (level 0) or cascades (above), TW_NONE
+// if the wheel is empty. A level's current slot is only still occupied when
+// tw->now sits exactly on its start and it has not cascaded yet.
+static uint64_t tw_next_tick(const timer_wheel_t *tw) {
+  uint64_t next = TW_NONE;
+
+  // The overflow is placed again at the start of the next top rotation, or
+  // right now if the clock jumped onto one.
+  if (tw->overflow) {
+    next = (tw->now & TW_ROTATION_MASK) == 0 ? tw->now
+                                             : (tw->now | TW_ROTATION_MASK) + 1;
+  }
+
+  for (int level = 0; level < TW_LEVELS; level++) {
+    if (!tw->bitmap[level]) {
+      continue;
+    }
+    int shift = LEVEL_SHIFT(level);
+    int index = (tw->now >> shift) & TW_MASK;
+    int at_start = (tw->now & ((1ULL << shift) - 1)) == 0;
+    uint64_t mask = at_start ? ~0ULL << index
+                    : index == TW_MASK ? 0
+                                       : ~0ULL << (index + 1);
+    uint64_t pending = tw->bitmap[level] & mask;
+    if (!pending) {
+      continue;
+    }
+    uint64_t rotation = tw->now >> (shift + TW_SLOT_BITS)
+                                    << (shift + TW_SLOT_BITS);
+    uint64_t tick =
+        rotation + ((uint64_t)__builtin_ctzll(pending) << shift);
+    if (tick < next) {
+      next = tick;
+    }
+  }
+  return next;
+}
+
+static void tw_cascade(timer_wheel_t *tw, int level, int index) {
+  tw_timer_t *list;
+  if (level == TW_LEVELS) {
+    list = tw->overflow;
+    tw->overflow = NULL;
+  } else {
+    list = tw->slots[level][index];
+    tw->slots[level][index] = NULL;
+    tw->bitmap[level] &= ~(1ULL << index);
+  }
+
+  while (list) {
+    tw_timer_t *t = list;
+    list = t->next;
+    tw_link(tw, t);
+  }
+}
+
+int timer_wheel_advance(timer_wheel_t *tw, uint64_t tick) {
+  int fired = 0;
+
+  while (1) {
+    uint64_t next = tw_next_tick(tw);
+    if (next == TW_NONE || next > tick) {
+      // Nothing fires or cascades in between, so jumping is safe.
+      if (tick + 1 > tw->now) {
+        tw->now = tick + 1;
+      }
+      return fired;
+    }
+
+    tw->now = next;
+    // From the top, so the overflow can still land in a slot cascading now.
+    if ((next & TW_ROTATION_MASK) == 0) {
+      tw_cascade(tw, TW_LEVELS, 0);
+    }
+    for (int level = TW_LEVELS - 1; level > 0; level--) {
+      if ((next & ((1ULL << LEVEL_SHIFT(level)) - 1)) == 0) {
+        tw_cascade(tw, level, (next >> LEVEL_SHIFT(level)) & TW_MASK);
+      }
+    }
+
+    // Detach the slot first: callbacks may schedule or cancel anything,
+    // including the timers still waiting in this batch.
+    int index = next & TW_MASK;
+    tw_timer_t *due = tw->slots[0][index];
+    tw->slots[0][index] = NULL;
+    tw->bitmap[0] &= ~(1ULL << index);
+    if (due) {
+      due->pprev = &due;
+    }
+    tw->now = next + 1;
+
+    while (due) {
+      tw_timer_t *t = due;
+      due = t->next;
+      if (due) {
+        due->pprev = &due;
+      }
+      t->next = NULL;
+      t->pprev = NULL;
+      t->cb(t, t->arg);
+      fired++;
+    }
+  }
+}
+
+static uint64_t tw_clock_tick(const timer_wheel_t *tw) {
+  return (monotonic_ms() - tw->start_ms) / tw->tick_ms;
+}
+
+// Points the timerfd at the next tick with work, skipping the syscall when
+// it is already there.
+static void tw_rearm(timer_wheel_t *tw) {
+  if (tw->timer_fd < 0) {
+    return;
+  }
+  uint64_t next = tw_next_tick(tw);
+  if (next == tw->armed_tick) {
+    return;
+  }
+  tw->armed_tick = next;
+
+  struct itimerspec its;
+  memset(&its, 0, sizeof(its));
+  if (next != TW_NONE) {
+    uint64_t at_ms = tw->start_ms + next * tw->tick_ms;
+    its.it_value.tv_sec = at_ms / 1000;
+    its.it_value.tv_nsec = (at_ms % 1000) * 1000000 + 1;
+  }
+  timerfd_settime(tw->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+void tw_timer_schedule_tick(timer_wheel_t *tw, tw_timer_t *t,
+                            uint64_t expires) {
+  if (t->pprev) {
+    tw_unlink(tw, t);
+  }
+  t->expires = expires;
+  tw_link(tw, t);
+  if (tw->armed_tick == TW_NONE || expires < tw->armed_tick) {
+    tw_rearm(tw);
+  }
+}
+
+void tw_timer_schedule(timer_wheel_t *tw, tw_timer_t *t, uint64_t delay_ms) {
+  uint64_t ticks = (delay_ms + tw->tick_ms - 1) / tw->tick_ms;
+  tw_timer_schedule_tick(tw, t, tw_clock_tick(tw) + ticks);
+}
+
+void tw_timer_cancel(timer_wheel_t *tw, tw_timer_t *t) {
+  // The timerfd stays armed; one spurious wakeup is cheaper than finding
+  // the new minimum on every cancel.
+  if (t->pprev) {
+    tw_unlink(tw, t);
+  }
+}
+
+int timer_wheel_next_timeout_ms(const timer_wheel_t *tw) {
+  uint64_t next = tw_next_tick(tw);
+  if (next == TW_NONE) {
+    return -1;
+  }
+  uint64_t at_ms = tw->start_ms + next * tw->tick_ms;
+  uint64_t now_ms = monotonic_ms();
+  return at_ms > now_ms ? (int)(at_ms - now_ms) : 0;
+}
+
+int timer_wheel_run(timer_wheel_t *tw) {
+  uint64_t expirations;
+  if (tw->timer_fd >= 0 &&
+      read(tw->timer_fd, &expirations, sizeof(expirations)) < 0 &&
+      errno != EAGAIN) {
+    perror("[-] read() timerfd");
+  }
+
+  uint64_t tick = tw_clock_tick(tw);
+  if (tw->armed_tick != TW_NONE && tw->armed_tick <= tick) {
+    tw->armed_tick = TW_NONE;  // it fired and is disarmed now
+  }
+  int fired = timer_wheel_advance(tw, tick);
+  tw_rearm(tw);
+  return fired;
+}
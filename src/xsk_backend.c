@@ -0,0 +1,546 @@
+#ifdef HAVE_AF_XDP
+
+#include <errno.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "io_backend.h"
+#include "network_utils.h"
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+#define XSK_FRAME_SIZE 2048
+#define XSK_RX_FRAMES 2048
+#define XSK_TX_FRAMES 2048
+#define XSK_NUM_FRAMES (XSK_RX_FRAMES + XSK_TX_FRAMES)
+#define XSK_RING_SIZE 2048  // must be a power of two
+#define XSK_QUEUE_ID 0
+#define XSK_MAP_ENTRIES 64
+
+typedef struct {
+  uint32_t *producer;
+  uint32_t *consumer;
+  uint32_t *flags;
+  void *ring;
+  uint32_t mask;
+  void *map;
+  size_t map_sz;
+} xsk_ring_t;
+
+typedef struct {
+  io_backend_t base;
+  int ifindex;
+  int map_fd;
+  int prog_fd;
+  int link_fd;
+
+  uint8_t *umem;
+  size_t umem_sz;
+
+  xsk_ring_t fill;
+  xsk_ring_t comp;
+  xsk_ring_t rx;
+  xsk_ring_t tx;
+
+  // Free TX chunks, as UMEM offsets.
+  uint64_t tx_free[XSK_TX_FRAMES];
+  uint32_t tx_free_count;
+  uint32_t tx_pending;
+
+  // Set by xsk_set_tx_template(): every TX chunk already holds this frame.
+  size_t template_len;
+} xsk_backend_t;
+
+// Minimal eBPF assembler: just what the DHCP redirect program needs.
+#define BPF_INSN(CODE, DST, SRC, OFF, IMM) \
+  ((struct bpf_insn){.code = (CODE),       \
+                     .dst_reg = (DST),     \
+                     .src_reg = (SRC),     \
+                     .off = (OFF),         \
+                     .imm = (IMM)})
+#define BPF_MOV64_REG(DST, SRC) \
+  BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_X, DST, SRC, 0, 0)
+#define BPF_MOV64_IMM(DST, IMM) \
+  BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_K, DST, 0, 0, IMM)
+#define BPF_ALU64_IMM(OP, DST, IMM) \
+  BPF_INSN(BPF_ALU64 | (OP) | BPF_K, DST, 0, 0, IMM)
+#define BPF_ALU64_REG(OP, DST, SRC) \
+  BPF_INSN(BPF_ALU64 | (OP) | BPF_X, DST, SRC, 0, 0)
+#define BPF_LDX_MEM(SIZE, DST, SRC, OFF) \
+  BPF_INSN(BPF_LDX | (SIZE) | BPF_MEM, DST, SRC, OFF, 0)
+#define BPF_JMP_REG(OP, DST, SRC, OFF) \
+  BPF_INSN(BPF_JMP | (OP) | BPF_X, DST, SRC, OFF, 0)
+#define BPF_JMP_IMM(OP, DST, IMM, OFF) \
+  BPF_INSN(BPF_JMP | (OP) | BPF_K, DST, 0, OFF, IMM)
+#define BPF_LD_MAP_FD(DST, FD)                                        \
+  BPF_INSN(BPF_LD | BPF_DW | BPF_IMM, DST, BPF_PSEUDO_MAP_FD, 0, FD), \
+      BPF_INSN(0, 0, 0, 0, 0)
+#define BPF_CALL_FUNC(FUNC) BPF_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, FUNC)
+#define BPF_EXIT_INSN() BPF_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+
+// Placeholder jump offset, patched to point at the XDP_PASS tail.
+#define JMP_PASS 0x7fff
+
+static long sys_bpf(int cmd, union bpf_attr *attr) {
+  return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+// Redirects IPv4/UDP frames for port 68 to the XSK bound on the receiving
+// queue; everything else (and any frame on a queue without a socket) goes to
+// the stack untouched.
+static int xsk_load_program(xsk_backend_t *x) {
+  struct bpf_insn insns[] = {
+      BPF_MOV64_REG(BPF_REG_6, BPF_REG_1),
+      BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, data)),
+      BPF_LDX_MEM(BPF_W, BPF_REG_3, BPF_REG_6,
+                  offsetof(struct xdp_md, data_end)),
+      // Ethernet + minimal IPv4 header in bounds
+      BPF_MOV64_REG(BPF_REG_4, BPF_REG_2),
+      BPF_ALU64_IMM(BPF_ADD, BPF_REG_4, 14 + 20),
+      BPF_JMP_REG(BPF_JGT, BPF_REG_4, BPF_REG_3, JMP_PASS),
+      BPF_LDX_MEM(BPF_H, BPF_REG_5, BPF_REG_2, 12),
+      BPF_JMP_IMM(BPF_JNE, BPF_REG_5, htons(ETH_P_IP), JMP_PASS),
+      BPF_LDX_MEM(BPF_B, BPF_REG_5, BPF_REG_2, 14 + 9),
+      BPF_JMP_IMM(BPF_JNE, BPF_REG_5, IPPROTO_UDP, JMP_PASS),
+      // Skip the IPv4 header (IHL * 4) and bounds-check the UDP header
+      BPF_LDX_MEM(BPF_B, BPF_REG_5, BPF_REG_2, 14),
+      BPF_ALU64_IMM(BPF_AND, BPF_REG_5, 0x0f),
+      BPF_ALU64_IMM(BPF_LSH, BPF_REG_5, 2),
+      BPF_ALU64_REG(BPF_ADD, BPF_REG_2, BPF_REG_5),
+      BPF_MOV64_REG(BPF_REG_4, BPF_REG_2),
+      BPF_ALU64_IMM(BPF_ADD, BPF_REG_4, 14 + 8),
+      BPF_JMP_REG(BPF_JGT, BPF_REG_4, BPF_REG_3, JMP_PASS),
+      BPF_LDX_MEM(BPF_H, BPF_REG_5, BPF_REG_2, 14 + 2),
+      BPF_JMP_IMM(BPF_JNE, BPF_REG_5, htons(DHCP_PORT_CLIENT), JMP_PASS),
+      // return bpf_redirect_map(&xsks, ctx->rx_queue_index, XDP_PASS)
+      BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_6,
+                  offsetof(struct xdp_md, rx_queue_index)),
+      BPF_LD_MAP_FD(BPF_REG_1, x->map_fd),
+      BPF_MOV64_IMM(BPF_REG_3, XDP_PASS),
+      BPF_CALL_FUNC(BPF_FUNC_redirect_map),
+      BPF_EXIT_INSN(),
+      // pass:
+      BPF_MOV64_IMM(BPF_REG_0, XDP_PASS),
+      BPF_EXIT_INSN(),
+  };
+  int n_insns = sizeof(insns) / sizeof(insns[0]);
+  int pass = n_insns - 2;
+
+  for (int i = 0; i < n_insns; i++) {
+    if (BPF_CLASS(insns[i].code) == BPF_JMP && insns[i].off == JMP_PASS) {
+      insns[i].off = pass - (i + 1);
+    }
+  }
+
+  char log[4096] = {0};
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.prog_type = BPF_PROG_TYPE_XDP;
+  attr.insns = (uint64_t)(uintptr_t)insns;
+  attr.insn_cnt = n_insns;
+  attr.license = (uint64_t)(uintptr_t) "GPL";
+  attr.log_buf = (uint64_t)(uintptr_t)log;
+  attr.log_size = sizeof(log);
+  attr.log_level = 1;
+
+  x->prog_fd = (int)sys_bpf(BPF_PROG_LOAD, &attr);
+  if (x->prog_fd < 0) {
+    perror("[-] bpf() BPF_PROG_LOAD");
+    fprintf(stderr, "%s\n", log);
+    return -1;
+  }
+  return 0;
+}
+
+static int xsk_create_map(xsk_backend_t *x) {
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.map_type = BPF_MAP_TYPE_XSKMAP;
+  attr.key_size = sizeof(uint32_t);
+  attr.value_size = sizeof(uint32_t);
+  attr.max_entries = XSK_MAP_ENTRIES;
+
+  x->map_fd = (int)sys_bpf(BPF_MAP_CREATE, &attr);
+  if (x->map_fd < 0) {
+    perror("[-] bpf() BPF_MAP_CREATE");
+    return -1;
+  }
+  return 0;
+}
+
+static int xsk_attach(xsk_backend_t *x) {
+  uint32_t key = XSK_QUEUE_ID;
+  uint32_t value = (uint32_t)x->base.sock;
+
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.map_fd = x->map_fd;
+  attr.key = (uint64_t)(uintptr_t)&key;
+  attr.value = (uint64_t)(uintptr_t)&value;
+  if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+    perror("[-] bpf() BPF_MAP_UPDATE_ELEM");
+    return -1;
+  }
+
+  // A bpf_link detaches the program automatically when the fd is closed,
+  // so a crashed client never leaves the interface filtered.
+  memset(&attr, 0, sizeof(attr));
+  attr.link_create.prog_fd = x->prog_fd;
+  attr.link_create.target_ifindex = x->ifindex;
+  attr.link_create.attach_type = BPF_XDP;
+  attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+
+  x->link_fd = (int)sys_bpf(BPF_LINK_CREATE, &attr);
+  if (x->link_fd < 0) {
+    perror("[-] bpf() BPF_LINK_CREATE");
+    return -1;
+  }
+  return 0;
+}
+
+static int xsk_map_ring(xsk_backend_t *x, xsk_ring_t *ring,
+                        const struct xdp_ring_offset *off, size_t desc_size,
+                        off_t pgoff) {
+  ring->map_sz = off->desc + XSK_RING_SIZE * desc_size;
+  ring->map = mmap(NULL, ring->map_sz, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, x->base.sock, pgoff);
+  if (ring->map == MAP_FAILED) {
+    ring->map = NULL;
+    perror("[-] mmap() xsk ring");
+    return -1;
+  }
+
+  uint8_t *base = ring->map;
+  ring->producer = (uint32_t *)(base + off->producer);
+  ring->consumer = (uint32_t *)(base + off->consumer);
+  ring->flags = (uint32_t *)(base + off->flags);
+  ring->ring = base + off->desc;
+  ring->mask = XSK_RING_SIZE - 1;
+  return 0;
+}
+
+static int xsk_setup_socket(xsk_backend_t *x) {
+  int fd = x->base.sock;
+
+  x->umem_sz = (size_t)XSK_NUM_FRAMES * XSK_FRAME_SIZE;
+  x->umem = mmap(NULL, x->umem_sz, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (x->umem == MAP_FAILED) {
+    x->umem = NULL;
+    perror("[-] mmap() umem");
+    return -1;
+  }
+
+  struct xdp_umem_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.addr = (uint64_t)(uintptr_t)x->umem;
+  reg.len = x->umem_sz;
+  reg.chunk_size = XSK_FRAME_SIZE;
+  if (setsockopt(fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0) {
+    perror("[-] setsockopt() XDP_UMEM_REG");
+    return -1;
+  }
+
+  int ring_size = XSK_RING_SIZE;
+  if (setsockopt(fd, SOL_XDP, XDP_UMEM_FILL_RING, &ring_size,
+                 sizeof(ring_size)) < 0 ||
+      setsockopt(fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ring_size,
+                 sizeof(ring_size)) < 0 ||
+      setsockopt(fd, SOL_XDP, XDP_RX_RING, &ring_size, sizeof(ring_size)) <
+          0 ||
+      setsockopt(fd, SOL_XDP, XDP_TX_RING, &ring_size, sizeof(ring_size)) <
+          0) {
+    perror("[-] setsockopt() xsk rings");
+    return -1;
+  }
+
+  struct xdp_mmap_offsets off;
+  socklen_t optlen = sizeof(off);
+  if (getsockopt(fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0) {
+    perror("[-] getsockopt() XDP_MMAP_OFFSETS");
+    return -1;
+  }
+
+  if (xsk_map_ring(x, &x->fill, &off.fr, sizeof(uint64_t),
+                   XDP_UMEM_PGOFF_FILL_RING) < 0 ||
+      xsk_map_ring(x, &x->comp, &off.cr, sizeof(uint64_t),
+                   XDP_UMEM_PGOFF_COMPLETION_RING) < 0 ||
+      xsk_map_ring(x, &x->rx, &off.rx, sizeof(struct xdp_desc),
+                   XDP_PGOFF_RX_RING) < 0 ||
+      xsk_map_ring(x, &x->tx, &off.tx, sizeof(struct xdp_desc),
+                   XDP_PGOFF_TX_RING) < 0) {
+    return -1;
+  }
+
+  // First half of the UMEM feeds the RX path, second half is TX.
+  uint64_t *fill = x->fill.ring;
+  for (uint32_t i = 0; i < XSK_RX_FRAMES; i++) {
+    fill[i & x->fill.mask] = (uint64_t)i * XSK_FRAME_SIZE;
+  }
+  __atomic_store_n(x->fill.producer, XSK_RX_FRAMES, __ATOMIC_RELEASE);
+
+  for (uint32_t i = 0; i < XSK_TX_FRAMES; i++) {
+    x->tx_free[i] = (uint64_t)(XSK_RX_FRAMES + i) * XSK_FRAME_SIZE;
+  }
+  x->tx_free_count = XSK_TX_FRAMES;
+
+  struct sockaddr_xdp sxdp;
+  memset(&sxdp, 0, sizeof(sxdp));
+  sxdp.sxdp_family = AF_XDP;
+  sxdp.sxdp_ifindex = x->ifindex;
+  sxdp.sxdp_queue_id = XSK_QUEUE_ID;
+  sxdp.sxdp_flags = XDP_COPY | XDP_USE_NEED_WAKEUP;
+  if (bind(fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) < 0) {
+    perror("[-] bind() AF_XDP");
+    return -1;
+  }
+  return 0;
+}
+
+static void xsk_reclaim_tx(xsk_backend_t *x) {
+  uint32_t cons = *x->comp.consumer;
+  uint32_t prod = __atomic_load_n(x->comp.producer, __ATOMIC_ACQUIRE);
+  uint64_t *comp = x->comp.ring;
+
+  for (; cons != prod; cons++) {
+    x->tx_free[x->tx_free_count++] = comp[cons & x->comp.mask];
+  }
+  __atomic_store_n(x->comp.consumer, cons, __ATOMIC_RELEASE);
+}
+
+static int xsk_kick_tx(xsk_backend_t *x) {
+  if (x->tx_pending == 0) {
+    return 0;
+  }
+  x->tx_pending = 0;
+  if (!(__atomic_load_n(x->tx.flags, __ATOMIC_ACQUIRE) &
+        XDP_RING_NEED_WAKEUP)) {
+    return 0;
+  }
+
+  x->base.stats.syscalls++;
+  if (sendto(x->base.sock, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 &&
+      errno != EAGAIN && errno != EBUSY && errno != ENOBUFS) {
+    perror("[-] sendto() xsk kick");
+    return -1;
+  }
+  return 0;
+}
+
+// Posts the chunk at umem offset addr (already filled) on the TX ring.
+static int xsk_post_tx(xsk_backend_t *x, uint64_t addr, size_t len) {
+  uint32_t prod = *x->tx.producer;
+  struct xdp_desc *desc = &((struct xdp_desc *)x->tx.ring)[prod & x->tx.mask];
+  desc->addr = addr;
+  desc->len = (uint32_t)len;
+  desc->options = 0;
+  __atomic_store_n(x->tx.producer, prod + 1, __ATOMIC_RELEASE);
+
+  x->tx_pending++;
+  x->base.stats.tx_frames++;
+  return 0;
+}
+
+static int xsk_get_tx_chunk(xsk_backend_t *x, uint64_t *addr) {
+  if (x->tx_free_count == 0) {
+    xsk_reclaim_tx(x);
+  }
+  while (x->tx_free_count == 0) {
+    if (x->tx_pending == 0) {
+      x->tx_pending = 1;  // force a kick so the kernel drains the ring
+    }
+    if (xsk_kick_tx(x) < 0) {
+      return -1;
+    }
+    xsk_reclaim_tx(x);
+  }
+  *addr = x->tx_free[--x->tx_free_count];
+  return 0;
+}
+
+static int xsk_send(io_backend_t *io, const void *buf, size_t len,
+                    const struct sockaddr *addr, socklen_t addrlen) {
+  xsk_backend_t *x = (xsk_backend_t *)io;
+  (void)addr;
+  (void)addrlen;
+
+  if (len > XSK_FRAME_SIZE) {
+    fprintf(stderr, "[-] xsk send: frame too large\n");
+    return -1;
+  }
+
+  uint64_t chunk;
+  if (xsk_get_tx_chunk(x, &chunk) < 0) {
+    return -1;
+  }
+  memcpy(x->umem + chunk, buf, len);
+  // The chunk no longer matches the template.
+  x->template_len = 0;
+  return xsk_post_tx(x, chunk, len);
+}
+
+static ssize_t xsk_recv(io_backend_t *io, uint8_t *buf, size_t len,
+                        int timeout_ms) {
+  xsk_backend_t *x = (xsk_backend_t *)io;
+  uint64_t deadline = monotonic_ms() + timeout_ms;
+
+  if (xsk_kick_tx(x) < 0) {
+    return -1;
+  }
+
+  while (1) {
+    uint32_t cons = *x->rx.consumer;
+    uint32_t prod = __atomic_load_n(x->rx.producer, __ATOMIC_ACQUIRE);
+
+    if (cons != prod) {
+      struct xdp_desc *desc =
+          &((struct xdp_desc *)x->rx.ring)[cons & x->rx.mask];
+      size_t n_bytes = desc->len < len ? desc->len : len;
+      uint64_t frame_addr = desc->addr;
+      memcpy(buf, x->umem + frame_addr, n_bytes);
+      __atomic_store_n(x->rx.consumer, cons + 1, __ATOMIC_RELEASE);
+
+      uint32_t fill_prod = *x->fill.producer;
+      ((uint64_t *)x->fill.ring)[fill_prod & x->fill.mask] = frame_addr;
+      __atomic_store_n(x->fill.producer, fill_prod + 1, __ATOMIC_RELEASE);
+
+      io->stats.rx_frames++;
+      return (ssize_t)n_bytes;
+    }
+
+    uint64_t now = monotonic_ms();
+    if (now >= deadline) {
+      return 0;
+    }
+
+    struct pollfd pfd = {.fd = io->sock, .events = POLLIN};
+    io->stats.syscalls++;
+    if (poll(&pfd, 1, (int)(deadline - now)) < 0 && errno != EINTR) {
+      perror("[-] poll() xsk");
+      return -1;
+    }
+  }
+}
+
+static int xsk_flush(io_backend_t *io) {
+  return xsk_kick_tx((xsk_backend_t *)io);
+}
+
+static void xsk_unmap_ring(xsk_ring_t *ring) {
+  if (ring->map) {
+    munmap(ring->map, ring->map_sz);
+  }
+}
+
+static void xsk_destroy(io_backend_t *io) {
+  xsk_backend_t *x = (xsk_backend_t *)io;
+
+  if (x->link_fd >= 0) {
+    close(x->link_fd);
+  }
+  if (x->prog_fd >= 0) {
+    close(x->prog_fd);
+  }
+  if (x->map_fd >= 0) {
+    close(x->map_fd);
+  }
+  xsk_unmap_ring(&x->fill);
+  xsk_unmap_ring(&x->comp);
+  xsk_unmap_ring(&x->rx);
+  xsk_unmap_ring(&x->tx);
+  if (x->base.sock >= 0) {
+    close(x->base.sock);
+  }
+  if (x->umem) {
+    munmap(x->umem, x->umem_sz);
+  }
+  free(x);
+}
+
+static const io_backend_ops_t xsk_ops = {
+    .name = "xdp",
+    .send = xsk_send,
+    .recv = xsk_recv,
+    .flush = xsk_flush,
+    .destroy = xsk_destroy,
+};
+
+io_backend_t *xsk_backend_create(int ifindex) {
+  xsk_backend_t *x = calloc(1, sizeof(xsk_backend_t));
+  if (!x) {
+    perror("calloc");
+    return NULL;
+  }
+  x->base.ops = &xsk_ops;
+  x->map_fd = x->prog_fd = x->link_fd = -1;
+  x->ifindex = ifindex;
+
+  if ((x->base.sock = socket(AF_XDP, SOCK_RAW, 0)) < 0) {
+    perror("[-] socket() AF_XDP");
+    free(x);
+    return NULL;
+  }
+  x->base.poll_fd = x->base.sock;
+
+  if (xsk_setup_socket(x) < 0 || xsk_create_map(x) < 0 ||
+      xsk_load_program(x) < 0 || xsk_attach(x) < 0) {
+    xsk_destroy(&x->base);
+    return NULL;
+  }
+
+  return &x->base;
+}
+
+int xsk_set_tx_template(io_backend_t *io, const void *frame, size_t len) {
+  xsk_backend_t *x = (xsk_backend_t *)io;
+
+  if (io->ops != &xsk_ops || len > XSK_FRAME_SIZE) {
+    return -1;
+  }
+
+  xsk_reclaim_tx(x);
+  for (uint32_t i = 0; i < XSK_TX_FRAMES; i++) {
+    uint64_t chunk = (uint64_t)(XSK_RX_FRAMES + i) * XSK_FRAME_SIZE;
+    memcpy(x->umem + chunk, frame, len);
+  }
+  x->template_len = len;
+  return 0;
+}
+
+int xsk_send_patched(io_backend_t *io, size_t patch_off, const void *patch,
+                     size_t patch_len) {
+  xsk_backend_t *x = (xsk_backend_t *)io;
+
+  if (io->ops != &xsk_ops || x->template_len == 0 ||
+      patch_off + patch_len > x->template_len) {
+    return -1;
+  }
+
+  uint64_t chunk;
+  if (xsk_get_tx_chunk(x, &chunk) < 0) {
+    return -1;
+  }
+  memcpy(x->umem + chunk + patch_off, patch, patch_len);
+  return xsk_post_tx(x, chunk, x->template_len);
+}
+
+#endif